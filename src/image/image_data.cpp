@@ -77,6 +77,9 @@ void InitializeFromImage(
 // the description of INTERPOLATE_ADDITIVE in image_data.h). If upsample is
 // true, the scale will be used as an upsampling scale, otherwise it will be
 // the downsampling scale. The new image size will be returned.
+//
+// PixelType must match the type of the channels (double or float).
+template <typename PixelType>
 cv::Size ResizeAdditiveInterpolation(
     const cv::Size& new_size, std::vector<cv::Mat>* channels) {
 
@@ -106,8 +109,8 @@ cv::Size ResizeAdditiveInterpolation(
         for (int col = 0; col < original_size.width; ++col) {
           const int new_row = row * y_scale;
           const int new_col = col * x_scale;
-          resized_image.at<double>(new_row, new_col) =
-              channel_image.at<double>(row, col);
+          resized_image.at<PixelType>(new_row, new_col) =
+              channel_image.at<PixelType>(row, col);
         }
       }
       (*channels)[i] = resized_image;
@@ -123,8 +126,8 @@ cv::Size ResizeAdditiveInterpolation(
         for (int col = 0; col < original_size.width; ++col) {
           const int new_row = row / y_scale;
           const int new_col = col / x_scale;
-          resized_image.at<double>(new_row, new_col) +=
-              channel_image.at<double>(row, col);
+          resized_image.at<PixelType>(new_row, new_col) +=
+              channel_image.at<PixelType>(row, col);
         }
       }
       (*channels)[i] = resized_image;
@@ -242,7 +245,10 @@ ImageData::ImageData(
 }
 
 ImageData::ImageData(
-    const double* pixel_values, const cv::Size& size, const int num_channels) {
+    const double* pixel_values,
+    const cv::Size& size,
+    const int num_channels,
+    const ImagePrecision precision) {
 
   CHECK_NOTNULL(pixel_values);
   CHECK_GE(num_channels, 1) << "The image must have at least one channel.";
@@ -259,7 +265,13 @@ ImageData::ImageData(
         size,
         util::kOpenCvMatrixType,
         const_cast<void*>(reinterpret_cast<const void*>(channel_pixels)));
-    channels_.push_back(channel_image.clone());  // copy data
+    if (precision == SINGLE_PRECISION) {
+      cv::Mat single_precision_image;
+      channel_image.convertTo(single_precision_image, CV_32FC1);  // copy data
+      channels_.push_back(single_precision_image);
+    } else {
+      channels_.push_back(channel_image.clone());  // copy data
+    }
   }
   spectral_mode_ = GetDefaultSpectralMode(channels_.size());
 }
@@ -320,7 +332,11 @@ void ImageData::ResizeImage(
   switch (interpolation_method) {
     case INTERPOLATE_ADDITIVE:
       // Custom implementation (not in OpenCV).
-      image_size_ = ResizeAdditiveInterpolation(new_size, &channels_);
+      if (GetPrecision() == SINGLE_PRECISION) {
+        image_size_ = ResizeAdditiveInterpolation<float>(new_size, &channels_);
+      } else {
+        image_size_ = ResizeAdditiveInterpolation<double>(new_size, &channels_);
+      }
       return;
       break;
     case INTERPOLATE_LINEAR:
@@ -520,20 +536,34 @@ double ImageData::GetPixelValue(
   CHECK(0 <= row && row < image_size_.height) << "Row index is out of bounds.";
   CHECK(0 <= col && col < image_size_.width) << "Col index is out of bounds.";
 
-  return channels_[channel_index].at<double>(row, col);
+  const cv::Mat& channel_image = channels_[channel_index];
+  if (channel_image.type() == CV_32FC1) {
+    return channel_image.at<float>(row, col);
+  }
+  return channel_image.at<double>(row, col);
 }
 
-const double* ImageData::GetChannelData(const int channel_index) const {
-  return GetMutableChannelData(channel_index);
+ImagePrecision ImageData::GetPrecision() const {
+  if (!channels_.empty() && channels_[0].type() == CV_32FC1) {
+    return SINGLE_PRECISION;
+  }
+  return DOUBLE_PRECISION;
 }
 
-double* ImageData::GetMutableChannelData(const int channel_index) const {
+const double* ImageData::GetChannelData(const int channel_index) const {
   CHECK_GE(channel_index, 0) << "Channel index must be at least 0.";
   CHECK_LT(channel_index, GetNumChannels()) << "Channel index out of bounds.";
+  // Reading single-precision data as doubles would silently give garbage.
+  CHECK_EQ(channels_[channel_index].type(), util::kOpenCvMatrixType)
+      << "Single-precision channels must be accessed with GetChannelImage().";
 
   // TODO: verify that this is the correct approach of getting the data array.
   // static_cast doesn't work here because the data is apparently uchar*.
-  return (double*)(channels_[channel_index].data);  // NOLINT
+  return (const double*)(channels_[channel_index].data);  // NOLINT
+}
+
+double* ImageData::GetMutableChannelData(const int channel_index) const {
+  return const_cast<double*>(GetChannelData(channel_index));
 }
 
 cv::Mat ImageData::GetVisualizationImage() const {
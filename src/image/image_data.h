@@ -67,6 +67,15 @@ enum ResizeInterpolationMethod {
   INTERPOLATE_ADDITIVE
 };
 
+// The precision that pixel values are stored in. Images are stored in double
+// precision unless single precision is requested explicitly, which halves the
+// memory traffic of the image model operators at the cost of accuracy (see
+// IRLSMapSolverOptions::use_mixed_precision).
+enum ImagePrecision {
+  DOUBLE_PRECISION,  // CV_64F channels.
+  SINGLE_PRECISION   // CV_32F channels.
+};
+
 // The image spectral mode. For color images, this is used to determine the
 // color space (default BGR). For hyperspectral images, this is used to
 // determine if the image has been converted into a basis (e.g. using PCA).
@@ -138,11 +147,15 @@ class ImageData {
   // pixels must match the given size width * height at each image channel.
   //
   // This constructor does not adjust the given pixel values in any way, so no
-  // normalization happens.
+  // normalization happens, but they are rounded if the image is stored in
+  // single precision. Single-precision images are only meant for applying the
+  // image model operators, and their pixel data can only be accessed through
+  // GetChannelImage() and GetPixelValue().
   ImageData(
       const double* pixel_values,
       const cv::Size& size,
-      const int num_channels = 1);
+      const int num_channels = 1,
+      const ImagePrecision precision = DOUBLE_PRECISION);
 
   // Appends a channel (band) to the image. Each new channel will be added as
   // the last index. Channel images should be single-band OpenCV images. The
@@ -279,9 +292,13 @@ class ImageData {
   double GetPixelValue(
       const int channel_index, const int row, const int col) const;
 
+  // Returns the precision of the pixel values. This is SINGLE_PRECISION only
+  // for images built as such with ImageData(const double*, ...).
+  ImagePrecision GetPrecision() const;
+
   // Returns a data pointer for the pixel values at the given channel index.
   // The size of the array will be the number of pixels in this image (use
-  // GetNumPixels()).
+  // GetNumPixels()). The image must be stored in double precision.
   const double* GetChannelData(const int channel_index) const;
 
   // Same as GetChannelData(), but allows the image to be modified by changing
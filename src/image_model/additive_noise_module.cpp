@@ -1,9 +1,9 @@
 #include "image_model/additive_noise_module.h"
 
+#include <memory>
 #include <vector>
 
 #include "image/image_data.h"
-#include "util/matrix_util.h"
 
 #include "opencv2/core/core.hpp"
 #include "opencv2/imgproc/imgproc.hpp"
@@ -28,9 +28,9 @@ void AdditiveNoiseModule::ApplyToImage(
   const cv::Size image_size = image_data->GetImageSize();
   const int num_image_channels = image_data->GetNumChannels();
   for (int i = 0; i < num_image_channels; ++i) {
-    cv::Mat noise = cv::Mat(image_size, util::kOpenCvMatrixType);
-    cv::randn(noise, 0, scaled_sigma);
     cv::Mat channel_image = image_data->GetChannelImage(i);
+    cv::Mat noise = cv::Mat(image_size, channel_image.type());
+    cv::randn(noise, 0, scaled_sigma);
     channel_image += noise;
   }
 }
@@ -43,4 +43,10 @@ void AdditiveNoiseModule::ApplyTransposeToImage(
   // TODO: implement.
 }
 
+std::shared_ptr<DegradationOperator>
+AdditiveNoiseModule::CreateDownscaledOperator(const int factor) const {
+  // The noise is independent per pixel, so it does not depend on the scale.
+  return std::shared_ptr<DegradationOperator>(new AdditiveNoiseModule(sigma_));
+}
+
 }  // namespace super_resolution
@@ -23,6 +23,9 @@ class AdditiveNoiseModule : public DegradationOperator {
   virtual void ApplyTransposeToImage(
       ImageData* image_data, const int index) const;
 
+  virtual std::shared_ptr<DegradationOperator> CreateDownscaledOperator(
+      const int factor) const;
+
  private:
   const double sigma_;
 };
@@ -1,5 +1,7 @@
 #include "image_model/blur_module.h"
 
+#include <memory>
+
 #include "image/image_data.h"
 #include "util/matrix_util.h"
 
@@ -11,7 +13,7 @@
 namespace super_resolution {
 
 BlurModule::BlurModule(const int blur_radius, const double sigma)
-    : blur_radius_(blur_radius) {
+    : blur_radius_(blur_radius), sigma_(sigma) {
 
   CHECK_GE(blur_radius, 1);
   CHECK_GT(sigma, 0.0);
@@ -41,4 +43,20 @@ cv::Mat BlurModule::GetOperatorMatrix(
   return ConvertKernelToOperatorMatrix(blur_kernel_, image_size);
 }
 
+int BlurModule::GetSupportRadius(const int index) const {
+  // The blur radius is the full (odd) kernel size.
+  return blur_radius_ / 2;
+}
+
+std::shared_ptr<DegradationOperator> BlurModule::CreateDownscaledOperator(
+    const int factor) const {
+
+  CHECK_GE(factor, 1);
+
+  // Scale the kernel size down as well, keeping it odd.
+  const int blur_radius = (blur_radius_ / factor) | 1;
+  return std::shared_ptr<DegradationOperator>(
+      new BlurModule(blur_radius, sigma_ / factor));
+}
+
 }  // namespace super_resolution
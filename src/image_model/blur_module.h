@@ -26,8 +26,14 @@ class BlurModule : public DegradationOperator {
   virtual cv::Mat GetOperatorMatrix(
       const cv::Size& image_size, const int index) const;
 
+  virtual std::shared_ptr<DegradationOperator> CreateDownscaledOperator(
+      const int factor) const;
+
+  virtual int GetSupportRadius(const int index) const;
+
  private:
   const int blur_radius_;
+  const double sigma_;
 
   // This kernel is created in the constructor and is used for the blurring
   // convolution and for getting the operator matrix.
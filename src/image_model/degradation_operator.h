@@ -8,6 +8,8 @@
 #ifndef SRC_IMAGE_MODEL_DEGRADATION_OPERATOR_H_
 #define SRC_IMAGE_MODEL_DEGRADATION_OPERATOR_H_
 
+#include <memory>
+
 #include "image/image_data.h"
 
 #include "opencv2/core/core.hpp"
@@ -54,6 +56,23 @@ class DegradationOperator {
   // small data sets.
   virtual cv::Mat GetOperatorMatrix(
       const cv::Size& image_size, const int index) const;
+
+  // Returns how far (in pixels of the input image) a pixel of this operator's
+  // output can depend on the input for the image at the given index. For
+  // example, this is the kernel radius of a blur. The default of 0 is for
+  // operators that map every pixel on its own (e.g. noise or downsampling).
+  virtual int GetSupportRadius(const int index) const {
+    return 0;
+  }
+
+  // Returns the equivalent operator for HR images that are downscaled by the
+  // given integer factor (e.g. for coarse-to-fine solving), with all spatial
+  // parameters scaled accordingly. Returns nullptr if this operator cannot be
+  // downscaled by that factor, which is the default.
+  virtual std::shared_ptr<DegradationOperator> CreateDownscaledOperator(
+      const int factor) const {
+    return nullptr;
+  }
 };
 
 }  // namespace super_resolution
@@ -1,6 +1,7 @@
 #include "image_model/downsampling_module.h"
 
 #include <cmath>
+#include <memory>
 
 #include "image/image_data.h"
 #include "util/matrix_util.h"
@@ -63,4 +64,16 @@ cv::Mat DownsamplingModule::GetOperatorMatrix(
   return downsampling_matrix;
 }
 
+std::shared_ptr<DegradationOperator>
+DownsamplingModule::CreateDownscaledOperator(const int factor) const {
+  CHECK_GE(factor, 1);
+
+  // The LR images stay the same, so the scale must shrink by the factor.
+  if (scale_ % factor != 0) {
+    return nullptr;
+  }
+  return std::shared_ptr<DegradationOperator>(
+      new DownsamplingModule(scale_ / factor));
+}
+
 }  // namespace super_resolution
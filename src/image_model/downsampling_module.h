@@ -27,6 +27,9 @@ class DownsamplingModule : public DegradationOperator {
   virtual cv::Mat GetOperatorMatrix(
       const cv::Size& image_size, const int index) const;
 
+  virtual std::shared_ptr<DegradationOperator> CreateDownscaledOperator(
+      const int factor) const;
+
  private:
   // The downsampling scale.
   const int scale_;
@@ -1,7 +1,10 @@
 #include "image_model/image_model.h"
 
+#include <algorithm>
+#include <cmath>
 #include <memory>
 #include <utility>
+#include <vector>
 
 #include "image/image_data.h"
 #include "image_model/additive_noise_module.h"
@@ -9,10 +12,22 @@
 #include "image_model/degradation_operator.h"
 #include "image_model/downsampling_module.h"
 #include "image_model/motion_module.h"
+#include "motion/motion_shift.h"
+#include "util/matrix_util.h"
+
+#include "opencv2/core/core.hpp"
 
 #include "glog/logging.h"
 
 namespace super_resolution {
+namespace {
+
+// Returns true if the given value is (exactly) an integer.
+bool IsInteger(const double value) {
+  return std::floor(value) == value;
+}
+
+}  // namespace
 
 ImageModel ImageModel::CreateImageModel(
     const ImageModelParameters& parameters) {
@@ -73,6 +88,70 @@ void ImageModel::AddDegradationOperator(
   degradation_operators_.push_back(degradation_operator);
 }
 
+int ImageModel::GetSupportRadius(const int num_images) const {
+  int support_radius = 0;
+  for (int index = 0; index < num_images; ++index) {
+    int image_support_radius = 0;
+    for (const auto& degradation_operator : degradation_operators_) {
+      image_support_radius += degradation_operator->GetSupportRadius(index);
+    }
+    support_radius = std::max(support_radius, image_support_radius);
+  }
+  return support_radius;
+}
+
+std::shared_ptr<ImageModel> ImageModel::CreateDownscaledModel(
+    const int factor) const {
+
+  CHECK_GE(factor, 1) << "Downscaling factor must be at least 1.";
+
+  if (downsampling_scale_ % factor != 0) {
+    return nullptr;
+  }
+  std::shared_ptr<ImageModel> downscaled_model(
+      new ImageModel(downsampling_scale_ / factor));
+  for (const auto& degradation_operator : degradation_operators_) {
+    const std::shared_ptr<DegradationOperator> downscaled_operator =
+        degradation_operator->CreateDownscaledOperator(factor);
+    if (downscaled_operator == nullptr) {
+      return nullptr;
+    }
+    downscaled_model->AddDegradationOperator(downscaled_operator);
+  }
+  return downscaled_model;
+}
+
+MotionShiftSequence ImageModel::GetMotionShiftSequence() const {
+  for (const auto& degradation_operator : degradation_operators_) {
+    const MotionModule* motion_module =
+        dynamic_cast<const MotionModule*>(degradation_operator.get());
+    if (motion_module != nullptr) {
+      return motion_module->GetMotionShiftSequence();
+    }
+  }
+  return MotionShiftSequence();
+}
+
+std::shared_ptr<ImageModel> ImageModel::CreateModelWithMotion(
+    const MotionShiftSequence& motion_shift_sequence) const {
+
+  std::shared_ptr<ImageModel> image_model(new ImageModel(downsampling_scale_));
+  bool has_motion_module = false;
+  for (const auto& degradation_operator : degradation_operators_) {
+    if (dynamic_cast<const MotionModule*>(
+            degradation_operator.get()) != nullptr) {
+      image_model->AddDegradationOperator(
+          std::shared_ptr<DegradationOperator>(
+              new MotionModule(motion_shift_sequence)));
+      has_motion_module = true;
+    } else {
+      image_model->AddDegradationOperator(degradation_operator);
+    }
+  }
+  CHECK(has_motion_module) << "The image model has no motion operator.";
+  return image_model;
+}
+
 ImageData ImageModel::ApplyToImage(
     const ImageData& image_data, const int index) const {
 
@@ -100,6 +179,132 @@ void ImageModel::ApplyTransposeToImage(
   }
 }
 
+bool ImageModel::IsTranslationalModel(const int num_images) const {
+  const int num_operators = degradation_operators_.size();
+  if (num_operators == 0) {
+    return false;
+  }
+
+  // The downsampling operator must be applied last, after all motion and blur
+  // operators.
+  if (dynamic_cast<const DownsamplingModule*>(
+          degradation_operators_[num_operators - 1].get()) == nullptr) {
+    return false;
+  }
+  for (int i = 0; i < num_operators - 1; ++i) {
+    const DegradationOperator* degradation_operator =
+        degradation_operators_[i].get();
+    if (dynamic_cast<const BlurModule*>(degradation_operator) != nullptr) {
+      continue;
+    }
+    const MotionModule* motion_module =
+        dynamic_cast<const MotionModule*>(degradation_operator);
+    if (motion_module == nullptr) {
+      return false;
+    }
+    // Sub-pixel motion is interpolated and does not yield a diagonal W.
+    const MotionShiftSequence& motion_shift_sequence =
+        motion_module->GetMotionShiftSequence();
+    if (motion_shift_sequence.GetNumMotionShifts() < num_images) {
+      return false;
+    }
+    for (int index = 0; index < num_images; ++index) {
+      const MotionShift& motion_shift = motion_shift_sequence[index];
+      if (!IsInteger(motion_shift.dx) || !IsInteger(motion_shift.dy)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+ImageData ImageModel::ComputeTranslationalCoverageMap(
+    const cv::Size& image_size, const int num_images) const {
+
+  CHECK(IsTranslationalModel(num_images))
+      << "Coverage map requires a translational image model.";
+
+  // M_k'D'DM_k is diagonal, so applying it to an image of all ones yields its
+  // diagonal. Blur operators are skipped since they are factored out.
+  const cv::Mat ones = cv::Mat::ones(
+      image_size.height, image_size.width, util::kOpenCvMatrixType);
+  ImageData coverage_map(
+      cv::Mat::zeros(image_size, util::kOpenCvMatrixType),
+      DO_NOT_NORMALIZE_IMAGE);
+  const int num_operators = degradation_operators_.size();
+  for (int index = 0; index < num_images; ++index) {
+    ImageData frame_coverage(ones, DO_NOT_NORMALIZE_IMAGE);
+    for (int i = 0; i < num_operators; ++i) {
+      if (dynamic_cast<const BlurModule*>(
+              degradation_operators_[i].get()) == nullptr) {
+        degradation_operators_[i]->ApplyToImage(&frame_coverage, index);
+      }
+    }
+    for (int i = num_operators - 1; i >= 0; --i) {
+      if (dynamic_cast<const BlurModule*>(
+              degradation_operators_[i].get()) == nullptr) {
+        degradation_operators_[i]->ApplyTransposeToImage(
+            &frame_coverage, index);
+      }
+    }
+    coverage_map = coverage_map + frame_coverage;
+  }
+  return coverage_map;
+}
+
+bool ImageModel::HasUniformTranslationalCoverage(const int num_images) const {
+  if (num_images <= 0 || !IsTranslationalModel(num_images)) {
+    return false;
+  }
+
+  // Count how often each downsampling phase is sampled by the net integer
+  // shift of each frame.
+  const int scale = downsampling_scale_;
+  std::vector<int> phase_counts(scale * scale, 0);
+  for (int index = 0; index < num_images; ++index) {
+    int dx = 0;
+    int dy = 0;
+    for (const auto& degradation_operator : degradation_operators_) {
+      const MotionModule* motion_module =
+          dynamic_cast<const MotionModule*>(degradation_operator.get());
+      if (motion_module != nullptr) {
+        const MotionShift& motion_shift =
+            motion_module->GetMotionShiftSequence()[index];
+        dx += static_cast<int>(motion_shift.dx);
+        dy += static_cast<int>(motion_shift.dy);
+      }
+    }
+    const int phase_x = ((dx % scale) + scale) % scale;
+    const int phase_y = ((dy % scale) + scale) % scale;
+    phase_counts[phase_y * scale + phase_x]++;
+  }
+  return std::all_of(
+      phase_counts.begin(),
+      phase_counts.end(),
+      [&phase_counts](const int count) { return count == phase_counts[0]; });
+}
+
+void ImageModel::ApplyBlurToImage(ImageData* image_data) const {
+  CHECK_NOTNULL(image_data);
+  for (const auto& degradation_operator : degradation_operators_) {
+    if (dynamic_cast<const BlurModule*>(
+            degradation_operator.get()) != nullptr) {
+      degradation_operator->ApplyToImage(image_data, 0);
+    }
+  }
+}
+
+void ImageModel::ApplyBlurTransposeToImage(ImageData* image_data) const {
+  CHECK_NOTNULL(image_data);
+  const int num_degradation_operators = degradation_operators_.size();
+  for (int i = num_degradation_operators - 1; i >= 0; --i) {
+    if (dynamic_cast<const BlurModule*>(
+            degradation_operators_[i].get()) != nullptr) {
+      degradation_operators_[i]->ApplyTransposeToImage(image_data, 0);
+    }
+  }
+}
+
 cv::Mat ImageModel::GetModelMatrix(
     const cv::Size& image_size, const int index) const {
 
@@ -104,6 +104,65 @@ class ImageModel {
   cv::Mat GetModelMatrix(
       const cv::Size& image_size, const int index) const;
 
+  // Returns true if this model is a pure translational model for the first
+  // num_images frames. That is, every operator is either an integer-valued
+  // translational motion, a frame-independent blur, or the downsampling
+  // operator (which must be the last operator). For such a model, with
+  // A_k = DBM_k, the blur and motion operators commute (up to the image
+  // border), so that
+  //    sum_k A_k'A_k = B'(sum_k M_k'D'DM_k)B = B'WB
+  // where W is a diagonal matrix. This allows the normal-equation operator
+  // over all frames to be applied in a single pass. See
+  // ComputeTranslationalCoverageMap().
+  bool IsTranslationalModel(const int num_images) const;
+
+  // Returns the diagonal W = sum_k M_k'D'DM_k (see IsTranslationalModel()) as
+  // a single-channel image of the given HR image size. Each pixel contains the
+  // number of LR observations that sample it. The model must be
+  // translational for the given number of images.
+  ImageData ComputeTranslationalCoverageMap(
+      const cv::Size& image_size, const int num_images) const;
+
+  // Returns true if this model is translational (see IsTranslationalModel())
+  // and the first num_images frames sample each of the scale x scale
+  // downsampling phases equally often. Then W is num_images / scale^2 times
+  // the identity (up to the image border), so sum_k A_k'A_k reduces to the
+  // convolution (num_images / scale^2) * B'B, which is diagonalized by the
+  // Fourier transform.
+  bool HasUniformTranslationalCoverage(const int num_images) const;
+
+  // Applies only the blur operators of this model (B) to the given image.
+  // These are independent of the frame index.
+  void ApplyBlurToImage(ImageData* image_data) const;
+
+  // Applies the transpose of the blur operators (B') to the given image.
+  void ApplyBlurTransposeToImage(ImageData* image_data) const;
+
+  // Returns the largest distance (in HR pixels) over the first num_images
+  // frames between an HR pixel and the HR pixels that any LR pixel sampled
+  // from it depends on. This is the sum of the support radii of all operators
+  // (see DegradationOperator::GetSupportRadius()), e.g. the blur radius plus
+  // the largest motion shift.
+  int GetSupportRadius(const int num_images) const;
+
+  // Returns the model for HR images that are downscaled by the given integer
+  // factor, for the same LR observations. The downsampling scale shrinks by the
+  // factor, and every operator is replaced by its downscaled version (see
+  // DegradationOperator::CreateDownscaledOperator()). Returns nullptr if the
+  // scale is not divisible by the factor or any operator cannot be
+  // downscaled.
+  std::shared_ptr<ImageModel> CreateDownscaledModel(const int factor) const;
+
+  // Returns the motion sequence of this model's motion operator, or an empty
+  // sequence if the model has no motion operator.
+  MotionShiftSequence GetMotionShiftSequence() const;
+
+  // Returns a copy of this model whose motion operator uses the given motion
+  // sequence instead (e.g. after the motion was refined). All other operators
+  // are shared with this model. The model must have a motion operator.
+  std::shared_ptr<ImageModel> CreateModelWithMotion(
+      const MotionShiftSequence& motion_shift_sequence) const;
+
   // Returns the downsampling scale.
   int GetDownsamplingScale() const {
     return downsampling_scale_;
@@ -2,6 +2,8 @@
 
 #include <algorithm>
 #include <cmath>
+#include <memory>
+#include <vector>
 
 #include "image/image_data.h"
 #include "motion/motion_shift.h"
@@ -72,4 +74,27 @@ cv::Mat MotionModule::GetOperatorMatrix(
   return motion_matrix;
 }
 
+int MotionModule::GetSupportRadius(const int index) const {
+  const MotionShift& motion_shift = motion_shift_sequence_[index];
+  return static_cast<int>(std::ceil(
+      std::max(std::abs(motion_shift.dx), std::abs(motion_shift.dy))));
+}
+
+std::shared_ptr<DegradationOperator> MotionModule::CreateDownscaledOperator(
+    const int factor) const {
+
+  CHECK_GE(factor, 1);
+
+  const int num_motion_shifts = motion_shift_sequence_.GetNumMotionShifts();
+  std::vector<MotionShift> motion_shifts;
+  motion_shifts.reserve(num_motion_shifts);
+  for (int i = 0; i < num_motion_shifts; ++i) {
+    const MotionShift& motion_shift = motion_shift_sequence_[i];
+    motion_shifts.push_back(
+        MotionShift(motion_shift.dx / factor, motion_shift.dy / factor));
+  }
+  return std::shared_ptr<DegradationOperator>(
+      new MotionModule(MotionShiftSequence(motion_shifts)));
+}
+
 }  // namespace super_resolution
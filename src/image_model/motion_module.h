@@ -27,6 +27,16 @@ class MotionModule : public DegradationOperator {
   virtual cv::Mat GetOperatorMatrix(
       const cv::Size& image_size, const int index) const;
 
+  virtual std::shared_ptr<DegradationOperator> CreateDownscaledOperator(
+      const int factor) const;
+
+  virtual int GetSupportRadius(const int index) const;
+
+  // Returns the motion sequence used by this module.
+  const MotionShiftSequence& GetMotionShiftSequence() const {
+    return motion_shift_sequence_;
+  }
+
  private:
   const MotionShiftSequence motion_shift_sequence_;
 };
@@ -0,0 +1,251 @@
+#include "motion/motion_refinement.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "image/image_data.h"
+#include "image_model/image_model.h"
+#include "motion/motion_shift.h"
+#include "util/util.h"
+
+#include "opencv2/core/core.hpp"
+
+#include "glog/logging.h"
+
+namespace super_resolution {
+namespace {
+
+// The largest change of a shift component (in HR pixels) in one Gauss-Newton
+// step. The linearization of the warp is only accurate within about a pixel.
+constexpr double kMaxShiftStep = 0.5;
+
+// The number of times a step that does not reduce the cost is halved before
+// the refinement of a frame stops.
+constexpr int kMaxNumStepHalvings = 4;
+
+// Returns the spatial derivatives of every channel of the given image along
+// the columns (x) and rows (y), using central differences (one-sided at the
+// image border).
+void ComputeImageGradients(
+    const double* image_data,
+    const cv::Size& image_size,
+    const int num_channels,
+    std::vector<double>* gradient_x,
+    std::vector<double>* gradient_y) {
+
+  const int width = image_size.width;
+  const int height = image_size.height;
+  const int num_pixels = width * height;
+  gradient_x->resize(num_pixels * num_channels);
+  gradient_y->resize(num_pixels * num_channels);
+  for (int channel = 0; channel < num_channels; ++channel) {
+    const double* channel_data = image_data + channel * num_pixels;
+    double* channel_gradient_x = gradient_x->data() + channel * num_pixels;
+    double* channel_gradient_y = gradient_y->data() + channel * num_pixels;
+    for (int row = 0; row < height; ++row) {
+      const int previous_row = std::max(row - 1, 0);
+      const int next_row = std::min(row + 1, height - 1);
+      for (int col = 0; col < width; ++col) {
+        const int previous_col = std::max(col - 1, 0);
+        const int next_col = std::min(col + 1, width - 1);
+        const int index = row * width + col;
+        channel_gradient_x[index] =
+            (channel_data[row * width + next_col] -
+             channel_data[row * width + previous_col]) /
+            std::max(next_col - previous_col, 1);
+        channel_gradient_y[index] =
+            (channel_data[next_row * width + col] -
+             channel_data[previous_row * width + col]) /
+            std::max(next_row - previous_row, 1);
+      }
+    }
+  }
+}
+
+// Applies the image model of the given frame to the image and returns the LR
+// pixel values of all channels, stacked.
+std::vector<double> ApplyModelToImage(
+    const ImageModel& image_model, const int index, const ImageData& image) {
+
+  const ImageData degraded_image = image_model.ApplyToImage(image, index);
+  const int num_pixels = degraded_image.GetNumPixels();
+  const int num_channels = degraded_image.GetNumChannels();
+  std::vector<double> values(num_pixels * num_channels);
+  for (int channel = 0; channel < num_channels; ++channel) {
+    const double* channel_data = degraded_image.GetChannelData(channel);
+    std::copy(
+        channel_data,
+        channel_data + num_pixels,
+        values.begin() + channel * num_pixels);
+  }
+  return values;
+}
+
+// Returns the dot product of the two vectors, which must have the same size.
+double DotProduct(const std::vector<double>& a, const std::vector<double>& b) {
+  double sum = 0.0;
+  for (int i = 0; i < a.size(); ++i) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+// Refines the shift of a single frame (see RefineMotionShifts()). The
+// observed values are the LR pixels of the frame, stacked like the values
+// returned by ApplyModelToImage().
+MotionShift RefineFrameMotionShift(
+    const ImageModel& image_model,
+    const std::vector<MotionShift>& motion_shifts,
+    const int index,
+    const ImageData& estimate,
+    const ImageData& estimate_gradient_x,
+    const ImageData& estimate_gradient_y,
+    const std::vector<double>& observed_values,
+    const int num_iterations) {
+
+  // Returns the model with the given shift for this frame.
+  const auto create_frame_model = [&](const MotionShift& motion_shift) {
+    std::vector<MotionShift> frame_motion_shifts = motion_shifts;
+    frame_motion_shifts[index] = motion_shift;
+    return image_model.CreateModelWithMotion(
+        MotionShiftSequence(frame_motion_shifts));
+  };
+  // Returns the residuals and cost of the frame for the given model.
+  const auto compute_residuals = [&](
+      const ImageModel& frame_model, std::vector<double>* residuals) {
+    *residuals = ApplyModelToImage(frame_model, index, estimate);
+    CHECK_EQ(residuals->size(), observed_values.size());
+    double cost = 0.0;
+    for (int i = 0; i < residuals->size(); ++i) {
+      (*residuals)[i] -= observed_values[i];
+      cost += (*residuals)[i] * (*residuals)[i];
+    }
+    return cost;
+  };
+
+  MotionShift motion_shift = motion_shifts[index];
+  std::shared_ptr<ImageModel> frame_model = create_frame_model(motion_shift);
+  std::vector<double> residuals;
+  double cost = compute_residuals(*frame_model, &residuals);
+  for (int iteration = 0; iteration < num_iterations; ++iteration) {
+    // The Jacobian of the residuals is -[j_x j_y], where j = A_k(s_k) grad(x).
+    // The Gauss-Newton step solves (j'j) step = j'r.
+    const std::vector<double> jacobian_x =
+        ApplyModelToImage(*frame_model, index, estimate_gradient_x);
+    const std::vector<double> jacobian_y =
+        ApplyModelToImage(*frame_model, index, estimate_gradient_y);
+    const double jxx = DotProduct(jacobian_x, jacobian_x);
+    const double jxy = DotProduct(jacobian_x, jacobian_y);
+    const double jyy = DotProduct(jacobian_y, jacobian_y);
+    const double jxr = DotProduct(jacobian_x, residuals);
+    const double jyr = DotProduct(jacobian_y, residuals);
+    const double determinant = jxx * jyy - jxy * jxy;
+    if (determinant <= 1.0e-12 * jxx * jyy) {
+      break;  // The frame has no texture to register in some direction.
+    }
+    double step_x = (jyy * jxr - jxy * jyr) / determinant;
+    double step_y = (jxx * jyr - jxy * jxr) / determinant;
+    const double largest_step = std::max(std::abs(step_x), std::abs(step_y));
+    if (largest_step > kMaxShiftStep) {
+      step_x *= kMaxShiftStep / largest_step;
+      step_y *= kMaxShiftStep / largest_step;
+    }
+
+    bool is_step_accepted = false;
+    for (int i = 0; i <= kMaxNumStepHalvings && !is_step_accepted; ++i) {
+      const MotionShift candidate_shift(
+          motion_shift.dx + step_x, motion_shift.dy + step_y);
+      const std::shared_ptr<ImageModel> candidate_model =
+          create_frame_model(candidate_shift);
+      std::vector<double> candidate_residuals;
+      const double candidate_cost =
+          compute_residuals(*candidate_model, &candidate_residuals);
+      if (candidate_cost < cost) {
+        motion_shift = candidate_shift;
+        frame_model = candidate_model;
+        residuals.swap(candidate_residuals);
+        cost = candidate_cost;
+        is_step_accepted = true;
+      }
+      step_x /= 2.0;
+      step_y /= 2.0;
+    }
+    if (!is_step_accepted) {
+      break;
+    }
+  }
+  return motion_shift;
+}
+
+}  // namespace
+
+MotionShiftSequence RefineMotionShifts(
+    const ImageModel& image_model,
+    const std::vector<ImageData>& observations,
+    const double* estimated_image_data,
+    const int channel_start,
+    const int channel_end,
+    const cv::Size& image_size,
+    const int num_iterations) {
+
+  CHECK_NOTNULL(estimated_image_data);
+  CHECK_GT(channel_end, channel_start) << "Invalid channel range.";
+
+  const int num_images = observations.size();
+  const MotionShiftSequence motion_shift_sequence =
+      image_model.GetMotionShiftSequence();
+  CHECK_GE(motion_shift_sequence.GetNumMotionShifts(), num_images)
+      << "The image model must have a motion shift for every observation.";
+  std::vector<MotionShift> motion_shifts;
+  for (int i = 0; i < motion_shift_sequence.GetNumMotionShifts(); ++i) {
+    motion_shifts.push_back(motion_shift_sequence[i]);
+  }
+
+  const int num_channels = channel_end - channel_start;
+  const ImageData estimate(estimated_image_data, image_size, num_channels);
+  std::vector<double> gradient_x;
+  std::vector<double> gradient_y;
+  ComputeImageGradients(
+      estimated_image_data, image_size, num_channels, &gradient_x, &gradient_y);
+  const ImageData estimate_gradient_x(
+      gradient_x.data(), image_size, num_channels);
+  const ImageData estimate_gradient_y(
+      gradient_y.data(), image_size, num_channels);
+
+  // The observations are stored as LR images upsampled to the HR size with
+  // nearest neighbor interpolation, so the top-left pixel of each block is
+  // the LR pixel.
+  const int scale = image_model.GetDownsamplingScale();
+  const cv::Size lr_image_size(
+      image_size.width / scale, image_size.height / scale);
+  std::vector<MotionShift> refined_motion_shifts = motion_shifts;
+  util::ParallelFor(num_images - 1, [&](const int i) {
+    const int index = i + 1;
+    std::vector<double> observed_values;
+    observed_values.reserve(lr_image_size.area() * num_channels);
+    for (int channel = channel_start; channel < channel_end; ++channel) {
+      const double* channel_data =
+          observations[index].GetChannelData(channel);
+      for (int row = 0; row < lr_image_size.height; ++row) {
+        for (int col = 0; col < lr_image_size.width; ++col) {
+          observed_values.push_back(
+              channel_data[row * scale * image_size.width + col * scale]);
+        }
+      }
+    }
+    refined_motion_shifts[index] = RefineFrameMotionShift(
+        image_model,
+        motion_shifts,
+        index,
+        estimate,
+        estimate_gradient_x,
+        estimate_gradient_y,
+        observed_values,
+        num_iterations);
+  });
+  return MotionShiftSequence(refined_motion_shifts);
+}
+
+}  // namespace super_resolution
@@ -0,0 +1,48 @@
+// Refines the translational motion of the LR frames against an HR estimate.
+// The initial motion estimates (see registration.h) are computed between the
+// aliased LR frames, so they are only approximately subpixel accurate. Given
+// an HR estimate, each frame's shift can be re-estimated by fitting the image
+// model to that frame, which allows alternating between solving for the HR
+// image and for the motion.
+
+#ifndef SRC_MOTION_MOTION_REFINEMENT_H_
+#define SRC_MOTION_MOTION_REFINEMENT_H_
+
+#include <vector>
+
+#include "image/image_data.h"
+#include "image_model/image_model.h"
+#include "motion/motion_shift.h"
+
+#include "opencv2/core/core.hpp"
+
+namespace super_resolution {
+
+// Re-estimates the motion shift s_k of every frame k to minimize the data cost
+// ||A_k(s_k)x - y_k||^2 of that frame, where x is the given HR estimate of
+// the channels in [channel_start, channel_end). The observations are the LR
+// images upsampled to the HR size, as stored by the MapSolver.
+//
+// Starting from the motion of the image model (which must have a motion
+// operator), each frame takes up to num_iterations Gauss-Newton steps. The
+// derivative of the warp is analytic: translating x commutes with taking its
+// spatial gradient, so
+//   d/ds_k A_k(s_k)x = -A_k(s_k) grad(x),
+// which costs one model application per shift component. Steps that do not
+// reduce the frame's cost are halved, and a frame stops once no step does.
+//
+// The first frame is the reference and keeps its shift, since shifting all
+// frames is equivalent to shifting the estimate. The other frames are refined
+// in parallel.
+MotionShiftSequence RefineMotionShifts(
+    const ImageModel& image_model,
+    const std::vector<ImageData>& observations,
+    const double* estimated_image_data,
+    const int channel_start,
+    const int channel_end,
+    const cv::Size& image_size,
+    const int num_iterations);
+
+}  // namespace super_resolution
+
+#endif  // SRC_MOTION_MOTION_REFINEMENT_H_
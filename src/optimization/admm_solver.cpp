@@ -1,36 +1,380 @@
 #include "optimization/admm_solver.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
 #include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
+#include "image/image_data.h"
+#include "image_model/image_model.h"
+#include "optimization/linear_conjugate_gradient.h"
 #include "optimization/objective_data_term.h"
 #include "optimization/objective_function.h"
+#include "optimization/objective_normal_equation_data_term.h"
+#include "optimization/regularizer.h"
+#include "optimization/shifted_differences.h"
+#include "optimization/solver_telemetry.h"
+#include "util/util.h"
+
+#include "opencv2/core/core.hpp"
+
+#include "glog/logging.h"
 
 namespace super_resolution {
+namespace {
+
+// The penalty parameter is rescaled if one residual exceeds the other by more
+// than this factor.
+constexpr double kPenaltyResidualRatio = 10.0;
+
+// Runs ADMM on the given channel range data, which holds the initial estimate
+// and is replaced by the solution. The data objective must only contain the
+// data term. Returns the final value of the full (1-norm) objective. If
+// telemetry is given, every iteration is recorded under the given stage name.
+// The loop stops early at the data objective's deadline, if it has one.
+double RunAdmmLoop(
+    const AdmmSolverOptions& options,
+    const ObjectiveFunction& data_objective,
+    const std::vector<ShiftedDifference>& shifts,
+    const cv::Size& image_size,
+    const int num_channels,
+    const std::shared_ptr<SolverTelemetry>& telemetry,
+    const std::string& telemetry_stage,
+    std::vector<double>* estimated_image_data) {
+
+  std::vector<double>& x = *estimated_image_data;
+  const int num_data_points = x.size();
+  const int num_shifts = shifts.size();
+
+  // The data term is quadratic, so its gradient is 2Hx - 2b where H is the
+  // normal-equation operator. The gradient at 0 gives the constant part.
+  std::vector<double> constant_gradient(num_data_points);
+  const std::vector<double> zeros(num_data_points, 0.0);
+  data_objective.ComputeAllTerms(zeros.data(), constant_gradient.data());
+
+  // The x-update minimizes data(x) + rho/2 sum_s ||D_s x - z_s + u_s||^2,
+  // which solves (2H + rho sum_s D_s'D_s)x = 2b + rho sum_s D_s'(z_s - u_s).
+  double penalty_parameter = options.penalty_parameter;
+  std::vector<double> shifted_differences(num_data_points);
+  const LinearOperator apply_x_update_operator =
+      [&](const double* input, double* output) {
+        data_objective.ComputeAllTerms(input, output);
+        for (int i = 0; i < num_data_points; ++i) {
+          output[i] -= constant_gradient[i];
+        }
+        for (const ShiftedDifference& shift : shifts) {
+          ApplyShiftedDifference(
+              input,
+              image_size,
+              num_channels,
+              shift,
+              shifted_differences.data());
+          AddShiftedDifferenceTranspose(
+              shifted_differences.data(),
+              image_size,
+              num_channels,
+              shift,
+              penalty_parameter,
+              output);
+        }
+      };
+
+  // The split variables z_s = D_s x and the scaled dual variables u_s.
+  std::vector<std::vector<double>> split_variables(num_shifts);
+  std::vector<std::vector<double>> dual_variables(
+      num_shifts, std::vector<double>(num_data_points, 0.0));
+  for (int shift_index = 0; shift_index < num_shifts; ++shift_index) {
+    split_variables[shift_index].resize(num_data_points);
+    ApplyShiftedDifference(
+        x.data(),
+        image_size,
+        num_channels,
+        shifts[shift_index],
+        split_variables[shift_index].data());
+  }
+
+  LinearConjugateGradientSolver linear_solver(num_data_points);
+  linear_solver.SetDeadline(data_objective.GetDeadline());
+  std::vector<double> right_hand_side(num_data_points);
+  std::vector<double> previous_x(num_data_points);
+  std::vector<double> split_variable_changes(num_data_points);
+  std::vector<double> dual_residual(num_data_points);
+  int num_iterations_ran = 0;
+  while (num_iterations_ran < options.max_num_admm_iterations) {
+    if (data_objective.IsPastDeadline()) {
+      LOG(INFO) << "Deadline reached. Stopping ADMM after "
+                << num_iterations_ran << " iterations.";
+      break;
+    }
+    // x-update.
+    for (int i = 0; i < num_data_points; ++i) {
+      right_hand_side[i] = -constant_gradient[i];
+    }
+    for (int shift_index = 0; shift_index < num_shifts; ++shift_index) {
+      const std::vector<double>& split_variable =
+          split_variables[shift_index];
+      const std::vector<double>& dual_variable = dual_variables[shift_index];
+      for (int i = 0; i < num_data_points; ++i) {
+        split_variable_changes[i] = split_variable[i] - dual_variable[i];
+      }
+      AddShiftedDifferenceTranspose(
+          split_variable_changes.data(),
+          image_size,
+          num_channels,
+          shifts[shift_index],
+          penalty_parameter,
+          right_hand_side.data());
+    }
+    previous_x = x;
+    linear_solver.Solve(
+        apply_x_update_operator,
+        right_hand_side.data(),
+        options.max_num_cg_iterations_per_update,
+        0.0,
+        x.data());
+    double estimate_change_sum = 0.0;
+    for (int i = 0; i < num_data_points; ++i) {
+      const double change = x[i] - previous_x[i];
+      estimate_change_sum += change * change;
+    }
+
+    // z-update (soft thresholding) and dual update.
+    double primal_residual_sum = 0.0;
+    std::fill(dual_residual.begin(), dual_residual.end(), 0.0);
+    for (int shift_index = 0; shift_index < num_shifts; ++shift_index) {
+      std::vector<double>& split_variable = split_variables[shift_index];
+      std::vector<double>& dual_variable = dual_variables[shift_index];
+      ApplyShiftedDifference(
+          x.data(),
+          image_size,
+          num_channels,
+          shifts[shift_index],
+          shifted_differences.data());
+      const double threshold =
+          shifts[shift_index].coefficient / penalty_parameter;
+      for (int i = 0; i < num_data_points; ++i) {
+        const double value = shifted_differences[i] + dual_variable[i];
+        const double shrunk_value =
+            std::max(std::abs(value) - threshold, 0.0) * util::GetSign(value);
+        const double primal_residual =
+            shifted_differences[i] - shrunk_value;
+        primal_residual_sum += primal_residual * primal_residual;
+        dual_variable[i] += primal_residual;
+        split_variable_changes[i] = shrunk_value - split_variable[i];
+        split_variable[i] = shrunk_value;
+      }
+      AddShiftedDifferenceTranspose(
+          split_variable_changes.data(),
+          image_size,
+          num_channels,
+          shifts[shift_index],
+          penalty_parameter,
+          dual_residual.data());
+    }
+    double dual_residual_sum = 0.0;
+    for (int i = 0; i < num_data_points; ++i) {
+      dual_residual_sum += dual_residual[i] * dual_residual[i];
+    }
+    num_iterations_ran++;
+    if (telemetry != nullptr) {
+      // The full objective is not evaluated during the iterations.
+      SolverIterationRecord record;
+      record.stage = telemetry_stage;
+      record.iteration = num_iterations_ran;
+      record.step_size = std::sqrt(estimate_change_sum);
+      record.num_evaluations = data_objective.GetNumEvaluations();
+      telemetry->RecordIteration(record);
+    }
+
+    // The x-update is inexact, so the change in the estimate must also be
+    // small. Without any regularizers that is the only criterion.
+    const double primal_residual_rms = (num_shifts > 0) ?
+        std::sqrt(primal_residual_sum / (num_shifts * num_data_points)) : 0.0;
+    const double dual_residual_rms =
+        std::sqrt(dual_residual_sum / num_data_points);
+    const double estimate_change_rms =
+        std::sqrt(estimate_change_sum / num_data_points);
+    if (primal_residual_rms < options.admm_residual_threshold &&
+        dual_residual_rms < options.admm_residual_threshold &&
+        estimate_change_rms < options.admm_residual_threshold) {
+      break;
+    }
+
+    // Rebalance the residuals. The scaled dual variables are u = y / rho for
+    // the unscaled duals y, so they are rescaled along with rho.
+    if (options.adapt_penalty_parameter) {
+      double penalty_scale = 1.0;
+      if (primal_residual_rms > kPenaltyResidualRatio * dual_residual_rms) {
+        penalty_scale = 2.0;
+      } else if (
+          dual_residual_rms > kPenaltyResidualRatio * primal_residual_rms) {
+        penalty_scale = 0.5;
+      }
+      if (penalty_scale != 1.0) {
+        penalty_parameter *= penalty_scale;
+        for (std::vector<double>& dual_variable : dual_variables) {
+          for (double& value : dual_variable) {
+            value /= penalty_scale;
+          }
+        }
+      }
+    }
+  }
+
+  double final_cost = data_objective.ComputeAllTerms(x.data());
+  for (const ShiftedDifference& shift : shifts) {
+    ApplyShiftedDifference(
+        x.data(),
+        image_size,
+        num_channels,
+        shift,
+        shifted_differences.data());
+    for (int i = 0; i < num_data_points; ++i) {
+      final_cost += shift.coefficient * std::abs(shifted_differences[i]);
+    }
+  }
+  LOG(INFO) << "ADMM done after " << num_iterations_ran << " iterations. "
+            << "Final loss is " << final_cost << ".";
+  return final_cost;
+}
+
+}  // namespace
+
+void AdmmSolverOptions::PrintSolverOptions() const {
+  std::cout << "AdmmSolver Options" << std::endl;
+  std::cout << "  Objective:                           "
+            << "maximum a posteriori" << std::endl;
+  std::cout << "  Optimization strategy:               "
+            << "alternating direction method of multipliers" << std::endl;
+  std::cout << "  Maximum ADMM iterations:             "
+            << max_num_admm_iterations << std::endl;
+  std::cout << "  CG iterations per x-update:          "
+            << max_num_cg_iterations_per_update << std::endl;
+  std::cout << "  Penalty parameter (rho):             "
+            << penalty_parameter
+            << (adapt_penalty_parameter ? " (adaptive)" : "") << std::endl;
+  std::cout << "  ADMM residual threshold:             "
+            << admm_residual_threshold << std::endl;
+  if (use_normal_equation_data_term) {
+    std::cout << "  Normal-equation data term enabled." << std::endl;
+  }
+  if (split_channels) {
+    std::cout << "  Channel splitting enabled." << std::endl;
+  }
+  if (time_limit_seconds > 0.0) {
+    std::cout << "  Time limit (seconds):                "
+              << time_limit_seconds << std::endl;
+  }
+}
+
+AdmmSolver::AdmmSolver(
+    const AdmmSolverOptions& solver_options,
+    const ImageModel& image_model,
+    const std::vector<ImageData>& low_res_images,
+    const bool print_solver_output)
+    : MapSolver(image_model, low_res_images, print_solver_output),
+      solver_options_(solver_options) {}
+
+void AdmmSolver::AddRegularizer(
+    std::shared_ptr<Regularizer> regularizer,
+    const double regularization_parameter) {
+
+  std::vector<ShiftedDifference> shifts;
+  CHECK(regularizer->GetShiftedDifferences(&shifts))
+      << "The ADMM solver only supports regularizers that are sums of "
+      << "absolute shifted differences (TV, 3D TV and BTV).";
+  MapSolver::AddRegularizer(regularizer, regularization_parameter);
+}
 
 ImageData AdmmSolver::Solve(const ImageData& initial_estimate) {
+  const int num_pixels = GetNumPixels();
   const int num_channels = GetNumChannels();
-  const int num_data_points = GetNumDataPoints();
-
-  ObjectiveFunction data_term_objective(num_data_points);
-  // TODO: Fix the range (0 - num_channels?).
-  std::shared_ptr<ObjectiveTerm> data_term(new ObjectiveDataTerm(
-      image_model_, observations_, 0, num_channels, GetImageSize()));
-  data_term_objective.AddTerm(data_term);
-  // ObjectiveEqualityConstraintTerm  TODO: implement this.
-
-  ObjectiveFunction regularization_objective(num_data_points);
-  // ObjectiveRegularizationTerm ?
-  // ObjectiveEqualityConstraintTerm
-
-  // TODO: verify that this is the correct approach and then implement it.
-  // X = Z = initial_estimate;
-  // while (not converged) {
-  //   Z = solve(data_term_objective) <- X, Z
-  //   X = solve(regularization_objective) <- X, Z
-  // }
-
-  // TODO: return the solved Image.
-  return initial_estimate;
+  const cv::Size image_size = GetImageSize();
+  CHECK_EQ(initial_estimate.GetNumPixels(), num_pixels);
+  CHECK_EQ(initial_estimate.GetNumChannels(), num_channels);
+  CHECK_EQ(initial_estimate.GetImageSize(), image_size);
+
+  if (IsVerbose()) {
+    solver_options_.PrintSolverOptions();
+  }
+
+  // Regularizers with a non-positive parameter are ignored.
+  std::vector<std::pair<std::shared_ptr<Regularizer>, double>>
+      active_regularizers;
+  for (const auto& regularizer_and_parameter : regularizers_) {
+    if (regularizer_and_parameter.second > 0.0) {
+      active_regularizers.push_back(regularizer_and_parameter);
+    }
+  }
+  const std::vector<ShiftedDifference> shifts =
+      GetMergedShiftedDifferences(active_regularizers);
+
+  // Channels are solved independently if the split_channels option is set.
+  const int num_channels_per_split =
+      solver_options_.split_channels ? 1 : num_channels;
+  const int num_solver_rounds = num_channels / num_channels_per_split;
+  const int num_data_points = num_channels_per_split * num_pixels;
+
+  const std::chrono::steady_clock::time_point deadline =
+      solver_options_.GetDeadline();
+  ImageData estimated_image;
+  for (int i = 0; i < num_solver_rounds; ++i) {
+    const int channel_start = i * num_channels_per_split;
+    const int channel_end = channel_start + num_channels_per_split;
+
+    std::vector<double> solver_data(num_data_points);
+    for (int channel = 0; channel < num_channels_per_split; ++channel) {
+      const double* channel_ptr = initial_estimate.GetChannelData(
+          channel_start + channel);
+      std::copy(
+          channel_ptr,
+          channel_ptr + num_pixels,
+          solver_data.begin() + channel * num_pixels);
+    }
+
+    // The conjugate gradient steps never revisit a point, so the evaluation
+    // cache is disabled.
+    ObjectiveFunction data_objective(num_data_points);
+    data_objective.SetCacheCapacity(0);
+    // Each subset gets an equal share of the time left by the previous ones.
+    data_objective.SetDeadline(
+        GetPartialDeadline(deadline, 1.0 / (num_solver_rounds - i)));
+    std::shared_ptr<ObjectiveTerm> data_term;
+    if (solver_options_.use_normal_equation_data_term) {
+      data_term = std::shared_ptr<ObjectiveTerm>(
+          new ObjectiveNormalEquationDataTerm(
+              image_model_,
+              observations_,
+              channel_start,
+              channel_end,
+              image_size));
+    } else {
+      data_term = std::shared_ptr<ObjectiveTerm>(new ObjectiveDataTerm(
+          image_model_, observations_, channel_start, channel_end, image_size));
+    }
+    data_objective.AddTerm(data_term);
+
+    RunAdmmLoop(
+        solver_options_,
+        data_objective,
+        shifts,
+        image_size,
+        num_channels_per_split,
+        telemetry_,
+        telemetry_stage_prefix_ + "admm" + ((num_solver_rounds > 1) ?
+            "_channel_" + std::to_string(channel_start) : ""),
+        &solver_data);
+
+    for (int channel = 0; channel < num_channels_per_split; ++channel) {
+      estimated_image.AddChannel(
+          solver_data.data() + channel * num_pixels, image_size);
+    }
+  }
+  return estimated_image;
 }
 
 }  // namespace super_resolution
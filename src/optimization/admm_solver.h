@@ -1,13 +1,76 @@
+// An alternating direction method of multipliers (ADMM) implementation of the
+// MAP objective formulation for 1-norm priors on shifted differences, such as
+// TV, 3D TV and BTV (see Regularizer::GetShiftedDifferences). The problem
+//   min_x data(x) + sum_s kappa_s ||D_s x||_1
+// where each D_s is a shifted-difference operator and kappa_s its combined
+// weight over all regularizers, is split with auxiliary variables z_s = D_s x
+// into two subproblems that are alternated:
+//   x-update: the quadratic data(x) + rho/2 sum_s ||D_s x - z_s + u_s||^2,
+//             solved with a few warm-started linear conjugate gradient steps.
+//   z-update: z_s = shrink(D_s x + u_s, kappa_s / rho), in closed form.
+// Unlike IRLS, no nonlinear problem is rebuilt and re-solved in every outer
+// round. This converges to the same minimizer that IRLS approximates.
+
 #ifndef SRC_OPTIMIZATION_ADMM_SOLVER_H_
 #define SRC_OPTIMIZATION_ADMM_SOLVER_H_
 
+#include <memory>
+#include <vector>
+
+#include "image/image_data.h"
+#include "image_model/image_model.h"
 #include "optimization/map_solver.h"
+#include "optimization/regularizer.h"
 
 namespace super_resolution {
 
+struct AdmmSolverOptions : public MapSolverOptions {
+  AdmmSolverOptions() {}  // Required for making a const instance.
+
+  // Print also includes specific ADMM parameters.
+  virtual void PrintSolverOptions() const;
+
+  // Maximum number of ADMM iterations (x-update and z-update pairs).
+  int max_num_admm_iterations = 200;
+
+  // Maximum number of linear conjugate gradient steps in each x-update. The
+  // x-update is warm-started from the previous estimate, so a few steps are
+  // enough.
+  int max_num_cg_iterations_per_update = 10;
+
+  // The initial augmented Lagrangian penalty rho.
+  double penalty_parameter = 1.0;
+
+  // If true, rho is doubled or halved whenever the primal and dual residuals
+  // differ by more than a factor of 10, which makes convergence much less
+  // sensitive to the initial penalty parameter.
+  bool adapt_penalty_parameter = true;
+
+  // ADMM stops once the root mean squares of the primal residual
+  // (D_s x - z_s), the dual residual (rho D_s'(z_s - previous z_s)) and the
+  // change in the estimate are all below this threshold.
+  double admm_residual_threshold = 1.0e-5;
+};
+
 class AdmmSolver : public MapSolver {
  public:
+  AdmmSolver(
+      const AdmmSolverOptions& solver_options,
+      const ImageModel& image_model,
+      const std::vector<ImageData>& low_res_images,
+      const bool print_solver_output = true);
+
+  // Only regularizers defined by shifted differences are supported. Adding
+  // any other regularizer causes a check fail.
+  virtual void AddRegularizer(
+      std::shared_ptr<Regularizer> regularizer,
+      const double regularization_parameter);
+
   virtual ImageData Solve(const ImageData& initial_estimate);
+
+ private:
+  // Passed in through the constructor.
+  const AdmmSolverOptions solver_options_;
 };
 
 }  // namespace super_resolution
@@ -10,6 +10,36 @@
 #include "glog/logging.h"
 
 namespace super_resolution {
+namespace {
+
+// Returns the objective's diagonal preconditioner as an ALGLIB array. Both
+// ALGLIB solvers expect the Hessian diagonal itself, not its inverse.
+alglib::real_1d_array GetDiagonalPreconditioner(
+    const ObjectiveFunction& objective_function) {
+
+  const std::vector<double> diagonal =
+      objective_function.ComputeDiagonalPreconditioner();
+  alglib::real_1d_array preconditioner;
+  preconditioner.setcontent(diagonal.size(), diagonal.data());
+  return preconditioner;
+}
+
+// The ALGLIB callbacks only need to modify the objective's iteration
+// bookkeeping, which is why the objective is passed in as non-const.
+AlglibCallbackData CreateCallbackData(
+    const ObjectiveFunction& objective_function,
+    alglib::mincgstate* cg_state,
+    alglib::minlbfgsstate* lbfgs_state) {
+
+  AlglibCallbackData callback_data;
+  callback_data.objective_function =
+      const_cast<ObjectiveFunction*>(&objective_function);
+  callback_data.cg_state = cg_state;
+  callback_data.lbfgs_state = lbfgs_state;
+  return callback_data;
+}
+
+}  // namespace
 
 double RunCGSolverNumericalDiff(
     const MapSolverOptions& solver_options,
@@ -17,6 +47,8 @@ double RunCGSolverNumericalDiff(
     alglib::real_1d_array* solver_data) {
 
   alglib::mincgstate solver_state;
+  AlglibCallbackData callback_data =
+      CreateCallbackData(objective_function, &solver_state, nullptr);
   alglib::mincgreport solver_report;
 
   alglib::mincgcreatef(
@@ -31,13 +63,17 @@ double RunCGSolverNumericalDiff(
       solver_options.parameter_variation_threshold,
       solver_options.max_num_solver_iterations);
   alglib::mincgsetxrep(solver_state, true);
+  if (solver_options.use_diagonal_preconditioner) {
+    alglib::mincgsetprecdiag(
+        solver_state, GetDiagonalPreconditioner(objective_function));
+  }
 
   // Optimize with conjugate gradient.
   alglib::mincgoptimize(
       solver_state,
       AlglibObjectiveFunctionNumericalDiff,
       AlglibSolverIterationCallback,
-      const_cast<void*>(reinterpret_cast<const void*>(&objective_function)));
+      &callback_data);
 
   alglib::mincgresults(solver_state, *solver_data, solver_report);
 
@@ -50,6 +86,8 @@ double RunCGSolverAnalyticalDiff(
     alglib::real_1d_array* solver_data) {
 
   alglib::mincgstate solver_state;
+  AlglibCallbackData callback_data =
+      CreateCallbackData(objective_function, &solver_state, nullptr);
   alglib::mincgreport solver_report;
 
   alglib::mincgcreate(*solver_data, solver_state);
@@ -61,13 +99,17 @@ double RunCGSolverAnalyticalDiff(
       solver_options.parameter_variation_threshold,
       solver_options.max_num_solver_iterations);
   alglib::mincgsetxrep(solver_state, true);
+  if (solver_options.use_diagonal_preconditioner) {
+    alglib::mincgsetprecdiag(
+        solver_state, GetDiagonalPreconditioner(objective_function));
+  }
 
   // Optimize with conjugate gradient.
   alglib::mincgoptimize(
       solver_state,
       AlglibObjectiveFunction,
       AlglibSolverIterationCallback,
-      const_cast<void*>(reinterpret_cast<const void*>(&objective_function)));
+      &callback_data);
 
   alglib::mincgresults(solver_state, *solver_data, solver_report);
 
@@ -80,6 +122,8 @@ double RunLBFGSSolverNumericalDiff(
     alglib::real_1d_array* solver_data) {
 
   alglib::minlbfgsstate solver_state;
+  AlglibCallbackData callback_data =
+      CreateCallbackData(objective_function, nullptr, &solver_state);
   alglib::minlbfgsreport solver_report;
 
   alglib::minlbfgscreatef(
@@ -95,13 +139,17 @@ double RunLBFGSSolverNumericalDiff(
       solver_options.parameter_variation_threshold,
       solver_options.max_num_solver_iterations);
   alglib::minlbfgssetxrep(solver_state, true);
+  if (solver_options.use_diagonal_preconditioner) {
+    alglib::minlbfgssetprecdiag(
+        solver_state, GetDiagonalPreconditioner(objective_function));
+  }
 
   // Optimize with LBFGS.
   alglib::minlbfgsoptimize(
       solver_state,
       AlglibObjectiveFunctionNumericalDiff,
       AlglibSolverIterationCallback,
-      const_cast<void*>(reinterpret_cast<const void*>(&objective_function)));
+      &callback_data);
 
   alglib::minlbfgsresults(solver_state, *solver_data, solver_report);
 
@@ -114,6 +162,8 @@ double RunLBFGSSolverAnalyticalDiff(
     alglib::real_1d_array* solver_data) {
 
   alglib::minlbfgsstate solver_state;
+  AlglibCallbackData callback_data =
+      CreateCallbackData(objective_function, nullptr, &solver_state);
   alglib::minlbfgsreport solver_report;
 
   alglib::minlbfgscreate(
@@ -126,13 +176,17 @@ double RunLBFGSSolverAnalyticalDiff(
       solver_options.parameter_variation_threshold,
       solver_options.max_num_solver_iterations);
   alglib::minlbfgssetxrep(solver_state, true);
+  if (solver_options.use_diagonal_preconditioner) {
+    alglib::minlbfgssetprecdiag(
+        solver_state, GetDiagonalPreconditioner(objective_function));
+  }
 
   // Optimize with LBFGS.
   alglib::minlbfgsoptimize(
       solver_state,
       AlglibObjectiveFunction,
       AlglibSolverIterationCallback,
-      const_cast<void*>(reinterpret_cast<const void*>(&objective_function)));
+      &callback_data);
 
   alglib::minlbfgsresults(solver_state, *solver_data, solver_report);
 
@@ -143,10 +197,11 @@ void AlglibObjectiveFunction(
     const alglib::real_1d_array& estimated_data,
     double& residual_sum,  // NOLINT
     alglib::real_1d_array& gradient,  // NOLINT
-    void* objective_function_ptr) {
+    void* callback_data_ptr) {
 
   const ObjectiveFunction* objective_function =
-      reinterpret_cast<ObjectiveFunction*>(objective_function_ptr);
+      reinterpret_cast<AlglibCallbackData*>(callback_data_ptr)
+          ->objective_function;
   residual_sum = objective_function->ComputeAllTerms(
       estimated_data.getcontent(), gradient.getcontent());
 }
@@ -154,10 +209,11 @@ void AlglibObjectiveFunction(
 void AlglibObjectiveFunctionNumericalDiff(
     const alglib::real_1d_array& estimated_data,
     double& residual_sum,  // NOLINT
-    void* objective_function_ptr) {
+    void* callback_data_ptr) {
 
   const ObjectiveFunction* objective_function =
-      reinterpret_cast<ObjectiveFunction*>(objective_function_ptr);
+      reinterpret_cast<AlglibCallbackData*>(callback_data_ptr)
+          ->objective_function;
   residual_sum = objective_function->ComputeAllTerms(
       estimated_data.getcontent());
 }
@@ -165,16 +221,31 @@ void AlglibObjectiveFunctionNumericalDiff(
 void AlglibSolverIterationCallback(
     const alglib::real_1d_array& estimated_data,
     double residual_sum,
-    void* objective_function_ptr) {
-
-  ObjectiveFunction* objective_function =
-      reinterpret_cast<ObjectiveFunction*>(objective_function_ptr);
-  objective_function->ReportIterationComplete(residual_sum);
-
-  // TODO: Don't log this if the solver is not verbose...
-  LOG(INFO) << "Iteration complete ("
-            << objective_function->GetNumCompletedIterations()
-            << "). Sum of squared residuals = " << residual_sum;
+    void* callback_data_ptr) {
+
+  const AlglibCallbackData* callback_data =
+      reinterpret_cast<AlglibCallbackData*>(callback_data_ptr);
+  ObjectiveFunction* objective_function = callback_data->objective_function;
+  objective_function->ReportIterationComplete(
+      estimated_data.getcontent(), residual_sum);
+
+  if (objective_function->IsVerbose()) {
+    LOG(INFO) << "Iteration complete ("
+              << objective_function->GetNumCompletedIterations()
+              << "). Sum of squared residuals = " << residual_sum;
+  }
+
+  if (objective_function->IsPastDeadline()) {
+    LOG(INFO) << "Deadline reached. Stopping the solver after "
+              << objective_function->GetNumCompletedIterations()
+              << " iterations.";
+    if (callback_data->cg_state != nullptr) {
+      alglib::mincgrequesttermination(*callback_data->cg_state);
+    }
+    if (callback_data->lbfgs_state != nullptr) {
+      alglib::minlbfgsrequesttermination(*callback_data->lbfgs_state);
+    }
+  }
 }
 
 }  // namespace super_resolution
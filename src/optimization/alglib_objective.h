@@ -44,6 +44,17 @@ double RunLBFGSSolverAnalyticalDiff(
     const ObjectiveFunction& objective_function,
     alglib::real_1d_array* solver_data);
 
+// The data passed to the callback functions below through their void pointer.
+struct AlglibCallbackData {
+  ObjectiveFunction* objective_function = nullptr;
+
+  // The running solver (only one of these is set), so that the iteration
+  // callback can stop it once the objective's deadline has passed. ALGLIB then
+  // returns the estimate of the last completed iteration.
+  alglib::mincgstate* cg_state = nullptr;
+  alglib::minlbfgsstate* lbfgs_state = nullptr;
+};
+
 // The objective function used by the ALGLIB solver to compute residuals. This
 // version uses analyitical differentiation, meaning that the gradient is
 // computed manually.
@@ -51,7 +62,7 @@ void AlglibObjectiveFunction(
     const alglib::real_1d_array& estimated_data,
     double& residual_sum,  // NOLINT
     alglib::real_1d_array& gradient,  // NOLINT
-    void* objective_function_ptr);
+    void* callback_data_ptr);
 
 // The same objective function as above, but does not compute the gradients.
 // This is for numerical differentiation (test purposes only). This version of
@@ -59,14 +70,15 @@ void AlglibObjectiveFunction(
 void AlglibObjectiveFunctionNumericalDiff(
     const alglib::real_1d_array& estimated_data,
     double& residual_sum,  // NOLINT
-    void* objective_function_ptr);
+    void* callback_data_ptr);
 
 // The callback function for the ALGLIB solver. Called after every solver
-// iteration.
+// iteration. Requests termination of the solver if the objective's deadline has
+// passed.
 void AlglibSolverIterationCallback(
     const alglib::real_1d_array& estimated_data,
     double residual_sum,
-    void* objective_function_ptr);
+    void* callback_data_ptr);
 
 }  // namespace super_resolution
 
@@ -1,6 +1,8 @@
 #include "optimization/btv_regularizer.h"
 
+#include <algorithm>
 #include <cmath>
+#include <memory>
 #include <utility>
 #include <vector>
 
@@ -14,35 +16,71 @@
 namespace super_resolution {
 namespace {
 
-// Returns the bilateral total variation value for the pixel at the given row
-// and col. Returned value will be 0 for invalid row and col values.
-double GetBilateralTotalVariation(
-    const double* image_data,
+// Adds decay * |x(r, c) - x(r + row_shift, c + col_shift)| to the values of
+// every pixel whose shifted neighbor is inside the image.
+void AddShiftedAbsoluteDifferences(
+    const double* channel_data,
     const cv::Size& image_size,
-    const int channel,
-    const int row,
-    const int col,
-    const int scale_range,
-    const double spatial_decay) {
-
-  double total_variation = 0.0;
-  const int index = util::GetPixelIndex(image_size, channel, row, col);
-  for (int i = 0; i <= scale_range; ++i) {
-    for (int j = 0; j <= scale_range; ++j) {
-      const int offset_row = row + i;
-      const int offset_col = col + j;
-      if (offset_row >= image_size.height || offset_col >= image_size.width) {
-        continue;
-      }
-      const int offset_index =
-          util::GetPixelIndex(image_size, channel, offset_row, offset_col);
-      const double decay = std::pow(spatial_decay, i + j);
-      const double absdiff =
-          std::abs(image_data[index] - image_data[offset_index]);
-      total_variation += decay * absdiff;
+    const int row_shift,
+    const int col_shift,
+    const double decay,
+    double* values) {
+
+  const int width = image_size.width;
+  const int num_cols = width - col_shift;
+  const int shift_offset = row_shift * width + col_shift;
+  if (num_cols <= 0) {
+    return;
+  }
+  for (int row = 0; row + row_shift < image_size.height; ++row) {
+    const double* pixels = channel_data + row * width;
+    const double* shifted_pixels = pixels + shift_offset;
+    double* row_values = values + row * width;
+    for (int col = 0; col < num_cols; ++col) {
+      row_values[col] += decay * std::abs(pixels[col] - shifted_pixels[col]);
+    }
+  }
+}
+
+// For the cost sum_p s_p * decay * |x_p - x_{p+shift}| (with s_p given by
+// partial_scales), adds the partial derivatives to both the pixel and its
+// shifted neighbor. The row_partials buffer must hold one image row.
+void AddShiftedPartials(
+    const double* channel_data,
+    const cv::Size& image_size,
+    const int row_shift,
+    const int col_shift,
+    const double decay,
+    const double* partial_scales,
+    double* row_partials,
+    double* gradient) {
+
+  const int width = image_size.width;
+  const int num_cols = width - col_shift;
+  const int shift_offset = row_shift * width + col_shift;
+  if (num_cols <= 0) {
+    return;
+  }
+  for (int row = 0; row + row_shift < image_size.height; ++row) {
+    const int row_index = row * width;
+    const double* pixels = channel_data + row_index;
+    const double* shifted_pixels = pixels + shift_offset;
+    const double* row_partial_scales = partial_scales + row_index;
+    for (int col = 0; col < num_cols; ++col) {
+      row_partials[col] = decay * row_partial_scales[col] *
+          util::GetSign(pixels[col] - shifted_pixels[col]);
+    }
+    // The pixel and its shifted neighbor are updated in separate passes since
+    // they can overlap within a row.
+    double* row_gradient = gradient + row_index;
+    for (int col = 0; col < num_cols; ++col) {
+      row_gradient[col] += row_partials[col];
+    }
+    double* shifted_gradient = row_gradient + shift_offset;
+    for (int col = 0; col < num_cols; ++col) {
+      shifted_gradient[col] -= row_partials[col];
     }
   }
-  return total_variation;
 }
 
 }  // namespace
@@ -60,6 +98,14 @@ BilateralTotalVariationRegularizer::BilateralTotalVariationRegularizer(
   CHECK(0 < spatial_decay_ && spatial_decay_ <= 1)
       << "Spatial decay must be between 0 and 1, (0, 1].";
 
+  const int table_size = scale_range_ + 1;
+  decay_table_.resize(table_size * table_size);
+  for (int i = 0; i < table_size; ++i) {
+    for (int j = 0; j < table_size; ++j) {
+      decay_table_[i * table_size + j] = std::pow(spatial_decay_, i + j);
+    }
+  }
+
   LOG(INFO) << "BTV set with range " << scale_range_
             << " and decay " << spatial_decay_;
 }
@@ -71,22 +117,45 @@ std::vector<double> BilateralTotalVariationRegularizer::ApplyToImage(
 
   const int num_pixels = image_size_.width * image_size_.height;
   std::vector<double> residuals(num_pixels * num_channels);
-  for (int channel = 0; channel < num_channels; ++channel) {
-    for (int row = 0; row < image_size_.height; ++row) {
-      for (int col = 0; col < image_size_.width; ++col) {
-        const int index = util::GetPixelIndex(image_size_, channel, row, col);
-        residuals[index] = GetBilateralTotalVariation(
-            image_data,
-            image_size_,
-            channel,
-            row,
-            col,
-            scale_range_,
-            spatial_decay_);
-      }
+  util::ParallelFor(num_channels, [&](const int channel) {
+    const int channel_index = channel * num_pixels;
+    ComputeChannelValues(
+        image_data + channel_index, residuals.data() + channel_index);
+  });
+  return residuals;
+}
+
+double BilateralTotalVariationRegularizer::ComputeWeightedSquaredSum(
+    const double* image_data,
+    const std::vector<double>& weights,
+    const int num_channels) const {
+
+  CHECK_NOTNULL(image_data);
+
+  const int num_pixels = image_size_.width * image_size_.height;
+  CHECK_EQ(weights.size(), num_pixels * num_channels)
+      << "Number of weights does not match the number of pixels.";
+
+  // Sums are kept per channel and added in order so that the result does not
+  // depend on the parallel execution order.
+  std::vector<double> channel_sums(num_channels, 0.0);
+  util::ParallelFor(num_channels, [&](const int channel) {
+    const int channel_index = channel * num_pixels;
+    std::vector<double> values(num_pixels);
+    ComputeChannelValues(image_data + channel_index, values.data());
+    const double* channel_weights = weights.data() + channel_index;
+    double weighted_sum = 0.0;
+    for (int i = 0; i < num_pixels; ++i) {
+      weighted_sum += channel_weights[i] * values[i] * values[i];
     }
+    channel_sums[channel] = weighted_sum;
+  });
+
+  double weighted_sum = 0.0;
+  for (const double channel_sum : channel_sums) {
+    weighted_sum += channel_sum;
   }
-  return residuals;
+  return weighted_sum;
 }
 
 std::pair<std::vector<double>, std::vector<double>>
@@ -95,78 +164,138 @@ BilateralTotalVariationRegularizer::ApplyToImageWithDifferentiation(
     const std::vector<double>& gradient_constants,
     const int num_channels) const {
 
-  CHECK_NOTNULL(image_data);
+  const int num_parameters = image_size_.area() * num_channels;
+  std::vector<double> residuals(num_parameters);
+  std::vector<double> gradient(num_parameters, 0.0);
+  ComputeWeightedSquaredSumAndGradient(
+      image_data,
+      num_channels,
+      1.0,
+      gradient_constants,
+      residuals.data(),
+      gradient.data());
+  return std::make_pair(residuals, gradient);
+}
+
+double BilateralTotalVariationRegularizer::ComputeWeightedSquaredSumAndGradient(
+    const double* image_data,
+    const int num_channels,
+    const double regularization_parameter,
+    const std::vector<double>& weights,
+    double* residuals,
+    double* gradient) const {
 
-  const std::vector<double> residuals = ApplyToImage(image_data, num_channels);
+  CHECK_NOTNULL(image_data);
+  CHECK_NOTNULL(gradient);
 
-  // Compute the gradient.
-  // TODO: add some descriptive comments about computing the gradient.
   const int num_pixels = image_size_.width * image_size_.height;
-  const int num_parameters = num_pixels * num_channels;
-  std::vector<double> gradient(num_parameters);
-  for (int channel = 0; channel < num_channels; ++channel) {
-    for (int row = 0; row < image_size_.height; ++row) {
-      for (int col = 0; col < image_size_.width; ++col) {
-        const int index = util::GetPixelIndex(image_size_, channel, row, col);
-        // Derivative w.r.t. the pixel itself. Need to consider every pixel in
-        // this pixel's range window.
-        double didi = 0.0;
-        for (int i = 0; i < scale_range_; ++i) {
-          for (int j = 0; j < scale_range_; ++j) {
-            const int offset_row = row + i;
-            const int offset_col = col + j;
-            if (offset_row >= image_size_.height ||
-                offset_col >= image_size_.width) {
-              continue;
-            }
-            const int offset_index = util::GetPixelIndex(
-                image_size_, channel, offset_row, offset_col);
-            const double diff = image_data[index] - image_data[offset_index];
-            double abs_gradient = 0.0;
-            if (diff > 0.0) {
-              abs_gradient = 1.0;
-            } else if (diff < 0.0) {
-              abs_gradient = -1.0;
-            }
-            const double decay = std::pow(spatial_decay_, i + j);
-            didi += decay * abs_gradient;
-          }
-        }
-        gradient[index] +=
-            2 * gradient_constants[index] * residuals[index] * didi;
-        // Derivative w.r.t. all other pixels where the range window overlaps
-        // this pixel.
-        for (int i = 0; i < scale_range_; ++i) {
-          for (int j = 0; j < scale_range_; ++j) {
-            const int offset_row = row - i;
-            const int offset_col = col - j;
-            if ((offset_row == 0 && offset_col == 0) ||
-                 offset_row < 0 || offset_col < 0) {
-              continue;
-            }
-            const int offset_index = util::GetPixelIndex(
-                image_size_, channel, offset_row, offset_col);
-            const double diff = image_data[offset_index] - image_data[index];
-            double didj = 0.0;
-            if (diff < 0.0) {
-              didj = 1.0;
-            } else if (diff > 0.0) {
-              didj = -1.0;
-            }
-            const double decay = std::pow(spatial_decay_, i + j);
-            didj *= decay;
-            gradient[index] +=
-                2 *
-                gradient_constants[offset_index] *
-                residuals[offset_index] *
-                didj;
-          }
+  CHECK_EQ(weights.size(), num_pixels * num_channels)
+      << "Number of weights does not match the number of pixels.";
+
+  // Each pixel's value r_p = sum_q decay_q * |x_p - x_q| only depends on the
+  // pixels q in its forward window, so once all r_p are known the gradient of
+  // lambda * w_p * r_p^2 is scattered shift by shift to the pixel and its
+  // shifted neighbor:
+  //   d/dx_p =  2 * lambda * w_p * r_p * decay_q * sign(x_p - x_q)
+  //   d/dx_q = -2 * lambda * w_p * r_p * decay_q * sign(x_p - x_q)
+  // Channels are independent, so each one is processed in parallel with its
+  // own channel-sized scratch buffer.
+  const int table_size = scale_range_ + 1;
+  std::vector<double> channel_sums(num_channels, 0.0);
+  util::ParallelFor(num_channels, [&](const int channel) {
+    const int channel_index = channel * num_pixels;
+    const double* channel_data = image_data + channel_index;
+    const double* channel_weights = weights.data() + channel_index;
+
+    // The values are converted in place into the partial scales.
+    std::vector<double> values(num_pixels);
+    ComputeChannelValues(channel_data, values.data());
+    if (residuals != nullptr) {
+      std::copy(values.begin(), values.end(), residuals + channel_index);
+    }
+    double weighted_sum = 0.0;
+    for (int i = 0; i < num_pixels; ++i) {
+      const double weighted_value = channel_weights[i] * values[i];
+      weighted_sum += weighted_value * values[i];
+      values[i] = 2 * regularization_parameter * weighted_value;
+    }
+    channel_sums[channel] = weighted_sum;
+
+    std::vector<double> row_partials(image_size_.width);
+    double* channel_gradient = gradient + channel_index;
+    for (int i = 0; i <= scale_range_; ++i) {
+      for (int j = 0; j <= scale_range_; ++j) {
+        if (i == 0 && j == 0) {
+          continue;
         }
+        AddShiftedPartials(
+            channel_data,
+            image_size_,
+            i,
+            j,
+            decay_table_[i * table_size + j],
+            values.data(),
+            row_partials.data(),
+            channel_gradient);
       }
     }
+  });
+
+  double weighted_sum = 0.0;
+  for (const double channel_sum : channel_sums) {
+    weighted_sum += channel_sum;
   }
+  return regularization_parameter * weighted_sum;
+}
 
-  return std::make_pair(residuals, gradient);
+bool BilateralTotalVariationRegularizer::GetShiftedDifferences(
+    std::vector<ShiftedDifference>* shifted_differences) const {
+
+  CHECK_NOTNULL(shifted_differences);
+  shifted_differences->clear();
+  const int table_size = scale_range_ + 1;
+  for (int i = 0; i <= scale_range_; ++i) {
+    for (int j = 0; j <= scale_range_; ++j) {
+      if (i == 0 && j == 0) {
+        continue;
+      }
+      shifted_differences->push_back(
+          ShiftedDifference(0, i, j, decay_table_[i * table_size + j]));
+    }
+  }
+  return true;
+}
+
+void BilateralTotalVariationRegularizer::ComputeChannelValues(
+    const double* channel_data, double* values) const {
+
+  const int num_pixels = image_size_.width * image_size_.height;
+  std::fill(values, values + num_pixels, 0.0);
+
+  // The (0, 0) shift compares each pixel to itself, so it is skipped.
+  const int table_size = scale_range_ + 1;
+  for (int i = 0; i <= scale_range_; ++i) {
+    for (int j = 0; j <= scale_range_; ++j) {
+      if (i == 0 && j == 0) {
+        continue;
+      }
+      AddShiftedAbsoluteDifferences(
+          channel_data,
+          image_size_,
+          i,
+          j,
+          decay_table_[i * table_size + j],
+          values);
+    }
+  }
+}
+
+std::shared_ptr<Regularizer>
+BilateralTotalVariationRegularizer::CreateForImageSize(
+    const cv::Size& image_size) const {
+
+  return std::shared_ptr<Regularizer>(new BilateralTotalVariationRegularizer(
+      image_size, scale_range_, spatial_decay_));
 }
 
 }  // namespace super_resolution
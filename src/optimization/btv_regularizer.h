@@ -1,6 +1,12 @@
 // The bilateral total variation regularizer is a cheap-to-compute
 // edge-preserving method for approximating the image gradient (i.e. standard
 // total variation).
+//
+// The value at each pixel (r, c) is
+//   sum_{0 <= i, j <= range} decay^(i + j) * |x(r, c) - x(r + i, c + j)|
+// over all shifted pixels that are inside the image. It is computed one (i, j)
+// shift at a time over whole image rows, and channels are processed in
+// parallel.
 
 #ifndef SRC_OPTIMIZATION_BTV_REGULARIZER_H_
 #define SRC_OPTIMIZATION_BTV_REGULARIZER_H_
@@ -30,6 +36,25 @@ class BilateralTotalVariationRegularizer : public Regularizer {
       const std::vector<double>& gradient_constants,
       const int num_channels) const;
 
+  virtual double ComputeWeightedSquaredSum(
+      const double* image_data,
+      const std::vector<double>& weights,
+      const int num_channels) const;
+
+  virtual double ComputeWeightedSquaredSumAndGradient(
+      const double* image_data,
+      const int num_channels,
+      const double regularization_parameter,
+      const std::vector<double>& weights,
+      double* residuals,
+      double* gradient) const;
+
+  virtual std::shared_ptr<Regularizer> CreateForImageSize(
+      const cv::Size& image_size) const;
+
+  virtual bool GetShiftedDifferences(
+      std::vector<ShiftedDifference>* shifted_differences) const;
+
  private:
   // The scale range controls the size of the patch that is checked for pixel
   // intensity variation.
@@ -42,6 +67,15 @@ class BilateralTotalVariationRegularizer : public Regularizer {
   // Smaller spatial_decay_ values mean more decay as the pixels get further,
   // and larger values will make the decay minimal.
   const double spatial_decay_;
+
+  // Precomputed spatial_decay_^(i + j) for every shift (i, j) in the scale
+  // range, stored at index i * (scale_range_ + 1) + j.
+  std::vector<double> decay_table_;
+
+  // Computes the BTV values of a single channel as a sum over all (i, j)
+  // shifts of decay-weighted absolute differences between the channel and its
+  // shifted copy. The values array must hold one value per pixel.
+  void ComputeChannelValues(const double* channel_data, double* values) const;
 };
 
 }  // namespace super_resolution
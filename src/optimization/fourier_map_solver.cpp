@@ -0,0 +1,184 @@
+#include "optimization/fourier_map_solver.h"
+
+#include <cmath>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "image/image_data.h"
+#include "image_model/image_model.h"
+#include "optimization/laplacian_regularizer.h"
+#include "optimization/objective_normal_equation_data_term.h"
+#include "optimization/regularizer.h"
+#include "util/matrix_util.h"
+
+#include "opencv2/core/core.hpp"
+
+#include "glog/logging.h"
+
+namespace super_resolution {
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+
+// Returns the squared magnitude of the transfer function of the blur operators
+// in the image model, |F(k_B)|^2, as a real image of the given size. This is
+// computed from the blurred image of a delta. The magnitude does not depend on
+// where the delta is placed, so it is put in the center of the image where it
+// is not affected by the border.
+cv::Mat ComputeBlurPowerSpectrum(
+    const ImageModel& image_model, const cv::Size& image_size) {
+
+  cv::Mat delta = cv::Mat::zeros(image_size, util::kOpenCvMatrixType);
+  delta.at<double>(image_size.height / 2, image_size.width / 2) = 1.0;
+  ImageData impulse_response(delta, DO_NOT_NORMALIZE_IMAGE);
+  image_model.ApplyBlurToImage(&impulse_response);
+
+  cv::Mat transfer_function;
+  cv::dft(
+      impulse_response.GetChannelImage(0),
+      transfer_function,
+      cv::DFT_COMPLEX_OUTPUT);
+  cv::Mat power_spectrum(image_size, util::kOpenCvMatrixType);
+  for (int row = 0; row < image_size.height; ++row) {
+    const double* transfer_row = transfer_function.ptr<double>(row);
+    double* power_row = power_spectrum.ptr<double>(row);
+    for (int col = 0; col < image_size.width; ++col) {
+      const double real = transfer_row[2 * col];
+      const double imaginary = transfer_row[2 * col + 1];
+      power_row[col] = real * real + imaginary * imaginary;
+    }
+  }
+  return power_spectrum;
+}
+
+}  // namespace
+
+FourierMapSolver::FourierMapSolver(
+    const ImageModel& image_model,
+    const std::vector<ImageData>& low_res_images,
+    const bool print_solver_output)
+    : MapSolver(image_model, low_res_images, print_solver_output) {}
+
+ImageData FourierMapSolver::Solve(const ImageData& initial_estimate) {
+  CHECK_EQ(initial_estimate.GetNumChannels(), GetNumChannels());
+  CHECK_EQ(initial_estimate.GetImageSize(), GetImageSize());
+  CHECK(CanSolve(image_model_, GetNumImages(), regularizers_))
+      << "The objective cannot be solved in closed form. It requires "
+      << "Laplacian regularizers and uniform translational coverage.";
+
+  return SolveClosedForm(
+      image_model_, observations_, regularizers_, GetImageSize());
+}
+
+bool FourierMapSolver::CanSolve(
+    const ImageModel& image_model,
+    const int num_images,
+    const std::vector<std::pair<std::shared_ptr<Regularizer>, double>>&
+        regularizers) {
+
+  // Without a regularizer the system can be singular at frequencies that the
+  // blur removes.
+  if (regularizers.empty()) {
+    return false;
+  }
+  for (const auto& regularizer_and_parameter : regularizers) {
+    if (dynamic_cast<const LaplacianRegularizer*>(
+            regularizer_and_parameter.first.get()) == nullptr ||
+        regularizer_and_parameter.second <= 0.0) {
+      return false;
+    }
+  }
+  return image_model.HasUniformTranslationalCoverage(num_images);
+}
+
+bool FourierMapSolver::CanSolve(
+    const MapSolverOptions& solver_options,
+    const ImageModel& image_model,
+    const int num_images,
+    const std::vector<std::pair<std::shared_ptr<Regularizer>, double>>&
+        regularizers) {
+
+  return solver_options.GetIterativeOnlyOption().empty() &&
+      CanSolve(image_model, num_images, regularizers);
+}
+
+ImageData FourierMapSolver::SolveClosedForm(
+    const ImageModel& image_model,
+    const std::vector<ImageData>& observations,
+    const std::vector<std::pair<std::shared_ptr<Regularizer>, double>>&
+        regularizers,
+    const cv::Size& image_size) {
+
+  const int num_images = observations.size();
+  CHECK(CanSolve(image_model, num_images, regularizers));
+
+  const int num_channels = observations[0].GetNumChannels();
+  const int num_pixels = image_size.area();
+  const int width = image_size.width;
+  const int height = image_size.height;
+
+  double regularization_parameter_sum = 0.0;
+  for (const auto& regularizer_and_parameter : regularizers) {
+    regularization_parameter_sum += regularizer_and_parameter.second;
+  }
+
+  // The denominator is the same for every channel:
+  //   n |F(k_B)|^2 + sum_r lambda_r |F(k_L)|^2,
+  // where the 5-point Laplacian has the transfer function
+  //   F(k_L)(u, v) = 2 cos(2 pi u / W) + 2 cos(2 pi v / H) - 4.
+  cv::Mat denominator = ComputeBlurPowerSpectrum(image_model, image_size);
+  std::vector<double> horizontal_frequency_responses(width);
+  for (int col = 0; col < width; ++col) {
+    horizontal_frequency_responses[col] =
+        2.0 - 2.0 * std::cos(2.0 * kPi * col / width);
+  }
+  for (int row = 0; row < height; ++row) {
+    const double vertical_frequency_response =
+        2.0 - 2.0 * std::cos(2.0 * kPi * row / height);
+    double* denominator_row = denominator.ptr<double>(row);
+    for (int col = 0; col < width; ++col) {
+      const double laplacian_response =
+          horizontal_frequency_responses[col] + vertical_frequency_response;
+      denominator_row[col] =
+          num_images * denominator_row[col] +
+          regularization_parameter_sum *
+          laplacian_response * laplacian_response;
+    }
+  }
+
+  // The right-hand side b = s^2 sum_k A_k'y_k is the linear term of the
+  // normal-equation data term.
+  const ObjectiveNormalEquationDataTerm data_term(
+      image_model, observations, 0, num_channels, image_size);
+  const std::vector<double>& adjoint_observations =
+      data_term.GetAdjointObservations();
+
+  ImageData estimated_image;
+  for (int channel = 0; channel < num_channels; ++channel) {
+    const cv::Mat right_hand_side(
+        image_size,
+        util::kOpenCvMatrixType,
+        const_cast<double*>(adjoint_observations.data()) +
+            channel * num_pixels);
+    cv::Mat spectrum;
+    cv::dft(right_hand_side, spectrum, cv::DFT_COMPLEX_OUTPUT);
+    for (int row = 0; row < height; ++row) {
+      double* spectrum_row = spectrum.ptr<double>(row);
+      const double* denominator_row = denominator.ptr<double>(row);
+      for (int col = 0; col < width; ++col) {
+        spectrum_row[2 * col] /= denominator_row[col];
+        spectrum_row[2 * col + 1] /= denominator_row[col];
+      }
+    }
+    cv::Mat channel_estimate;
+    cv::dft(
+        spectrum,
+        channel_estimate,
+        cv::DFT_INVERSE | cv::DFT_SCALE | cv::DFT_REAL_OUTPUT);
+    estimated_image.AddChannel(channel_estimate.ptr<double>(0), image_size);
+  }
+  return estimated_image;
+}
+
+}  // namespace super_resolution
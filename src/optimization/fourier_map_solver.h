@@ -0,0 +1,80 @@
+// A closed-form MAP solver for quadratic objectives with a shift-invariant
+// normal-equation operator. With only Laplacian (Tikhonov) regularizers, the
+// MAP estimate solves the linear system
+//   (s^2 sum_k A_k'A_k + sum_r lambda_r L'L) x = s^2 sum_k A_k'y_k.
+// If the image model is translational and the observations cover every
+// downsampling phase equally often (see
+// ImageModel::HasUniformTranslationalCoverage()), then
+// s^2 sum_k A_k'A_k = n B'B for n observations, and every operator on the
+// left-hand side is a convolution. Assuming periodic image borders, the
+// system is diagonalized by the 2D discrete Fourier transform and each channel
+// is solved with one forward and one inverse FFT:
+//   x = F^-1[ F(b) / (n |F(k_B)|^2 + sum_r lambda_r |F(k_L)|^2) ]
+// where k_B and k_L are the blur and Laplacian kernels.
+//
+// The periodic border assumption differs from the true (cropped) operators
+// within the blur and stencil radius of the image border, so the solution is
+// approximate there and exact in the interior.
+
+#ifndef SRC_OPTIMIZATION_FOURIER_MAP_SOLVER_H_
+#define SRC_OPTIMIZATION_FOURIER_MAP_SOLVER_H_
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "image/image_data.h"
+#include "image_model/image_model.h"
+#include "optimization/map_solver.h"
+#include "optimization/regularizer.h"
+
+#include "opencv2/core/core.hpp"
+
+namespace super_resolution {
+
+class FourierMapSolver : public MapSolver {
+ public:
+  // Same parameters as MapSolver. CanSolve() must be true for the image model
+  // and the added regularizers when Solve() is called.
+  FourierMapSolver(
+      const ImageModel& image_model,
+      const std::vector<ImageData>& low_res_images,
+      const bool print_solver_output = true);
+
+  // Returns the closed-form solution. The initial estimate is only used to
+  // validate the image dimensions.
+  virtual ImageData Solve(const ImageData& initial_estimate);
+
+  // Returns true if the objective defined by the given image model and
+  // regularizers can be solved in closed form. All regularizers must be
+  // LaplacianRegularizers with a positive regularization parameter, and the
+  // image model must have uniform translational coverage.
+  static bool CanSolve(
+      const ImageModel& image_model,
+      const int num_images,
+      const std::vector<std::pair<std::shared_ptr<Regularizer>, double>>&
+          regularizers);
+
+  // Same as above, but also returns false if the given solver options set an
+  // option that the closed-form solution would ignore (see
+  // MapSolverOptions::GetIterativeOnlyOption()).
+  static bool CanSolve(
+      const MapSolverOptions& solver_options,
+      const ImageModel& image_model,
+      const int num_images,
+      const std::vector<std::pair<std::shared_ptr<Regularizer>, double>>&
+          regularizers);
+
+  // Computes the closed-form solution for the given observations (scaled up
+  // to the HR image size, as in MapSolver). CanSolve() must be true.
+  static ImageData SolveClosedForm(
+      const ImageModel& image_model,
+      const std::vector<ImageData>& observations,
+      const std::vector<std::pair<std::shared_ptr<Regularizer>, double>>&
+          regularizers,
+      const cv::Size& image_size);
+};
+
+}  // namespace super_resolution
+
+#endif  // SRC_OPTIMIZATION_FOURIER_MAP_SOLVER_H_
@@ -0,0 +1,323 @@
+#include "optimization/irls_checkpoint.h"
+
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "glog/logging.h"
+
+namespace super_resolution {
+namespace {
+
+// Identifies checkpoint files, followed by the format version.
+constexpr char kCheckpointMagic[8] = {'S', 'R', 'I', 'R', 'L', 'S', 'C', 'P'};
+constexpr int32_t kCheckpointVersion = 2;
+
+// The file is written with stdio, since the data must be synced to the disk
+// (with fsync) before the file replaces the previous checkpoint. Write errors
+// are sticky, so they are checked once after all values are written.
+template <typename T>
+void WriteValue(const T& value, std::FILE* file) {
+  std::fwrite(&value, sizeof(T), 1, file);
+}
+
+void WriteVector(const std::vector<double>& values, std::FILE* file) {
+  WriteValue<int64_t>(values.size(), file);
+  std::fwrite(values.data(), sizeof(double), values.size(), file);
+}
+
+void WriteString(const std::string& value, std::FILE* file) {
+  WriteValue<int64_t>(value.size(), file);
+  std::fwrite(value.data(), sizeof(char), value.size(), file);
+}
+
+template <typename T>
+bool ReadValue(std::ifstream* file, T* value) {
+  file->read(reinterpret_cast<char*>(value), sizeof(T));
+  return file->good();
+}
+
+// Returns true if the file has at least num_values values of type T left, so
+// that corrupt counts are rejected before anything is allocated for them.
+template <typename T>
+bool HasValuesLeft(
+    std::ifstream* file, const int64_t file_size, const int64_t num_values) {
+
+  const int64_t num_bytes_left =
+      file_size - static_cast<int64_t>(file->tellg());
+  return num_values >= 0 &&
+      num_values <= num_bytes_left / static_cast<int64_t>(sizeof(T));
+}
+
+// Reads a vector that must either have the expected size or be empty.
+bool ReadVector(
+    std::ifstream* file,
+    const int64_t file_size,
+    const int64_t expected_size,
+    std::vector<double>* values) {
+
+  int64_t size = 0;
+  if (!ReadValue(file, &size) || (size != expected_size && size != 0) ||
+      !HasValuesLeft<double>(file, file_size, size)) {
+    return false;
+  }
+  values->resize(size);
+  file->read(
+      reinterpret_cast<char*>(values->data()), size * sizeof(double));
+  return file->good();
+}
+
+bool ReadString(
+    std::ifstream* file, const int64_t file_size, std::string* value) {
+
+  int64_t size = 0;
+  if (!ReadValue(file, &size) || !HasValuesLeft<char>(file, file_size, size)) {
+    return false;
+  }
+  value->resize(size);
+  file->read(&(*value)[0], size);
+  return file->good();
+}
+
+}  // namespace
+
+bool WriteIRLSCheckpoint(
+    const std::string& file_path, const IRLSCheckpoint& checkpoint) {
+
+  const std::string temporary_file_path = file_path + ".tmp";
+  std::FILE* file = std::fopen(temporary_file_path.c_str(), "wb");
+  if (file == nullptr) {
+    LOG(WARNING) << "Could not open checkpoint file " << temporary_file_path;
+    return false;
+  }
+  std::fwrite(kCheckpointMagic, sizeof(kCheckpointMagic), 1, file);
+  WriteValue(kCheckpointVersion, file);
+  WriteValue<int32_t>(checkpoint.image_width, file);
+  WriteValue<int32_t>(checkpoint.image_height, file);
+  WriteValue<int32_t>(checkpoint.num_channels, file);
+  WriteValue<uint8_t>(checkpoint.split_channels, file);
+  WriteValue<int32_t>(checkpoint.max_num_irls_iterations, file);
+  WriteValue<int32_t>(checkpoint.max_num_solver_iterations, file);
+  WriteValue(checkpoint.irls_cost_difference_threshold, file);
+  WriteVector(checkpoint.regularization_parameters, file);
+  WriteValue<int32_t>(checkpoint.regularizer_types.size(), file);
+  for (const std::string& regularizer_type : checkpoint.regularizer_types) {
+    WriteString(regularizer_type, file);
+  }
+  WriteValue(checkpoint.regularization_norm, file);
+  WriteValue(checkpoint.problem_hash, file);
+  WriteValue<int32_t>(checkpoint.subsets.size(), file);
+  for (const IRLSSubsetState& subset : checkpoint.subsets) {
+    WriteValue<int32_t>(subset.channel_start, file);
+    WriteValue<int32_t>(subset.channel_end, file);
+    WriteValue<uint8_t>(subset.is_complete, file);
+    WriteValue<int32_t>(subset.num_irls_iterations_ran, file);
+    WriteValue(subset.previous_cost, file);
+    WriteVector(subset.estimate, file);
+    WriteValue<int32_t>(subset.irls_weights.size(), file);
+    for (const std::vector<double>& weights : subset.irls_weights) {
+      WriteVector(weights, file);
+    }
+  }
+  // The data must be on the disk before the rename, or a crash right after it
+  // could leave an empty or partial file in place of the previous checkpoint.
+  const bool is_written = !std::ferror(file) && std::fflush(file) == 0 &&
+      fsync(fileno(file)) == 0;
+  if (std::fclose(file) != 0 || !is_written) {
+    LOG(WARNING) << "Could not write checkpoint file " << temporary_file_path;
+    return false;
+  }
+  if (std::rename(temporary_file_path.c_str(), file_path.c_str()) != 0) {
+    LOG(WARNING) << "Could not replace checkpoint file " << file_path;
+    return false;
+  }
+  return true;
+}
+
+bool ReadIRLSCheckpoint(
+    const std::string& file_path, IRLSCheckpoint* checkpoint) {
+
+  CHECK_NOTNULL(checkpoint);
+
+  std::ifstream file(file_path, std::ios::binary);
+  if (!file.is_open()) {
+    LOG(WARNING) << "Could not open checkpoint file " << file_path;
+    return false;
+  }
+  file.seekg(0, std::ios::end);
+  const int64_t file_size = file.tellg();
+  file.seekg(0, std::ios::beg);
+  char magic[sizeof(kCheckpointMagic)];
+  file.read(magic, sizeof(magic));
+  int32_t version = 0;
+  if (!file.good() ||
+      std::memcmp(magic, kCheckpointMagic, sizeof(magic)) != 0 ||
+      !ReadValue(&file, &version) || version != kCheckpointVersion) {
+    LOG(WARNING) << file_path << " is not a valid checkpoint file.";
+    return false;
+  }
+
+  IRLSCheckpoint result;
+  int32_t image_width = 0;
+  int32_t image_height = 0;
+  int32_t num_channels = 0;
+  uint8_t split_channels = 0;
+  int32_t max_num_irls_iterations = 0;
+  int32_t max_num_solver_iterations = 0;
+  int64_t num_regularizers = 0;
+  bool is_valid =
+      ReadValue(&file, &image_width) && image_width > 0 &&
+      ReadValue(&file, &image_height) && image_height > 0 &&
+      ReadValue(&file, &num_channels) && num_channels > 0 &&
+      ReadValue(&file, &split_channels) &&
+      ReadValue(&file, &max_num_irls_iterations) &&
+      ReadValue(&file, &max_num_solver_iterations) &&
+      ReadValue(&file, &result.irls_cost_difference_threshold) &&
+      ReadValue(&file, &num_regularizers) &&
+      HasValuesLeft<double>(&file, file_size, num_regularizers);
+  if (is_valid) {
+    result.image_width = image_width;
+    result.image_height = image_height;
+    result.num_channels = num_channels;
+    result.split_channels = split_channels;
+    result.max_num_irls_iterations = max_num_irls_iterations;
+    result.max_num_solver_iterations = max_num_solver_iterations;
+    result.regularization_parameters.resize(num_regularizers);
+    file.read(
+        reinterpret_cast<char*>(result.regularization_parameters.data()),
+        num_regularizers * sizeof(double));
+    is_valid = file.good();
+  }
+  int32_t num_regularizer_types = 0;
+  is_valid = is_valid && ReadValue(&file, &num_regularizer_types) &&
+      num_regularizer_types == num_regularizers;
+  result.regularizer_types.resize(is_valid ? num_regularizer_types : 0);
+  for (std::string& regularizer_type : result.regularizer_types) {
+    is_valid = is_valid && ReadString(&file, file_size, &regularizer_type);
+  }
+  is_valid = is_valid &&
+      ReadValue(&file, &result.regularization_norm) &&
+      ReadValue(&file, &result.problem_hash);
+
+  // Every subset must cover a valid channel range with matching data sizes.
+  const int64_t num_pixels =
+      static_cast<int64_t>(image_width) * image_height;
+  int32_t num_subsets = 0;
+  is_valid = is_valid && ReadValue(&file, &num_subsets) &&
+      num_subsets > 0 && num_subsets <= num_channels;
+  for (int i = 0; is_valid && i < num_subsets; ++i) {
+    IRLSSubsetState subset;
+    int32_t channel_start = 0;
+    int32_t channel_end = 0;
+    uint8_t is_complete = 0;
+    int32_t num_irls_iterations_ran = 0;
+    int32_t num_weight_vectors = 0;
+    is_valid =
+        ReadValue(&file, &channel_start) && channel_start >= 0 &&
+        ReadValue(&file, &channel_end) && channel_end > channel_start &&
+        channel_end <= num_channels &&
+        ReadValue(&file, &is_complete) &&
+        ReadValue(&file, &num_irls_iterations_ran) &&
+        ReadValue(&file, &subset.previous_cost);
+    const int64_t num_data_points =
+        num_pixels * (channel_end - channel_start);
+    is_valid = is_valid &&
+        ReadVector(&file, file_size, num_data_points, &subset.estimate) &&
+        ReadValue(&file, &num_weight_vectors) && num_weight_vectors >= 0 &&
+        num_weight_vectors <= num_regularizers;
+    subset.irls_weights.resize(is_valid ? num_weight_vectors : 0);
+    for (std::vector<double>& weights : subset.irls_weights) {
+      is_valid = is_valid &&
+          ReadVector(&file, file_size, num_data_points, &weights);
+    }
+    subset.channel_start = channel_start;
+    subset.channel_end = channel_end;
+    subset.is_complete = is_complete;
+    subset.num_irls_iterations_ran = num_irls_iterations_ran;
+    result.subsets.push_back(subset);
+  }
+  if (!is_valid) {
+    LOG(WARNING) << file_path << " is not a valid checkpoint file.";
+    return false;
+  }
+  *checkpoint = result;
+  return true;
+}
+
+IRLSCheckpointWriter::IRLSCheckpointWriter(
+    const std::string& file_path, const IRLSCheckpoint& checkpoint)
+    : file_path_(file_path),
+      checkpoint_(checkpoint),
+      has_pending_update_(false),
+      is_writing_(false),
+      stop_requested_(false),
+      writer_thread_(&IRLSCheckpointWriter::WriteLoop, this) {}
+
+IRLSCheckpointWriter::~IRLSCheckpointWriter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_requested_ = true;
+  }
+  update_condition_.notify_all();
+  writer_thread_.join();
+}
+
+void IRLSCheckpointWriter::UpdateSubset(const IRLSSubsetState& subset_state) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool found_subset = false;
+    for (IRLSSubsetState& subset : checkpoint_.subsets) {
+      if (subset.channel_start == subset_state.channel_start &&
+          subset.channel_end == subset_state.channel_end) {
+        subset = subset_state;
+        found_subset = true;
+        break;
+      }
+    }
+    CHECK(found_subset) << "The checkpoint has no subset for channels ["
+                        << subset_state.channel_start << ", "
+                        << subset_state.channel_end << ").";
+    has_pending_update_ = true;
+  }
+  update_condition_.notify_all();
+}
+
+void IRLSCheckpointWriter::Flush() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  update_condition_.wait(lock, [this]() {
+    return !has_pending_update_ && !is_writing_;
+  });
+}
+
+void IRLSCheckpointWriter::WriteLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    update_condition_.wait(lock, [this]() {
+      return has_pending_update_ || stop_requested_;
+    });
+    if (!has_pending_update_) {
+      return;  // Stop requested and everything is written.
+    }
+    // Copying the state is much faster than writing it, so the solver is
+    // only blocked for the copy.
+    const IRLSCheckpoint checkpoint = checkpoint_;
+    has_pending_update_ = false;
+    is_writing_ = true;
+    lock.unlock();
+    if (WriteIRLSCheckpoint(file_path_, checkpoint)) {
+      LOG(INFO) << "Checkpoint written to " << file_path_;
+    }
+    lock.lock();
+    is_writing_ = false;
+    update_condition_.notify_all();
+  }
+}
+
+}  // namespace super_resolution
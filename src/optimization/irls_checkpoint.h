@@ -0,0 +1,119 @@
+// Checkpoints of the IRLSMapSolver state, so that long solves can be resumed
+// after a crash or preemption. A checkpoint holds the current estimate, the
+// IRLS weights and the iteration counters of every channel subset (see
+// MapSolverOptions::split_channels), along with the options that determine
+// the layout of that state. Checkpoints are stored in a compact binary file in
+// the native byte order, so they are meant to be resumed on the same machine
+// architecture.
+
+#ifndef SRC_OPTIMIZATION_IRLS_CHECKPOINT_H_
+#define SRC_OPTIMIZATION_IRLS_CHECKPOINT_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace super_resolution {
+
+// The IRLS state of one channel subset [channel_start, channel_end).
+struct IRLSSubsetState {
+  int channel_start = 0;
+  int channel_end = 0;
+
+  // True once the IRLS loop of this subset has finished, in which case the
+  // estimate is the final solution of the subset.
+  bool is_complete = false;
+
+  // The number of completed IRLS iterations and the cost of the last one.
+  int num_irls_iterations_ran = 0;
+  double previous_cost = std::numeric_limits<double>::infinity();
+
+  // The estimate of the subset's channels, and the IRLS weights for the next
+  // iteration (one vector per regularizer). The weights are empty before the
+  // first iteration, which starts with all weights set to 1.
+  std::vector<double> estimate;
+  std::vector<std::vector<double>> irls_weights;
+};
+
+struct IRLSCheckpoint {
+  // The problem size and the options that the state depends on. A checkpoint
+  // can only be resumed with the same problem size and channel splitting. The
+  // remaining options may change, in which case completed subsets are solved
+  // further with the new options.
+  int image_width = 0;
+  int image_height = 0;
+  int num_channels = 0;
+  bool split_channels = false;
+  int max_num_irls_iterations = 0;
+  int max_num_solver_iterations = 0;
+  double irls_cost_difference_threshold = 0.0;
+  std::vector<double> regularization_parameters;
+
+  // The objective that the state was computed for, which a checkpoint can
+  // only be resumed with: the type of every regularizer, the regularization
+  // norm, and a hash of the observations and of the motion of the image model.
+  std::vector<std::string> regularizer_types;
+  double regularization_norm = 0.0;
+  uint64_t problem_hash = 0;
+
+  // The state of every channel subset, in channel order.
+  std::vector<IRLSSubsetState> subsets;
+};
+
+// Writes the checkpoint to the given file. The data is first written to a
+// temporary file and synced to the disk, and that file then replaces the given
+// file, so an interrupted write never corrupts an existing checkpoint. Returns
+// false if writing failed.
+bool WriteIRLSCheckpoint(
+    const std::string& file_path, const IRLSCheckpoint& checkpoint);
+
+// Reads the checkpoint from the given file. Returns false (and logs a warning)
+// if the file does not exist or is not a valid checkpoint.
+bool ReadIRLSCheckpoint(
+    const std::string& file_path, IRLSCheckpoint* checkpoint);
+
+// Writes checkpoints on a background thread so that the solver does not wait
+// for the disk. Updates that arrive while a write is in progress are merged,
+// and only the latest state is written once the write finishes.
+class IRLSCheckpointWriter {
+ public:
+  // Checkpoints are written to the given file, starting from the given
+  // checkpoint (which also provides the options and subset layout).
+  IRLSCheckpointWriter(
+      const std::string& file_path, const IRLSCheckpoint& checkpoint);
+
+  // Writes any pending update before returning.
+  ~IRLSCheckpointWriter();
+
+  // Replaces the state of the subset with the same channel range and
+  // schedules a write. This is thread-safe, so concurrently solved subsets
+  // can share a writer.
+  void UpdateSubset(const IRLSSubsetState& subset_state);
+
+  // Blocks until all updates so far have been written.
+  void Flush();
+
+ private:
+  // Runs on the background thread.
+  void WriteLoop();
+
+  const std::string file_path_;
+
+  // The latest state, and whether it has changed since it was last written.
+  IRLSCheckpoint checkpoint_;
+  bool has_pending_update_;
+  bool is_writing_;
+  bool stop_requested_;
+
+  std::mutex mutex_;
+  std::condition_variable update_condition_;
+  std::thread writer_thread_;
+};
+
+}  // namespace super_resolution
+
+#endif  // SRC_OPTIMIZATION_IRLS_CHECKPOINT_H_
@@ -1,18 +1,33 @@
 #include "optimization/irls_map_solver.h"
 
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
 #include <iostream>
 #include <limits>
 #include <memory>
+#include <string>
+#include <typeinfo>
 #include <utility>
 #include <vector>
 
 #include "image/image_data.h"
 #include "image_model/image_model.h"
+#include "motion/motion_refinement.h"
+#include "motion/motion_shift.h"
 #include "optimization/alglib_objective.h"
+#include "optimization/fourier_map_solver.h"
+#include "optimization/irls_checkpoint.h"
+#include "optimization/linear_conjugate_gradient.h"
 #include "optimization/objective_data_term.h"
 #include "optimization/objective_function.h"
-#include "optimization/objective_irls_regularization_term.h"
+#include "optimization/objective_fused_regularization_term.h"
+#include "optimization/objective_normal_equation_data_term.h"
+#include "optimization/solver_telemetry.h"
+#include "util/util.h"
 
 #include "alglib/src/optimization.h"
 
@@ -34,6 +49,55 @@ namespace {
 // zero.
 constexpr double kMinResidualValue = 0.00001;
 
+// Sets the IRLS weights w_i = max(|r_i|, kMinResidualValue)^(p - 2) for the
+// given regularization values r_i and norm p, so that w_i * r_i^2 approximates
+// |r_i|^p in the next round. The loops are branch-free so that the compiler can
+// vectorize them, and the common 1-norm and 2-norm cases avoid std::pow().
+void ComputeIRLSWeights(
+    const double* residuals,
+    const int num_values,
+    const double norm,
+    double* weights) {
+
+  if (norm == 2.0) {
+    std::fill(weights, weights + num_values, 1.0);
+  } else if (norm == 1.0) {
+    for (int i = 0; i < num_values; ++i) {
+      weights[i] = 1.0 / std::max(std::abs(residuals[i]), kMinResidualValue);
+    }
+  } else {
+    const double exponent = norm - 2.0;
+    for (int i = 0; i < num_values; ++i) {
+      weights[i] = std::pow(
+          std::max(std::abs(residuals[i]), kMinResidualValue), exponent);
+    }
+  }
+}
+
+// Each coarse-to-fine level halves the image resolution.
+constexpr int kMultiscaleLevelFactor = 2;
+
+// With a time limit, each IRLS round gets this fraction of the remaining time
+// (the last round gets all of it), since later rounds start from a better
+// estimate and need fewer iterations.
+constexpr double kIRLSRoundTimeShare = 0.5;
+
+// With a time limit, a new IRLS round is only started if the remaining time
+// allows at least this many objective evaluations, based on the measured time
+// per evaluation in the previous rounds. Shorter rounds would barely change the
+// estimate after the weights are updated.
+constexpr int kMinEvaluationsPerIRLSRound = 10;
+
+// The number of Gauss-Newton steps per frame each time the motion is refined
+// between IRLS iterations.
+constexpr int kNumMotionRefinementIterations = 5;
+
+// Returns a new data term objective for the given estimate, which re-estimates
+// the motion of the frames against it. Used for refining the motion between
+// IRLS iterations.
+using DataObjectiveRefiner =
+    std::function<std::shared_ptr<ObjectiveFunction>(const double*)>;
+
 // Runs the IRLS loop for the given data and channel(s). After every iteration,
 // update the IRLS weights and solve again until the change in residual sum is
 // sufficiently low.
@@ -42,16 +106,43 @@ constexpr double kMinResidualValue = 0.00001;
 // be at least one channel and must not exceed the number of channels in the
 // image. NOTE that the range is non-inclusive of the last element (i.e.
 // [channel_start, channel_end).
+//
+// If telemetry is given, the solver iterations of every IRLS round are
+// recorded under the given stage name.
+//
+// If the data term objective has a deadline (see
+// ObjectiveFunction::SetDeadline), the time until the deadline is split
+// between the IRLS rounds and the loop stops with the current estimate once
+// there is not enough time left for another round.
+//
+// With the use_mixed_precision option, the IRLS iterations evaluate the data
+// term in mixed precision until the loop would stop, and that iteration is then
+// repeated in double precision (with the same weights) from its result.
+//
+// If a data objective refiner is given (the refine_motion option), the motion
+// is re-estimated against the current estimate before every IRLS iteration
+// except the first, and the iterations use the returned data term objective.
+//
+// The loop continues from the given subset state (IRLS weights and iteration
+// counters), which is empty for a new solve. If a checkpoint writer is given,
+// the state is updated and checkpointed every checkpoint_interval iterations
+// and when the loop ends.
 void RunIRLSLoop(
     const IRLSMapSolverOptions& options,
     const ObjectiveFunction& objective_function_data_term_only,
+    const DataObjectiveRefiner& refine_data_objective,
     const RegularizersAndParameters& regularizers,
     const cv::Size& image_size,
     const int channel_start,
     const int channel_end,
+    const std::shared_ptr<SolverTelemetry>& telemetry,
+    const std::string& telemetry_stage,
+    IRLSCheckpointWriter* checkpoint_writer,
+    IRLSSubsetState* subset_state,
     alglib::real_1d_array* solver_data) {
 
   CHECK_GE(channel_end, channel_start) << "Invalid channel range.";
+  CHECK_NOTNULL(subset_state);
 
   const int num_pixels = image_size.width * image_size.height;
   const int num_channels = channel_end - channel_start;
@@ -72,30 +163,170 @@ void RunIRLSLoop(
         1.0);
     irls_weights[reg_index] = weights_for_regularizer;
   }
+  if (!subset_state->irls_weights.empty()) {
+    CHECK_EQ(subset_state->irls_weights.size(), num_regularizers)
+        << "The resumed IRLS weights do not match the regularizers.";
+    irls_weights = subset_state->irls_weights;
+  }
+
+  // If every regularizer is quadratic, each round minimizes a quadratic, which
+  // linear CG solves without the line searches of the nonlinear solvers.
+  const bool use_linear_solver =
+      options.least_squares_solver == CG_SOLVER &&
+      !options.use_numerical_differentiation &&
+      std::all_of(
+          regularizers.begin(),
+          regularizers.end(),
+          [](const std::pair<std::shared_ptr<Regularizer>, double>& pair) {
+            return pair.first->IsQuadratic();
+          });
+  // The linear solver's work vectors are allocated once for all rounds.
+  std::unique_ptr<LinearConjugateGradientSolver> linear_solver;
+  if (use_linear_solver) {
+    linear_solver.reset(new LinearConjugateGradientSolver(num_data_points));
+  }
+
+  // If there are no regularizers to reweight, then no need to continue after
+  // the first round since the solver already converged and the objective
+  // won't change. Smooth regularizers are minimized directly and are never
+  // reweighted.
+  const bool has_nonsmooth_regularizer = std::any_of(
+      regularizers.begin(),
+      regularizers.end(),
+      [](const std::pair<std::shared_ptr<Regularizer>, double>& pair) {
+        return !pair.first->IsSmooth();
+      });
+
+  // The regularization term references the IRLS weights, which are updated in
+  // place after every round, so the same term is used in every round. All
+  // regularizers share one term so that compatible ones are evaluated in a
+  // single fused pass over the image.
+  std::shared_ptr<ObjectiveFusedRegularizationTerm> regularization_term;
+  if (num_regularizers > 0) {
+    regularization_term = std::shared_ptr<ObjectiveFusedRegularizationTerm>(
+        new ObjectiveFusedRegularizationTerm(num_channels, image_size));
+    for (int reg_index = 0; reg_index < num_regularizers; ++reg_index) {
+      regularization_term->AddRegularizer(
+          regularizers[reg_index].first,
+          regularizers[reg_index].second,
+          irls_weights[reg_index]);
+    }
+  }
+  // The regularization values for the weight update, reused in every round.
+  std::vector<double> regularization_residuals;
+  if (has_nonsmooth_regularizer) {
+    regularization_residuals.resize(num_data_points);
+  }
 
-  double previous_cost = std::numeric_limits<double>::infinity();
+  // The time spent in the solvers and the number of objective evaluations so
+  // far, for budgeting the remaining rounds if there is a deadline.
+  const std::chrono::steady_clock::time_point deadline =
+      objective_function_data_term_only.GetDeadline();
+  const bool has_deadline =
+      deadline != std::chrono::steady_clock::time_point::max();
+  double total_solver_seconds = 0.0;
+  int total_num_evaluations = 0;
+
+  double previous_cost = subset_state->previous_cost;
   double cost_difference = options.irls_cost_difference_threshold + 1.0;
-  int num_iterations_ran = 0;
+  int num_iterations_ran = subset_state->num_irls_iterations_ran;
+  const auto save_checkpoint = [&](const bool is_complete) {
+    subset_state->is_complete = is_complete;
+    subset_state->num_irls_iterations_ran = num_iterations_ran;
+    subset_state->previous_cost = previous_cost;
+    subset_state->estimate.assign(
+        solver_data->getcontent(),
+        solver_data->getcontent() + num_data_points);
+    subset_state->irls_weights = irls_weights;
+    checkpoint_writer->UpdateSubset(*subset_state);
+  };
+
+  // The loop is not complete if it stops at the deadline, so that a resumed
+  // solve continues it.
+  bool is_stopped_at_deadline = false;
+  bool use_mixed_precision = options.use_mixed_precision;
+  // The data term objective with the latest refined motion, if any.
+  std::shared_ptr<ObjectiveFunction> refined_data_objective;
+  bool refine_motion_before_round = false;
   while (std::abs(cost_difference) >= options.irls_cost_difference_threshold) {
-    // Add the weighted regularization term(s) to the next objective function.
-    // This makes a new copy of the objective function for each iteration.
-    ObjectiveFunction objective_function = objective_function_data_term_only;
-    for (int reg_index = 0; reg_index < num_regularizers; ++reg_index) {
-      const auto& regularizer_and_parameter = regularizers[reg_index];
-      std::shared_ptr<ObjectiveTerm> regularization_term(
-          new ObjectiveIRLSRegularizationTerm(
-              regularizer_and_parameter.first,
-              regularizer_and_parameter.second,
-              irls_weights[reg_index],
-              num_channels,
-              image_size));
+    const std::chrono::steady_clock::time_point round_start_time =
+        std::chrono::steady_clock::now();
+    double round_time_share = 1.0;
+    if (has_deadline) {
+      if (round_start_time >= deadline) {
+        LOG(INFO) << "Deadline reached. Stopping IRLS after "
+                  << num_iterations_ran << " iterations.";
+        is_stopped_at_deadline = true;
+        break;
+      }
+      const double remaining_seconds =
+          std::chrono::duration<double>(deadline - round_start_time).count();
+      const double min_round_seconds = (total_num_evaluations > 0) ?
+          kMinEvaluationsPerIRLSRound * total_solver_seconds /
+              total_num_evaluations : 0.0;
+      if (num_iterations_ran > 0 && remaining_seconds < min_round_seconds) {
+        LOG(INFO) << "Not enough time left for another IRLS iteration. "
+                  << "Stopping IRLS after " << num_iterations_ran
+                  << " iterations.";
+        is_stopped_at_deadline = true;
+        break;
+      }
+      const bool is_last_round = !has_nonsmooth_regularizer ||
+          (options.max_num_irls_iterations > 0 &&
+           num_iterations_ran + 1 >= options.max_num_irls_iterations);
+      if (!is_last_round &&
+          kIRLSRoundTimeShare * remaining_seconds >= min_round_seconds) {
+        round_time_share = kIRLSRoundTimeShare;
+      }
+    }
+
+    // The motion is refined once per completed iteration, so not before the
+    // double-precision repeat of a mixed-precision iteration.
+    if (refine_data_objective && refine_motion_before_round) {
+      refined_data_objective =
+          refine_data_objective(solver_data->getcontent());
+      refine_motion_before_round = false;
+    }
+
+    // Regularizers that adapt to the image content (e.g. the non-local
+    // neighbor graph) are rebuilt from the current estimate once per round.
+    for (const auto& regularizer_and_parameter : regularizers) {
+      regularizer_and_parameter.first->UpdateFromEstimate(
+          solver_data->getcontent(), num_channels);
+    }
+
+    // Add the weighted regularization term to the next objective function.
+    // This makes a new copy of the objective function (but not of its terms)
+    // for each iteration.
+    ObjectiveFunction objective_function = (refined_data_objective != nullptr) ?
+        *refined_data_objective : objective_function_data_term_only;
+    if (telemetry != nullptr) {
+      objective_function.SetTelemetry(
+          telemetry, telemetry_stage, num_iterations_ran);
+    }
+    objective_function.SetDeadline(
+        GetPartialDeadline(deadline, round_time_share));
+    objective_function.SetMixedPrecision(use_mixed_precision);
+    const int num_evaluations_before_round =
+        objective_function.GetNumEvaluations();
+    if (regularization_term != nullptr) {
       objective_function.AddTerm(regularization_term);
     }
 
     // Run the solver on the reweighted objective function. Solver choice and
     // differentiation method are determined by options.
     double final_cost = 0.0;
-    if (options.use_numerical_differentiation) {
+    if (use_linear_solver) {
+      // Every CG iteration evaluates at a new point, so caching never hits.
+      objective_function.SetCacheCapacity(0);
+      final_cost = MinimizeQuadraticObjective(
+          objective_function,
+          options.max_num_solver_iterations,
+          options.gradient_norm_threshold,
+          options.use_diagonal_preconditioner,
+          linear_solver.get(),
+          solver_data->getcontent());
+    } else if (options.use_numerical_differentiation) {
       if (options.least_squares_solver == CG_SOLVER) {
         final_cost = RunCGSolverNumericalDiff(
             options, objective_function, solver_data);
@@ -113,38 +344,52 @@ void RunIRLSLoop(
       }
     }
 
-    // If there are no regularizers, then no need to continue since the solver
-    // already converged and the objective won't change.
-    if (num_regularizers == 0) {
+    total_solver_seconds += std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - round_start_time).count();
+    total_num_evaluations +=
+        objective_function.GetNumEvaluations() - num_evaluations_before_round;
+
+    if (use_mixed_precision) {
+      const bool is_last_round = !has_nonsmooth_regularizer ||
+          (options.max_num_irls_iterations > 0 &&
+           num_iterations_ran + 1 >= options.max_num_irls_iterations) ||
+          std::abs(previous_cost - final_cost) <
+              options.irls_cost_difference_threshold;
+      if (is_last_round) {
+        LOG(INFO) << "Repeating the last IRLS iteration in double precision.";
+        use_mixed_precision = false;
+        continue;
+      }
+    }
+
+    if (!has_nonsmooth_regularizer) {
       LOG(INFO) << "Least squares done (no regularization terms to reweight).";
       break;
     }
 
-    // Update the IRLS weights.
+    // Update the IRLS weights in place.
     // TODO: should this be computed off of the initial estimate? That seems to
     // get better results at the cost of A LOT of extra computational time.
-    // TODO: the regularizer is assumed to be L1 norm. Scale appropriately to
-    // L* norm based on the regularizer's properties.
     for (int reg_index = 0; reg_index < num_regularizers; ++reg_index) {
       const auto& regularizer_and_parameter = regularizers[reg_index];
-      const double* estimated_image_data = solver_data->getcontent();
-      const std::vector<double>& regularization_residuals =
-          regularizer_and_parameter.first->ApplyToImage(
-              estimated_image_data, num_channels);
-      CHECK_EQ(regularization_residuals.size(), num_data_points)
-          << "Number of residuals does not match number of weights.";
-      for (int pixel_index = 0; pixel_index < num_data_points; ++pixel_index) {
-        // TODO: this assumes L1 loss!
-        // w = |r|^(p-2)
-        const double residual_value = regularization_residuals[pixel_index];
-        irls_weights[reg_index][pixel_index] =
-            1.0 / std::max(kMinResidualValue, residual_value);
+      if (regularizer_and_parameter.first->IsSmooth()) {
+        continue;
       }
+      regularizer_and_parameter.first->ComputeValues(
+          solver_data->getcontent(),
+          num_channels,
+          regularization_residuals.data());
+      ComputeIRLSWeights(
+          regularization_residuals.data(),
+          num_data_points,
+          options.regularization_norm,
+          irls_weights[reg_index].data());
     }
 
     cost_difference = previous_cost - final_cost;
     previous_cost = final_cost;
     num_iterations_ran++;
+    refine_motion_before_round = true;
     LOG(INFO) << "IRLS Iteration complete (#" << num_iterations_ran << "). "
               << "New loss is " << final_cost
               << " with a difference of " << cost_difference << ".";
@@ -153,6 +398,140 @@ void RunIRLSLoop(
         num_iterations_ran >= options.max_num_irls_iterations) {
       break;
     }
+    if (checkpoint_writer != nullptr &&
+        num_iterations_ran % options.checkpoint_interval == 0) {
+      save_checkpoint(false);
+    }
+  }
+  if (checkpoint_writer != nullptr) {
+    save_checkpoint(!is_stopped_at_deadline);
+  }
+}
+
+// Returns a fast 64-bit hash (FNV-1a over 64-bit words) of the given
+// observations and of the motion of the given image model, which identifies
+// the problem that a checkpoint was saved for.
+uint64_t HashProblem(
+    const std::vector<ImageData>& observations,
+    const ImageModel& image_model) {
+
+  constexpr uint64_t kOffsetBasis = 14695981039346656037ULL;
+  constexpr uint64_t kPrime = 1099511628211ULL;
+  uint64_t hash = kOffsetBasis;
+  const auto add_value = [&hash](const double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    hash = (hash ^ bits) * kPrime;
+  };
+  for (const ImageData& observation : observations) {
+    const int num_pixels = observation.GetNumPixels();
+    for (int channel = 0; channel < observation.GetNumChannels(); ++channel) {
+      const double* channel_data = observation.GetChannelData(channel);
+      for (int i = 0; i < num_pixels; ++i) {
+        add_value(channel_data[i]);
+      }
+    }
+  }
+  const MotionShiftSequence motion_shift_sequence =
+      image_model.GetMotionShiftSequence();
+  for (int i = 0; i < motion_shift_sequence.GetNumMotionShifts(); ++i) {
+    add_value(motion_shift_sequence[i].dx);
+    add_value(motion_shift_sequence[i].dy);
+  }
+  return hash;
+}
+
+// Returns a checkpoint for a new solve with the given options, with one empty
+// state per channel subset. The problem hash identifies the observations and
+// motion (see HashProblem()).
+IRLSCheckpoint CreateCheckpoint(
+    const IRLSMapSolverOptions& options,
+    const RegularizersAndParameters& regularizers,
+    const uint64_t problem_hash,
+    const cv::Size& image_size,
+    const int num_channels,
+    const int num_channels_per_split) {
+
+  IRLSCheckpoint checkpoint;
+  checkpoint.image_width = image_size.width;
+  checkpoint.image_height = image_size.height;
+  checkpoint.num_channels = num_channels;
+  checkpoint.split_channels = options.split_channels;
+  checkpoint.max_num_irls_iterations = options.max_num_irls_iterations;
+  checkpoint.max_num_solver_iterations = options.max_num_solver_iterations;
+  checkpoint.irls_cost_difference_threshold =
+      options.irls_cost_difference_threshold;
+  for (const auto& regularizer_and_parameter : regularizers) {
+    checkpoint.regularization_parameters.push_back(
+        regularizer_and_parameter.second);
+    checkpoint.regularizer_types.push_back(
+        typeid(*regularizer_and_parameter.first).name());
+  }
+  checkpoint.regularization_norm = options.regularization_norm;
+  checkpoint.problem_hash = problem_hash;
+  for (int channel_start = 0;
+       channel_start < num_channels;
+       channel_start += num_channels_per_split) {
+    IRLSSubsetState subset_state;
+    subset_state.channel_start = channel_start;
+    subset_state.channel_end = channel_start + num_channels_per_split;
+    checkpoint.subsets.push_back(subset_state);
+  }
+  return checkpoint;
+}
+
+// Verifies that the resumed checkpoint has the problem size, subset layout and
+// objective of the expected (new) checkpoint. The iteration options and the
+// regularization parameters may change, in which case the completed subsets
+// are reopened so that they are solved further with the new options. If the
+// regularization parameters changed, the cost of the last iteration is also
+// reset, since it was computed for a different objective.
+void ResumeCheckpoint(
+    const IRLSCheckpoint& expected_checkpoint,
+    IRLSCheckpoint* resumed_checkpoint) {
+
+  CHECK_NOTNULL(resumed_checkpoint);
+
+  CHECK(resumed_checkpoint->image_width == expected_checkpoint.image_width &&
+        resumed_checkpoint->image_height == expected_checkpoint.image_height &&
+        resumed_checkpoint->num_channels == expected_checkpoint.num_channels)
+      << "The checkpoint was saved for a different image size.";
+  CHECK_EQ(resumed_checkpoint->split_channels,
+           expected_checkpoint.split_channels)
+      << "The checkpoint was saved with different channel splitting.";
+  CHECK_EQ(resumed_checkpoint->regularization_parameters.size(),
+           expected_checkpoint.regularization_parameters.size())
+      << "The checkpoint was saved with a different number of regularizers.";
+  CHECK(resumed_checkpoint->regularizer_types ==
+        expected_checkpoint.regularizer_types)
+      << "The checkpoint was saved with different regularizers.";
+  CHECK_EQ(resumed_checkpoint->regularization_norm,
+           expected_checkpoint.regularization_norm)
+      << "The checkpoint was saved with a different regularization norm.";
+  CHECK_EQ(resumed_checkpoint->problem_hash, expected_checkpoint.problem_hash)
+      << "The checkpoint was saved for different observations or motion.";
+  CHECK_EQ(resumed_checkpoint->subsets.size(),
+           expected_checkpoint.subsets.size())
+      << "The checkpoint was saved with different channel subsets.";
+
+  const bool regularization_parameters_changed =
+      resumed_checkpoint->regularization_parameters !=
+          expected_checkpoint.regularization_parameters;
+  if (regularization_parameters_changed ||
+      resumed_checkpoint->max_num_irls_iterations !=
+          expected_checkpoint.max_num_irls_iterations ||
+      resumed_checkpoint->max_num_solver_iterations !=
+          expected_checkpoint.max_num_solver_iterations ||
+      resumed_checkpoint->irls_cost_difference_threshold !=
+          expected_checkpoint.irls_cost_difference_threshold) {
+    LOG(WARNING) << "The solver options differ from the checkpointed ones. "
+                 << "Resuming all image subsets with the new options.";
+    for (IRLSSubsetState& subset : resumed_checkpoint->subsets) {
+      subset.is_complete = false;
+      if (regularization_parameters_changed) {
+        subset.previous_cost = std::numeric_limits<double>::infinity();
+      }
+    }
   }
 }
 
@@ -179,6 +558,43 @@ void IRLSMapSolverOptions::PrintSolverOptions() const {
   MapSolverOptions::PrintSolverOptions();
   std::cout << "  IRLS cost difference threshold:      "
             << irls_cost_difference_threshold << std::endl;
+  if (num_multiscale_levels > 1) {
+    std::cout << "  Multiscale levels:                   "
+              << num_multiscale_levels << std::endl;
+  }
+  if (regularization_norm != 1.0) {
+    std::cout << "  Regularization norm (p):             "
+              << regularization_norm << std::endl;
+  }
+  if (use_mixed_precision) {
+    std::cout << "  Mixed-precision data term enabled." << std::endl;
+  }
+  if (refine_motion) {
+    std::cout << "  Motion refinement enabled." << std::endl;
+  }
+  if (!checkpoint_path.empty()) {
+    std::cout << "  Checkpoint file:                     "
+              << checkpoint_path
+              << (resume_from_checkpoint ? " (resume)" : "") << std::endl;
+    std::cout << "  Checkpoint interval (iterations):    "
+              << checkpoint_interval << std::endl;
+  }
+}
+
+std::string IRLSMapSolverOptions::GetIterativeOnlyOption() const {
+  if (num_multiscale_levels > 1) {
+    return "num_multiscale_levels";
+  }
+  if (use_mixed_precision) {
+    return "use_mixed_precision";
+  }
+  if (refine_motion) {
+    return "refine_motion";
+  }
+  if (!checkpoint_path.empty()) {
+    return "checkpoint_path";
+  }
+  return MapSolverOptions::GetIterativeOnlyOption();
 }
 
 IRLSMapSolver::IRLSMapSolver(
@@ -197,6 +613,53 @@ ImageData IRLSMapSolver::Solve(const ImageData& initial_estimate) {
   CHECK_EQ(initial_estimate.GetNumChannels(), num_channels);
   CHECK_EQ(initial_estimate.GetImageSize(), image_size);
 
+  // A quadratic objective with a shift-invariant normal-equation operator is
+  // solved directly in the Fourier domain without any iterations, unless that
+  // would ignore some of the options or the telemetry.
+  if (solver_options_.use_fourier_solver_if_possible) {
+    if (telemetry_ == nullptr && FourierMapSolver::CanSolve(
+            solver_options_, image_model_, GetNumImages(), regularizers_)) {
+      LOG(INFO) << "Objective is shift-invariant: using the closed-form "
+                << "Fourier solver.";
+      return FourierMapSolver::SolveClosedForm(
+          image_model_, observations_, regularizers_, image_size);
+    }
+    if (FourierMapSolver::CanSolve(
+            image_model_, GetNumImages(), regularizers_)) {
+      const std::string iterative_only_option =
+          solver_options_.GetIterativeOnlyOption();
+      if (!iterative_only_option.empty()) {
+        LOG(INFO) << "Objective is shift-invariant, but the closed-form "
+                  << "Fourier solver does not support the "
+                  << iterative_only_option << " option. Solving iteratively.";
+      } else {
+        LOG(INFO) << "Objective is shift-invariant, but the closed-form "
+                  << "Fourier solver records no telemetry. Solving "
+                  << "iteratively.";
+      }
+    }
+  }
+
+  const std::chrono::steady_clock::time_point deadline =
+      solver_options_.GetDeadline();
+
+  CHECK(solver_options_.regularization_norm > 0.0 &&
+        solver_options_.regularization_norm <= 2.0)
+      << "The regularization norm must be in (0, 2].";
+
+  // Refining the motion of each channel separately would misregister the
+  // channels against each other.
+  CHECK(!solver_options_.refine_motion || !solver_options_.split_channels)
+      << "Motion refinement cannot be combined with split_channels.";
+  bool refine_motion = solver_options_.refine_motion;
+  if (refine_motion &&
+      image_model_.GetMotionShiftSequence().GetNumMotionShifts() <
+          GetNumImages()) {
+    LOG(WARNING) << "The image model has no motion for every image. "
+                 << "Motion refinement is disabled.";
+    refine_motion = false;
+  }
+
   // If the split_channels option is set, loop over the channels here and solve
   // them independently. Otherwise, solve all channels at once.
   const int num_channels_per_split =
@@ -209,6 +672,45 @@ ImageData IRLSMapSolver::Solve(const ImageData& initial_estimate) {
               << " channel(s) in each section.";
   }
 
+  // The state of every subset, which a resumed solve reads from the
+  // checkpoint file.
+  IRLSCheckpoint checkpoint = CreateCheckpoint(
+      solver_options_,
+      regularizers_,
+      solver_options_.checkpoint_path.empty() ?
+          0 : HashProblem(observations_, image_model_),
+      image_size,
+      num_channels,
+      num_channels_per_split);
+  bool is_resumed = false;
+  if (!solver_options_.checkpoint_path.empty() &&
+      solver_options_.resume_from_checkpoint) {
+    IRLSCheckpoint resumed_checkpoint;
+    if (ReadIRLSCheckpoint(
+            solver_options_.checkpoint_path, &resumed_checkpoint)) {
+      ResumeCheckpoint(checkpoint, &resumed_checkpoint);
+      checkpoint.subsets = resumed_checkpoint.subsets;
+      is_resumed = true;
+      LOG(INFO) << "Resuming from checkpoint "
+                << solver_options_.checkpoint_path << ".";
+    } else {
+      LOG(WARNING) << "No checkpoint to resume from. Starting a new solve.";
+    }
+  }
+  std::unique_ptr<IRLSCheckpointWriter> checkpoint_writer;
+  if (!solver_options_.checkpoint_path.empty()) {
+    CHECK_GT(solver_options_.checkpoint_interval, 0)
+        << "The checkpoint interval must be at least one iteration.";
+    checkpoint_writer.reset(new IRLSCheckpointWriter(
+        solver_options_.checkpoint_path, checkpoint));
+  }
+
+  // Start from the upsampled solution of the coarser levels, if any. A resumed
+  // solve already has a better estimate.
+  const ImageData warm_start =
+      (solver_options_.num_multiscale_levels > 1 && !is_resumed) ?
+      SolveCoarserLevels(initial_estimate) : initial_estimate;
+
   // Scale the option stop criteria parameters based on the number of
   // parameters and strength of the regularizers.
   IRLSMapSolverOptions solver_options_scaled = solver_options_;
@@ -219,8 +721,36 @@ ImageData IRLSMapSolver::Solve(const ImageData& initial_estimate) {
     solver_options_scaled.PrintSolverOptions();
   }
 
-  ImageData estimated_image;
-  for (int i = 0; i < num_solver_rounds; ++i) {
+  // The rounds are independent and run concurrently. Regularizers may keep
+  // state that is rebuilt from the estimate of their round (see
+  // Regularizer::UpdateFromEstimate()), so every round gets its own copies.
+  // If a regularizer cannot be copied, the rounds run one at a time.
+  std::vector<RegularizersAndParameters> round_regularizers(
+      num_solver_rounds, regularizers_);
+  bool run_rounds_concurrently = true;
+  for (int i = 1; i < num_solver_rounds && run_rounds_concurrently; ++i) {
+    for (auto& regularizer_and_parameter : round_regularizers[i]) {
+      regularizer_and_parameter.first =
+          regularizer_and_parameter.first->CreateForImageSize(image_size);
+      if (regularizer_and_parameter.first == nullptr) {
+        LOG(WARNING) << "A regularizer cannot be copied. Solving the image "
+                     << "subsets sequentially.";
+        run_rounds_concurrently = false;
+        break;
+      }
+    }
+  }
+
+  // Each round writes its solution to its own array, and the channels are
+  // assembled in order afterwards.
+  std::vector<std::vector<double>> round_solutions(num_solver_rounds);
+  const auto solve_round = [&](const int i) {
+    IRLSSubsetState& subset_state = checkpoint.subsets[i];
+    if (subset_state.is_complete) {
+      LOG(INFO) << "Image subset #" << (i + 1) << " was already solved.";
+      round_solutions[i] = subset_state.estimate;
+      return;
+    }
     if (num_solver_rounds > 1) {
       LOG(INFO) << "Starting solver on image subset #" << (i + 1) << ".";
     }
@@ -228,40 +758,187 @@ ImageData IRLSMapSolver::Solve(const ImageData& initial_estimate) {
     const int channel_end = channel_start + num_channels_per_split;
 
     // Copy the initial estimate data (within the appropriate channel range) to
-    // the solver's array.
+    // the solver's array, or continue from the checkpointed estimate.
     alglib::real_1d_array solver_data;
     solver_data.setlength(num_data_points);
-    for (int channel = 0; channel < num_channels_per_split; ++channel) {
-      double* data_ptr = solver_data.getcontent() + (num_pixels * channel);
-      const double* channel_ptr = initial_estimate.GetChannelData(
-          channel_start + channel);
-      std::copy(channel_ptr, channel_ptr + num_pixels, data_ptr);
+    if (!subset_state.estimate.empty()) {
+      std::copy(
+          subset_state.estimate.begin(),
+          subset_state.estimate.end(),
+          solver_data.getcontent());
+    } else {
+      for (int channel = 0; channel < num_channels_per_split; ++channel) {
+        double* data_ptr = solver_data.getcontent() + (num_pixels * channel);
+        const double* channel_ptr = warm_start.GetChannelData(
+            channel_start + channel);
+        std::copy(channel_ptr, channel_ptr + num_pixels, data_ptr);
+      }
     }
 
     // Set up the base objective function (just data term). The regularization
     // term depends on the IRLS weights, so it gets added in the IRLS loop.
-    ObjectiveFunction objective_function_data_term_only(num_data_points);
-    std::shared_ptr<ObjectiveTerm> data_term(new ObjectiveDataTerm(
-        image_model_, observations_, channel_start, channel_end, image_size));
-    objective_function_data_term_only.AddTerm(data_term);
+    // Concurrent rounds share the deadline. Sequential rounds each get an
+    // equal share of the time that the previous rounds left.
+    const std::chrono::steady_clock::time_point round_deadline =
+        run_rounds_concurrently ? deadline :
+        GetPartialDeadline(deadline, 1.0 / (num_solver_rounds - i));
+    const auto create_data_objective = [&](const ImageModel& image_model) {
+      std::shared_ptr<ObjectiveFunction> objective_function(
+          new ObjectiveFunction(num_data_points));
+      objective_function->SetCacheCapacity(
+          solver_options_.num_cached_objective_evaluations);
+      objective_function->SetVerbose(IsVerbose());
+      objective_function->SetDeadline(round_deadline);
+      std::shared_ptr<ObjectiveTerm> data_term;
+      if (solver_options_.use_normal_equation_data_term) {
+        data_term = std::shared_ptr<ObjectiveTerm>(
+            new ObjectiveNormalEquationDataTerm(
+                image_model,
+                observations_,
+                channel_start,
+                channel_end,
+                image_size));
+      } else {
+        data_term = std::shared_ptr<ObjectiveTerm>(new ObjectiveDataTerm(
+            image_model, observations_, channel_start, channel_end,
+            image_size));
+      }
+      objective_function->AddTerm(data_term);
+      return objective_function;
+    };
+    const std::shared_ptr<ObjectiveFunction> objective_function_data_term_only =
+        create_data_objective(image_model_);
+
+    // The data terms keep a reference to their image model. The data term
+    // that RunIRLSLoop() holds while the motion is refined references the
+    // current model, so that model is kept until the new data term replaces
+    // it, i.e. until the next refinement.
+    std::shared_ptr<ImageModel> current_refined_image_model;
+    std::shared_ptr<ImageModel> previous_refined_image_model;
+    DataObjectiveRefiner refine_data_objective;
+    if (refine_motion) {
+      refine_data_objective = [&](const double* estimated_image_data) {
+        const ImageModel& image_model =
+            (current_refined_image_model != nullptr) ?
+            *current_refined_image_model : image_model_;
+        const MotionShiftSequence motion_shift_sequence = RefineMotionShifts(
+            image_model,
+            observations_,
+            estimated_image_data,
+            channel_start,
+            channel_end,
+            image_size,
+            kNumMotionRefinementIterations);
+        previous_refined_image_model = current_refined_image_model;
+        current_refined_image_model =
+            image_model.CreateModelWithMotion(motion_shift_sequence);
+        for (int index = 1; index < GetNumImages(); ++index) {
+          LOG(INFO) << "Refined motion of image #" << index << ": ("
+                    << motion_shift_sequence[index].dx << ", "
+                    << motion_shift_sequence[index].dy << ").";
+        }
+        return create_data_objective(*current_refined_image_model);
+      };
+    }
 
     RunIRLSLoop(
         solver_options_scaled,
-        objective_function_data_term_only,
-        regularizers_,
+        *objective_function_data_term_only,
+        refine_data_objective,
+        run_rounds_concurrently ? round_regularizers[i] : regularizers_,
         image_size,
         channel_start,
         channel_end,
+        telemetry_,
+        telemetry_stage_prefix_ + "irls" + ((num_solver_rounds > 1) ?
+            "_channel_" + std::to_string(channel_start) : ""),
+        checkpoint_writer.get(),
+        &subset_state,
         &solver_data);
 
+    round_solutions[i].assign(
+        solver_data.getcontent(), solver_data.getcontent() + num_data_points);
+  };
+  if (run_rounds_concurrently) {
+    util::ParallelFor(num_solver_rounds, solve_round);
+  } else {
+    for (int i = 0; i < num_solver_rounds; ++i) {
+      solve_round(i);
+    }
+  }
+
+  ImageData estimated_image;
+  for (const std::vector<double>& round_solution : round_solutions) {
     for (int channel = 0; channel < num_channels_per_split; ++channel) {
-      const double* data_ptr =
-          solver_data.getcontent() + (num_pixels * channel);
-      estimated_image.AddChannel(data_ptr, image_size);
+      estimated_image.AddChannel(
+          round_solution.data() + (num_pixels * channel), image_size);
     }
   }
 
   return estimated_image;
 }
 
+ImageData IRLSMapSolver::SolveCoarserLevels(
+    const ImageData& initial_estimate) {
+
+  const std::shared_ptr<ImageModel> coarse_image_model =
+      image_model_.CreateDownscaledModel(kMultiscaleLevelFactor);
+  if (coarse_image_model == nullptr) {
+    LOG(WARNING) << "The image model cannot be downscaled. Skipping the "
+                 << "coarse multiscale levels.";
+    return initial_estimate;
+  }
+  const cv::Size image_size = GetImageSize();
+  const cv::Size coarse_image_size(
+      image_size.width / kMultiscaleLevelFactor,
+      image_size.height / kMultiscaleLevelFactor);
+
+  IRLSMapSolverOptions coarse_solver_options = solver_options_;
+  coarse_solver_options.num_multiscale_levels--;
+  // Only the full resolution solve is checkpointed.
+  coarse_solver_options.checkpoint_path.clear();
+  // The motion refined at a coarse level is not passed on to the finer levels.
+  coarse_solver_options.refine_motion = false;
+  // The coarser levels have a fraction of the pixels, so they get the same
+  // fraction of the time.
+  coarse_solver_options.time_limit_seconds /=
+      kMultiscaleLevelFactor * kMultiscaleLevelFactor;
+
+  // The observations are the LR images upsampled with nearest neighbor
+  // interpolation, so downsampling them again recovers the LR images exactly.
+  const int scale = image_model_.GetDownsamplingScale();
+  const cv::Size lr_image_size(
+      image_size.width / scale, image_size.height / scale);
+  std::vector<ImageData> low_res_images;
+  low_res_images.reserve(observations_.size());
+  for (const ImageData& observation : observations_) {
+    ImageData low_res_image = observation;  // copy
+    low_res_image.ResizeImage(lr_image_size, INTERPOLATE_NEAREST);
+    low_res_images.push_back(low_res_image);
+  }
+
+  IRLSMapSolver coarse_solver(
+      coarse_solver_options, *coarse_image_model, low_res_images, IsVerbose());
+  coarse_solver.SetTelemetry(telemetry_, telemetry_stage_prefix_ + "coarse/");
+  for (const auto& regularizer_and_parameter : regularizers_) {
+    const std::shared_ptr<Regularizer> coarse_regularizer =
+        regularizer_and_parameter.first->CreateForImageSize(coarse_image_size);
+    if (coarse_regularizer == nullptr) {
+      LOG(WARNING) << "A regularizer cannot be resized. Skipping the coarse "
+                   << "multiscale levels.";
+      return initial_estimate;
+    }
+    coarse_solver.AddRegularizer(
+        coarse_regularizer, regularizer_and_parameter.second);
+  }
+
+  LOG(INFO) << "Solving multiscale level at " << coarse_image_size.width
+            << "x" << coarse_image_size.height << ".";
+  ImageData coarse_estimate = initial_estimate;  // copy
+  coarse_estimate.ResizeImage(coarse_image_size, INTERPOLATE_LINEAR);
+  ImageData estimate = coarse_solver.Solve(coarse_estimate);
+  estimate.ResizeImage(image_size, INTERPOLATE_LINEAR);
+  return estimate;
+}
+
 }  // namespace super_resolution
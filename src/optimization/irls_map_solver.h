@@ -3,6 +3,7 @@
 #ifndef SRC_OPTIMIZATION_IRLS_MAP_SOLVER_H_
 #define SRC_OPTIMIZATION_IRLS_MAP_SOLVER_H_
 
+#include <string>
 #include <utility>
 #include <vector>
 
@@ -21,6 +22,11 @@ struct IRLSMapSolverOptions : public MapSolverOptions {
   // Print also includes specific IRLS parameters.
   virtual void PrintSolverOptions() const;
 
+  // Also includes the IRLS options that the closed-form solver ignores
+  // (multiscale levels, mixed precision, motion refinement and
+  // checkpointing).
+  virtual std::string GetIterativeOnlyOption() const;
+
   // Maximum number of outer loop iterations. Each outer loop runs Conjugate
   // Gradient which has its own max number of iterations
   // (max_num_solver_iterations).
@@ -33,6 +39,55 @@ struct IRLSMapSolverOptions : public MapSolverOptions {
   // The stopping criteria for the inner loop (conjugate gradient) is defined
   // independently in MapSolverOptions.
   double irls_cost_difference_threshold = 1.0e-5;
+
+  // The p of the p-norm that the IRLS weights reweight the nonsmooth
+  // regularizers (e.g. TV) towards, in (0, 2]. The default of 1 minimizes the
+  // 1-norm of the regularization values, values below 1 favor sparser
+  // differences (sharper edges), and 2 keeps all weights at 1.
+  double regularization_norm = 1.0;
+
+  // The number of resolution levels for a coarse-to-fine solve. If this is
+  // greater than 1, the problem is first solved at half the HR resolution
+  // (recursively with the remaining levels), with a correspondingly downscaled
+  // image model, and that result is upsampled as the initial estimate for the
+  // full resolution. Coarse levels resolve most of the low-frequency error at
+  // a fraction of the cost. Every level halves the downsampling scale, so
+  // levels that the scale does not support are skipped.
+  int num_multiscale_levels = 1;
+
+  // If this is set to true, the image model operators of the data term are
+  // applied in single precision (see ObjectiveDataTerm::SetMixedPrecision()),
+  // while the solvers keep double-precision vectors and reductions. Once the
+  // IRLS loop would stop, its final iteration is repeated in full double
+  // precision from the mixed-precision result to recover the accuracy. This
+  // has no effect with the normal-equation data term.
+  bool use_mixed_precision = false;
+
+  // If this is set to true, the motion of every frame (except the first) is
+  // re-estimated against the current HR estimate between IRLS iterations (see
+  // motion_refinement.h), and the following iterations use the refined motion.
+  // This alternates between solving for the image and for the motion, which
+  // corrects errors of the LR registration. It requires an image model with a
+  // motion operator and a regularizer that is reweighted (otherwise there is
+  // only one iteration). The motion is not checkpointed. It cannot be combined
+  // with split_channels, since the motion must be shared by all channels.
+  bool refine_motion = false;
+
+  // If this is not empty, the IRLS state of the full resolution solve (the
+  // estimate, IRLS weights and iteration counters) is checkpointed to this
+  // file every checkpoint_interval IRLS iterations and whenever a channel
+  // subset is done. Checkpoints are written on a background thread, so the
+  // solver only waits for a copy of the state. See irls_checkpoint.h.
+  std::string checkpoint_path;
+  int checkpoint_interval = 1;
+
+  // If this is set to true and the checkpoint file exists, the solve
+  // continues from the checkpointed state instead of the initial estimate.
+  // The checkpoint must have been saved for the same problem size, channel
+  // splitting, regularizers, regularization norm, observations and motion. If
+  // the iteration options or regularization parameters changed, completed
+  // channel subsets are solved further with the new options.
+  bool resume_from_checkpoint = false;
 };
 
 class IRLSMapSolver : public MapSolver {
@@ -48,6 +103,12 @@ class IRLSMapSolver : public MapSolver {
   virtual ImageData Solve(const ImageData& initial_estimate);
 
  private:
+  // Solves the problem at half the HR resolution with the remaining multiscale
+  // levels, and returns the result upsampled to the HR size. Returns the given
+  // initial estimate instead if the image model or any regularizer cannot be
+  // downscaled.
+  ImageData SolveCoarserLevels(const ImageData& initial_estimate);
+
   // Passed in through the constructor.
   const IRLSMapSolverOptions solver_options_;
 };
@@ -0,0 +1,213 @@
+#include "optimization/laplacian_regularizer.h"
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "opencv2/core/core.hpp"
+
+#include "glog/logging.h"
+
+namespace super_resolution {
+namespace {
+
+// Computes the Laplacian of one image channel into the given output channel.
+// Both arrays hold one value per pixel of the given image size.
+void ComputeChannelLaplacian(
+    const double* channel_data, const cv::Size& image_size, double* output) {
+
+  const int width = image_size.width;
+  const int height = image_size.height;
+  for (int row = 0; row < height; ++row) {
+    const double* pixels = channel_data + row * width;
+    double* row_output = output + row * width;
+    for (int col = 0; col < width; ++col) {
+      row_output[col] = 0.0;
+    }
+    // Horizontal neighbors.
+    for (int col = 0; col < width - 1; ++col) {
+      const double difference = pixels[col + 1] - pixels[col];
+      row_output[col] += difference;
+      row_output[col + 1] -= difference;
+    }
+    // Vertical neighbors.
+    if (row > 0) {
+      const double* above_pixels = pixels - width;
+      for (int col = 0; col < width; ++col) {
+        row_output[col] += above_pixels[col] - pixels[col];
+      }
+    }
+    if (row + 1 < height) {
+      const double* below_pixels = pixels + width;
+      for (int col = 0; col < width; ++col) {
+        row_output[col] += below_pixels[col] - pixels[col];
+      }
+    }
+  }
+}
+
+}  // namespace
+
+std::vector<double> LaplacianRegularizer::ApplyToImage(
+    const double* image_data, const int num_channels) const {
+
+  CHECK_NOTNULL(image_data);
+
+  const int num_pixels = image_size_.area();
+  std::vector<double> residuals(num_pixels * num_channels);
+  for (int channel = 0; channel < num_channels; ++channel) {
+    const int channel_index = channel * num_pixels;
+    ComputeChannelLaplacian(
+        image_data + channel_index, image_size_, &residuals[channel_index]);
+  }
+  return residuals;
+}
+
+std::pair<std::vector<double>, std::vector<double>>
+LaplacianRegularizer::ApplyToImageWithDifferentiation(
+    const double* image_data,
+    const std::vector<double>& gradient_constants,
+    const int num_channels) const {
+
+  const int num_parameters = image_size_.area() * num_channels;
+  std::vector<double> residuals(num_parameters);
+  std::vector<double> gradient(num_parameters, 0.0);
+  ComputeWeightedSquaredSumAndGradient(
+      image_data,
+      num_channels,
+      1.0,
+      gradient_constants,
+      residuals.data(),
+      gradient.data());
+  return std::make_pair(residuals, gradient);
+}
+
+double LaplacianRegularizer::ComputeWeightedSquaredSum(
+    const double* image_data,
+    const std::vector<double>& weights,
+    const int num_channels) const {
+
+  CHECK_NOTNULL(image_data);
+
+  const int num_pixels = image_size_.area();
+  CHECK_EQ(weights.size(), num_pixels * num_channels)
+      << "Number of weights does not match the number of pixels.";
+
+  std::vector<double> laplacian(num_pixels);
+  double weighted_sum = 0.0;
+  for (int channel = 0; channel < num_channels; ++channel) {
+    const int channel_index = channel * num_pixels;
+    ComputeChannelLaplacian(
+        image_data + channel_index, image_size_, laplacian.data());
+    for (int pixel_index = 0; pixel_index < num_pixels; ++pixel_index) {
+      const double value = laplacian[pixel_index];
+      weighted_sum += weights[channel_index + pixel_index] * value * value;
+    }
+  }
+  return weighted_sum;
+}
+
+double LaplacianRegularizer::ComputeWeightedSquaredSumAndGradient(
+    const double* image_data,
+    const int num_channels,
+    const double regularization_parameter,
+    const std::vector<double>& weights,
+    double* residuals,
+    double* gradient) const {
+
+  CHECK_NOTNULL(image_data);
+  CHECK_NOTNULL(gradient);
+
+  const int num_pixels = image_size_.area();
+  CHECK_EQ(weights.size(), num_pixels * num_channels)
+      << "Number of weights does not match the number of pixels.";
+
+  // Two channel-sized buffers: the Laplacian (overwritten in place with the
+  // scaled partials 2 * lambda * w * Lx) and L applied to those partials.
+  std::vector<double> laplacian(num_pixels);
+  std::vector<double> laplacian_of_partials(num_pixels);
+  double weighted_sum = 0.0;
+  for (int channel = 0; channel < num_channels; ++channel) {
+    const int channel_index = channel * num_pixels;
+    ComputeChannelLaplacian(
+        image_data + channel_index, image_size_, laplacian.data());
+    if (residuals != nullptr) {
+      std::copy(
+          laplacian.begin(), laplacian.end(), residuals + channel_index);
+    }
+    for (int pixel_index = 0; pixel_index < num_pixels; ++pixel_index) {
+      const double value = laplacian[pixel_index];
+      const double weight = weights[channel_index + pixel_index];
+      weighted_sum += weight * value * value;
+      laplacian[pixel_index] = 2 * regularization_parameter * weight * value;
+    }
+    // L is symmetric, so the gradient is L'(partials) = L(partials).
+    ComputeChannelLaplacian(
+        laplacian.data(), image_size_, laplacian_of_partials.data());
+    double* channel_gradient = gradient + channel_index;
+    for (int pixel_index = 0; pixel_index < num_pixels; ++pixel_index) {
+      channel_gradient[pixel_index] += laplacian_of_partials[pixel_index];
+    }
+  }
+  return regularization_parameter * weighted_sum;
+}
+
+void LaplacianRegularizer::AddToHessianDiagonal(
+    const int num_channels,
+    const double regularization_parameter,
+    const std::vector<double>& weights,
+    double* diagonal) const {
+
+  CHECK_NOTNULL(diagonal);
+
+  const int width = image_size_.width;
+  const int height = image_size_.height;
+  const int num_pixels = image_size_.area();
+  CHECK_EQ(weights.size(), num_pixels * num_channels)
+      << "Number of weights does not match the number of pixels.";
+
+  // The Hessian is exactly 2 * lambda * L'WL. Row p of L has -n_p on the
+  // diagonal (n_p being the number of neighbors of p) and 1 for each of the
+  // neighbors, so the diagonal at p is 2 * lambda * (w_p * n_p^2 + sum of the
+  // weights of its neighbors).
+  const double scale = 2 * regularization_parameter;
+  for (int channel = 0; channel < num_channels; ++channel) {
+    const double* channel_weights = weights.data() + channel * num_pixels;
+    double* channel_diagonal = diagonal + channel * num_pixels;
+    for (int row = 0; row < height; ++row) {
+      for (int col = 0; col < width; ++col) {
+        const int index = row * width + col;
+        int num_neighbors = 0;
+        double neighbor_weight_sum = 0.0;
+        if (col > 0) {
+          num_neighbors++;
+          neighbor_weight_sum += channel_weights[index - 1];
+        }
+        if (col + 1 < width) {
+          num_neighbors++;
+          neighbor_weight_sum += channel_weights[index + 1];
+        }
+        if (row > 0) {
+          num_neighbors++;
+          neighbor_weight_sum += channel_weights[index - width];
+        }
+        if (row + 1 < height) {
+          num_neighbors++;
+          neighbor_weight_sum += channel_weights[index + width];
+        }
+        channel_diagonal[index] += scale * (
+            channel_weights[index] * num_neighbors * num_neighbors +
+            neighbor_weight_sum);
+      }
+    }
+  }
+}
+
+std::shared_ptr<Regularizer> LaplacianRegularizer::CreateForImageSize(
+    const cv::Size& image_size) const {
+
+  return std::shared_ptr<Regularizer>(new LaplacianRegularizer(image_size));
+}
+
+}  // namespace super_resolution
@@ -0,0 +1,73 @@
+// A Tikhonov regularizer on the discrete Laplacian of each image channel. The
+// value at pixel p is
+//   (Lx)_p = sum_{n in N(p)} (x_n - x_p)
+// where N(p) are the 4-connected neighbors of p that lie inside the image.
+// This is the graph Laplacian with reflective (Neumann) borders, so L is
+// symmetric and the gradient of sum_p w_p (Lx)_p^2 is 2L(w * Lx).
+//
+// The squared Laplacian is a smooth quadratic penalty, so it is never
+// reweighted by the IRLS solver. Away from the image border L is the
+// convolution with the 5-point stencil, which is diagonalized by the Fourier
+// transform. That allows a closed-form solve for suitable image models (see
+// FourierMapSolver).
+
+#ifndef SRC_OPTIMIZATION_LAPLACIAN_REGULARIZER_H_
+#define SRC_OPTIMIZATION_LAPLACIAN_REGULARIZER_H_
+
+#include <utility>
+#include <vector>
+
+#include "optimization/regularizer.h"
+
+#include "opencv2/core/core.hpp"
+
+namespace super_resolution {
+
+class LaplacianRegularizer : public Regularizer {
+ public:
+  explicit LaplacianRegularizer(const cv::Size& image_size)
+      : Regularizer(image_size) {}
+
+  virtual std::vector<double> ApplyToImage(
+      const double* image_data, const int num_channels) const;
+
+  virtual std::pair<std::vector<double>, std::vector<double>>
+  ApplyToImageWithDifferentiation(
+      const double* image_data,
+      const std::vector<double>& gradient_constants,
+      const int num_channels) const;
+
+  virtual double ComputeWeightedSquaredSum(
+      const double* image_data,
+      const std::vector<double>& weights,
+      const int num_channels) const;
+
+  virtual double ComputeWeightedSquaredSumAndGradient(
+      const double* image_data,
+      const int num_channels,
+      const double regularization_parameter,
+      const std::vector<double>& weights,
+      double* residuals,
+      double* gradient) const;
+
+  virtual std::shared_ptr<Regularizer> CreateForImageSize(
+      const cv::Size& image_size) const;
+
+  virtual void AddToHessianDiagonal(
+      const int num_channels,
+      const double regularization_parameter,
+      const std::vector<double>& weights,
+      double* diagonal) const;
+
+  virtual bool IsSmooth() const {
+    return true;
+  }
+
+  virtual bool IsQuadratic() const {
+    return true;
+  }
+};
+
+}  // namespace super_resolution
+
+#endif  // SRC_OPTIMIZATION_LAPLACIAN_REGULARIZER_H_
@@ -0,0 +1,183 @@
+#include "optimization/linear_conjugate_gradient.h"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "optimization/objective_function.h"
+
+#include "glog/logging.h"
+
+namespace super_resolution {
+namespace {
+
+double DotProduct(const double* a, const double* b, const int size) {
+  double dot_product = 0.0;
+  for (int i = 0; i < size; ++i) {
+    dot_product += a[i] * b[i];
+  }
+  return dot_product;
+}
+
+}  // namespace
+
+LinearConjugateGradientSolver::LinearConjugateGradientSolver(const int size)
+    : size_(size),
+      residual_(size),
+      direction_(size),
+      operator_direction_(size),
+      deadline_(std::chrono::steady_clock::time_point::max()) {
+
+  CHECK_GT(size_, 0) << "The system must have at least one variable.";
+}
+
+void LinearConjugateGradientSolver::SetDiagonalPreconditioner(
+    const std::vector<double>& diagonal) {
+
+  if (diagonal.empty()) {
+    inverse_diagonal_.clear();
+    preconditioned_residual_.clear();
+    return;
+  }
+  CHECK_EQ(diagonal.size(), size_)
+      << "Preconditioner size does not match the system size.";
+  inverse_diagonal_.resize(size_);
+  for (int i = 0; i < size_; ++i) {
+    CHECK_GT(diagonal[i], 0.0) << "Preconditioner values must be positive.";
+    inverse_diagonal_[i] = 1.0 / diagonal[i];
+  }
+  preconditioned_residual_.resize(size_);
+}
+
+int LinearConjugateGradientSolver::Solve(
+    const LinearOperator& apply_operator,
+    const double* right_hand_side,
+    const int max_num_iterations,
+    const double residual_threshold,
+    double* solution) {
+
+  CHECK_NOTNULL(right_hand_side);
+  CHECK_NOTNULL(solution);
+
+  double* residual = residual_.data();
+  double* direction = direction_.data();
+  double* operator_direction = operator_direction_.data();
+
+  // Without a preconditioner, the preconditioned residual z = M^-1 r is the
+  // residual itself.
+  const bool is_preconditioned = !inverse_diagonal_.empty();
+  double* preconditioned_residual =
+      is_preconditioned ? preconditioned_residual_.data() : residual;
+  const auto precondition_residual = [&]() {
+    if (is_preconditioned) {
+      for (int i = 0; i < size_; ++i) {
+        preconditioned_residual[i] = inverse_diagonal_[i] * residual[i];
+      }
+    }
+  };
+
+  // r = b - Qx, and the first search direction is z.
+  apply_operator(solution, residual);
+  for (int i = 0; i < size_; ++i) {
+    residual[i] = right_hand_side[i] - residual[i];
+  }
+  precondition_residual();
+  std::copy(
+      preconditioned_residual, preconditioned_residual + size_, direction);
+
+  const double stopping_norm_squared = residual_threshold * residual_threshold;
+  double residual_norm_squared = DotProduct(residual, residual, size_);
+  double residual_dot_preconditioned =
+      DotProduct(residual, preconditioned_residual, size_);
+  int num_iterations = 0;
+  while (num_iterations < max_num_iterations &&
+         residual_norm_squared > stopping_norm_squared) {
+    if (std::chrono::steady_clock::now() >= deadline_) {
+      LOG(INFO) << "Deadline reached. Stopping linear conjugate gradient "
+                << "after " << num_iterations << " iterations.";
+      break;
+    }
+    apply_operator(direction, operator_direction);
+    const double curvature =
+        DotProduct(direction, operator_direction, size_);
+    if (curvature <= 0.0) {
+      break;  // Q is singular along the search direction.
+    }
+    const double step_size = residual_dot_preconditioned / curvature;
+    for (int i = 0; i < size_; ++i) {
+      solution[i] += step_size * direction[i];
+      residual[i] -= step_size * operator_direction[i];
+    }
+    precondition_residual();
+    const double previous_residual_dot_preconditioned =
+        residual_dot_preconditioned;
+    residual_norm_squared = DotProduct(residual, residual, size_);
+    residual_dot_preconditioned =
+        DotProduct(residual, preconditioned_residual, size_);
+    const double direction_scale =
+        residual_dot_preconditioned / previous_residual_dot_preconditioned;
+    for (int i = 0; i < size_; ++i) {
+      direction[i] =
+          preconditioned_residual[i] + direction_scale * direction[i];
+    }
+    num_iterations++;
+  }
+  return num_iterations;
+}
+
+double MinimizeQuadraticObjective(
+    const ObjectiveFunction& objective_function,
+    const int max_num_iterations,
+    const double gradient_norm_threshold,
+    const bool use_preconditioner,
+    LinearConjugateGradientSolver* solver,
+    double* parameters) {
+
+  CHECK_NOTNULL(solver);
+  CHECK_NOTNULL(parameters);
+
+  // For f(x) = x'Qx / 2 - b'x + c, grad f(x) = Qx - b, so b = -grad f(0) and
+  // Qv = grad f(v) - grad f(0). The residual b - Qx is the negative gradient.
+  const int num_parameters = objective_function.GetNumParameters();
+  CHECK_EQ(solver->GetSize(), num_parameters)
+      << "The solver size does not match the number of parameters.";
+  std::vector<double> constant_gradient(num_parameters);
+  const std::vector<double> zeros(num_parameters, 0.0);
+  objective_function.ComputeAllTerms(zeros.data(), constant_gradient.data());
+  std::vector<double> right_hand_side(num_parameters);
+  for (int i = 0; i < num_parameters; ++i) {
+    right_hand_side[i] = -constant_gradient[i];
+  }
+  const bool has_hessian_product = objective_function.HasHessianProduct();
+  const LinearOperator apply_hessian =
+      [&](const double* input, double* output) {
+        if (has_hessian_product) {
+          objective_function.ComputeHessianProduct(input, output);
+          return;
+        }
+        objective_function.ComputeAllTerms(input, output);
+        for (int i = 0; i < num_parameters; ++i) {
+          output[i] -= constant_gradient[i];
+        }
+      };
+
+  // In exact arithmetic CG converges in at most num_parameters iterations.
+  const int iteration_limit =
+      (max_num_iterations > 0) ? max_num_iterations : num_parameters;
+  solver->SetDeadline(objective_function.GetDeadline());
+  solver->SetDiagonalPreconditioner(
+      use_preconditioner ? objective_function.ComputeDiagonalPreconditioner()
+                         : std::vector<double>());
+  const int num_iterations = solver->Solve(
+      apply_hessian,
+      right_hand_side.data(),
+      iteration_limit,
+      gradient_norm_threshold,
+      parameters);
+  const double final_cost = objective_function.ComputeAllTerms(parameters);
+  LOG(INFO) << "Linear conjugate gradient finished after " << num_iterations
+            << " iterations with cost " << final_cost << ".";
+  return final_cost;
+}
+
+}  // namespace super_resolution
@@ -0,0 +1,94 @@
+// A matrix-free linear conjugate gradient solver for symmetric positive
+// (semi-)definite systems Qx = b, where Q is only available as a function that
+// applies it to a vector. Unlike the nonlinear solvers in alglib_objective.h,
+// this uses the exact step size of the quadratic and needs no line search, so
+// every iteration costs exactly one operator application.
+
+#ifndef SRC_OPTIMIZATION_LINEAR_CONJUGATE_GRADIENT_H_
+#define SRC_OPTIMIZATION_LINEAR_CONJUGATE_GRADIENT_H_
+
+#include <chrono>
+#include <functional>
+#include <vector>
+
+#include "optimization/objective_function.h"
+
+namespace super_resolution {
+
+// Applies the operator Q to the first argument and writes the result to the
+// second argument. Both arrays have the size of the system.
+using LinearOperator = std::function<void(const double*, double*)>;
+
+class LinearConjugateGradientSolver {
+ public:
+  // All work vectors for a system of the given size are allocated here, so
+  // repeated solves (e.g. warm-started inner solves) do not allocate.
+  explicit LinearConjugateGradientSolver(const int size);
+
+  // Returns the number of variables of the system.
+  int GetSize() const {
+    return size_;
+  }
+
+  // Enables Jacobi preconditioning with the given diagonal of Q (or an
+  // approximation of it). All values must be positive. Pass an empty vector
+  // to disable preconditioning again.
+  void SetDiagonalPreconditioner(const std::vector<double>& diagonal);
+
+  // Solves stop early (keeping the current solution) once the given wall-clock
+  // deadline has passed. There is no deadline by default.
+  void SetDeadline(const std::chrono::steady_clock::time_point& deadline) {
+    deadline_ = deadline;
+  }
+
+  // Solves Qx = b starting from the given solution (warm start), which is
+  // updated in place. Both arrays must have the size of the system. Stops
+  // after max_num_iterations, or once the residual norm ||b - Qx|| drops
+  // below residual_threshold. Returns the number of iterations that were run.
+  int Solve(
+      const LinearOperator& apply_operator,
+      const double* right_hand_side,
+      const int max_num_iterations,
+      const double residual_threshold,
+      double* solution);
+
+ private:
+  const int size_;
+  std::vector<double> residual_;
+  std::vector<double> preconditioned_residual_;
+  std::vector<double> direction_;
+  std::vector<double> operator_direction_;
+
+  // The inverse of the preconditioner diagonal. Empty if not preconditioned.
+  std::vector<double> inverse_diagonal_;
+
+  // Set with SetDeadline().
+  std::chrono::steady_clock::time_point deadline_;
+};
+
+// Minimizes the given objective function, which must be quadratic in the
+// parameters (e.g. the data term with quadratic regularizers), with the given
+// linear conjugate gradient solver, which must have the size of the objective.
+// The solver (and its work vectors) can be reused for every solve of the same
+// size. The objective's Hessian is applied with
+// ObjectiveFunction::ComputeHessianProduct() if all of its terms support it,
+// and otherwise as the gradient difference grad f(v) - grad f(0), which costs
+// one objective evaluation. The given parameters hold the initial estimate and
+// are replaced by the solution. Stops after max_num_iterations (0 for no
+// limit) or once the gradient norm drops below gradient_norm_threshold. If
+// use_preconditioner is true, the objective's diagonal preconditioner (see
+// ObjectiveFunction::ComputeDiagonalPreconditioner()) is applied. The solver
+// also stops at the objective's deadline (see ObjectiveFunction::SetDeadline).
+//
+// Returns the final objective cost value.
+double MinimizeQuadraticObjective(
+    const ObjectiveFunction& objective_function,
+    const int max_num_iterations,
+    const double gradient_norm_threshold,
+    const bool use_preconditioner,
+    LinearConjugateGradientSolver* solver,
+    double* parameters);
+
+}  // namespace super_resolution
+
+#endif  // SRC_OPTIMIZATION_LINEAR_CONJUGATE_GRADIENT_H_
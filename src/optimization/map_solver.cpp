@@ -1,5 +1,6 @@
 #include "optimization/map_solver.h"
 
+#include <chrono>
 #include <iostream>
 #include <limits>
 #include <memory>
@@ -38,9 +39,23 @@ void MapSolverOptions::PrintSolverOptions() const {
   } else {
     std::cout << " (analytical differentiation)" << std::endl;
   }
+  if (use_normal_equation_data_term) {
+    std::cout << "  Normal-equation data term enabled." << std::endl;
+  }
+  if (use_diagonal_preconditioner) {
+    std::cout << "  Diagonal preconditioner enabled." << std::endl;
+  }
+  if (use_fourier_solver_if_possible) {
+    std::cout << "  Closed-form Fourier solver enabled if applicable."
+              << std::endl;
+  }
   if (split_channels) {
     std::cout << "  Channel splitting enabled." << std::endl;
   }
+  if (time_limit_seconds > 0.0) {
+    std::cout << "  Time limit (seconds):                "
+              << time_limit_seconds << std::endl;
+  }
   std::cout << "  Threshold 1 (gradient norm):         "
             << gradient_norm_threshold << std::endl;
   std::cout << "  Threshold 2 (cost decrease):         "
@@ -49,6 +64,40 @@ void MapSolverOptions::PrintSolverOptions() const {
             << parameter_variation_threshold << std::endl;
 }
 
+std::string MapSolverOptions::GetIterativeOnlyOption() const {
+  if (time_limit_seconds > 0.0) {
+    return "time_limit_seconds";
+  }
+  if (split_channels) {
+    return "split_channels";
+  }
+  return "";
+}
+
+std::chrono::steady_clock::time_point MapSolverOptions::GetDeadline() const {
+  if (time_limit_seconds <= 0.0) {
+    return std::chrono::steady_clock::time_point::max();
+  }
+  return std::chrono::steady_clock::now() +
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(time_limit_seconds));
+}
+
+std::chrono::steady_clock::time_point GetPartialDeadline(
+    const std::chrono::steady_clock::time_point& deadline,
+    const double fraction) {
+
+  const std::chrono::steady_clock::time_point now =
+      std::chrono::steady_clock::now();
+  if (deadline == std::chrono::steady_clock::time_point::max() ||
+      deadline <= now) {
+    return deadline;
+  }
+  const std::chrono::duration<double> remaining_time = deadline - now;
+  return now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      fraction * remaining_time);
+}
+
 MapSolver::MapSolver(
     const ImageModel& image_model,
     const std::vector<ImageData>& low_res_images,
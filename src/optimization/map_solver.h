@@ -6,12 +6,15 @@
 #ifndef SRC_OPTIMIZATION_MAP_SOLVER_H_
 #define SRC_OPTIMIZATION_MAP_SOLVER_H_
 
+#include <chrono>
 #include <memory>
+#include <string>
 #include <utility>
 #include <vector>
 
 #include "image/image_data.h"
 #include "image_model/image_model.h"
+#include "optimization/objective_function.h"
 #include "optimization/regularizer.h"
 #include "optimization/solver.h"
 
@@ -41,6 +44,12 @@ struct MapSolverOptions {
   // Neatly prints out all options used for the user.
   virtual void PrintSolverOptions() const;
 
+  // Returns the name of an option that is set and that only the iterative
+  // solve supports (e.g. the time limit), or an empty string if there is none.
+  // The closed-form solver (see FourierMapSolver) is only used if this is
+  // empty, since it would silently ignore such options.
+  virtual std::string GetIterativeOnlyOption() const;
+
   // Which solver to use.
   LeastSquaresSolver least_squares_solver = CG_SOLVER;
 
@@ -68,6 +77,34 @@ struct MapSolverOptions {
   bool use_numerical_differentiation = false;
   double numerical_differentiation_step = 1.0e-6;
 
+  // If this is set to true, the data term is evaluated in normal-equation
+  // form with the constant A'y terms precomputed once per solve. For purely
+  // translational image models, the A'A operator of all observations is also
+  // fused into a single pass, making the evaluation cost independent of the
+  // number of observations. See ObjectiveNormalEquationDataTerm.
+  bool use_normal_equation_data_term = false;
+
+  // If this is set to true and the objective is quadratic with a
+  // shift-invariant normal-equation operator (only Laplacian regularizers and
+  // uniform translational coverage), the solver returns the closed-form FFT
+  // solution instead of iterating, unless an option that only the iterative
+  // solve supports is set (see GetIterativeOnlyOption()). See
+  // FourierMapSolver.
+  bool use_fourier_solver_if_possible = true;
+
+  // If this is set to true, the iterative solvers are preconditioned with an
+  // approximation of the diagonal of the objective's Hessian, built from the
+  // per-pixel observation coverage and the regularization weights. This
+  // mostly speeds up convergence of pixels that few observations cover. See
+  // ObjectiveFunction::ComputeDiagonalPreconditioner().
+  bool use_diagonal_preconditioner = true;
+
+  // The number of recent objective evaluations that are cached to avoid
+  // recomputing the objective at previously visited points. Each cached
+  // evaluation stores two copies of the parameter vector, so set this to 0 to
+  // save memory on very large problems.
+  int num_cached_objective_evaluations = kDefaultObjectiveCacheCapacity;
+
   // If this is set to true, channels in the the given image will be solved
   // independently. This split will occur after any other dimension reductions
   // have been applied (such as PCA or color space interpolation).
@@ -76,8 +113,28 @@ struct MapSolverOptions {
   // option will prevent it from seeing multiple channels. Not recommended for
   // 3D regularizers.
   bool split_channels = false;
+
+  // If this is positive, the solve stops once this many seconds of wall time
+  // have passed, and returns the best estimate found so far. The iterative
+  // solvers check the time between iterations, so the limit may be exceeded
+  // by up to the duration of one iteration. Solvers that run in rounds (e.g.
+  // IRLS) split the time between the rounds based on the measured cost of
+  // the iterations.
+  double time_limit_seconds = 0.0;
+
+  // Returns the deadline for a solve that starts now, which is
+  // time_point::max() if there is no time limit.
+  std::chrono::steady_clock::time_point GetDeadline() const;
 };
 
+// Returns the time point after the given fraction of the time remaining until
+// the deadline, for splitting a time limit between the stages of a solve.
+// Returns the deadline itself if there is no time limit (the deadline is
+// time_point::max()) or if it has already passed.
+std::chrono::steady_clock::time_point GetPartialDeadline(
+    const std::chrono::steady_clock::time_point& deadline,
+    const double fraction);
+
 class MapSolver : public Solver {
  public:
   // Constructor is the same as Solver constructor but also takes the
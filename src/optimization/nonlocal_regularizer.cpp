@@ -0,0 +1,484 @@
+#include "optimization/nonlocal_regularizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "util/util.h"
+
+#include "opencv2/core/core.hpp"
+
+#include "glog/logging.h"
+
+namespace super_resolution {
+namespace {
+
+// The neighbor graph is built in bands of this many image rows, which are
+// processed in parallel. Each band only needs integral images of its own rows
+// (plus the patch radius above and below).
+constexpr int kRowsPerBand = 32;
+
+// Computes the integral image of the given values (num_rows x width) into
+// integral, which must hold (num_rows + 1) x (width + 1) values with a zero
+// first row and column.
+void ComputeIntegralImage(
+    const double* values,
+    const int num_rows,
+    const int width,
+    double* integral) {
+
+  const int integral_width = width + 1;
+  std::fill(integral, integral + integral_width, 0.0);
+  for (int row = 0; row < num_rows; ++row) {
+    const double* row_values = values + row * width;
+    double* integral_row = integral + (row + 1) * integral_width;
+    const double* integral_above = integral_row - integral_width;
+    integral_row[0] = 0.0;
+    double row_sum = 0.0;
+    for (int col = 0; col < width; ++col) {
+      row_sum += row_values[col];
+      integral_row[col + 1] = integral_above[col + 1] + row_sum;
+    }
+  }
+}
+
+// Returns the sum of the values in rows [row_start, row_end) and columns
+// [col_start, col_end) from their integral image.
+inline double GetBoxSum(
+    const double* integral,
+    const int width,
+    const int row_start,
+    const int row_end,
+    const int col_start,
+    const int col_end) {
+
+  const int integral_width = width + 1;
+  const double* top = integral + row_start * integral_width;
+  const double* bottom = integral + row_end * integral_width;
+  return bottom[col_end] - bottom[col_start] - top[col_end] + top[col_start];
+}
+
+}  // namespace
+
+NonLocalRegularizer::NonLocalRegularizer(
+    const cv::Size& image_size,
+    const int search_radius,
+    const int patch_radius,
+    const int num_neighbors,
+    const double filtering_parameter)
+    : Regularizer(image_size),
+      search_radius_(search_radius),
+      patch_radius_(patch_radius),
+      num_neighbors_(num_neighbors),
+      filtering_parameter_(filtering_parameter) {
+
+  CHECK_GE(search_radius_, 1) << "The search radius must be at least 1.";
+  CHECK_GE(patch_radius_, 0) << "The patch radius cannot be negative.";
+  CHECK_GE(num_neighbors_, 1) << "At least one neighbor is required.";
+  CHECK_GT(filtering_parameter_, 0.0)
+      << "The filtering parameter must be positive.";
+}
+
+void NonLocalRegularizer::UpdateFromEstimate(
+    const double* image_data, const int num_channels) {
+
+  CHECK_NOTNULL(image_data);
+  CHECK_GT(num_channels, 0);
+
+  const int num_pixels = image_size_.area();
+  neighbor_indices_.resize(num_pixels * num_neighbors_);
+  neighbor_weights_.resize(num_pixels * num_neighbors_);
+  scratch_values_.resize(num_pixels * num_channels);
+
+  const int height = image_size_.height;
+  const int num_bands = (height + kRowsPerBand - 1) / kRowsPerBand;
+  util::ParallelFor(num_bands, [&](const int band) {
+    const int row_start = band * kRowsPerBand;
+    const int row_end = std::min(row_start + kRowsPerBand, height);
+    BuildNeighborIndexForRows(image_data, num_channels, row_start, row_end);
+  });
+}
+
+void NonLocalRegularizer::BuildNeighborIndexForRows(
+    const double* image_data,
+    const int num_channels,
+    const int row_start,
+    const int row_end) {
+
+  const int width = image_size_.width;
+  const int height = image_size_.height;
+  const int num_pixels = image_size_.area();
+
+  // The patches of the band's pixels cover these rows.
+  const int halo_start = std::max(row_start - patch_radius_, 0);
+  const int halo_end = std::min(row_end + patch_radius_, height);
+  const int num_halo_rows = halo_end - halo_start;
+
+  // For the current search offset d: the squared pixel differences
+  // sum_c (x(p) - x(p + d))^2 and whether p + d is inside the image, along
+  // with their integral images.
+  std::vector<double> squared_differences(num_halo_rows * width);
+  std::vector<double> valid_pixels(num_halo_rows * width);
+  std::vector<double> squared_difference_integral(
+      (num_halo_rows + 1) * (width + 1));
+  std::vector<double> valid_pixel_integral((num_halo_rows + 1) * (width + 1));
+
+  // The best neighbors of each pixel in the band so far, sorted by increasing
+  // patch distance.
+  const int num_band_pixels = (row_end - row_start) * width;
+  std::vector<double> best_distances(
+      num_band_pixels * num_neighbors_,
+      std::numeric_limits<double>::infinity());
+  int* band_neighbor_indices =
+      neighbor_indices_.data() + row_start * width * num_neighbors_;
+  for (int i = 0; i < num_band_pixels; ++i) {
+    std::fill(
+        band_neighbor_indices + i * num_neighbors_,
+        band_neighbor_indices + (i + 1) * num_neighbors_,
+        row_start * width + i);
+  }
+
+  for (int row_shift = -search_radius_; row_shift <= search_radius_;
+       ++row_shift) {
+    for (int col_shift = -search_radius_; col_shift <= search_radius_;
+         ++col_shift) {
+      if (row_shift == 0 && col_shift == 0) {
+        continue;
+      }
+
+      // Columns for which the shifted pixel is inside the image.
+      const int col_start = std::max(0, -col_shift);
+      const int col_end = std::min(width, width - col_shift);
+      std::fill(squared_differences.begin(), squared_differences.end(), 0.0);
+      std::fill(valid_pixels.begin(), valid_pixels.end(), 0.0);
+      for (int row = halo_start; row < halo_end; ++row) {
+        const int shifted_row = row + row_shift;
+        if (shifted_row < 0 || shifted_row >= height) {
+          continue;
+        }
+        double* row_differences =
+            squared_differences.data() + (row - halo_start) * width;
+        double* row_valid = valid_pixels.data() + (row - halo_start) * width;
+        for (int channel = 0; channel < num_channels; ++channel) {
+          const double* pixels =
+              image_data + channel * num_pixels + row * width;
+          const double* shifted_pixels =
+              image_data + channel * num_pixels + shifted_row * width +
+              col_shift;
+          for (int col = col_start; col < col_end; ++col) {
+            const double difference = pixels[col] - shifted_pixels[col];
+            row_differences[col] += difference * difference;
+          }
+        }
+        std::fill(row_valid + col_start, row_valid + col_end, 1.0);
+      }
+      ComputeIntegralImage(
+          squared_differences.data(),
+          num_halo_rows,
+          width,
+          squared_difference_integral.data());
+      ComputeIntegralImage(
+          valid_pixels.data(),
+          num_halo_rows,
+          width,
+          valid_pixel_integral.data());
+
+      // The patch distance is the mean squared difference over the part of
+      // the patch pair that is inside the image.
+      const int shift_offset = row_shift * width + col_shift;
+      for (int row = row_start; row < row_end; ++row) {
+        const int shifted_row = row + row_shift;
+        if (shifted_row < 0 || shifted_row >= height) {
+          continue;
+        }
+        const int patch_row_start =
+            std::max(row - patch_radius_, halo_start) - halo_start;
+        const int patch_row_end =
+            std::min(row + patch_radius_ + 1, halo_end) - halo_start;
+        for (int col = col_start; col < col_end; ++col) {
+          const int patch_col_start = std::max(col - patch_radius_, 0);
+          const int patch_col_end = std::min(col + patch_radius_ + 1, width);
+          const double distance = GetBoxSum(
+              squared_difference_integral.data(),
+              width,
+              patch_row_start,
+              patch_row_end,
+              patch_col_start,
+              patch_col_end) / GetBoxSum(
+              valid_pixel_integral.data(),
+              width,
+              patch_row_start,
+              patch_row_end,
+              patch_col_start,
+              patch_col_end);
+
+          // Insert into the sorted list of the best neighbors.
+          const int band_pixel_index = (row - row_start) * width + col;
+          double* distances =
+              best_distances.data() + band_pixel_index * num_neighbors_;
+          int* indices =
+              band_neighbor_indices + band_pixel_index * num_neighbors_;
+          int slot = num_neighbors_ - 1;
+          if (distance >= distances[slot]) {
+            continue;
+          }
+          while (slot > 0 && distances[slot - 1] > distance) {
+            distances[slot] = distances[slot - 1];
+            indices[slot] = indices[slot - 1];
+            --slot;
+          }
+          distances[slot] = distance;
+          indices[slot] = row * width + col + shift_offset;
+        }
+      }
+    }
+  }
+
+  // Normalized weights exp(-d / h^2). The smallest distance is subtracted
+  // before exponentiating (which cancels out in the normalization) so that
+  // the weights cannot all underflow to 0.
+  const double weight_scale =
+      1.0 / (filtering_parameter_ * filtering_parameter_);
+  double* band_neighbor_weights =
+      neighbor_weights_.data() + row_start * width * num_neighbors_;
+  for (int i = 0; i < num_band_pixels; ++i) {
+    const double* distances = best_distances.data() + i * num_neighbors_;
+    double* weights = band_neighbor_weights + i * num_neighbors_;
+    double weight_sum = 0.0;
+    for (int k = 0; k < num_neighbors_; ++k) {
+      weights[k] = std::isinf(distances[k]) ?
+          0.0 : std::exp((distances[0] - distances[k]) * weight_scale);
+      weight_sum += weights[k];
+    }
+    if (weight_sum > 0.0) {
+      for (int k = 0; k < num_neighbors_; ++k) {
+        weights[k] /= weight_sum;
+      }
+    }
+  }
+}
+
+double NonLocalRegularizer::EvaluateChannel(
+    const double* channel_data,
+    const double regularization_parameter,
+    const double* weights,
+    double* values,
+    double* gradient) const {
+
+  const int num_pixels = image_size_.area();
+  const int* neighbor_indices = neighbor_indices_.data();
+  const double* neighbor_weights = neighbor_weights_.data();
+
+  double weighted_sum = 0.0;
+  for (int pixel_index = 0; pixel_index < num_pixels; ++pixel_index) {
+    const double pixel_value = channel_data[pixel_index];
+    const int* indices = neighbor_indices + pixel_index * num_neighbors_;
+    const double* neighbor_weights_at_pixel =
+        neighbor_weights + pixel_index * num_neighbors_;
+    double value = 0.0;
+    for (int k = 0; k < num_neighbors_; ++k) {
+      value += neighbor_weights_at_pixel[k] *
+          std::abs(pixel_value - channel_data[indices[k]]);
+    }
+    values[pixel_index] = value;
+    if (weights != nullptr) {
+      weighted_sum += weights[pixel_index] * value * value;
+    }
+  }
+  if (gradient == nullptr) {
+    return weighted_sum;
+  }
+
+  // The neighbors are scattered over the image, so each edge adds its partial
+  // derivative to both of its pixels.
+  for (int pixel_index = 0; pixel_index < num_pixels; ++pixel_index) {
+    const double pixel_value = channel_data[pixel_index];
+    const int* indices = neighbor_indices + pixel_index * num_neighbors_;
+    const double* neighbor_weights_at_pixel =
+        neighbor_weights + pixel_index * num_neighbors_;
+    const double partial_scale = 2 * regularization_parameter *
+        weights[pixel_index] * values[pixel_index];
+    for (int k = 0; k < num_neighbors_; ++k) {
+      const double partial = partial_scale * neighbor_weights_at_pixel[k] *
+          util::GetSign(pixel_value - channel_data[indices[k]]);
+      gradient[pixel_index] += partial;
+      gradient[indices[k]] -= partial;
+    }
+  }
+  return weighted_sum;
+}
+
+double* NonLocalRegularizer::GetScratchValues(const int num_channels) const {
+  const int num_values = image_size_.area() * num_channels;
+  if (scratch_values_.size() < static_cast<size_t>(num_values)) {
+    scratch_values_.resize(num_values);
+  }
+  return scratch_values_.data();
+}
+
+std::vector<double> NonLocalRegularizer::ApplyToImage(
+    const double* image_data, const int num_channels) const {
+
+  CHECK_NOTNULL(image_data);
+
+  const int num_pixels = image_size_.area();
+  CHECK_EQ(neighbor_indices_.size(), num_pixels * num_neighbors_)
+      << "UpdateFromEstimate() must be called before evaluation.";
+
+  std::vector<double> residuals(num_pixels * num_channels);
+  util::ParallelFor(num_channels, [&](const int channel) {
+    const int channel_index = channel * num_pixels;
+    EvaluateChannel(
+        image_data + channel_index,
+        1.0,
+        nullptr,
+        residuals.data() + channel_index,
+        nullptr);
+  });
+  return residuals;
+}
+
+std::pair<std::vector<double>, std::vector<double>>
+NonLocalRegularizer::ApplyToImageWithDifferentiation(
+    const double* image_data,
+    const std::vector<double>& gradient_constants,
+    const int num_channels) const {
+
+  const int num_parameters = image_size_.area() * num_channels;
+  std::vector<double> residuals(num_parameters);
+  std::vector<double> gradient(num_parameters, 0.0);
+  ComputeWeightedSquaredSumAndGradient(
+      image_data,
+      num_channels,
+      1.0,
+      gradient_constants,
+      residuals.data(),
+      gradient.data());
+  return std::make_pair(residuals, gradient);
+}
+
+double NonLocalRegularizer::ComputeWeightedSquaredSum(
+    const double* image_data,
+    const std::vector<double>& weights,
+    const int num_channels) const {
+
+  CHECK_NOTNULL(image_data);
+
+  const int num_pixels = image_size_.area();
+  CHECK_EQ(neighbor_indices_.size(), num_pixels * num_neighbors_)
+      << "UpdateFromEstimate() must be called before evaluation.";
+  CHECK_EQ(weights.size(), num_pixels * num_channels)
+      << "Number of weights does not match the number of pixels.";
+
+  // Sums are kept per channel and added in order so that the result does not
+  // depend on the parallel execution order.
+  double* values = GetScratchValues(num_channels);
+  std::vector<double> channel_sums(num_channels, 0.0);
+  util::ParallelFor(num_channels, [&](const int channel) {
+    const int channel_index = channel * num_pixels;
+    channel_sums[channel] = EvaluateChannel(
+        image_data + channel_index,
+        1.0,
+        weights.data() + channel_index,
+        values + channel_index,
+        nullptr);
+  });
+
+  double weighted_sum = 0.0;
+  for (const double channel_sum : channel_sums) {
+    weighted_sum += channel_sum;
+  }
+  return weighted_sum;
+}
+
+double NonLocalRegularizer::ComputeWeightedSquaredSumAndGradient(
+    const double* image_data,
+    const int num_channels,
+    const double regularization_parameter,
+    const std::vector<double>& weights,
+    double* residuals,
+    double* gradient) const {
+
+  CHECK_NOTNULL(image_data);
+  CHECK_NOTNULL(gradient);
+
+  const int num_pixels = image_size_.area();
+  CHECK_EQ(neighbor_indices_.size(), num_pixels * num_neighbors_)
+      << "UpdateFromEstimate() must be called before evaluation.";
+  CHECK_EQ(weights.size(), num_pixels * num_channels)
+      << "Number of weights does not match the number of pixels.";
+
+  // Each channel only writes to its own part of the gradient.
+  double* values =
+      (residuals != nullptr) ? residuals : GetScratchValues(num_channels);
+  std::vector<double> channel_sums(num_channels, 0.0);
+  util::ParallelFor(num_channels, [&](const int channel) {
+    const int channel_index = channel * num_pixels;
+    channel_sums[channel] = EvaluateChannel(
+        image_data + channel_index,
+        regularization_parameter,
+        weights.data() + channel_index,
+        values + channel_index,
+        gradient + channel_index);
+  });
+
+  double weighted_sum = 0.0;
+  for (const double channel_sum : channel_sums) {
+    weighted_sum += channel_sum;
+  }
+  return regularization_parameter * weighted_sum;
+}
+
+void NonLocalRegularizer::AddToHessianDiagonal(
+    const int num_channels,
+    const double regularization_parameter,
+    const std::vector<double>& weights,
+    double* diagonal) const {
+
+  CHECK_NOTNULL(diagonal);
+
+  const int num_pixels = image_size_.area();
+  CHECK_EQ(neighbor_indices_.size(), num_pixels * num_neighbors_)
+      << "UpdateFromEstimate() must be called before evaluation.";
+  CHECK_EQ(weights.size(), num_pixels * num_channels)
+      << "Number of weights does not match the number of pixels.";
+
+  // As for shifted differences (see Regularizer::AddToHessianDiagonal()), each
+  // edge w_pq * |x(p) - x(q)| adds 2 * lambda * weight_p * w_pq^2 to both p
+  // and q.
+  for (int channel = 0; channel < num_channels; ++channel) {
+    const double* channel_weights = weights.data() + channel * num_pixels;
+    double* channel_diagonal = diagonal + channel * num_pixels;
+    for (int pixel_index = 0; pixel_index < num_pixels; ++pixel_index) {
+      const int* indices =
+          neighbor_indices_.data() + pixel_index * num_neighbors_;
+      const double* neighbor_weights =
+          neighbor_weights_.data() + pixel_index * num_neighbors_;
+      const double scale =
+          2 * regularization_parameter * channel_weights[pixel_index];
+      for (int k = 0; k < num_neighbors_; ++k) {
+        const double value = scale * neighbor_weights[k] * neighbor_weights[k];
+        channel_diagonal[pixel_index] += value;
+        channel_diagonal[indices[k]] += value;
+      }
+    }
+  }
+}
+
+std::shared_ptr<Regularizer> NonLocalRegularizer::CreateForImageSize(
+    const cv::Size& image_size) const {
+
+  // The neighbor graph is not copied. It is rebuilt for the new size in
+  // UpdateFromEstimate().
+  return std::shared_ptr<Regularizer>(new NonLocalRegularizer(
+      image_size,
+      search_radius_,
+      patch_radius_,
+      num_neighbors_,
+      filtering_parameter_));
+}
+
+}  // namespace super_resolution
@@ -0,0 +1,134 @@
+// A non-local (patch-based) regularizer. Every pixel p is linked to the
+// num_neighbors pixels q within its search window whose surrounding patches
+// are most similar to the patch around p, and the value at p is
+//   sum_{q in N(p)} w_pq * |x(p) - x(q)|
+// with weights w_pq = exp(-d_pq / h^2) normalized to sum to 1 over N(p), where
+// d_pq is the mean squared difference between the two patches (over all
+// channels). This smooths along self-similar structures and preserves
+// repeated textures better than local (TV or BTV) priors.
+//
+// The neighbor graph depends on the image, so it is built from the current
+// estimate in UpdateFromEstimate(), which the IRLS solver calls once per
+// round. The graph is then reused for every evaluation within the round. Patch
+// distances are computed for one search offset at a time with integral images,
+// so building the graph costs O(num_pixels * search_window_size) regardless of
+// the patch size.
+//
+// Evaluations reuse a scratch buffer of the regularizer, so one instance must
+// not be evaluated from several threads at once. Concurrent solves use their
+// own copies (see CreateForImageSize()).
+
+#ifndef SRC_OPTIMIZATION_NONLOCAL_REGULARIZER_H_
+#define SRC_OPTIMIZATION_NONLOCAL_REGULARIZER_H_
+
+#include <utility>
+#include <vector>
+
+#include "optimization/regularizer.h"
+
+#include "opencv2/core/core.hpp"
+
+namespace super_resolution {
+
+class NonLocalRegularizer : public Regularizer {
+ public:
+  // The search window and patches are squares of (2 * radius + 1) pixels per
+  // side. The filtering parameter h controls how quickly the weights fall off
+  // with the patch distance.
+  NonLocalRegularizer(
+      const cv::Size& image_size,
+      const int search_radius,
+      const int patch_radius,
+      const int num_neighbors,
+      const double filtering_parameter);
+
+  // Rebuilds the neighbor graph from the given estimate. This must be called
+  // at least once before the regularizer is evaluated.
+  virtual void UpdateFromEstimate(
+      const double* image_data, const int num_channels);
+
+  virtual std::vector<double> ApplyToImage(
+      const double* image_data, const int num_channels) const;
+
+  virtual std::pair<std::vector<double>, std::vector<double>>
+  ApplyToImageWithDifferentiation(
+      const double* image_data,
+      const std::vector<double>& gradient_constants,
+      const int num_channels) const;
+
+  virtual double ComputeWeightedSquaredSum(
+      const double* image_data,
+      const std::vector<double>& weights,
+      const int num_channels) const;
+
+  virtual double ComputeWeightedSquaredSumAndGradient(
+      const double* image_data,
+      const int num_channels,
+      const double regularization_parameter,
+      const std::vector<double>& weights,
+      double* residuals,
+      double* gradient) const;
+
+  virtual std::shared_ptr<Regularizer> CreateForImageSize(
+      const cv::Size& image_size) const;
+
+  virtual void AddToHessianDiagonal(
+      const int num_channels,
+      const double regularization_parameter,
+      const std::vector<double>& weights,
+      double* diagonal) const;
+
+  // Returns the neighbors of every pixel, num_neighbors per pixel and stored
+  // at pixel_index * num_neighbors. Unused neighbor slots refer to the pixel
+  // itself with a weight of 0.
+  const std::vector<int>& GetNeighborIndices() const {
+    return neighbor_indices_;
+  }
+
+  // Returns the normalized weights w_pq, laid out as GetNeighborIndices().
+  const std::vector<double>& GetNeighborWeights() const {
+    return neighbor_weights_;
+  }
+
+ private:
+  // Builds the neighbor lists of all pixels in rows [row_start, row_end).
+  void BuildNeighborIndexForRows(
+      const double* image_data,
+      const int num_channels,
+      const int row_start,
+      const int row_end);
+
+  // Computes the values of one channel. If weights is not null, returns
+  // sum_p weights[p] * value_p^2 and, if gradient is not null, adds the
+  // gradient of regularization_parameter times that sum. All arrays hold one
+  // value per pixel of the channel.
+  double EvaluateChannel(
+      const double* channel_data,
+      const double regularization_parameter,
+      const double* weights,
+      double* values,
+      double* gradient) const;
+
+  // Returns the scratch buffer for the values of all channels, which is only
+  // reallocated if the number of channels grows. Must not be called from
+  // within a parallel loop.
+  double* GetScratchValues(const int num_channels) const;
+
+  const int search_radius_;
+  const int patch_radius_;
+  const int num_neighbors_;
+  const double filtering_parameter_;
+
+  // The neighbor graph (see GetNeighborIndices()). Empty until
+  // UpdateFromEstimate() is called.
+  std::vector<int> neighbor_indices_;
+  std::vector<double> neighbor_weights_;
+
+  // The values of each pixel for evaluations that do not return them. This is
+  // allocated with the neighbor graph, so evaluations do not allocate.
+  mutable std::vector<double> scratch_values_;
+};
+
+}  // namespace super_resolution
+
+#endif  // SRC_OPTIMIZATION_NONLOCAL_REGULARIZER_H_
@@ -1,5 +1,6 @@
 #include "optimization/objective_data_term.h"
 
+#include <type_traits>
 #include <vector>
 
 #include "image/image_data.h"
@@ -12,6 +13,9 @@
 namespace super_resolution {
 namespace {
 
+// Computes the term for one observation. PixelType is the type that the image
+// model operators are applied in: double, or float for mixed precision.
+template <typename PixelType>
 double ComputeTermForObservation(
     const ImageData& observation,
     const int image_index,
@@ -22,48 +26,56 @@ double ComputeTermForObservation(
     const double* estimated_image_data,
     double* gradient) {
 
-  // Degrade (and re-upsample) the HR estimate with the image model.
+  // Degrade the HR estimate with the image model.
   const int num_channels = channel_end - channel_start;
-  ImageData degraded_hr_image(estimated_image_data, image_size, num_channels);
-  image_model.ApplyToImage(&degraded_hr_image, image_index);
-  degraded_hr_image.ResizeImage(image_size, INTERPOLATE_NEAREST);
-
-  // Compute the individual residuals by comparing pixel values. Sum them up
-  // for the final residual sum.
+  const ImagePrecision precision = std::is_same<PixelType, float>::value ?
+      SINGLE_PRECISION : DOUBLE_PRECISION;
+  ImageData degraded_image(
+      estimated_image_data, image_size, num_channels, precision);
+  image_model.ApplyToImage(&degraded_image, image_index);
+
+  // The observations are stored as LR images upsampled to the HR size with
+  // nearest neighbor interpolation, so each LR pixel is repeated scale^2
+  // times. Comparing at the LR resolution against the top-left pixel of each
+  // block gives the same residual sum scaled by scale^2, without upsampling
+  // the degraded image or building a separate residual image. The residuals
+  // are written in place, also scaled by scale^2 (which is what additive
+  // downsampling of the upsampled residuals would produce for the gradient).
+  const int scale = image_model.GetDownsamplingScale();
+  const double scale_squared = scale * scale;
+  const cv::Size degraded_image_size = degraded_image.GetImageSize();
   double residual_sum = 0;
-  const int num_pixels = image_size.width * image_size.height;
-  const int num_data_points = num_pixels * num_channels;
-  std::vector<double> residuals;
-  residuals.reserve(num_data_points);
   for (int channel = 0; channel < num_channels; ++channel) {
-    const double* degraded_hr_channel_data =
-        degraded_hr_image.GetChannelData(channel);
+    PixelType* degraded_channel_data =
+        degraded_image.GetChannelImage(channel).ptr<PixelType>();
     const double* observation_channel_data =
         observation.GetChannelData(channel + channel_start);
-    for (int pixel_index = 0; pixel_index < num_pixels; ++pixel_index) {
-      const double residual =
-          degraded_hr_channel_data[pixel_index] -
-          observation_channel_data[pixel_index];
-      residuals.push_back(residual);
-      residual_sum += (residual * residual);
+    for (int row = 0; row < degraded_image_size.height; ++row) {
+      const double* observation_row_data =
+          observation_channel_data + (row * scale * image_size.width);
+      PixelType* degraded_row_data =
+          degraded_channel_data + (row * degraded_image_size.width);
+      for (int col = 0; col < degraded_image_size.width; ++col) {
+        const double residual =
+            degraded_row_data[col] - observation_row_data[col * scale];
+        residual_sum += (residual * residual);
+        degraded_row_data[col] = scale_squared * residual;
+      }
     }
   }
+  residual_sum *= scale_squared;
 
   // If gradient is not null, apply transpose operations to the residual image.
   // This is used to compute the gradient.
   if (gradient != nullptr) {
-    ImageData residual_image(residuals.data(), image_size, num_channels);
-    const int scale = image_model.GetDownsamplingScale();
-    residual_image.ResizeImage(
-        cv::Size(image_size.width / scale, image_size.height / scale),
-        INTERPOLATE_ADDITIVE);
-    image_model.ApplyTransposeToImage(&residual_image, image_index);
+    image_model.ApplyTransposeToImage(&degraded_image, image_index);
 
     // Add to the gradient.
+    const int num_pixels = image_size.width * image_size.height;
     for (int channel = 0; channel < num_channels; ++channel) {
       const int channel_index = channel * num_pixels;
-      const double* residual_channel_data =
-          residual_image.GetChannelData(channel);
+      const PixelType* residual_channel_data =
+          degraded_image.GetChannelImage(channel).ptr<PixelType>();
       for (int pixel_index = 0; pixel_index < num_pixels; ++pixel_index) {
         const int index = channel_index + pixel_index;
         gradient[index] += 2 * residual_channel_data[pixel_index];
@@ -86,7 +98,8 @@ ObjectiveDataTerm::ObjectiveDataTerm(
       observations_(observations),
       channel_start_(channel_start),
       channel_end_(channel_end),
-      image_size_(image_size) {
+      image_size_(image_size),
+      use_mixed_precision_(false) {
 
   CHECK_GT(observations.size(), 0) << "Cannot solve with 0 observations.";
   CHECK_GE(channel_start, 0) << "First channel in range is out of bounds.";
@@ -100,9 +113,11 @@ double ObjectiveDataTerm::Compute(
 
   CHECK_NOTNULL(estimated_image_data);
 
+  const auto compute_term_for_observation = use_mixed_precision_ ?
+      ComputeTermForObservation<float> : ComputeTermForObservation<double>;
   double residual_sum = 0.0;
   for (int image_index = 0; image_index < observations_.size(); ++image_index) {
-    residual_sum += ComputeTermForObservation(
+    residual_sum += compute_term_for_observation(
         observations_[image_index],
         image_index,
         image_model_,
@@ -115,4 +130,39 @@ double ObjectiveDataTerm::Compute(
   return residual_sum;
 }
 
+void ObjectiveDataTerm::AddToHessianDiagonal(double* diagonal) const {
+  CHECK_NOTNULL(diagonal);
+
+  // The image model has non-negative entries, so the row sums are H1.
+  const int num_channels = channel_end_ - channel_start_;
+  const int num_pixels = image_size_.width * image_size_.height;
+  const std::vector<double> ones(num_pixels * num_channels, 1.0);
+  AddHessianProduct(ones.data(), diagonal);
+}
+
+void ObjectiveDataTerm::AddHessianProduct(
+    const double* direction, double* product) const {
+
+  CHECK_NOTNULL(direction);
+  CHECK_NOTNULL(product);
+
+  const int num_channels = channel_end_ - channel_start_;
+  const int num_pixels = image_size_.width * image_size_.height;
+  const int scale = image_model_.GetDownsamplingScale();
+  const double scale_squared = scale * scale;
+  for (int image_index = 0; image_index < observations_.size(); ++image_index) {
+    ImageData degraded_direction(direction, image_size_, num_channels);
+    image_model_.ApplyToImage(&degraded_direction, image_index);
+    image_model_.ApplyTransposeToImage(&degraded_direction, image_index);
+    for (int channel = 0; channel < num_channels; ++channel) {
+      const int channel_index = channel * num_pixels;
+      const double* channel_data = degraded_direction.GetChannelData(channel);
+      for (int pixel_index = 0; pixel_index < num_pixels; ++pixel_index) {
+        product[channel_index + pixel_index] +=
+            2 * scale_squared * channel_data[pixel_index];
+      }
+    }
+  }
+}
+
 }  // namespace super_resolution
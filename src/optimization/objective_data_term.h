@@ -35,6 +35,29 @@ class ObjectiveDataTerm : public ObjectiveTerm {
   virtual double Compute(
       const double* estimated_image_data, double* gradient) const;
 
+  // The Hessian of this term is H = 2 * scale^2 * sum_k A_k'A_k. Because the
+  // image model has non-negative entries, the row sums H1 bound its diagonal
+  // and count (blur-weighted) how many LR observations sample each pixel.
+  // Adds H1, computed with one forward and transpose pass per observation.
+  virtual void AddToHessianDiagonal(double* diagonal) const;
+
+  // The term is quadratic, so the product Hv = 2 * scale^2 * sum_k A_k'A_kv
+  // is applied with one forward and transpose pass per observation, always
+  // in double precision.
+  virtual bool HasHessianProduct() const {
+    return true;
+  }
+
+  virtual void AddHessianProduct(
+      const double* direction, double* product) const;
+
+  // With mixed precision, the image model and its transpose are applied to
+  // single-precision copies of the estimate and residuals. The residual sum
+  // and gradient are still accumulated in double precision.
+  virtual void SetMixedPrecision(const bool use_mixed_precision) {
+    use_mixed_precision_ = use_mixed_precision;
+  }
+
  private:
   // The image model and observation information.
   const ImageModel& image_model_;
@@ -42,6 +65,9 @@ class ObjectiveDataTerm : public ObjectiveTerm {
   const int channel_start_;
   const int channel_end_;
   const cv::Size& image_size_;
+
+  // Set with SetMixedPrecision(). Disabled by default.
+  bool use_mixed_precision_;
 };
 
 }  // namespace super_resolution
@@ -1,10 +1,83 @@
 #include "optimization/objective_function.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "optimization/solver_telemetry.h"
+
+#include "glog/logging.h"
+
 namespace super_resolution {
+namespace {
+
+// Entries of the diagonal preconditioner are at least this fraction of the
+// largest entry. Parameters with (almost) no curvature, such as pixels that no
+// observation covers, would otherwise get arbitrarily large steps.
+constexpr double kMinRelativePreconditionerValue = 0.001;
+
+// Returns a fast 64-bit hash (FNV-1a over 64-bit words) of the given
+// parameter values.
+uint64_t HashParameters(const double* parameters, const int num_parameters) {
+  constexpr uint64_t kOffsetBasis = 14695981039346656037ULL;
+  constexpr uint64_t kPrime = 1099511628211ULL;
+  uint64_t hash = kOffsetBasis;
+  for (int i = 0; i < num_parameters; ++i) {
+    uint64_t bits;
+    std::memcpy(&bits, &parameters[i], sizeof(bits));
+    hash = (hash ^ bits) * kPrime;
+  }
+  return hash;
+}
+
+// Returns the Euclidean norm of the given values.
+double ComputeNorm(const double* values, const int num_values) {
+  double squared_sum = 0.0;
+  for (int i = 0; i < num_values; ++i) {
+    squared_sum += values[i] * values[i];
+  }
+  return std::sqrt(squared_sum);
+}
+
+}  // namespace
 
 double ObjectiveFunction::ComputeAllTerms(
     const double* estimated_image_data, double* gradient) const {
 
+  num_evaluations_++;
+
+  // Return the cached result if these parameters were recently evaluated. A
+  // cost-only evaluation cannot serve a request for the gradient.
+  uint64_t parameters_hash = 0;
+  if (cache_capacity_ > 0) {
+    parameters_hash = HashParameters(estimated_image_data, num_parameters_);
+    for (const CachedEvaluation& entry : cache_) {
+      if (entry.parameters_hash != parameters_hash ||
+          (gradient != nullptr && !entry.has_gradient) ||
+          !std::equal(
+              entry.parameters.begin(),
+              entry.parameters.end(),
+              estimated_image_data)) {
+        continue;
+      }
+      if (gradient != nullptr) {
+        std::copy(entry.gradient.begin(), entry.gradient.end(), gradient);
+      }
+      if (telemetry_ != nullptr) {
+        last_cost_ = entry.cost;
+        last_term_costs_ = entry.term_costs;
+        last_gradient_norm_ = entry.gradient_norm;
+      }
+      num_cache_hits_++;
+      return entry.cost;
+    }
+  }
+
   // Reset gradient to 0 (if applicable).
   if (gradient != nullptr) {
     for (int i = 0; i < num_parameters_; ++i) {
@@ -13,14 +86,148 @@ double ObjectiveFunction::ComputeAllTerms(
   }
 
   double residual_sum = 0.0;
-  for (const std::shared_ptr<ObjectiveTerm> term : terms_) {
-    residual_sum += term->Compute(estimated_image_data, gradient);
+  if (telemetry_ != nullptr) {
+    last_term_costs_.resize(terms_.size());
+  }
+  for (int i = 0; i < terms_.size(); ++i) {
+    const double term_cost = terms_[i]->Compute(estimated_image_data, gradient);
+    residual_sum += term_cost;
+    if (telemetry_ != nullptr) {
+      last_term_costs_[i] = term_cost;
+    }
+  }
+  if (telemetry_ != nullptr) {
+    last_cost_ = residual_sum;
+    last_gradient_norm_ = (gradient != nullptr) ?
+        ComputeNorm(gradient, num_parameters_) :
+        std::numeric_limits<double>::quiet_NaN();
+  }
+
+  // Store the result, reusing the buffers of the replaced entry.
+  if (cache_capacity_ > 0) {
+    if (cache_.size() < cache_capacity_) {
+      cache_.push_back(CachedEvaluation());
+      next_cache_entry_ = cache_.size() - 1;
+    }
+    CachedEvaluation& entry = cache_[next_cache_entry_];
+    entry.parameters_hash = parameters_hash;
+    entry.parameters.assign(
+        estimated_image_data, estimated_image_data + num_parameters_);
+    entry.cost = residual_sum;
+    entry.has_gradient = (gradient != nullptr);
+    if (entry.has_gradient) {
+      entry.gradient.assign(gradient, gradient + num_parameters_);
+    }
+    if (telemetry_ != nullptr) {
+      entry.term_costs = last_term_costs_;
+      entry.gradient_norm = last_gradient_norm_;
+    }
+    next_cache_entry_ = (next_cache_entry_ + 1) % cache_capacity_;
   }
+
   return residual_sum;
 }
 
-void ObjectiveFunction::ReportIterationComplete(const double residual_sum) {
+std::vector<double> ObjectiveFunction::ComputeDiagonalPreconditioner() const {
+  std::vector<double> diagonal(num_parameters_, 0.0);
+  for (const std::shared_ptr<ObjectiveTerm> term : terms_) {
+    term->AddToHessianDiagonal(diagonal.data());
+  }
+  const double max_value =
+      *std::max_element(diagonal.begin(), diagonal.end());
+  if (max_value <= 0.0) {
+    // No term estimates its curvature, so fall back to the identity.
+    std::fill(diagonal.begin(), diagonal.end(), 1.0);
+    return diagonal;
+  }
+  const double min_value = kMinRelativePreconditionerValue * max_value;
+  for (double& value : diagonal) {
+    value = std::max(value, min_value);
+  }
+  return diagonal;
+}
+
+bool ObjectiveFunction::HasHessianProduct() const {
+  return std::all_of(
+      terms_.begin(),
+      terms_.end(),
+      [](const std::shared_ptr<ObjectiveTerm>& term) {
+        return term->HasHessianProduct();
+      });
+}
+
+void ObjectiveFunction::ComputeHessianProduct(
+    const double* direction, double* product) const {
+
+  CHECK_NOTNULL(direction);
+  CHECK_NOTNULL(product);
+  CHECK(HasHessianProduct()) << "Not every term has a Hessian product.";
+
+  std::fill(product, product + num_parameters_, 0.0);
+  for (const std::shared_ptr<ObjectiveTerm>& term : terms_) {
+    term->AddHessianProduct(direction, product);
+  }
+}
+
+void ObjectiveFunction::SetCacheCapacity(const int cache_capacity) {
+  CHECK_GE(cache_capacity, 0) << "Cache capacity cannot be negative.";
+  cache_capacity_ = cache_capacity;
+  ClearCache();
+}
+
+void ObjectiveFunction::ClearCache() {
+  cache_.clear();
+  next_cache_entry_ = 0;
+}
+
+void ObjectiveFunction::SetMixedPrecision(const bool use_mixed_precision) {
+  for (const std::shared_ptr<ObjectiveTerm>& term : terms_) {
+    term->SetMixedPrecision(use_mixed_precision);
+  }
+  ClearCache();
+}
+
+void ObjectiveFunction::ReportIterationComplete(
+    const double* parameters, const double cost) {
+
   num_iterations_completed_++;
+  if (telemetry_ == nullptr) {
+    return;
+  }
+
+  SolverIterationRecord record;
+  record.stage = telemetry_stage_;
+  record.round = telemetry_round_;
+  record.iteration = num_iterations_completed_;
+  record.cost = cost;
+  record.num_evaluations = num_evaluations_;
+  if (last_cost_ == cost) {
+    record.gradient_norm = last_gradient_norm_;
+    record.term_costs = last_term_costs_;
+  }
+  if (!previous_parameters_.empty()) {
+    double squared_step_size = 0.0;
+    for (int i = 0; i < num_parameters_; ++i) {
+      const double change = parameters[i] - previous_parameters_[i];
+      squared_step_size += change * change;
+    }
+    record.step_size = std::sqrt(squared_step_size);
+  }
+  previous_parameters_.assign(parameters, parameters + num_parameters_);
+  telemetry_->RecordIteration(record);
+}
+
+void ObjectiveFunction::SetTelemetry(
+    std::shared_ptr<SolverTelemetry> telemetry,
+    const std::string& stage,
+    const int round) {
+
+  telemetry_ = telemetry;
+  telemetry_stage_ = stage;
+  telemetry_round_ = round;
+  previous_parameters_.clear();
+  // Cached entries do not have the term costs yet.
+  ClearCache();
 }
 
 }  // namespace super_resolution
@@ -7,9 +7,14 @@
 #ifndef SRC_OPTIMIZATION_OBJECTIVE_FUNCTION_H_
 #define SRC_OPTIMIZATION_OBJECTIVE_FUNCTION_H_
 
+#include <chrono>
+#include <cstdint>
 #include <memory>
+#include <string>
 #include <vector>
 
+#include "optimization/solver_telemetry.h"
+
 namespace super_resolution {
 
 // An ObjectiveTerm computes the cost and gradient of a part of the objective
@@ -23,33 +28,159 @@ class ObjectiveTerm {
   // NOTE: The gradient may be NULL (nullptr), in which case it is not computed.
   virtual double Compute(
       const double* estimated_image_data, double* gradient) const = 0;
+
+  // Adds a non-negative approximation of the diagonal of this term's Hessian
+  // (one value per parameter) to the given array, which is not reset. This is
+  // used to build a diagonal (Jacobi) preconditioner for the solvers. Terms
+  // that cannot estimate their curvature add nothing (the default).
+  virtual void AddToHessianDiagonal(double* diagonal) const {}
+
+  // Returns true if this term is quadratic and implements
+  // AddHessianProduct(). Terms are not quadratic by default.
+  virtual bool HasHessianProduct() const {
+    return false;
+  }
+
+  // Adds the product of this term's (constant) Hessian and the given
+  // direction to the given array, which is not reset. This lets the linear
+  // solver apply the Hessian without evaluating the cost. Only called if
+  // HasHessianProduct() is true.
+  virtual void AddHessianProduct(
+      const double* direction, double* product) const {}
+
+  // Sets whether the term may run its most expensive operations in single
+  // precision, while costs and gradients are still accumulated in double
+  // precision. Terms without a single-precision path ignore this (the
+  // default).
+  virtual void SetMixedPrecision(const bool use_mixed_precision) {}
 };
 
+// The default number of evaluations remembered by the ObjectiveFunction.
+constexpr int kDefaultObjectiveCacheCapacity = 2;
+
 // The ObjectiveFunction is just a collection of ObjectiveTerms which are
 // computed independently.
+//
+// Solvers sometimes request the objective again at a point they have just
+// evaluated (e.g. around line search restarts). To avoid recomputing all
+// terms, the most recent evaluations are cached, keyed by a hash of the
+// parameter vector. Cache hits are verified against the stored parameters, so
+// results are always exact.
 class ObjectiveFunction {
  public:
   explicit ObjectiveFunction(const int num_parameters)
       : num_parameters_(num_parameters),
-        num_iterations_completed_(0) {}
+        num_iterations_completed_(0),
+        cache_capacity_(kDefaultObjectiveCacheCapacity),
+        next_cache_entry_(0),
+        num_evaluations_(0),
+        num_cache_hits_(0),
+        is_verbose_(true),
+        telemetry_round_(0),
+        last_cost_(0.0),
+        last_gradient_norm_(0.0),
+        deadline_(std::chrono::steady_clock::time_point::max()) {}
 
-  // Add a new ObjectiveTerm to the list.
+  // Add a new ObjectiveTerm to the list. This invalidates the cache.
   void AddTerm(const std::shared_ptr<ObjectiveTerm> objective_term) {
     terms_.push_back(objective_term);
+    ClearCache();
   }
 
   // Computes all terms and returns the sum of the residual costs and the sum
   // of the gradients. If gradient is NULL, it will not be computed.
+  //
+  // If the same parameters were recently evaluated, the cached cost (and
+  // gradient, if it was computed then) is returned instead.
   double ComputeAllTerms(
       const double* estimated_image_data, double* gradient = nullptr) const;
 
-  // Callback to report that a solver iteration was complete, allowing the
-  // ObjectiveFunction to track progress and statistics about the solver's
-  // progress. This is optional.
-  //
-  // TODO: Do some more advanced tracking of the solver progress, like
-  // visualizing a graph of the cost, etc.
-  void ReportIterationComplete(const double residual_sum);
+  // Returns a diagonal (Jacobi) preconditioner for this objective: the sum of
+  // the Hessian diagonal approximations of all terms (see
+  // ObjectiveTerm::AddToHessianDiagonal()). Values are clamped to a small
+  // fraction of the largest one, so every entry is positive. If no term
+  // estimates its curvature, this is the identity.
+  std::vector<double> ComputeDiagonalPreconditioner() const;
+
+  // Returns true if every term implements the Hessian product (see
+  // ObjectiveTerm::HasHessianProduct()), so the objective is quadratic.
+  bool HasHessianProduct() const;
+
+  // Computes the product of the objective's Hessian (the sum over all terms)
+  // and the given direction. Requires HasHessianProduct(). This bypasses the
+  // cache and the evaluation statistics.
+  void ComputeHessianProduct(const double* direction, double* product) const;
+
+  // Returns the number of parameters (and gradient values) of the objective.
+  int GetNumParameters() const {
+    return num_parameters_;
+  }
+
+  // Sets the number of evaluations to remember. Each entry stores a copy of
+  // the parameters and of the gradient, so set this to 0 to disable caching
+  // for very large problems. Clears the cache.
+  void SetCacheCapacity(const int cache_capacity);
+
+  // Removes all cached evaluations. This must be called if any term's state
+  // (e.g. referenced IRLS weights) changes between evaluations.
+  void ClearCache();
+
+  // Sets mixed-precision evaluation for all terms (see
+  // ObjectiveTerm::SetMixedPrecision()). The terms are shared with copies of
+  // this objective, so this applies to those copies as well. Clears the
+  // cache.
+  void SetMixedPrecision(const bool use_mixed_precision);
+
+  // Returns the number of times ComputeAllTerms() was called, including calls
+  // that were served from the cache.
+  int GetNumEvaluations() const {
+    return num_evaluations_;
+  }
+
+  // Returns the number of ComputeAllTerms() calls served from the cache.
+  int GetNumCacheHits() const {
+    return num_cache_hits_;
+  }
+
+  // Callback to report that a solver iteration was complete, with the new
+  // parameters and their cost. This counts the iterations and, if telemetry
+  // is set, records the iteration statistics. This is optional.
+  void ReportIterationComplete(const double* parameters, const double cost);
+
+  // Records every iteration reported by ReportIterationComplete() to the given
+  // telemetry sink, under the given stage name and outer round. While
+  // telemetry is set, each evaluation also keeps the cost of every term and
+  // the gradient norm for the record. Set to nullptr to disable (default).
+  void SetTelemetry(
+      std::shared_ptr<SolverTelemetry> telemetry,
+      const std::string& stage,
+      const int round);
+
+  // Sets whether solver callbacks should log the progress of every iteration
+  // (true by default).
+  void SetVerbose(const bool verbose) {
+    is_verbose_ = verbose;
+  }
+
+  bool IsVerbose() const {
+    return is_verbose_;
+  }
+
+  // Sets a wall-clock deadline for minimizing this objective. Solvers that
+  // support it stop at the first iteration after the deadline and keep their
+  // current iterate. There is no deadline by default.
+  void SetDeadline(const std::chrono::steady_clock::time_point& deadline) {
+    deadline_ = deadline;
+  }
+
+  const std::chrono::steady_clock::time_point& GetDeadline() const {
+    return deadline_;
+  }
+
+  // Returns true if the deadline has passed.
+  bool IsPastDeadline() const {
+    return std::chrono::steady_clock::now() >= deadline_;
+  }
 
   // Returns the number of iterations that were completed by the solver. This
   // only works if the solver reports its progress after every iteration by
@@ -69,6 +200,50 @@ class ObjectiveFunction {
 
   // The number of iterations performed. Updated with ReportIterationComplete().
   int num_iterations_completed_;
+
+  // A single cached evaluation of all terms. The term costs and gradient norm
+  // are only stored while telemetry is set.
+  struct CachedEvaluation {
+    uint64_t parameters_hash;
+    std::vector<double> parameters;
+    double cost;
+    bool has_gradient;
+    std::vector<double> gradient;
+    std::vector<double> term_costs;
+    double gradient_norm;
+  };
+
+  // The cache of recent evaluations. Entries are replaced in round-robin
+  // order once the capacity is reached.
+  int cache_capacity_;
+  mutable std::vector<CachedEvaluation> cache_;
+  mutable int next_cache_entry_;
+
+  // Evaluation statistics.
+  mutable int num_evaluations_;
+  mutable int num_cache_hits_;
+
+  // Whether solver callbacks log every iteration.
+  bool is_verbose_;
+
+  // The telemetry sink and the stage and round that records are made for.
+  std::shared_ptr<SolverTelemetry> telemetry_;
+  std::string telemetry_stage_;
+  int telemetry_round_;
+
+  // The latest evaluation (with telemetry only). Its term costs and gradient
+  // norm are recorded if it is at the reported parameters, which is the
+  // usual case since line searches end at the accepted point.
+  mutable double last_cost_;
+  mutable double last_gradient_norm_;
+  mutable std::vector<double> last_term_costs_;
+
+  // The parameters at the previous reported iteration (with telemetry only),
+  // for computing the step size.
+  std::vector<double> previous_parameters_;
+
+  // Set with SetDeadline().
+  std::chrono::steady_clock::time_point deadline_;
 };
 
 }  // namespace super_resolution
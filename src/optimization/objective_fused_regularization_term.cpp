@@ -0,0 +1,263 @@
+#include "optimization/objective_fused_regularization_term.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "optimization/regularizer.h"
+#include "util/util.h"
+
+#include "glog/logging.h"
+
+namespace super_resolution {
+
+void ObjectiveFusedRegularizationTerm::AddRegularizer(
+    const std::shared_ptr<Regularizer> regularizer,
+    const double regularization_parameter,
+    const std::vector<double>& irls_weights) {
+
+  CHECK_EQ(irls_weights.size(), image_size_.area() * num_channels_)
+      << "Number of IRLS weights does not match the number of parameters.";
+
+  // Nothing to compute if the regularization parameter is 0.
+  if (regularization_parameter <= 0.0) {
+    return;
+  }
+
+  WeightedRegularizer weighted_regularizer;
+  weighted_regularizer.regularizer = regularizer;
+  weighted_regularizer.regularization_parameter = regularization_parameter;
+  weighted_regularizer.irls_weights = &irls_weights;
+
+  std::vector<ShiftedDifference> shifted_differences;
+  if (!regularizer->GetShiftedDifferences(&shifted_differences)) {
+    other_regularizers_.push_back(weighted_regularizer);
+    return;
+  }
+
+  // Merge the regularizer's shifts into the distinct fused shifts.
+  const int regularizer_index = fused_regularizers_.size();
+  fused_regularizers_.push_back(weighted_regularizer);
+  for (const ShiftedDifference& shifted_difference : shifted_differences) {
+    CHECK(shifted_difference.channel_shift >= 0 &&
+          shifted_difference.row_shift >= 0 &&
+          shifted_difference.col_shift >= 0)
+        << "Shifted differences must use non-negative shifts.";
+    auto fused_shift = std::find_if(
+        fused_shifts_.begin(),
+        fused_shifts_.end(),
+        [&shifted_difference](const FusedShift& shift) {
+          return shift.channel_shift == shifted_difference.channel_shift &&
+                 shift.row_shift == shifted_difference.row_shift &&
+                 shift.col_shift == shifted_difference.col_shift;
+        });
+    if (fused_shift == fused_shifts_.end()) {
+      FusedShift shift;
+      shift.channel_shift = shifted_difference.channel_shift;
+      shift.row_shift = shifted_difference.row_shift;
+      shift.col_shift = shifted_difference.col_shift;
+      fused_shifts_.push_back(shift);
+      fused_shift = fused_shifts_.end() - 1;
+    }
+    fused_shift->coefficients.push_back(
+        std::make_pair(regularizer_index, shifted_difference.coefficient));
+  }
+}
+
+double ObjectiveFusedRegularizationTerm::Compute(
+    const double* estimated_image_data, double* gradient) const {
+
+  CHECK_NOTNULL(estimated_image_data);
+
+  double residual_sum = 0.0;
+  for (const WeightedRegularizer& weighted_regularizer : other_regularizers_) {
+    residual_sum += ComputeRegularizer(
+        weighted_regularizer, estimated_image_data, gradient);
+  }
+
+  // A single regularizer gains nothing from fusion, and its own
+  // implementation avoids the per-channel value buffers.
+  if (fused_regularizers_.size() == 1) {
+    residual_sum += ComputeRegularizer(
+        fused_regularizers_[0], estimated_image_data, gradient);
+  } else if (fused_regularizers_.size() > 1) {
+    residual_sum += ComputeFusedRegularizers(estimated_image_data, gradient);
+  }
+  return residual_sum;
+}
+
+void ObjectiveFusedRegularizationTerm::AddToHessianDiagonal(
+    double* diagonal) const {
+
+  for (const std::vector<WeightedRegularizer>* regularizers :
+       {&fused_regularizers_, &other_regularizers_}) {
+    for (const WeightedRegularizer& weighted_regularizer : *regularizers) {
+      weighted_regularizer.regularizer->AddToHessianDiagonal(
+          num_channels_,
+          weighted_regularizer.regularization_parameter,
+          *weighted_regularizer.irls_weights,
+          diagonal);
+    }
+  }
+}
+
+bool ObjectiveFusedRegularizationTerm::HasHessianProduct() const {
+  for (const std::vector<WeightedRegularizer>* regularizers :
+       {&fused_regularizers_, &other_regularizers_}) {
+    for (const WeightedRegularizer& weighted_regularizer : *regularizers) {
+      if (!weighted_regularizer.regularizer->IsQuadratic()) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+void ObjectiveFusedRegularizationTerm::AddHessianProduct(
+    const double* direction, double* product) const {
+
+  CHECK_NOTNULL(direction);
+  CHECK_NOTNULL(product);
+
+  // The gradient of each quadratic regularizer at v is its Hessian product.
+  for (const std::vector<WeightedRegularizer>* regularizers :
+       {&fused_regularizers_, &other_regularizers_}) {
+    for (const WeightedRegularizer& weighted_regularizer : *regularizers) {
+      ComputeRegularizer(weighted_regularizer, direction, product);
+    }
+  }
+}
+
+double ObjectiveFusedRegularizationTerm::ComputeRegularizer(
+    const WeightedRegularizer& weighted_regularizer,
+    const double* estimated_image_data,
+    double* gradient) const {
+
+  const Regularizer& regularizer = *weighted_regularizer.regularizer;
+  const double regularization_parameter =
+      weighted_regularizer.regularization_parameter;
+  if (gradient == nullptr) {
+    return regularization_parameter * regularizer.ComputeWeightedSquaredSum(
+        estimated_image_data,
+        *weighted_regularizer.irls_weights,
+        num_channels_);
+  }
+  return regularizer.ComputeWeightedSquaredSumAndGradient(
+      estimated_image_data,
+      num_channels_,
+      regularization_parameter,
+      *weighted_regularizer.irls_weights,
+      nullptr,  // Residuals are not needed.
+      gradient);
+}
+
+double ObjectiveFusedRegularizationTerm::ComputeFusedRegularizers(
+    const double* estimated_image_data, double* gradient) const {
+
+  // For each channel, the first pass differences the image once per distinct
+  // shift and adds the weighted absolute differences to the values r_k of
+  // every regularizer k that uses the shift. The values are then turned into
+  // the partial scales 2 * lambda_k * w_k * r_k, and the second pass combines
+  // them per shift into a single gradient contribution,
+  //   sign(x_p - x_q) * sum_k coefficient_k * 2 * lambda_k * w_k,p * r_k,p
+  // which is added to pixel p and subtracted from its shifted neighbor q.
+  const int width = image_size_.width;
+  const int height = image_size_.height;
+  const int num_pixels = image_size_.area();
+  const int num_fused_regularizers = fused_regularizers_.size();
+  std::vector<double> values(num_fused_regularizers * num_pixels);
+  std::vector<double> row_buffer(width);
+
+  double residual_sum = 0.0;
+  for (int channel = 0; channel < num_channels_; ++channel) {
+    const int channel_index = channel * num_pixels;
+    const double* channel_data = estimated_image_data + channel_index;
+
+    std::fill(values.begin(), values.end(), 0.0);
+    for (const FusedShift& shift : fused_shifts_) {
+      const int num_cols = width - shift.col_shift;
+      if (channel + shift.channel_shift >= num_channels_ || num_cols <= 0) {
+        continue;
+      }
+      const int shift_offset =
+          shift.channel_shift * num_pixels +
+          shift.row_shift * width +
+          shift.col_shift;
+      for (int row = 0; row + shift.row_shift < height; ++row) {
+        const double* pixels = channel_data + row * width;
+        const double* shifted_pixels = pixels + shift_offset;
+        for (int col = 0; col < num_cols; ++col) {
+          row_buffer[col] = std::abs(pixels[col] - shifted_pixels[col]);
+        }
+        for (const std::pair<int, double>& coefficient : shift.coefficients) {
+          double* row_values =
+              values.data() + coefficient.first * num_pixels + row * width;
+          for (int col = 0; col < num_cols; ++col) {
+            row_values[col] += coefficient.second * row_buffer[col];
+          }
+        }
+      }
+    }
+
+    for (int k = 0; k < num_fused_regularizers; ++k) {
+      const double regularization_parameter =
+          fused_regularizers_[k].regularization_parameter;
+      const double* weights =
+          fused_regularizers_[k].irls_weights->data() + channel_index;
+      double* regularizer_values = values.data() + k * num_pixels;
+      double weighted_sum = 0.0;
+      for (int i = 0; i < num_pixels; ++i) {
+        const double weighted_value = weights[i] * regularizer_values[i];
+        weighted_sum += weighted_value * regularizer_values[i];
+        regularizer_values[i] = 2 * regularization_parameter * weighted_value;
+      }
+      residual_sum += regularization_parameter * weighted_sum;
+    }
+    if (gradient == nullptr) {
+      continue;
+    }
+
+    double* channel_gradient = gradient + channel_index;
+    for (const FusedShift& shift : fused_shifts_) {
+      const int num_cols = width - shift.col_shift;
+      if (channel + shift.channel_shift >= num_channels_ || num_cols <= 0) {
+        continue;
+      }
+      const int shift_offset =
+          shift.channel_shift * num_pixels +
+          shift.row_shift * width +
+          shift.col_shift;
+      for (int row = 0; row + shift.row_shift < height; ++row) {
+        const int row_index = row * width;
+        std::fill(row_buffer.begin(), row_buffer.end(), 0.0);
+        for (const std::pair<int, double>& coefficient : shift.coefficients) {
+          const double* partial_scales =
+              values.data() + coefficient.first * num_pixels + row_index;
+          for (int col = 0; col < num_cols; ++col) {
+            row_buffer[col] += coefficient.second * partial_scales[col];
+          }
+        }
+        const double* pixels = channel_data + row_index;
+        const double* shifted_pixels = pixels + shift_offset;
+        for (int col = 0; col < num_cols; ++col) {
+          row_buffer[col] *= util::GetSign(pixels[col] - shifted_pixels[col]);
+        }
+        // The pixel and its shifted neighbor are updated in separate passes
+        // since they can overlap within a row.
+        double* row_gradient = channel_gradient + row_index;
+        for (int col = 0; col < num_cols; ++col) {
+          row_gradient[col] += row_buffer[col];
+        }
+        double* shifted_gradient = row_gradient + shift_offset;
+        for (int col = 0; col < num_cols; ++col) {
+          shifted_gradient[col] -= row_buffer[col];
+        }
+      }
+    }
+  }
+  return residual_sum;
+}
+
+}  // namespace super_resolution
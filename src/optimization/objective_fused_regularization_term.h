@@ -0,0 +1,97 @@
+// Defines a regularization term that evaluates several IRLS-weighted
+// regularizers together, computing
+//   sum_k lambda_k * sum_i w_k,i * r_k,i^2
+// for regularizers k with parameters lambda_k and IRLS weights w_k.
+//
+// Regularizers whose values are sums of absolute shifted differences (see
+// Regularizer::GetShiftedDifferences, e.g. TV, 3D TV and BTV) are fused: every
+// distinct shift is differenced once per pass over the image for all of them,
+// and its gradient contributions are scattered once. All other regularizers
+// are evaluated independently, as in ObjectiveIRLSRegularizationTerm.
+
+#ifndef SRC_OPTIMIZATION_OBJECTIVE_FUSED_REGULARIZATION_TERM_H_
+#define SRC_OPTIMIZATION_OBJECTIVE_FUSED_REGULARIZATION_TERM_H_
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "optimization/objective_function.h"
+#include "optimization/regularizer.h"
+
+#include "opencv2/core/core.hpp"
+
+namespace super_resolution {
+
+class ObjectiveFusedRegularizationTerm : public ObjectiveTerm {
+ public:
+  // Here num_channels is the number of channels in the image being optimized
+  // for.
+  ObjectiveFusedRegularizationTerm(
+      const int num_channels, const cv::Size& image_size)
+      : num_channels_(num_channels), image_size_(image_size) {}
+
+  // Adds a regularizer to the term. The IRLS weights are referenced, so they
+  // must stay valid for the lifetime of this term.
+  void AddRegularizer(
+      const std::shared_ptr<Regularizer> regularizer,
+      const double regularization_parameter,
+      const std::vector<double>& irls_weights);
+
+  virtual double Compute(
+      const double* estimated_image_data, double* gradient) const;
+
+  // Adds the Hessian diagonal approximation of every regularizer (see
+  // Regularizer::AddToHessianDiagonal()).
+  virtual void AddToHessianDiagonal(double* diagonal) const;
+
+  // Only if every regularizer is quadratic (see
+  // ObjectiveIRLSRegularizationTerm::AddHessianProduct()).
+  virtual bool HasHessianProduct() const;
+
+  virtual void AddHessianProduct(
+      const double* direction, double* product) const;
+
+  // Returns the number of regularizers that are evaluated in the fused pass.
+  int GetNumFusedRegularizers() const {
+    return fused_regularizers_.size();
+  }
+
+ private:
+  // A regularizer with its regularization parameter and IRLS weights.
+  struct WeightedRegularizer {
+    std::shared_ptr<Regularizer> regularizer;
+    double regularization_parameter;
+    const std::vector<double>* irls_weights;
+  };
+
+  // A distinct shift over all fused regularizers, and the coefficient of
+  // each fused regularizer (by index) that uses it.
+  struct FusedShift {
+    int channel_shift;
+    int row_shift;
+    int col_shift;
+    std::vector<std::pair<int, double>> coefficients;
+  };
+
+  // Evaluates a single regularizer on its own.
+  double ComputeRegularizer(
+      const WeightedRegularizer& weighted_regularizer,
+      const double* estimated_image_data,
+      double* gradient) const;
+
+  // Evaluates all fused regularizers in a single pass per shift.
+  double ComputeFusedRegularizers(
+      const double* estimated_image_data, double* gradient) const;
+
+  const int num_channels_;
+  const cv::Size& image_size_;
+
+  std::vector<WeightedRegularizer> fused_regularizers_;
+  std::vector<FusedShift> fused_shifts_;
+  std::vector<WeightedRegularizer> other_regularizers_;
+};
+
+}  // namespace super_resolution
+
+#endif  // SRC_OPTIMIZATION_OBJECTIVE_FUSED_REGULARIZATION_TERM_H_
@@ -1,6 +1,5 @@
 #include "optimization/objective_irls_regularization_term.h"
 
-#include <utility>
 #include <vector>
 
 #include "glog/logging.h"
@@ -17,44 +16,39 @@ double ObjectiveIRLSRegularizationTerm::Compute(
     return 0.0;
   }
 
-  double residual_sum = 0.0;
-
-  // Precompute the constant terms in the gradients at each pixel. This is
-  // the regularization parameter (lambda) and the IRLS weights.
-  // TODO: if gradient == nullptr, no need to compute the constants.
-  const int num_pixels = image_size_.width * image_size_.height;
-  const int num_data_points = num_pixels * num_channels_;
-  std::vector<double> gradient_constants;
-  gradient_constants.reserve(num_data_points);
-  for (int i = 0; i < num_data_points; ++i) {
-    gradient_constants.push_back(
-        regularization_parameter_ * irls_weights_.at(i));
+  // Cost-only path: the weighted squared sum is computed in a single pass
+  // without building the gradient constants or the residual vector.
+  if (gradient == nullptr) {
+    return regularization_parameter_ * regularizer_->ComputeWeightedSquaredSum(
+        estimated_image_data, irls_weights_, num_channels_);
   }
 
-  // Compute the residuals and squared residual sum.
-  // TODO: just ApplyToImage if gradient == nullptr.
-  const std::pair<std::vector<double>, std::vector<double>>&
-  values_and_partials = regularizer_->ApplyToImageWithDifferentiation(
-          estimated_image_data, gradient_constants, num_channels_);
-
-  // The values are the regularizer values at each pixel and the partials are
-  // the sum of partial derivatives at each pixel.
-  const std::vector<double>& values = values_and_partials.first;
-  const std::vector<double>& partials = values_and_partials.second;
-
-  for (int i = 0; i < num_data_points; ++i) {
-    const double residual = values[i];
-    const double weight = irls_weights_.at(i);
-
-    residual_sum += regularization_parameter_ * weight * residual * residual;
-    // TODO: this still computes the gradient, just use ApplyToImage if
-    // gradient is nullptr.
-    if (gradient != nullptr) {
-      gradient[i] += partials[i];
-    }
+  // Value and gradient path: the regularizer accumulates the weighted
+  // gradient directly into the objective gradient.
+  return regularizer_->ComputeWeightedSquaredSumAndGradient(
+      estimated_image_data,
+      num_channels_,
+      regularization_parameter_,
+      irls_weights_,
+      nullptr,  // Residuals are not needed.
+      gradient);
+}
+
+void ObjectiveIRLSRegularizationTerm::AddToHessianDiagonal(
+    double* diagonal) const {
+
+  if (regularization_parameter_ <= 0.0) {
+    return;
   }
+  regularizer_->AddToHessianDiagonal(
+      num_channels_, regularization_parameter_, irls_weights_, diagonal);
+}
+
+void ObjectiveIRLSRegularizationTerm::AddHessianProduct(
+    const double* direction, double* product) const {
 
-  return residual_sum;
+  CHECK_NOTNULL(product);
+  Compute(direction, product);
 }
 
 }  // namespace super_resolution
@@ -34,6 +34,17 @@ class ObjectiveIRLSRegularizationTerm : public ObjectiveTerm {
   virtual double Compute(
       const double* estimated_image_data, double* gradient) const;
 
+  virtual void AddToHessianDiagonal(double* diagonal) const;
+
+  // A quadratic regularizer has linear values Dx, so the gradient of the
+  // term at v is the Hessian product 2 * lambda * D'WDv.
+  virtual bool HasHessianProduct() const {
+    return regularizer_->IsQuadratic();
+  }
+
+  virtual void AddHessianProduct(
+      const double* direction, double* product) const;
+
  private:
   const std::shared_ptr<Regularizer> regularizer_;
   const double regularization_parameter_;
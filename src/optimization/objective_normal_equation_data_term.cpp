@@ -0,0 +1,205 @@
+#include "optimization/objective_normal_equation_data_term.h"
+
+#include <vector>
+
+#include "image/image_data.h"
+#include "image_model/image_model.h"
+
+#include "opencv2/core/core.hpp"
+
+#include "glog/logging.h"
+
+namespace super_resolution {
+
+ObjectiveNormalEquationDataTerm::ObjectiveNormalEquationDataTerm(
+    const ImageModel& image_model,
+    const std::vector<ImageData>& observations,
+    const int channel_start,
+    const int channel_end,
+    const cv::Size& image_size)
+    : image_model_(image_model),
+      num_observations_(observations.size()),
+      num_channels_(channel_end - channel_start),
+      image_size_(image_size),
+      observations_norm_(0.0) {
+
+  CHECK_GT(observations.size(), 0) << "Cannot solve with 0 observations.";
+  CHECK_GE(channel_start, 0) << "First channel in range is out of bounds.";
+  CHECK_LE(channel_end, observations[0].GetNumChannels())
+      << "Last channel in range is out of bounds (non-inclusive).";
+  CHECK_GT(channel_end, channel_start) << "Invalid channel range.";
+
+  // The observations are the LR images upsampled to the HR size with nearest
+  // neighbor interpolation, so every LR pixel is counted scale^2 times. All
+  // constant terms are scaled the same way to match ObjectiveDataTerm.
+  const int num_pixels = image_size_.width * image_size_.height;
+  const int scale = image_model_.GetDownsamplingScale();
+  const cv::Size lr_image_size(
+      image_size_.width / scale, image_size_.height / scale);
+  adjoint_observations_.resize(num_pixels * num_channels_);
+  for (int image_index = 0; image_index < num_observations_; ++image_index) {
+    ImageData adjoint_observation;
+    for (int channel = 0; channel < num_channels_; ++channel) {
+      const double* observation_channel_data =
+          observations[image_index].GetChannelData(channel + channel_start);
+      adjoint_observation.AddChannel(observation_channel_data, image_size_);
+      for (int pixel_index = 0; pixel_index < num_pixels; ++pixel_index) {
+        const double value = observation_channel_data[pixel_index];
+        observations_norm_ += value * value;
+      }
+    }
+    adjoint_observation.ResizeImage(lr_image_size, INTERPOLATE_ADDITIVE);
+    image_model_.ApplyTransposeToImage(&adjoint_observation, image_index);
+    for (int channel = 0; channel < num_channels_; ++channel) {
+      const int channel_index = channel * num_pixels;
+      const double* adjoint_channel_data =
+          adjoint_observation.GetChannelData(channel);
+      for (int pixel_index = 0; pixel_index < num_pixels; ++pixel_index) {
+        adjoint_observations_[channel_index + pixel_index] +=
+            adjoint_channel_data[pixel_index];
+      }
+    }
+  }
+
+  if (image_model_.IsTranslationalModel(num_observations_)) {
+    const ImageData coverage_map =
+        image_model_.ComputeTranslationalCoverageMap(
+            image_size_, num_observations_);
+    const double* coverage_data = coverage_map.GetChannelData(0);
+    const double scale_squared = scale * scale;
+    coverage_map_.resize(num_pixels);
+    for (int pixel_index = 0; pixel_index < num_pixels; ++pixel_index) {
+      coverage_map_[pixel_index] = scale_squared * coverage_data[pixel_index];
+    }
+    LOG(INFO) << "Translational image model: using the fused normal-equation "
+              << "data term.";
+  }
+}
+
+double ObjectiveNormalEquationDataTerm::Compute(
+    const double* estimated_image_data, double* gradient) const {
+
+  CHECK_NOTNULL(estimated_image_data);
+
+  double residual_sum = observations_norm_;
+  if (IsFused()) {
+    residual_sum +=
+        ComputeQuadraticTermFused(estimated_image_data, gradient);
+  } else {
+    residual_sum +=
+        ComputeQuadraticTermPerObservation(estimated_image_data, gradient);
+  }
+
+  // Linear term: -2x'(sum_k A_k'y_k), with gradient -2(sum_k A_k'y_k).
+  const int num_data_points = adjoint_observations_.size();
+  double linear_term = 0.0;
+  for (int i = 0; i < num_data_points; ++i) {
+    linear_term += estimated_image_data[i] * adjoint_observations_[i];
+  }
+  residual_sum -= 2 * linear_term;
+  if (gradient != nullptr) {
+    for (int i = 0; i < num_data_points; ++i) {
+      gradient[i] -= 2 * adjoint_observations_[i];
+    }
+  }
+
+  return residual_sum;
+}
+
+void ObjectiveNormalEquationDataTerm::AddToHessianDiagonal(
+    double* diagonal) const {
+
+  CHECK_NOTNULL(diagonal);
+
+  // The quadratic term adds 2(sum_k A_k'A_k)x to the gradient, which for
+  // x = 1 is exactly the vector of Hessian row sums.
+  const std::vector<double> ones(adjoint_observations_.size(), 1.0);
+  AddHessianProduct(ones.data(), diagonal);
+}
+
+void ObjectiveNormalEquationDataTerm::AddHessianProduct(
+    const double* direction, double* product) const {
+
+  CHECK_NOTNULL(direction);
+  CHECK_NOTNULL(product);
+
+  if (IsFused()) {
+    ComputeQuadraticTermFused(direction, product);
+  } else {
+    ComputeQuadraticTermPerObservation(direction, product);
+  }
+}
+
+double ObjectiveNormalEquationDataTerm::ComputeQuadraticTermPerObservation(
+    const double* estimated_image_data, double* gradient) const {
+
+  const int num_pixels = image_size_.width * image_size_.height;
+  const int scale = image_model_.GetDownsamplingScale();
+  const double scale_squared = scale * scale;
+
+  double quadratic_term = 0.0;
+  for (int image_index = 0; image_index < num_observations_; ++image_index) {
+    ImageData degraded_image(estimated_image_data, image_size_, num_channels_);
+    image_model_.ApplyToImage(&degraded_image, image_index);
+    const int num_lr_pixels = degraded_image.GetNumPixels();
+    for (int channel = 0; channel < num_channels_; ++channel) {
+      const double* degraded_channel_data =
+          degraded_image.GetChannelData(channel);
+      for (int pixel_index = 0; pixel_index < num_lr_pixels; ++pixel_index) {
+        const double value = degraded_channel_data[pixel_index];
+        quadratic_term += scale_squared * value * value;
+      }
+    }
+
+    if (gradient != nullptr) {
+      image_model_.ApplyTransposeToImage(&degraded_image, image_index);
+      for (int channel = 0; channel < num_channels_; ++channel) {
+        const int channel_index = channel * num_pixels;
+        const double* adjoint_channel_data =
+            degraded_image.GetChannelData(channel);
+        for (int pixel_index = 0; pixel_index < num_pixels; ++pixel_index) {
+          gradient[channel_index + pixel_index] +=
+              2 * scale_squared * adjoint_channel_data[pixel_index];
+        }
+      }
+    }
+  }
+  return quadratic_term;
+}
+
+double ObjectiveNormalEquationDataTerm::ComputeQuadraticTermFused(
+    const double* estimated_image_data, double* gradient) const {
+
+  const int num_pixels = image_size_.width * image_size_.height;
+
+  // x'B'WBx = (Bx)'W(Bx), and the gradient is 2B'W(Bx).
+  ImageData blurred_image(estimated_image_data, image_size_, num_channels_);
+  image_model_.ApplyBlurToImage(&blurred_image);
+  double quadratic_term = 0.0;
+  for (int channel = 0; channel < num_channels_; ++channel) {
+    double* blurred_channel_data =
+        blurred_image.GetMutableChannelData(channel);
+    for (int pixel_index = 0; pixel_index < num_pixels; ++pixel_index) {
+      const double value = blurred_channel_data[pixel_index];
+      const double weighted_value = coverage_map_[pixel_index] * value;
+      quadratic_term += weighted_value * value;
+      blurred_channel_data[pixel_index] = weighted_value;
+    }
+  }
+
+  if (gradient != nullptr) {
+    image_model_.ApplyBlurTransposeToImage(&blurred_image);
+    for (int channel = 0; channel < num_channels_; ++channel) {
+      const int channel_index = channel * num_pixels;
+      const double* adjoint_channel_data =
+          blurred_image.GetChannelData(channel);
+      for (int pixel_index = 0; pixel_index < num_pixels; ++pixel_index) {
+        gradient[channel_index + pixel_index] +=
+            2 * adjoint_channel_data[pixel_index];
+      }
+    }
+  }
+  return quadratic_term;
+}
+
+}  // namespace super_resolution
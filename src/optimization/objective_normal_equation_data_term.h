@@ -0,0 +1,97 @@
+// Defines a normal-equation form of the MAP objective data term. The cost is
+// the same as in ObjectiveDataTerm, sum_k ||A_kx - y_k||_2^2, but it is
+// expanded as
+//    x'(sum_k A_k'A_k)x - 2x'(sum_k A_k'y_k) + sum_k y_k'y_k
+// where the last two sums are constant and are precomputed once per solve.
+// The gradient is then 2((sum_k A_k'A_k)x - sum_k A_k'y_k).
+//
+// If the image model is purely translational (see
+// ImageModel::IsTranslationalModel()), the sum_k A_k'A_k operator is fused
+// into a single B'WB application, so the evaluation cost no longer depends on
+// the number of observations. Because the blur and motion operators are
+// commuted to do this, the fused result differs from ObjectiveDataTerm within
+// the blur radius of the image border.
+
+#ifndef SRC_OPTIMIZATION_OBJECTIVE_NORMAL_EQUATION_DATA_TERM_H_
+#define SRC_OPTIMIZATION_OBJECTIVE_NORMAL_EQUATION_DATA_TERM_H_
+
+#include <vector>
+
+#include "image/image_data.h"
+#include "image_model/image_model.h"
+#include "optimization/objective_function.h"
+
+#include "opencv2/core/core.hpp"
+
+namespace super_resolution {
+
+class ObjectiveNormalEquationDataTerm : public ObjectiveTerm {
+ public:
+  // Same parameters as ObjectiveDataTerm. The constant terms are computed
+  // here, so construct this term once per solve.
+  ObjectiveNormalEquationDataTerm(
+      const ImageModel& image_model,
+      const std::vector<ImageData>& observations,
+      const int channel_start,
+      const int channel_end,
+      const cv::Size& image_size);
+
+  virtual double Compute(
+      const double* estimated_image_data, double* gradient) const;
+
+  // Adds the row sums of the Hessian 2 * sum_k A_k'A_k (see
+  // ObjectiveDataTerm::AddToHessianDiagonal()), using the fused operator if
+  // available.
+  virtual void AddToHessianDiagonal(double* diagonal) const;
+
+  // Adds 2(sum_k A_k'A_k)v, the gradient of the quadratic term at v, using
+  // the fused operator if available.
+  virtual bool HasHessianProduct() const {
+    return true;
+  }
+
+  virtual void AddHessianProduct(
+      const double* direction, double* product) const;
+
+  // Returns true if the sum_k A_k'A_k operator was fused into a single
+  // operator application.
+  bool IsFused() const {
+    return !coverage_map_.empty();
+  }
+
+  // Returns the precomputed sum_k A_k'y_k (scaled like the cost), one value
+  // per pixel in each channel of the range.
+  const std::vector<double>& GetAdjointObservations() const {
+    return adjoint_observations_;
+  }
+
+ private:
+  // Computes x'(sum_k A_k'A_k)x, and adds 2(sum_k A_k'A_k)x to the gradient
+  // if it is not null, using one forward and adjoint pass per observation.
+  double ComputeQuadraticTermPerObservation(
+      const double* estimated_image_data, double* gradient) const;
+
+  // Same as ComputeQuadraticTermPerObservation(), but uses the fused B'WB
+  // operator instead.
+  double ComputeQuadraticTermFused(
+      const double* estimated_image_data, double* gradient) const;
+
+  const ImageModel& image_model_;
+  const int num_observations_;
+  const int num_channels_;
+  const cv::Size& image_size_;
+
+  // The precomputed sum_k A_k'y_k, for each channel in the range.
+  std::vector<double> adjoint_observations_;
+
+  // The precomputed sum_k y_k'y_k.
+  double observations_norm_;
+
+  // The diagonal W of the fused operator (one value per pixel) for
+  // translational image models. Empty if the model is not translational.
+  std::vector<double> coverage_map_;
+};
+
+}  // namespace super_resolution
+
+#endif  // SRC_OPTIMIZATION_OBJECTIVE_NORMAL_EQUATION_DATA_TERM_H_
@@ -0,0 +1,314 @@
+#include "optimization/primal_dual_solver.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "image/image_data.h"
+#include "image_model/image_model.h"
+#include "optimization/objective_data_term.h"
+#include "optimization/objective_function.h"
+#include "optimization/objective_normal_equation_data_term.h"
+#include "optimization/regularizer.h"
+#include "optimization/shifted_differences.h"
+#include "optimization/solver_telemetry.h"
+#include "util/util.h"
+
+#include "opencv2/core/core.hpp"
+
+#include "glog/logging.h"
+
+namespace super_resolution {
+namespace {
+
+// The step sizes are kept slightly below the convergence bound.
+constexpr double kStepSizeSafetyFactor = 0.99;
+
+// Upper bound on ||D_s||^2 for any shifted difference, since every pixel
+// appears in at most two differences.
+constexpr double kShiftedDifferenceNormBound = 4.0;
+
+// Runs the primal-dual iterations on the given channel range data, which holds
+// the initial estimate and is replaced by the solution. The data objective
+// must only contain the data term. Returns the final value of the full
+// (1-norm) objective. If telemetry is given, every iteration is recorded under
+// the given stage name. The loop stops early at the data objective's deadline,
+// if it has one.
+double RunPrimalDualLoop(
+    const PrimalDualSolverOptions& options,
+    const ObjectiveFunction& data_objective,
+    const std::vector<ShiftedDifference>& shifts,
+    const cv::Size& image_size,
+    const int num_channels,
+    const std::shared_ptr<SolverTelemetry>& telemetry,
+    const std::string& telemetry_stage,
+    std::vector<double>* estimated_image_data) {
+
+  std::vector<double>& x = *estimated_image_data;
+  const int num_data_points = x.size();
+  const int num_shifts = shifts.size();
+
+  // The gradient of the data term is Lipschitz continuous with the largest
+  // eigenvalue of its Hessian. The image model operators are non-negative, so
+  // this is bounded by the largest row sum of the Hessian, which is what the
+  // data term reports as its diagonal estimate.
+  const std::vector<double> hessian_row_sums =
+      data_objective.ComputeDiagonalPreconditioner();
+  const double lipschitz_constant =
+      *std::max_element(hessian_row_sums.begin(), hessian_row_sums.end());
+
+  // The iterations converge if 1/tau - sigma ||D||^2 >= L/2 (Condat, 2013),
+  // where D stacks all shifted differences. With sigma = ratio * tau, the
+  // largest such tau solves ratio ||D||^2 tau^2 + L/2 tau - 1 = 0.
+  const double operator_norm_squared =
+      kShiftedDifferenceNormBound * num_shifts;
+  const double quadratic_coefficient =
+      options.step_size_ratio * operator_norm_squared;
+  double primal_step_size = 2.0 / lipschitz_constant;
+  if (quadratic_coefficient > 0.0) {
+    primal_step_size = (std::sqrt(
+        lipschitz_constant * lipschitz_constant / 4.0 +
+        4.0 * quadratic_coefficient) - lipschitz_constant / 2.0) /
+        (2.0 * quadratic_coefficient);
+  }
+  primal_step_size *= kStepSizeSafetyFactor;
+  const double dual_step_size = options.step_size_ratio * primal_step_size;
+
+  // The dual variables p_s, one image per shift, and a buffer per shift so
+  // that the dual updates can run in parallel.
+  std::vector<std::vector<double>> dual_variables(
+      num_shifts, std::vector<double>(num_data_points, 0.0));
+  std::vector<std::vector<double>> shifted_differences(
+      num_shifts, std::vector<double>(num_data_points));
+  std::vector<double> dual_change_sums(num_shifts);
+
+  std::vector<double> gradient(num_data_points);
+  std::vector<double> previous_x(num_data_points);
+  std::vector<double> extrapolated_x(num_data_points);
+  int num_iterations_ran = 0;
+  while (num_iterations_ran < options.max_num_primal_dual_iterations) {
+    if (data_objective.IsPastDeadline()) {
+      LOG(INFO) << "Deadline reached. Stopping primal-dual after "
+                << num_iterations_ran << " iterations.";
+      break;
+    }
+    // Primal step: x' = x - tau (grad data(x) + sum_s D_s' p_s).
+    data_objective.ComputeAllTerms(x.data(), gradient.data());
+    for (int shift_index = 0; shift_index < num_shifts; ++shift_index) {
+      AddShiftedDifferenceTranspose(
+          dual_variables[shift_index].data(),
+          image_size,
+          num_channels,
+          shifts[shift_index],
+          1.0,
+          gradient.data());
+    }
+    previous_x = x;
+    double estimate_change_sum = 0.0;
+    for (int i = 0; i < num_data_points; ++i) {
+      x[i] -= primal_step_size * gradient[i];
+      extrapolated_x[i] = 2.0 * x[i] - previous_x[i];
+      const double change = x[i] - previous_x[i];
+      estimate_change_sum += change * change;
+    }
+
+    // Dual step: p_s = clip(p_s + sigma D_s (2x' - x), -kappa_s, kappa_s).
+    // Every shift is independent.
+    util::ParallelFor(num_shifts, [&](const int shift_index) {
+      std::vector<double>& dual_variable = dual_variables[shift_index];
+      std::vector<double>& differences = shifted_differences[shift_index];
+      ApplyShiftedDifference(
+          extrapolated_x.data(),
+          image_size,
+          num_channels,
+          shifts[shift_index],
+          differences.data());
+      const double bound = shifts[shift_index].coefficient;
+      double dual_change_sum = 0.0;
+      for (int i = 0; i < num_data_points; ++i) {
+        const double value = std::min(std::max(
+            dual_variable[i] + dual_step_size * differences[i], -bound),
+            bound);
+        const double change = value - dual_variable[i];
+        dual_change_sum += change * change;
+        dual_variable[i] = value;
+      }
+      dual_change_sums[shift_index] = dual_change_sum;
+    });
+    num_iterations_ran++;
+    if (telemetry != nullptr) {
+      // The full objective is not evaluated during the iterations.
+      SolverIterationRecord record;
+      record.stage = telemetry_stage;
+      record.iteration = num_iterations_ran;
+      record.step_size = std::sqrt(estimate_change_sum);
+      record.num_evaluations = data_objective.GetNumEvaluations();
+      telemetry->RecordIteration(record);
+    }
+
+    const double estimate_change_rms =
+        std::sqrt(estimate_change_sum / num_data_points);
+    double dual_change_sum = 0.0;
+    for (const double shift_dual_change_sum : dual_change_sums) {
+      dual_change_sum += shift_dual_change_sum;
+    }
+    const double dual_change_rms = (num_shifts > 0) ?
+        std::sqrt(dual_change_sum / (num_shifts * num_data_points)) : 0.0;
+    if (estimate_change_rms < options.primal_dual_change_threshold &&
+        dual_change_rms < options.primal_dual_change_threshold) {
+      break;
+    }
+  }
+
+  double final_cost = data_objective.ComputeAllTerms(x.data());
+  std::vector<double> differences(num_data_points);
+  for (const ShiftedDifference& shift : shifts) {
+    ApplyShiftedDifference(
+        x.data(), image_size, num_channels, shift, differences.data());
+    for (int i = 0; i < num_data_points; ++i) {
+      final_cost += shift.coefficient * std::abs(differences[i]);
+    }
+  }
+  LOG(INFO) << "Primal-dual done after " << num_iterations_ran
+            << " iterations. Final loss is " << final_cost << ".";
+  return final_cost;
+}
+
+}  // namespace
+
+void PrimalDualSolverOptions::PrintSolverOptions() const {
+  std::cout << "PrimalDualSolver Options" << std::endl;
+  std::cout << "  Objective:                           "
+            << "maximum a posteriori" << std::endl;
+  std::cout << "  Optimization strategy:               "
+            << "primal-dual (Chambolle-Pock)" << std::endl;
+  std::cout << "  Maximum primal-dual iterations:      "
+            << max_num_primal_dual_iterations << std::endl;
+  std::cout << "  Step size ratio (sigma / tau):       "
+            << step_size_ratio << std::endl;
+  std::cout << "  Primal-dual change threshold:        "
+            << primal_dual_change_threshold << std::endl;
+  if (use_normal_equation_data_term) {
+    std::cout << "  Normal-equation data term enabled." << std::endl;
+  }
+  if (split_channels) {
+    std::cout << "  Channel splitting enabled." << std::endl;
+  }
+  if (time_limit_seconds > 0.0) {
+    std::cout << "  Time limit (seconds):                "
+              << time_limit_seconds << std::endl;
+  }
+}
+
+PrimalDualSolver::PrimalDualSolver(
+    const PrimalDualSolverOptions& solver_options,
+    const ImageModel& image_model,
+    const std::vector<ImageData>& low_res_images,
+    const bool print_solver_output)
+    : MapSolver(image_model, low_res_images, print_solver_output),
+      solver_options_(solver_options) {}
+
+void PrimalDualSolver::AddRegularizer(
+    std::shared_ptr<Regularizer> regularizer,
+    const double regularization_parameter) {
+
+  std::vector<ShiftedDifference> shifts;
+  CHECK(regularizer->GetShiftedDifferences(&shifts))
+      << "The primal-dual solver only supports regularizers that are sums of "
+      << "absolute shifted differences (TV, 3D TV and BTV).";
+  MapSolver::AddRegularizer(regularizer, regularization_parameter);
+}
+
+ImageData PrimalDualSolver::Solve(const ImageData& initial_estimate) {
+  const int num_pixels = GetNumPixels();
+  const int num_channels = GetNumChannels();
+  const cv::Size image_size = GetImageSize();
+  CHECK_EQ(initial_estimate.GetNumPixels(), num_pixels);
+  CHECK_EQ(initial_estimate.GetNumChannels(), num_channels);
+  CHECK_EQ(initial_estimate.GetImageSize(), image_size);
+
+  if (IsVerbose()) {
+    solver_options_.PrintSolverOptions();
+  }
+
+  // Regularizers with a non-positive parameter are ignored.
+  std::vector<std::pair<std::shared_ptr<Regularizer>, double>>
+      active_regularizers;
+  for (const auto& regularizer_and_parameter : regularizers_) {
+    if (regularizer_and_parameter.second > 0.0) {
+      active_regularizers.push_back(regularizer_and_parameter);
+    }
+  }
+  const std::vector<ShiftedDifference> shifts =
+      GetMergedShiftedDifferences(active_regularizers);
+
+  // Channels are solved independently if the split_channels option is set.
+  const int num_channels_per_split =
+      solver_options_.split_channels ? 1 : num_channels;
+  const int num_solver_rounds = num_channels / num_channels_per_split;
+  const int num_data_points = num_channels_per_split * num_pixels;
+
+  const std::chrono::steady_clock::time_point deadline =
+      solver_options_.GetDeadline();
+  ImageData estimated_image;
+  for (int i = 0; i < num_solver_rounds; ++i) {
+    const int channel_start = i * num_channels_per_split;
+    const int channel_end = channel_start + num_channels_per_split;
+
+    std::vector<double> solver_data(num_data_points);
+    for (int channel = 0; channel < num_channels_per_split; ++channel) {
+      const double* channel_ptr = initial_estimate.GetChannelData(
+          channel_start + channel);
+      std::copy(
+          channel_ptr,
+          channel_ptr + num_pixels,
+          solver_data.begin() + channel * num_pixels);
+    }
+
+    // Every iteration evaluates at a new point, so the evaluation cache is
+    // disabled.
+    ObjectiveFunction data_objective(num_data_points);
+    data_objective.SetCacheCapacity(0);
+    // Each subset gets an equal share of the time left by the previous ones.
+    data_objective.SetDeadline(
+        GetPartialDeadline(deadline, 1.0 / (num_solver_rounds - i)));
+    std::shared_ptr<ObjectiveTerm> data_term;
+    if (solver_options_.use_normal_equation_data_term) {
+      data_term = std::shared_ptr<ObjectiveTerm>(
+          new ObjectiveNormalEquationDataTerm(
+              image_model_,
+              observations_,
+              channel_start,
+              channel_end,
+              image_size));
+    } else {
+      data_term = std::shared_ptr<ObjectiveTerm>(new ObjectiveDataTerm(
+          image_model_, observations_, channel_start, channel_end, image_size));
+    }
+    data_objective.AddTerm(data_term);
+
+    RunPrimalDualLoop(
+        solver_options_,
+        data_objective,
+        shifts,
+        image_size,
+        num_channels_per_split,
+        telemetry_,
+        telemetry_stage_prefix_ + "primal_dual" + ((num_solver_rounds > 1) ?
+            "_channel_" + std::to_string(channel_start) : ""),
+        &solver_data);
+
+    for (int channel = 0; channel < num_channels_per_split; ++channel) {
+      estimated_image.AddChannel(
+          solver_data.data() + channel * num_pixels, image_size);
+    }
+  }
+  return estimated_image;
+}
+
+}  // namespace super_resolution
@@ -0,0 +1,69 @@
+// A first-order primal-dual (Chambolle-Pock) implementation of the MAP
+// objective formulation for 1-norm priors on shifted differences, such as TV,
+// 3D TV and BTV (see Regularizer::GetShiftedDifferences). The problem
+//   min_x data(x) + sum_s kappa_s ||D_s x||_1
+// is solved through its saddle point form with one dual image p_s per shift,
+// constrained to |p_s| <= kappa_s. The smooth data term is handled with an
+// explicit gradient step (the Condat-Vu variant), so every iteration is
+//   x' = x - tau (grad data(x) + sum_s D_s' p_s)
+//   p_s = clip(p_s + sigma D_s (2x' - x), -kappa_s, kappa_s)
+// This only needs one application of the image model and its transpose, and
+// otherwise pointwise operations. There are no inner solves or reweighting
+// rounds, so the cost of every iteration is the same and known up front.
+
+#ifndef SRC_OPTIMIZATION_PRIMAL_DUAL_SOLVER_H_
+#define SRC_OPTIMIZATION_PRIMAL_DUAL_SOLVER_H_
+
+#include <memory>
+#include <vector>
+
+#include "image/image_data.h"
+#include "image_model/image_model.h"
+#include "optimization/map_solver.h"
+#include "optimization/regularizer.h"
+
+namespace super_resolution {
+
+struct PrimalDualSolverOptions : public MapSolverOptions {
+  PrimalDualSolverOptions() {}  // Required for making a const instance.
+
+  // Print also includes specific primal-dual parameters.
+  virtual void PrintSolverOptions() const;
+
+  // Maximum number of primal-dual iterations.
+  int max_num_primal_dual_iterations = 1000;
+
+  // The ratio sigma / tau of the dual and primal step sizes. The step sizes
+  // themselves are the largest ones for which the iterations are guaranteed to
+  // converge, given this ratio.
+  double step_size_ratio = 1.0;
+
+  // The solver stops once the root mean squares of the changes in both the
+  // estimate and the dual variables in one iteration are below this threshold.
+  double primal_dual_change_threshold = 1.0e-6;
+};
+
+class PrimalDualSolver : public MapSolver {
+ public:
+  PrimalDualSolver(
+      const PrimalDualSolverOptions& solver_options,
+      const ImageModel& image_model,
+      const std::vector<ImageData>& low_res_images,
+      const bool print_solver_output = true);
+
+  // Only regularizers defined by shifted differences are supported. Adding
+  // any other regularizer causes a check fail.
+  virtual void AddRegularizer(
+      std::shared_ptr<Regularizer> regularizer,
+      const double regularization_parameter);
+
+  virtual ImageData Solve(const ImageData& initial_estimate);
+
+ private:
+  // Passed in through the constructor.
+  const PrimalDualSolverOptions solver_options_;
+};
+
+}  // namespace super_resolution
+
+#endif  // SRC_OPTIMIZATION_PRIMAL_DUAL_SOLVER_H_
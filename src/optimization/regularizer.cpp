@@ -0,0 +1,154 @@
+#include "optimization/regularizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include "util/util.h"
+
+#include "glog/logging.h"
+
+namespace super_resolution {
+
+void Regularizer::ComputeValues(
+    const double* image_data, const int num_channels, double* values) const {
+
+  CHECK_NOTNULL(image_data);
+  CHECK_NOTNULL(values);
+
+  const int width = image_size_.width;
+  const int height = image_size_.height;
+  const int num_pixels = image_size_.area();
+  std::vector<ShiftedDifference> shifted_differences;
+  if (!GetShiftedDifferences(&shifted_differences)) {
+    const std::vector<double> image_values =
+        ApplyToImage(image_data, num_channels);
+    CHECK_EQ(image_values.size(), num_pixels * num_channels)
+        << "Number of values does not match the number of pixels.";
+    std::copy(image_values.begin(), image_values.end(), values);
+    return;
+  }
+
+  // Each channel only writes its own values, so the channels are computed in
+  // parallel. The differences are still added in the same order per value.
+  util::ParallelFor(num_channels, [&](const int channel) {
+    double* channel_values = values + channel * num_pixels;
+    std::fill(channel_values, channel_values + num_pixels, 0.0);
+    for (const ShiftedDifference& difference : shifted_differences) {
+      if (channel >= num_channels - difference.channel_shift) {
+        continue;
+      }
+      const int index_shift = difference.channel_shift * num_pixels +
+          difference.row_shift * width + difference.col_shift;
+      for (int row = 0; row < height - difference.row_shift; ++row) {
+        const int row_index = channel * num_pixels + row * width;
+        const double* pixels = image_data + row_index;
+        const double* shifted_pixels = pixels + index_shift;
+        double* row_values = values + row_index;
+        for (int col = 0; col < width - difference.col_shift; ++col) {
+          row_values[col] += difference.coefficient *
+              std::abs(pixels[col] - shifted_pixels[col]);
+        }
+      }
+    }
+  });
+}
+
+double Regularizer::ComputeWeightedSquaredSum(
+    const double* image_data,
+    const std::vector<double>& weights,
+    const int num_channels) const {
+
+  CHECK_NOTNULL(image_data);
+
+  const std::vector<double> values = ApplyToImage(image_data, num_channels);
+  CHECK_EQ(values.size(), weights.size())
+      << "Number of weights does not match the number of values.";
+
+  double weighted_sum = 0.0;
+  const int num_values = values.size();
+  for (int i = 0; i < num_values; ++i) {
+    weighted_sum += weights[i] * values[i] * values[i];
+  }
+  return weighted_sum;
+}
+
+double Regularizer::ComputeWeightedSquaredSumAndGradient(
+    const double* image_data,
+    const int num_channels,
+    const double regularization_parameter,
+    const std::vector<double>& weights,
+    double* residuals,
+    double* gradient) const {
+
+  CHECK_NOTNULL(image_data);
+  CHECK_NOTNULL(gradient);
+
+  const int num_values = image_size_.area() * num_channels;
+  CHECK_EQ(weights.size(), num_values)
+      << "Number of weights does not match the number of values.";
+
+  std::vector<double> gradient_constants(num_values);
+  for (int i = 0; i < num_values; ++i) {
+    gradient_constants[i] = regularization_parameter * weights[i];
+  }
+  const std::pair<std::vector<double>, std::vector<double>>
+  values_and_partials = ApplyToImageWithDifferentiation(
+      image_data, gradient_constants, num_channels);
+  const std::vector<double>& values = values_and_partials.first;
+  const std::vector<double>& partials = values_and_partials.second;
+
+  double weighted_sum = 0.0;
+  for (int i = 0; i < num_values; ++i) {
+    weighted_sum += gradient_constants[i] * values[i] * values[i];
+    gradient[i] += partials[i];
+  }
+  if (residuals != nullptr) {
+    std::copy(values.begin(), values.end(), residuals);
+  }
+  return weighted_sum;
+}
+
+void Regularizer::AddToHessianDiagonal(
+    const int num_channels,
+    const double regularization_parameter,
+    const std::vector<double>& weights,
+    double* diagonal) const {
+
+  CHECK_NOTNULL(diagonal);
+
+  std::vector<ShiftedDifference> shifted_differences;
+  if (!GetShiftedDifferences(&shifted_differences)) {
+    return;
+  }
+
+  // Each term c * |x(p) - x(q)| of the value at p contributes
+  // 2 * lambda * w_p * c^2 to the curvature at both p and q.
+  const int width = image_size_.width;
+  const int height = image_size_.height;
+  const int num_pixels = image_size_.area();
+  CHECK_EQ(weights.size(), num_pixels * num_channels)
+      << "Number of weights does not match the number of pixels.";
+  for (const ShiftedDifference& difference : shifted_differences) {
+    const double scale = 2 * regularization_parameter *
+        difference.coefficient * difference.coefficient;
+    const int index_shift = difference.channel_shift * num_pixels +
+        difference.row_shift * width + difference.col_shift;
+    for (int channel = 0;
+         channel < num_channels - difference.channel_shift;
+         ++channel) {
+      for (int row = 0; row < height - difference.row_shift; ++row) {
+        const int row_index = channel * num_pixels + row * width;
+        for (int col = 0; col < width - difference.col_shift; ++col) {
+          const int index = row_index + col;
+          const double value = scale * weights[index];
+          diagonal[index] += value;
+          diagonal[index + index_shift] += value;
+        }
+      }
+    }
+  }
+}
+
+}  // namespace super_resolution
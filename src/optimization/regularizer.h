@@ -3,6 +3,7 @@
 #ifndef SRC_OPTIMIZATION_REGULARIZER_H_
 #define SRC_OPTIMIZATION_REGULARIZER_H_
 
+#include <memory>
 #include <utility>
 #include <vector>
 
@@ -10,6 +11,28 @@
 
 namespace super_resolution {
 
+// One term of a regularizer value that is a weighted sum of absolute forward
+// differences. At pixel p = (channel, row, col), the term is
+//   coefficient * |x(p) - x(p + shift)|
+// where shift = (channel_shift, row_shift, col_shift), and it is 0 if the
+// shifted pixel is outside of the image. All shifts are non-negative.
+struct ShiftedDifference {
+  ShiftedDifference(
+      const int channel_shift,
+      const int row_shift,
+      const int col_shift,
+      const double coefficient)
+      : channel_shift(channel_shift),
+        row_shift(row_shift),
+        col_shift(col_shift),
+        coefficient(coefficient) {}
+
+  int channel_shift;
+  int row_shift;
+  int col_shift;
+  double coefficient;
+};
+
 class Regularizer {
  public:
   // Initialize the regularization term object with the image size, which is
@@ -26,6 +49,16 @@ class Regularizer {
   virtual std::vector<double> ApplyToImage(
       const double* image_data, const int num_channels) const = 0;
 
+  // Same as ApplyToImage, but writes the values to the given array (one value
+  // per pixel in every channel) instead of allocating a new vector, e.g. for
+  // reusing a buffer across solver iterations. The default implementation
+  // evaluates the shifted differences (see GetShiftedDifferences()) directly,
+  // and otherwise copies the values of ApplyToImage().
+  virtual void ComputeValues(
+      const double* image_data,
+      const int num_channels,
+      double* values) const;
+
   // Same as ApplyToImage, but the second vector returned in the pair contains
   // the gradient (assuming a single residual value) in the objective
   // function). That is, this is the gradient with respect to each pixel.
@@ -44,6 +77,87 @@ class Regularizer {
       const std::vector<double>& gradient_constants,
       const int num_channels) const = 0;
 
+  // Returns the weighted sum of squared regularization values over all pixels,
+  // sum_i weights[i] * r_i^2, where r_i are the values that ApplyToImage()
+  // would return. This is the cost-only path used when no gradient is needed,
+  // so implementations should compute it in a single pass without allocating
+  // any full-size buffers. The default implementation uses ApplyToImage().
+  virtual double ComputeWeightedSquaredSum(
+      const double* image_data,
+      const std::vector<double>& weights,
+      const int num_channels) const;
+
+  // Allocation-free value and gradient evaluation. Returns
+  //   regularization_parameter * sum_i weights[i] * r_i^2
+  // and adds the gradient of that cost w.r.t. each pixel to the given
+  // gradient array (which is not reset). If residuals is not null, the
+  // regularization values r_i are also written to it. Both arrays are owned by
+  // the caller and must hold one value per pixel in every channel.
+  //
+  // Implementations should compute everything in a single pass without
+  // allocating any full-size buffers. The default implementation uses
+  // ApplyToImageWithDifferentiation().
+  virtual double ComputeWeightedSquaredSumAndGradient(
+      const double* image_data,
+      const int num_channels,
+      const double regularization_parameter,
+      const std::vector<double>& weights,
+      double* residuals,
+      double* gradient) const;
+
+  // Adds a non-negative approximation of the diagonal of the Hessian of
+  //   regularization_parameter * sum_i weights[i] * r_i^2
+  // to the given array (one value per pixel in every channel), which is not
+  // reset. This is used for diagonal preconditioning. The default
+  // implementation uses GetShiftedDifferences(), treating every absolute
+  // difference as linear and dropping the cross terms between differences.
+  // Regularizers without shifted differences add nothing by default.
+  virtual void AddToHessianDiagonal(
+      const int num_channels,
+      const double regularization_parameter,
+      const std::vector<double>& weights,
+      double* diagonal) const;
+
+  // Returns a new regularizer of the same type and with the same parameters
+  // for images of the given size (e.g. for coarse-to-fine solving), or nullptr
+  // if this regularizer does not support that, which is the default.
+  virtual std::shared_ptr<Regularizer> CreateForImageSize(
+      const cv::Size& image_size) const {
+    return nullptr;
+  }
+
+  // Returns true if the squared values of this regularizer already form a
+  // smooth (differentiable) penalty that should be minimized as is. The IRLS
+  // solver keeps the weights of smooth regularizers at 1 instead of
+  // reweighting them towards a 1-norm.
+  virtual bool IsSmooth() const {
+    return false;
+  }
+
+  // Returns true if the weighted squared sum of this regularizer is a
+  // quadratic function of the image (i.e. every value is linear in the pixels,
+  // as for the Laplacian). With fixed weights the IRLS subproblem is then a
+  // linear least squares problem that can be solved with linear CG.
+  virtual bool IsQuadratic() const {
+    return false;
+  }
+
+  // Called by iterative solvers with the current estimate once before each
+  // outer round (e.g. each IRLS round). Regularizers that adapt to the image
+  // content rebuild their internal state here, which then stays fixed for
+  // every evaluation within the round. Does nothing by default.
+  virtual void UpdateFromEstimate(
+      const double* image_data, const int num_channels) {}
+
+  // If this regularizer's value at every pixel is a sum of ShiftedDifference
+  // terms, returns true and sets the list of terms. Such regularizers can be
+  // evaluated together in a single fused pass over the image (see
+  // ObjectiveFusedRegularizationTerm). Returns false by default.
+  virtual bool GetShiftedDifferences(
+      std::vector<ShiftedDifference>* shifted_differences) const {
+    return false;
+  }
+
  protected:
   // The size of the image to be regularized.
   const cv::Size image_size_;
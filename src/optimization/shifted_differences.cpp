@@ -0,0 +1,132 @@
+#include "optimization/shifted_differences.h"
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "optimization/regularizer.h"
+
+#include "opencv2/core/core.hpp"
+
+#include "glog/logging.h"
+
+namespace super_resolution {
+namespace {
+
+// Returns the index offset of the shifted neighbor, and sets the number of
+// channels, rows and columns for which that neighbor is inside the image.
+int GetShiftRange(
+    const cv::Size& image_size,
+    const int num_channels,
+    const ShiftedDifference& shift,
+    int* num_shifted_channels,
+    int* num_shifted_rows,
+    int* num_shifted_cols) {
+
+  *num_shifted_channels = num_channels - shift.channel_shift;
+  *num_shifted_rows = image_size.height - shift.row_shift;
+  *num_shifted_cols = image_size.width - shift.col_shift;
+  return shift.channel_shift * image_size.area() +
+      shift.row_shift * image_size.width + shift.col_shift;
+}
+
+}  // namespace
+
+void ApplyShiftedDifference(
+    const double* image_data,
+    const cv::Size& image_size,
+    const int num_channels,
+    const ShiftedDifference& shift,
+    double* differences) {
+
+  std::fill(differences, differences + image_size.area() * num_channels, 0.0);
+  int num_shifted_channels, num_shifted_rows, num_shifted_cols;
+  const int shift_offset = GetShiftRange(
+      image_size,
+      num_channels,
+      shift,
+      &num_shifted_channels,
+      &num_shifted_rows,
+      &num_shifted_cols);
+  for (int channel = 0; channel < num_shifted_channels; ++channel) {
+    for (int row = 0; row < num_shifted_rows; ++row) {
+      const int row_index = (channel * image_size.height + row) *
+          image_size.width;
+      const double* pixels = image_data + row_index;
+      const double* shifted_pixels = pixels + shift_offset;
+      double* row_differences = differences + row_index;
+      for (int col = 0; col < num_shifted_cols; ++col) {
+        row_differences[col] = pixels[col] - shifted_pixels[col];
+      }
+    }
+  }
+}
+
+void AddShiftedDifferenceTranspose(
+    const double* values,
+    const cv::Size& image_size,
+    const int num_channels,
+    const ShiftedDifference& shift,
+    const double scale,
+    double* output) {
+
+  int num_shifted_channels, num_shifted_rows, num_shifted_cols;
+  const int shift_offset = GetShiftRange(
+      image_size,
+      num_channels,
+      shift,
+      &num_shifted_channels,
+      &num_shifted_rows,
+      &num_shifted_cols);
+  for (int channel = 0; channel < num_shifted_channels; ++channel) {
+    for (int row = 0; row < num_shifted_rows; ++row) {
+      const int row_index = (channel * image_size.height + row) *
+          image_size.width;
+      const double* row_values = values + row_index;
+      double* row_output = output + row_index;
+      for (int col = 0; col < num_shifted_cols; ++col) {
+        row_output[col] += scale * row_values[col];
+      }
+      // The shifted pixels are updated in a separate pass since they can
+      // overlap with the unshifted ones within a row.
+      double* shifted_output = row_output + shift_offset;
+      for (int col = 0; col < num_shifted_cols; ++col) {
+        shifted_output[col] -= scale * row_values[col];
+      }
+    }
+  }
+}
+
+std::vector<ShiftedDifference> GetMergedShiftedDifferences(
+    const std::vector<std::pair<std::shared_ptr<Regularizer>, double>>&
+        regularizers) {
+
+  std::vector<ShiftedDifference> merged_shifts;
+  for (const auto& regularizer_and_parameter : regularizers) {
+    std::vector<ShiftedDifference> shifts;
+    CHECK(regularizer_and_parameter.first->GetShiftedDifferences(&shifts));
+    for (const ShiftedDifference& shift : shifts) {
+      const double coefficient =
+          regularizer_and_parameter.second * shift.coefficient;
+      auto merged_shift = std::find_if(
+          merged_shifts.begin(),
+          merged_shifts.end(),
+          [&shift](const ShiftedDifference& other) {
+            return other.channel_shift == shift.channel_shift &&
+                   other.row_shift == shift.row_shift &&
+                   other.col_shift == shift.col_shift;
+          });
+      if (merged_shift != merged_shifts.end()) {
+        merged_shift->coefficient += coefficient;
+      } else {
+        merged_shifts.push_back(ShiftedDifference(
+            shift.channel_shift, shift.row_shift, shift.col_shift,
+            coefficient));
+      }
+    }
+  }
+  return merged_shifts;
+}
+
+}  // namespace super_resolution
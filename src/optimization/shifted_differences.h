@@ -0,0 +1,46 @@
+// Operators for the shifted differences that define 1-norm regularizers such
+// as TV, 3D TV and BTV (see Regularizer::GetShiftedDifferences). For a shift s,
+// D_s maps an image x to x(p) - x(p + s) at every pixel p. These are used by
+// the solvers that handle the 1-norm terms directly instead of through IRLS.
+
+#ifndef SRC_OPTIMIZATION_SHIFTED_DIFFERENCES_H_
+#define SRC_OPTIMIZATION_SHIFTED_DIFFERENCES_H_
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "optimization/regularizer.h"
+
+#include "opencv2/core/core.hpp"
+
+namespace super_resolution {
+
+// Writes D_s x to differences, that is x(p) - x(p + shift) for every pixel p
+// whose shifted neighbor is inside the image, and 0 for all other pixels.
+void ApplyShiftedDifference(
+    const double* image_data,
+    const cv::Size& image_size,
+    const int num_channels,
+    const ShiftedDifference& shift,
+    double* differences);
+
+// Adds scale * D_s'v to the output.
+void AddShiftedDifferenceTranspose(
+    const double* values,
+    const cv::Size& image_size,
+    const int num_channels,
+    const ShiftedDifference& shift,
+    const double scale,
+    double* output);
+
+// Returns the shifted differences of all regularizers, with the coefficients
+// of identical shifts merged and scaled by the regularization parameters. All
+// regularizers must define shifted differences.
+std::vector<ShiftedDifference> GetMergedShiftedDifferences(
+    const std::vector<std::pair<std::shared_ptr<Regularizer>, double>>&
+        regularizers);
+
+}  // namespace super_resolution
+
+#endif  // SRC_OPTIMIZATION_SHIFTED_DIFFERENCES_H_
@@ -0,0 +1,278 @@
+#include "optimization/smooth_tv_regularizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "util/util.h"
+
+#include "opencv2/core/core.hpp"
+
+#include "glog/logging.h"
+
+namespace super_resolution {
+namespace {
+
+// Charbonnier penalty: rho(t) = sqrt(t^2 + epsilon^2) - epsilon, with
+// rho'(t) / t = 1 / sqrt(t^2 + epsilon^2).
+struct IsotropicPenalty {
+  explicit IsotropicPenalty(const double epsilon)
+      : epsilon(epsilon), epsilon_squared(epsilon * epsilon) {}
+
+  // Returns rho(t) given t^2, and sets rho'(t) / t, which scales each forward
+  // difference in the gradient.
+  inline double Evaluate(
+      const double magnitude_squared, double* derivative_scale) const {
+    const double smoothed_magnitude =
+        std::sqrt(magnitude_squared + epsilon_squared);
+    *derivative_scale = 1.0 / smoothed_magnitude;
+    return smoothed_magnitude - epsilon;
+  }
+
+  const double epsilon;
+  const double epsilon_squared;
+};
+
+// Huber penalty: rho(t) = t^2 / (2 * delta) for t <= delta and t - delta / 2
+// otherwise, with rho'(t) / t = 1 / max(t, delta).
+struct HuberPenalty {
+  explicit HuberPenalty(const double delta) : delta(delta) {}
+
+  inline double Evaluate(
+      const double magnitude_squared, double* derivative_scale) const {
+    const double magnitude = std::sqrt(magnitude_squared);
+    *derivative_scale = 1.0 / std::max(magnitude, delta);
+    return (magnitude <= delta) ?
+        magnitude_squared / (2 * delta) : magnitude - delta / 2;
+  }
+
+  const double delta;
+};
+
+// Row-sweep evaluation shared by both penalties (see
+// SmoothTotalVariationRegularizer::Evaluate for the parameters). Forward
+// differences are computed once per row and the neighbor partials are
+// buffered, the same way as in TotalVariationRegularizer.
+template <typename Penalty>
+double EvaluateSmoothTotalVariation(
+    const Penalty& penalty,
+    const double* image_data,
+    const cv::Size& image_size,
+    const int num_channels,
+    const bool use_3d_total_variation,
+    const double regularization_parameter,
+    const double* weights,
+    double* residuals,
+    double* gradient) {
+
+  const int width = image_size.width;
+  const int height = image_size.height;
+  const int num_pixels = image_size.area();
+  std::vector<double> x_differences(width);
+  std::vector<double> y_differences(width);
+  std::vector<double> z_differences(width, 0.0);
+  std::vector<double> derivative_scales(width);
+
+  double penalty_sum = 0.0;
+  for (int channel = 0; channel < num_channels; ++channel) {
+    const bool has_next_channel =
+        use_3d_total_variation && (channel + 1) < num_channels;
+    for (int row = 0; row < height; ++row) {
+      const int row_index = util::GetPixelIndex(image_size, channel, row, 0);
+      const double* pixels = image_data + row_index;
+      for (int col = 0; col < width - 1; ++col) {
+        x_differences[col] = pixels[col + 1] - pixels[col];
+      }
+      x_differences[width - 1] = 0.0;
+      if (row + 1 < height) {
+        for (int col = 0; col < width; ++col) {
+          y_differences[col] = pixels[col + width] - pixels[col];
+        }
+      } else {
+        std::fill(y_differences.begin(), y_differences.end(), 0.0);
+      }
+      if (has_next_channel) {
+        for (int col = 0; col < width; ++col) {
+          z_differences[col] = pixels[col + num_pixels] - pixels[col];
+        }
+      } else {
+        std::fill(z_differences.begin(), z_differences.end(), 0.0);
+      }
+
+      for (int col = 0; col < width; ++col) {
+        const double magnitude_squared =
+            x_differences[col] * x_differences[col] +
+            y_differences[col] * y_differences[col] +
+            z_differences[col] * z_differences[col];
+        const double value =
+            penalty.Evaluate(magnitude_squared, &derivative_scales[col]);
+        if (residuals != nullptr) {
+          residuals[row_index + col] = std::sqrt(value);
+        }
+        const double weight =
+            (weights != nullptr) ? weights[row_index + col] : 1.0;
+        penalty_sum += weight * value;
+        derivative_scales[col] *= regularization_parameter * weight;
+      }
+      if (gradient == nullptr) {
+        continue;
+      }
+
+      // d rho / d dx = dx * rho'(t) / t. The differences are overwritten with
+      // their partials.
+      for (int col = 0; col < width; ++col) {
+        x_differences[col] *= derivative_scales[col];
+        y_differences[col] *= derivative_scales[col];
+        z_differences[col] *= derivative_scales[col];
+      }
+      double* row_gradient = gradient + row_index;
+      row_gradient[0] -= x_differences[0] + y_differences[0] + z_differences[0];
+      for (int col = 1; col < width; ++col) {
+        row_gradient[col] +=
+            x_differences[col - 1] -
+            x_differences[col] -
+            y_differences[col] -
+            z_differences[col];
+      }
+      if (row + 1 < height) {
+        double* below_gradient = row_gradient + width;
+        for (int col = 0; col < width; ++col) {
+          below_gradient[col] += y_differences[col];
+        }
+      }
+      if (has_next_channel) {
+        double* next_channel_gradient = row_gradient + num_pixels;
+        for (int col = 0; col < width; ++col) {
+          next_channel_gradient[col] += z_differences[col];
+        }
+      }
+    }
+  }
+  return penalty_sum;
+}
+
+}  // namespace
+
+SmoothTotalVariationRegularizer::SmoothTotalVariationRegularizer(
+    const cv::Size& image_size,
+    const SmoothTotalVariationPenalty penalty,
+    const double smoothing_parameter)
+    : Regularizer(image_size),
+      penalty_(penalty),
+      smoothing_parameter_(smoothing_parameter),
+      use_3d_total_variation_(false) {
+
+  CHECK_GT(smoothing_parameter_, 0.0)
+      << "The smoothing parameter must be positive.";
+}
+
+std::vector<double> SmoothTotalVariationRegularizer::ApplyToImage(
+    const double* image_data, const int num_channels) const {
+
+  CHECK_NOTNULL(image_data);
+
+  std::vector<double> residuals(image_size_.area() * num_channels);
+  Evaluate(image_data, num_channels, 1.0, nullptr, residuals.data(), nullptr);
+  return residuals;
+}
+
+std::pair<std::vector<double>, std::vector<double>>
+SmoothTotalVariationRegularizer::ApplyToImageWithDifferentiation(
+    const double* image_data,
+    const std::vector<double>& gradient_constants,
+    const int num_channels) const {
+
+  const int num_parameters = image_size_.area() * num_channels;
+  std::vector<double> residuals(num_parameters);
+  std::vector<double> gradient(num_parameters, 0.0);
+  ComputeWeightedSquaredSumAndGradient(
+      image_data,
+      num_channels,
+      1.0,
+      gradient_constants,
+      residuals.data(),
+      gradient.data());
+  return std::make_pair(residuals, gradient);
+}
+
+double SmoothTotalVariationRegularizer::ComputeWeightedSquaredSum(
+    const double* image_data,
+    const std::vector<double>& weights,
+    const int num_channels) const {
+
+  CHECK_NOTNULL(image_data);
+  CHECK_EQ(weights.size(), image_size_.area() * num_channels)
+      << "Number of weights does not match the number of pixels.";
+
+  return Evaluate(
+      image_data, num_channels, 1.0, weights.data(), nullptr, nullptr);
+}
+
+double SmoothTotalVariationRegularizer::ComputeWeightedSquaredSumAndGradient(
+    const double* image_data,
+    const int num_channels,
+    const double regularization_parameter,
+    const std::vector<double>& weights,
+    double* residuals,
+    double* gradient) const {
+
+  CHECK_NOTNULL(image_data);
+  CHECK_NOTNULL(gradient);
+  CHECK_EQ(weights.size(), image_size_.area() * num_channels)
+      << "Number of weights does not match the number of pixels.";
+
+  return regularization_parameter * Evaluate(
+      image_data,
+      num_channels,
+      regularization_parameter,
+      weights.data(),
+      residuals,
+      gradient);
+}
+
+double SmoothTotalVariationRegularizer::Evaluate(
+    const double* image_data,
+    const int num_channels,
+    const double regularization_parameter,
+    const double* weights,
+    double* residuals,
+    double* gradient) const {
+
+  if (penalty_ == HUBER_PENALTY) {
+    return EvaluateSmoothTotalVariation(
+        HuberPenalty(smoothing_parameter_),
+        image_data,
+        image_size_,
+        num_channels,
+        use_3d_total_variation_,
+        regularization_parameter,
+        weights,
+        residuals,
+        gradient);
+  }
+  return EvaluateSmoothTotalVariation(
+      IsotropicPenalty(smoothing_parameter_),
+      image_data,
+      image_size_,
+      num_channels,
+      use_3d_total_variation_,
+      regularization_parameter,
+      weights,
+      residuals,
+      gradient);
+}
+
+std::shared_ptr<Regularizer>
+SmoothTotalVariationRegularizer::CreateForImageSize(
+    const cv::Size& image_size) const {
+
+  std::shared_ptr<SmoothTotalVariationRegularizer> regularizer(
+      new SmoothTotalVariationRegularizer(
+          image_size, penalty_, smoothing_parameter_));
+  regularizer->SetUse3dTotalVariation(use_3d_total_variation_);
+  return regularizer;
+}
+
+}  // namespace super_resolution
@@ -0,0 +1,115 @@
+// Smooth (differentiable) variants of total variation. Unlike the anisotropic
+// 1-norm TotalVariationRegularizer, whose sign-function derivatives make the
+// gradient discontinuous, these penalize the isotropic gradient magnitude
+//   t_i = sqrt(dx_i^2 + dy_i^2 (+ dz_i^2 for 3D TV))
+// of forward differences with a penalty rho(t) that is continuously
+// differentiable. That lets quasi-Newton solvers (e.g. LBFGS_SOLVER) minimize
+// the regularized objective directly, without IRLS reweighting.
+//
+// The values returned by ApplyToImage() are sqrt(rho(t_i)), so that the sum of
+// squared values (the form used by the objective terms) is the penalty itself.
+
+#ifndef SRC_OPTIMIZATION_SMOOTH_TV_REGULARIZER_H_
+#define SRC_OPTIMIZATION_SMOOTH_TV_REGULARIZER_H_
+
+#include <utility>
+#include <vector>
+
+#include "optimization/regularizer.h"
+
+#include "opencv2/core/core.hpp"
+
+namespace super_resolution {
+
+// The available smooth penalties on the gradient magnitude t.
+enum SmoothTotalVariationPenalty {
+  // rho(t) = sqrt(t^2 + epsilon^2) - epsilon (Charbonnier smoothed TV).
+  ISOTROPIC_PENALTY,
+
+  // rho(t) = t^2 / (2 * delta) if t <= delta, or t - delta / 2 otherwise.
+  HUBER_PENALTY
+};
+
+class SmoothTotalVariationRegularizer : public Regularizer {
+ public:
+  // The smoothing parameter is epsilon for the isotropic penalty and delta
+  // for the Huber penalty. It must be positive.
+  SmoothTotalVariationRegularizer(
+      const cv::Size& image_size,
+      const SmoothTotalVariationPenalty penalty,
+      const double smoothing_parameter);
+
+  virtual std::vector<double> ApplyToImage(
+      const double* image_data, const int num_channels) const;
+
+  virtual std::pair<std::vector<double>, std::vector<double>>
+  ApplyToImageWithDifferentiation(
+      const double* image_data,
+      const std::vector<double>& gradient_constants,
+      const int num_channels) const;
+
+  virtual double ComputeWeightedSquaredSum(
+      const double* image_data,
+      const std::vector<double>& weights,
+      const int num_channels) const;
+
+  virtual double ComputeWeightedSquaredSumAndGradient(
+      const double* image_data,
+      const int num_channels,
+      const double regularization_parameter,
+      const std::vector<double>& weights,
+      double* residuals,
+      double* gradient) const;
+
+  virtual std::shared_ptr<Regularizer> CreateForImageSize(
+      const cv::Size& image_size) const;
+
+  virtual bool IsSmooth() const {
+    return true;
+  }
+
+  // Turn using 3D total variation on or off (also includes the spectral
+  // difference in the gradient magnitude).
+  void SetUse3dTotalVariation(const bool use_3d_total_variation) {
+    use_3d_total_variation_ = use_3d_total_variation;
+  }
+
+ private:
+  // Computes the penalty rho(t_i) for every pixel. If residuals is not null,
+  // sqrt(rho(t_i)) is written to it. If gradient is not null, the gradient of
+  // regularization_parameter * sum_i weights[i] * rho(t_i) is added to it.
+  // Returns sum_i weights[i] * rho(t_i), or sum_i rho(t_i) if weights is null.
+  double Evaluate(
+      const double* image_data,
+      const int num_channels,
+      const double regularization_parameter,
+      const double* weights,
+      double* residuals,
+      double* gradient) const;
+
+  const SmoothTotalVariationPenalty penalty_;
+  const double smoothing_parameter_;
+  bool use_3d_total_variation_;
+};
+
+// Isotropic TV with Charbonnier smoothing, sqrt(t^2 + epsilon^2) - epsilon.
+class IsotropicTotalVariationRegularizer
+    : public SmoothTotalVariationRegularizer {
+ public:
+  IsotropicTotalVariationRegularizer(
+      const cv::Size& image_size, const double epsilon)
+      : SmoothTotalVariationRegularizer(
+            image_size, ISOTROPIC_PENALTY, epsilon) {}
+};
+
+// Huber TV: quadratic for gradient magnitudes up to delta, linear above.
+class HuberTotalVariationRegularizer : public SmoothTotalVariationRegularizer {
+ public:
+  HuberTotalVariationRegularizer(
+      const cv::Size& image_size, const double delta)
+      : SmoothTotalVariationRegularizer(image_size, HUBER_PENALTY, delta) {}
+};
+
+}  // namespace super_resolution
+
+#endif  // SRC_OPTIMIZATION_SMOOTH_TV_REGULARIZER_H_
@@ -4,10 +4,13 @@
 #ifndef SRC_OPTIMIZATION_SOLVER_H_
 #define SRC_OPTIMIZATION_SOLVER_H_
 
+#include <memory>
+#include <string>
 #include <vector>
 
 #include "image/image_data.h"
 #include "image_model/image_model.h"
+#include "optimization/solver_telemetry.h"
 
 namespace super_resolution {
 
@@ -33,6 +36,16 @@ class Solver {
     return is_verbose_;
   }
 
+  // Records the statistics of every solver iteration to the given sink. The
+  // stage prefix is prepended to the stage names of all records (e.g. to tell
+  // nested solvers apart). Set to nullptr to disable (default).
+  void SetTelemetry(
+      std::shared_ptr<SolverTelemetry> telemetry,
+      const std::string& stage_prefix = "") {
+    telemetry_ = telemetry;
+    telemetry_stage_prefix_ = stage_prefix;
+  }
+
  protected:
   const ImageModel& image_model_;
 
@@ -40,6 +53,10 @@ class Solver {
   // output (after or even during iterations) so that it runs silently. This
   // feature must be implemented by all derived classes to work.
   bool is_verbose_ = true;
+
+  // Set with SetTelemetry().
+  std::shared_ptr<SolverTelemetry> telemetry_;
+  std::string telemetry_stage_prefix_;
 };
 
 }  // namespace super_resolution
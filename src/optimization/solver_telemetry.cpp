@@ -0,0 +1,108 @@
+#include "optimization/solver_telemetry.h"
+
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "util/string_util.h"
+
+#include "glog/logging.h"
+
+namespace super_resolution {
+namespace {
+
+// Significant digits written for every value.
+constexpr int kTelemetryPrecision = 10;
+
+// Writes the value, or the given placeholder if the value is NaN.
+void WriteValue(
+    const double value, const std::string& nan_placeholder, std::ostream* out) {
+  if (std::isnan(value)) {
+    *out << nan_placeholder;
+  } else {
+    *out << value;
+  }
+}
+
+}  // namespace
+
+SolverTelemetry::SolverTelemetry(
+    std::shared_ptr<std::ostream> stream, const TelemetryFormat format)
+    : stream_(stream),
+      format_(format),
+      start_time_(std::chrono::steady_clock::now()),
+      header_written_(false) {
+
+  CHECK(stream_ != nullptr) << "The telemetry stream must not be null.";
+  stream_->precision(kTelemetryPrecision);
+}
+
+std::shared_ptr<SolverTelemetry> SolverTelemetry::CreateForFile(
+    const std::string& file_path) {
+
+  std::shared_ptr<std::ofstream> file(new std::ofstream(file_path));
+  CHECK(file->is_open()) << "Could not open telemetry file " << file_path;
+  const std::string extension = util::GetFileExtension(file_path);
+  const TelemetryFormat format =
+      (extension == "json" || extension == "jsonl") ?
+      TELEMETRY_JSON : TELEMETRY_CSV;
+  return std::shared_ptr<SolverTelemetry>(new SolverTelemetry(file, format));
+}
+
+void SolverTelemetry::RecordIteration(const SolverIterationRecord& record) {
+  const std::chrono::duration<double> wall_time =
+      std::chrono::steady_clock::now() - start_time_;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::ostream& out = *stream_;
+  if (format_ == TELEMETRY_CSV) {
+    if (!header_written_) {
+      out << "stage,round,iteration,cost,gradient_norm,step_size,wall_time,"
+          << "num_evaluations,term_costs\n";
+      header_written_ = true;
+    }
+    out << record.stage << ',' << record.round << ',' << record.iteration
+        << ',';
+    WriteValue(record.cost, "", &out);
+    out << ',';
+    WriteValue(record.gradient_norm, "", &out);
+    out << ',';
+    WriteValue(record.step_size, "", &out);
+    out << ',' << wall_time.count() << ',' << record.num_evaluations << ',';
+    // Term costs share one column, separated by semicolons.
+    for (int i = 0; i < record.term_costs.size(); ++i) {
+      if (i > 0) {
+        out << ';';
+      }
+      WriteValue(record.term_costs[i], "", &out);
+    }
+    out << '\n';
+  } else {
+    out << "{\"stage\":\"" << record.stage << "\""
+        << ",\"round\":" << record.round
+        << ",\"iteration\":" << record.iteration
+        << ",\"cost\":";
+    WriteValue(record.cost, "null", &out);
+    out << ",\"gradient_norm\":";
+    WriteValue(record.gradient_norm, "null", &out);
+    out << ",\"step_size\":";
+    WriteValue(record.step_size, "null", &out);
+    out << ",\"wall_time\":" << wall_time.count()
+        << ",\"num_evaluations\":" << record.num_evaluations
+        << ",\"term_costs\":[";
+    for (int i = 0; i < record.term_costs.size(); ++i) {
+      if (i > 0) {
+        out << ',';
+      }
+      WriteValue(record.term_costs[i], "null", &out);
+    }
+    out << "]}\n";
+  }
+}
+
+}  // namespace super_resolution
@@ -0,0 +1,83 @@
+// A sink for per-iteration solver statistics (cost, gradient norm, step size,
+// timing and objective evaluations), written as CSV or JSON Lines so that
+// iteration budgets can be tuned offline. Recording an iteration only formats
+// one line into a buffered stream, so telemetry can stay enabled in
+// production runs.
+
+#ifndef SRC_OPTIMIZATION_SOLVER_TELEMETRY_H_
+#define SRC_OPTIMIZATION_SOLVER_TELEMETRY_H_
+
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace super_resolution {
+
+// The available output formats.
+enum TelemetryFormat {
+  TELEMETRY_CSV,  // One header line, then one comma-separated line per record.
+  TELEMETRY_JSON  // One JSON object per line (JSON Lines).
+};
+
+// The statistics of one solver iteration. Values that a solver does not
+// compute are left as NaN, and are written as empty CSV fields or JSON nulls.
+struct SolverIterationRecord {
+  // Identifies the (sub)problem that was solved, e.g. "irls_channel_2" or
+  // "tile_3/irls" for nested solvers. Must not contain commas or quotes.
+  std::string stage;
+
+  // The outer round (e.g. IRLS reweighting iteration) and the iteration
+  // within that round.
+  int round = 0;
+  int iteration = 0;
+
+  // The objective cost and gradient norm at the new estimate.
+  double cost = std::numeric_limits<double>::quiet_NaN();
+  double gradient_norm = std::numeric_limits<double>::quiet_NaN();
+
+  // The norm of the change in the estimate during this iteration.
+  double step_size = std::numeric_limits<double>::quiet_NaN();
+
+  // The total number of objective evaluations in this round so far.
+  int num_evaluations = 0;
+
+  // The cost of each objective term (e.g. data term and regularization), in
+  // the order that the terms were added.
+  std::vector<double> term_costs;
+};
+
+class SolverTelemetry {
+ public:
+  // Writes records to the given stream in the given format.
+  SolverTelemetry(
+      std::shared_ptr<std::ostream> stream, const TelemetryFormat format);
+
+  // Creates a sink that writes to the given file, which is overwritten. Files
+  // ending in ".json" or ".jsonl" are written as JSON Lines, all others as
+  // CSV.
+  static std::shared_ptr<SolverTelemetry> CreateForFile(
+      const std::string& file_path);
+
+  // Writes the record, along with the wall time in seconds since this sink
+  // was created. This is thread-safe, so concurrent solvers can share a sink.
+  void RecordIteration(const SolverIterationRecord& record);
+
+ private:
+  std::shared_ptr<std::ostream> stream_;
+  const TelemetryFormat format_;
+  const std::chrono::steady_clock::time_point start_time_;
+
+  // The CSV header is written with the first record.
+  bool header_written_;
+
+  // Serializes records written from concurrent solvers.
+  std::mutex mutex_;
+};
+
+}  // namespace super_resolution
+
+#endif  // SRC_OPTIMIZATION_SOLVER_TELEMETRY_H_
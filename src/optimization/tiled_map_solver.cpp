@@ -0,0 +1,247 @@
+#include "optimization/tiled_map_solver.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "image/image_data.h"
+#include "image_model/image_model.h"
+#include "optimization/irls_map_solver.h"
+#include "optimization/map_solver.h"
+#include "optimization/regularizer.h"
+#include "util/util.h"
+
+#include "opencv2/core/core.hpp"
+
+#include "glog/logging.h"
+
+namespace super_resolution {
+namespace {
+
+// Extra halo (in HR pixels) beyond the model support. The regularizers also
+// couple neighboring pixels, so the tile boundary needs a little more room.
+constexpr int kHaloPaddingSize = 4;
+
+// Returns the given region of every channel of the image as a new image.
+ImageData CropImage(const ImageData& image, const cv::Rect& region) {
+  const int image_width = image.GetImageSize().width;
+  const cv::Size region_size(region.width, region.height);
+  std::vector<double> region_pixels(region.width * region.height);
+  ImageData cropped_image;
+  for (int channel = 0; channel < image.GetNumChannels(); ++channel) {
+    const double* channel_data = image.GetChannelData(channel);
+    for (int row = 0; row < region.height; ++row) {
+      const double* row_start =
+          channel_data + (region.y + row) * image_width + region.x;
+      std::copy(
+          row_start,
+          row_start + region.width,
+          region_pixels.begin() + row * region.width);
+    }
+    cropped_image.AddChannel(region_pixels.data(), region_size);
+  }
+  return cropped_image;
+}
+
+// Returns the blending weight of a pixel at the given position for a tile that
+// covers [tile_start, tile_end). The weight is 1 inside the tile and drops
+// linearly to 0 over blend_size pixels on either side. Pixels further out in
+// the halo are too close to the edge of the extended tile, where the missing
+// data beyond it distorts the solution, and are not used at all.
+double GetBlendingWeight(
+    const int position,
+    const int tile_start,
+    const int tile_end,
+    const int blend_size) {
+
+  int distance = 0;
+  if (position < tile_start) {
+    distance = tile_start - position;
+  } else if (position >= tile_end) {
+    distance = position - tile_end + 1;
+  }
+  return std::max(
+      0.0, 1.0 - static_cast<double>(distance) / (blend_size + 1));
+}
+
+}  // namespace
+
+TiledMapSolver::TiledMapSolver(
+    const IRLSMapSolverOptions& solver_options,
+    const int tile_size,
+    const ImageModel& image_model,
+    const std::vector<ImageData>& low_res_images,
+    const bool print_solver_output)
+    : Solver(image_model, print_solver_output),
+      solver_options_(solver_options),
+      tile_size_(tile_size),
+      low_res_images_(low_res_images) {
+
+  CHECK_GT(low_res_images.size(), 0)
+      << "Cannot super-resolve with 0 low-res images.";
+
+  const int scale = image_model.GetDownsamplingScale();
+  CHECK_GT(tile_size, 0) << "The tile size must be positive.";
+  CHECK_EQ(tile_size % scale, 0)
+      << "The tile size must be a multiple of the downsampling scale.";
+  if (!solver_options.checkpoint_path.empty()) {
+    LOG(WARNING) << "Checkpointing is not supported for tiled solves.";
+  }
+
+  // The data term couples HR pixels that are up to twice the support radius
+  // apart (through A'A). The halo is kept aligned with the LR pixel grid.
+  const int support_radius =
+      image_model.GetSupportRadius(low_res_images.size());
+  const int min_halo_size = 2 * support_radius + kHaloPaddingSize;
+  halo_size_ = ((min_halo_size + scale - 1) / scale) * scale;
+}
+
+void TiledMapSolver::AddRegularizer(
+    const std::shared_ptr<Regularizer> regularizer,
+    const double regularization_parameter) {
+
+  regularizers_.push_back(
+      std::make_pair(regularizer, regularization_parameter));
+}
+
+ImageData TiledMapSolver::Solve(const ImageData& initial_estimate) {
+  const int scale = image_model_.GetDownsamplingScale();
+  const cv::Size image_size = initial_estimate.GetImageSize();
+  const int num_channels = initial_estimate.GetNumChannels();
+  CHECK_EQ(image_size.width, low_res_images_[0].GetImageSize().width * scale)
+      << "The initial estimate does not match the HR image size.";
+  CHECK_EQ(image_size.height, low_res_images_[0].GetImageSize().height * scale)
+      << "The initial estimate does not match the HR image size.";
+
+  // The tiles, and their extended regions including the halo.
+  std::vector<cv::Rect> tiles;
+  std::vector<cv::Rect> extended_tiles;
+  for (int y = 0; y < image_size.height; y += tile_size_) {
+    for (int x = 0; x < image_size.width; x += tile_size_) {
+      const int tile_end_x = std::min(x + tile_size_, image_size.width);
+      const int tile_end_y = std::min(y + tile_size_, image_size.height);
+      tiles.push_back(cv::Rect(x, y, tile_end_x - x, tile_end_y - y));
+      const int extended_x = std::max(x - halo_size_, 0);
+      const int extended_y = std::max(y - halo_size_, 0);
+      const int extended_end_x =
+          std::min(tile_end_x + halo_size_, image_size.width);
+      const int extended_end_y =
+          std::min(tile_end_y + halo_size_, image_size.height);
+      extended_tiles.push_back(cv::Rect(
+          extended_x,
+          extended_y,
+          extended_end_x - extended_x,
+          extended_end_y - extended_y));
+    }
+  }
+  const int num_tiles = tiles.size();
+  if (IsVerbose()) {
+    LOG(INFO) << "Solving " << num_tiles << " tiles of size " << tile_size_
+              << " with a halo of " << halo_size_ << " pixels.";
+  }
+
+  // Only the inner half of the halo is blended with the neighboring tiles.
+  const int blend_size = halo_size_ / 2;
+
+  // Weighted sums of the tile results, normalized once all tiles are done.
+  const int num_pixels = image_size.width * image_size.height;
+  std::vector<double> blended_pixels(num_channels * num_pixels, 0.0);
+  std::vector<double> weight_sums(num_pixels, 0.0);
+  std::mutex blending_mutex;
+
+  // With a time limit, the tiles that have not started yet run in batches of
+  // one tile per thread, and every batch gets an equal share of the time that
+  // is left.
+  const std::chrono::steady_clock::time_point deadline =
+      solver_options_.GetDeadline();
+  const int num_threads = std::max(cv::getNumThreads(), 1);
+  std::atomic<int> num_tiles_started(0);
+
+  const auto solve_tile = [&](const int tile_index) {
+    const cv::Rect& tile = tiles[tile_index];
+    const cv::Rect& extended_tile = extended_tiles[tile_index];
+    const cv::Size extended_tile_size(
+        extended_tile.width, extended_tile.height);
+    const cv::Rect low_res_region(
+        extended_tile.x / scale,
+        extended_tile.y / scale,
+        extended_tile.width / scale,
+        extended_tile.height / scale);
+
+    std::vector<ImageData> low_res_tiles;
+    for (const ImageData& low_res_image : low_res_images_) {
+      low_res_tiles.push_back(CropImage(low_res_image, low_res_region));
+    }
+    IRLSMapSolverOptions tile_solver_options = solver_options_;
+    tile_solver_options.checkpoint_path.clear();
+    if (solver_options_.time_limit_seconds > 0.0) {
+      const int num_tiles_left = num_tiles - num_tiles_started++;
+      const int num_batches_left =
+          (num_tiles_left + num_threads - 1) / num_threads;
+      const std::chrono::duration<double> tile_time_limit =
+          GetPartialDeadline(deadline, 1.0 / num_batches_left) -
+          std::chrono::steady_clock::now();
+      // A non-positive limit would disable the limit altogether.
+      tile_solver_options.time_limit_seconds = std::max(
+          tile_time_limit.count(), std::numeric_limits<double>::min());
+    }
+    IRLSMapSolver tile_solver(
+        tile_solver_options, image_model_, low_res_tiles, false);
+    tile_solver.SetTelemetry(
+        telemetry_,
+        telemetry_stage_prefix_ + "tile_" + std::to_string(tile_index) + "/");
+    for (const auto& regularizer_and_parameter : regularizers_) {
+      const std::shared_ptr<Regularizer> tile_regularizer =
+          regularizer_and_parameter.first->CreateForImageSize(
+              extended_tile_size);
+      CHECK(tile_regularizer != nullptr)
+          << "Tiled solving requires regularizers that can be resized.";
+      tile_solver.AddRegularizer(
+          tile_regularizer, regularizer_and_parameter.second);
+    }
+    const ImageData tile_result =
+        tile_solver.Solve(CropImage(initial_estimate, extended_tile));
+
+    std::lock_guard<std::mutex> lock(blending_mutex);
+    for (int row = 0; row < extended_tile.height; ++row) {
+      const int y = extended_tile.y + row;
+      const double row_weight =
+          GetBlendingWeight(y, tile.y, tile.y + tile.height, blend_size);
+      for (int col = 0; col < extended_tile.width; ++col) {
+        const int x = extended_tile.x + col;
+        const double weight = row_weight *
+            GetBlendingWeight(x, tile.x, tile.x + tile.width, blend_size);
+        const int pixel_index = y * image_size.width + x;
+        const int tile_pixel_index = row * extended_tile.width + col;
+        for (int channel = 0; channel < num_channels; ++channel) {
+          blended_pixels[channel * num_pixels + pixel_index] += weight *
+              tile_result.GetChannelData(channel)[tile_pixel_index];
+        }
+        weight_sums[pixel_index] += weight;
+      }
+    }
+    if (IsVerbose()) {
+      LOG(INFO) << "Tile " << (tile_index + 1) << " of " << num_tiles
+                << " done.";
+    }
+  };
+  util::ParallelFor(num_tiles, solve_tile);
+
+  // Every pixel is covered by its own tile with a weight of 1, so the sums are
+  // always positive.
+  for (int channel = 0; channel < num_channels; ++channel) {
+    for (int pixel_index = 0; pixel_index < num_pixels; ++pixel_index) {
+      blended_pixels[channel * num_pixels + pixel_index] /=
+          weight_sums[pixel_index];
+    }
+  }
+  return ImageData(blended_pixels.data(), image_size, num_channels);
+}
+
+}  // namespace super_resolution
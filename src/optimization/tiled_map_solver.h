@@ -0,0 +1,75 @@
+// A MAP solver for very large images. The HR image is divided into square
+// tiles that are each solved independently by an IRLSMapSolver. Every tile is
+// extended by a halo (overlap with its neighbors) that is wide enough to cover
+// the support of the image model, and the tile results are blended back
+// together with weights that fade out linearly across the halo. Only the LR
+// pixels of one extended tile are upsampled at a time, so the memory used is
+// bounded by the tile size (times the number of tiles solved concurrently)
+// instead of the full HR image size.
+//
+// The image model must be spatially invariant (e.g. global motion shifts and
+// a single blur kernel), so that the same model applies to every tile.
+
+#ifndef SRC_OPTIMIZATION_TILED_MAP_SOLVER_H_
+#define SRC_OPTIMIZATION_TILED_MAP_SOLVER_H_
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "image/image_data.h"
+#include "image_model/image_model.h"
+#include "optimization/irls_map_solver.h"
+#include "optimization/regularizer.h"
+#include "optimization/solver.h"
+
+namespace super_resolution {
+
+class TiledMapSolver : public Solver {
+ public:
+  // The tile size is given in HR pixels and must be a multiple of the image
+  // model's downsampling scale. Tiles at the right and bottom image edges may
+  // be smaller. Every tile is solved with the given IRLS options, except that
+  // the time limit (if any) applies to the whole solve and is split between
+  // the tiles, and the tiles are not checkpointed.
+  //
+  // The low-res images are not copied, so they must outlive this solver.
+  TiledMapSolver(
+      const IRLSMapSolverOptions& solver_options,
+      const int tile_size,
+      const ImageModel& image_model,
+      const std::vector<ImageData>& low_res_images,
+      const bool print_solver_output = true);
+
+  // Adds a regularizer for the full HR image. Each tile is regularized by its
+  // own copy for the tile size (see Regularizer::CreateForImageSize()), so
+  // only regularizers that support copying can be used.
+  void AddRegularizer(
+      const std::shared_ptr<Regularizer> regularizer,
+      const double regularization_parameter);
+
+  // Solves all tiles in parallel and returns the blended HR image.
+  virtual ImageData Solve(const ImageData& initial_estimate);
+
+  // Returns the number of HR pixels by which every tile is extended on each
+  // side (except at the image borders).
+  int GetHaloSize() const {
+    return halo_size_;
+  }
+
+ private:
+  // Passed in through the constructor.
+  const IRLSMapSolverOptions solver_options_;
+  const int tile_size_;
+  const std::vector<ImageData>& low_res_images_;
+
+  // Computed from the image model support and the downsampling scale.
+  int halo_size_;
+
+  // The full image regularizers and their regularization parameters.
+  std::vector<std::pair<std::shared_ptr<Regularizer>, double>> regularizers_;
+};
+
+}  // namespace super_resolution
+
+#endif  // SRC_OPTIMIZATION_TILED_MAP_SOLVER_H_
@@ -2,6 +2,7 @@
 
 #include <algorithm>
 #include <cmath>
+#include <memory>
 #include <utility>
 #include <vector>
 
@@ -14,95 +15,238 @@
 namespace super_resolution {
 namespace {
 
-// For a given image row and col, returns the value of (x_{r,c+1} - x_{r,c}) if
-// c+1 is a valid column position, or 0 otherwise. That is, the X-direction
-// gradient between the pixel at position index in the data and the pixel
-// immediately to its right in the image.
-double GetXGradientAtPixel(
+// Buffers holding the forward differences and total variation values of a
+// single image row. Allocated once per call and reused for every row.
+struct TotalVariationRow {
+  explicit TotalVariationRow(const int width)
+      : x_differences(width),
+        y_differences(width),
+        z_differences(width),
+        values(width),
+        has_z_differences(false) {}
+
+  // x_{r,c+1} - x_{r,c}, x_{r+1,c} - x_{r,c}, and x_{r,c}^{channel+1} -
+  // x_{r,c}. Differences to pixels outside of the image are 0.
+  std::vector<double> x_differences;
+  std::vector<double> y_differences;
+  std::vector<double> z_differences;
+
+  // The total variation 1-norm for each pixel in the row.
+  std::vector<double> values;
+
+  // True if the Z-direction (spectral) differences are used for this row.
+  bool has_z_differences;
+};
+
+// Computes the forward differences once for every pixel in the given row,
+// then the total variation values from them. The image borders are handled
+// outside of the inner loops, so those are branch-free.
+void ComputeTotalVariationRow(
     const double* image_data,
     const cv::Size& image_size,
+    const int num_channels,
+    const bool use_3d_total_variation,
     const int channel,
     const int row,
-    const int col) {
+    TotalVariationRow* total_variation_row) {
+
+  const int width = image_size.width;
+  const double* pixels =
+      image_data + util::GetPixelIndex(image_size, channel, row, 0);
+  double* x_differences = total_variation_row->x_differences.data();
+  double* y_differences = total_variation_row->y_differences.data();
+  double* z_differences = total_variation_row->z_differences.data();
+  double* values = total_variation_row->values.data();
 
-  if (col >= 0 && col + 1 < image_size.width) {
-    const int pixel_index = util::GetPixelIndex(image_size, channel, row, col);
-    const int x_neighbor_index =
-        util::GetPixelIndex(image_size, channel, row, col + 1);
-    return image_data[x_neighbor_index] - image_data[pixel_index];
+  for (int col = 0; col < width - 1; ++col) {
+    x_differences[col] = pixels[col + 1] - pixels[col];
   }
-  return 0;
-}
+  x_differences[width - 1] = 0.0;
 
-// Same as GetXGradientAtPixel, but for the value below the given pixel
-// rather than to the right. That is, the Y-direction gradient at that pixel.
-double GetYGradientAtPixel(
-    const double* image_data,
-    const cv::Size& image_size,
-    const int channel,
-    const int row,
-    const int col) {
+  if (row + 1 < image_size.height) {
+    const double* pixels_below = pixels + width;
+    for (int col = 0; col < width; ++col) {
+      y_differences[col] = pixels_below[col] - pixels[col];
+    }
+  } else {
+    std::fill(y_differences, y_differences + width, 0.0);
+  }
 
-  if (row >= 0 && row + 1 < image_size.height) {
-    const int pixel_index = util::GetPixelIndex(image_size, channel, row, col);
-    const int y_neighbor_index =
-        util::GetPixelIndex(image_size, channel, row + 1, col);
-    return image_data[y_neighbor_index] - image_data[pixel_index];
+  total_variation_row->has_z_differences =
+      use_3d_total_variation && (channel + 1) < num_channels;
+  if (total_variation_row->has_z_differences) {
+    const double* pixels_next_channel = pixels + image_size.area();
+    for (int col = 0; col < width; ++col) {
+      z_differences[col] = pixels_next_channel[col] - pixels[col];
+    }
+    for (int col = 0; col < width; ++col) {
+      values[col] =
+          std::abs(x_differences[col]) +
+          std::abs(y_differences[col]) +
+          std::abs(z_differences[col]);
+    }
+  } else {
+    for (int col = 0; col < width; ++col) {
+      values[col] = std::abs(x_differences[col]) + std::abs(y_differences[col]);
+    }
   }
-  return 0;
 }
 
-// Same as GetXGradientAtPixel, but uses the Z-direction for multispectral
-// images. This does not check for the validity of the index at the next image
-// channel, so only call if there is definately a channel + 1.
-double GetZGradientAtPixel(
+// The approximate number of pixels in one band of a 3D TV tile. A tile's rows
+// of two adjacent bands, with their weights and gradients, should fit in the
+// L2 cache.
+constexpr int kTilePixels = 4096;
+
+// Evaluates 3D total variation over the rows [row_start, row_end) of every
+// band. Bands are swept in order within the tile, so the rows of band c and
+// c + 1 are still in cache when they are differenced.
+//
+// Returns sum_i weights[i] * r_i^2 over the tile (or 0 if weights is null).
+// If residuals is not null, the values r_i of the tile are written to it. If
+// gradient is not null, the gradient of regularization_parameter *
+// sum_i weights[i] * r_i^2 is added to the tile's pixels. The gradient is
+// gathered, i.e. the partials from the row above and the previous band are
+// pulled into each pixel instead of being pushed forward, so that tiles only
+// write to their own rows and can run in parallel. The row above the tile is
+// evaluated as a halo for that purpose.
+double Evaluate3dTotalVariationTile(
     const double* image_data,
     const cv::Size& image_size,
-    const int channel,
-    const int row,
-    const int col) {
+    const int num_channels,
+    const int row_start,
+    const int row_end,
+    const double regularization_parameter,
+    const double* weights,
+    double* residuals,
+    double* gradient) {
 
-  const int pixel_index = util::GetPixelIndex(image_size, channel, row, col);
-  const int z_neighbor_index =
-      util::GetPixelIndex(image_size, channel + 1, row, col);
-  return image_data[z_neighbor_index] - image_data[pixel_index];
-}
+  const int width = image_size.width;
+  const int first_row =
+      (gradient != nullptr) ? std::max(0, row_start - 1) : row_start;
+  TotalVariationRow total_variation_row(width);
+  const double* x_differences = total_variation_row.x_differences.data();
+  const double* y_differences = total_variation_row.y_differences.data();
+  const double* z_differences = total_variation_row.z_differences.data();
+  const double* values = total_variation_row.values.data();
+  std::vector<double> x_partials(width);
+  std::vector<double> y_partials(width);
+  std::vector<double> z_partials(width);
+  std::vector<double> y_partials_above(width);
+  std::vector<double> z_partials_previous_band(
+      (row_end - row_start) * width, 0.0);
 
-// Computes the full total variation 1-norm for a pixel at (row, col) of the
-// given image_data. Returned value will be 0 for invalid row and col values.
-double GetTotalVariationAbs(
-    const double* image_data,
-    const cv::Size& image_size,
-    const int channel,
-    const int row,
-    const int col) {
+  double weighted_sum = 0.0;
+  for (int channel = 0; channel < num_channels; ++channel) {
+    std::fill(y_partials_above.begin(), y_partials_above.end(), 0.0);
+    for (int row = first_row; row < row_end; ++row) {
+      ComputeTotalVariationRow(
+          image_data,
+          image_size,
+          num_channels,
+          true,  // 3D total variation.
+          channel,
+          row,
+          &total_variation_row);
+      const bool is_halo_row = row < row_start;
+      const int row_index = util::GetPixelIndex(image_size, channel, row, 0);
+      if (!is_halo_row && residuals != nullptr) {
+        std::copy(values, values + width, residuals + row_index);
+      }
+      if (weights == nullptr) {
+        continue;
+      }
+
+      const double* row_weights = weights + row_index;
+      if (!is_halo_row) {
+        for (int col = 0; col < width; ++col) {
+          weighted_sum += row_weights[col] * values[col] * values[col];
+        }
+      }
+      if (gradient == nullptr) {
+        continue;
+      }
 
-  const double y_variation = std::abs(
-      GetYGradientAtPixel(image_data, image_size, channel, row, col));
-  const double x_variation = std::abs(
-      GetXGradientAtPixel(image_data, image_size, channel, row, col));
-  return y_variation + x_variation;
+      for (int col = 0; col < width; ++col) {
+        const double partial_scale =
+            2 * regularization_parameter * row_weights[col] * values[col];
+        x_partials[col] = partial_scale * util::GetSign(x_differences[col]);
+        y_partials[col] = partial_scale * util::GetSign(y_differences[col]);
+      }
+      if (total_variation_row.has_z_differences) {
+        for (int col = 0; col < width; ++col) {
+          const double partial_scale =
+              2 * regularization_parameter * row_weights[col] * values[col];
+          z_partials[col] = partial_scale * util::GetSign(z_differences[col]);
+        }
+      } else {
+        std::fill(z_partials.begin(), z_partials.end(), 0.0);
+      }
+      if (!is_halo_row) {
+        double* z_partials_previous =
+            z_partials_previous_band.data() + (row - row_start) * width;
+        double* row_gradient = gradient + row_index;
+        row_gradient[0] +=
+            y_partials_above[0] +
+            z_partials_previous[0] -
+            x_partials[0] -
+            y_partials[0] -
+            z_partials[0];
+        for (int col = 1; col < width; ++col) {
+          row_gradient[col] +=
+              x_partials[col - 1] +
+              y_partials_above[col] +
+              z_partials_previous[col] -
+              x_partials[col] -
+              y_partials[col] -
+              z_partials[col];
+        }
+        std::copy(z_partials.begin(), z_partials.end(), z_partials_previous);
+      }
+      std::swap(y_partials, y_partials_above);
+    }
+  }
+  return weighted_sum;
 }
 
-// Computes the 3D total variation, which is defined just as the 2D total
-// variation plus the Z-direction (spectral) variation. Same as
-// GetTotalVariationAbs if (channel + 1) >= num_channels.
-double GetTotalVariation3d(
+// Evaluates 3D total variation (see Evaluate3dTotalVariationTile) by
+// splitting the image into tiles of rows that are processed in parallel.
+// Returns sum_i weights[i] * r_i^2.
+double Evaluate3dTotalVariation(
     const double* image_data,
     const cv::Size& image_size,
     const int num_channels,
-    const int channel,
-    const int row,
-    const int col) {
-
-  double total_variation =
-      GetTotalVariationAbs(image_data, image_size, channel, row, col);
-  if ((channel + 1) < num_channels) {
-    const double z_variation = std::abs(
-        GetZGradientAtPixel(image_data, image_size, channel, row, col));
-    total_variation += z_variation;
+    const double regularization_parameter,
+    const double* weights,
+    double* residuals,
+    double* gradient) {
+
+  const int tile_height =
+      std::max(1, std::min(image_size.height, kTilePixels / image_size.width));
+  const int num_tiles = (image_size.height + tile_height - 1) / tile_height;
+
+  // Sums are kept per tile and added in order so that the result does not
+  // depend on the parallel execution order.
+  std::vector<double> tile_sums(num_tiles, 0.0);
+  util::ParallelFor(num_tiles, [&](const int tile) {
+    const int row_start = tile * tile_height;
+    const int row_end = std::min(image_size.height, row_start + tile_height);
+    tile_sums[tile] = Evaluate3dTotalVariationTile(
+        image_data,
+        image_size,
+        num_channels,
+        row_start,
+        row_end,
+        regularization_parameter,
+        weights,
+        residuals,
+        gradient);
+  });
+
+  double weighted_sum = 0.0;
+  for (const double tile_sum : tile_sums) {
+    weighted_sum += tile_sum;
   }
-  return total_variation;
+  return weighted_sum;
 }
 
 }  // namespace
@@ -114,116 +258,233 @@ std::vector<double> TotalVariationRegularizer::ApplyToImage(
 
   const int num_pixels = image_size_.area();
   std::vector<double> residuals(num_pixels * num_channels);
+  if (use_3d_total_variation_ && num_channels > 1) {
+    Evaluate3dTotalVariation(
+        image_data,
+        image_size_,
+        num_channels,
+        1.0,
+        nullptr,  // No weights.
+        residuals.data(),
+        nullptr);  // No gradient.
+    return residuals;
+  }
+
+  TotalVariationRow total_variation_row(image_size_.width);
   for (int channel = 0; channel < num_channels; ++channel) {
     for (int row = 0; row < image_size_.height; ++row) {
-      for (int col = 0; col < image_size_.width; ++col) {
-        const int index = util::GetPixelIndex(image_size_, channel, row, col);
-        if (use_3d_total_variation_) {
-          residuals[index] = GetTotalVariation3d(
-              image_data, image_size_, num_channels, channel, row, col);
-        } else {
-          residuals[index] = GetTotalVariationAbs(
-              image_data, image_size_, channel, row, col);
-        }
-      }
+      ComputeTotalVariationRow(
+          image_data,
+          image_size_,
+          num_channels,
+          use_3d_total_variation_,
+          channel,
+          row,
+          &total_variation_row);
+      std::copy(
+          total_variation_row.values.begin(),
+          total_variation_row.values.end(),
+          residuals.begin() +
+              util::GetPixelIndex(image_size_, channel, row, 0));
     }
   }
   return residuals;
 }
 
+double TotalVariationRegularizer::ComputeWeightedSquaredSum(
+    const double* image_data,
+    const std::vector<double>& weights,
+    const int num_channels) const {
+
+  CHECK_NOTNULL(image_data);
+
+  const int num_pixels = image_size_.area();
+  CHECK_EQ(weights.size(), num_pixels * num_channels)
+      << "Number of weights does not match the number of pixels.";
+
+  if (use_3d_total_variation_ && num_channels > 1) {
+    return Evaluate3dTotalVariation(
+        image_data,
+        image_size_,
+        num_channels,
+        1.0,
+        weights.data(),
+        nullptr,  // No residuals.
+        nullptr);  // No gradient.
+  }
+
+  const int width = image_size_.width;
+  TotalVariationRow total_variation_row(width);
+  const double* values = total_variation_row.values.data();
+  double weighted_sum = 0.0;
+  for (int channel = 0; channel < num_channels; ++channel) {
+    for (int row = 0; row < image_size_.height; ++row) {
+      ComputeTotalVariationRow(
+          image_data,
+          image_size_,
+          num_channels,
+          use_3d_total_variation_,
+          channel,
+          row,
+          &total_variation_row);
+      const double* row_weights =
+          weights.data() + util::GetPixelIndex(image_size_, channel, row, 0);
+      for (int col = 0; col < width; ++col) {
+        weighted_sum += row_weights[col] * values[col] * values[col];
+      }
+    }
+  }
+  return weighted_sum;
+}
+
 std::pair<std::vector<double>, std::vector<double>>
 TotalVariationRegularizer::ApplyToImageWithDifferentiation(
     const double* image_data,
     const std::vector<double>& gradient_constants,
     const int num_channels) const {
 
-  CHECK_NOTNULL(image_data);
+  const int num_parameters = image_size_.area() * num_channels;
+  std::vector<double> residuals(num_parameters);
+  std::vector<double> gradient(num_parameters, 0.0);
+  ComputeWeightedSquaredSumAndGradient(
+      image_data,
+      num_channels,
+      1.0,
+      gradient_constants,
+      residuals.data(),
+      gradient.data());
+  return std::make_pair(residuals, gradient);
+}
+
+double TotalVariationRegularizer::ComputeWeightedSquaredSumAndGradient(
+    const double* image_data,
+    const int num_channels,
+    const double regularization_parameter,
+    const std::vector<double>& weights,
+    double* residuals,
+    double* gradient) const {
 
-  const std::vector<double> residuals = ApplyToImage(image_data, num_channels);
+  CHECK_NOTNULL(image_data);
+  CHECK_NOTNULL(gradient);
 
-  // Compute the gradient.
-  // TODO: add some descriptive comments about computing the gradient.
   const int num_pixels = image_size_.area();
-  const int num_parameters = num_pixels * num_channels;
-  std::vector<double> gradient(num_parameters);
+  CHECK_EQ(weights.size(), num_pixels * num_channels)
+      << "Number of weights does not match the number of pixels.";
+
+  // 3D TV reads and writes across bands, so it uses the cache-blocked tiles.
+  if (use_3d_total_variation_ && num_channels > 1) {
+    return regularization_parameter * Evaluate3dTotalVariation(
+        image_data,
+        image_size_,
+        num_channels,
+        regularization_parameter,
+        weights.data(),
+        residuals,
+        gradient);
+  }
+
+  // Each pixel's value r_i = |x_right - x_i| + |x_below - x_i| (+ |x_next -
+  // x_i| in 3D) only depends on itself and its forward neighbors, so the
+  // gradient of lambda * w_i * r_i^2 is
+  //   d/dx_i        = -2 * lambda * w_i * r_i * (sign(dx) + sign(dy) + ...)
+  //   d/dx_neighbor =  2 * lambda * w_i * r_i * sign(d_neighbor)
+  // The neighbor partials of each row are buffered so that every pixel's
+  // gradient is gathered in a single vectorizable pass.
+  const int width = image_size_.width;
+  const int height = image_size_.height;
+  TotalVariationRow total_variation_row(width);
+  const double* x_differences = total_variation_row.x_differences.data();
+  const double* y_differences = total_variation_row.y_differences.data();
+  const double* z_differences = total_variation_row.z_differences.data();
+  const double* values = total_variation_row.values.data();
+  std::vector<double> x_partials(width);
+  std::vector<double> y_partials(width);
+  std::vector<double> z_partials(width, 0.0);
+
+  double weighted_sum = 0.0;
   for (int channel = 0; channel < num_channels; ++channel) {
-    for (int row = 0; row < image_size_.height; ++row) {
-      for (int col = 0; col < image_size_.width; ++col) {
-        const int index = util::GetPixelIndex(image_size_, channel, row, col);
-        // Derivative w.r.t. the pixel itself.
-        double didi = 0.0;
-        const double x_gradient =
-            GetXGradientAtPixel(image_data, image_size_, channel, row, col);
-        if (x_gradient < 0.0) {
-          didi += 1.0;
-        } else if (x_gradient > 0.0) {
-          didi -= 1.0;
-        }
-        const double y_gradient =
-            GetYGradientAtPixel(image_data, image_size_, channel, row, col);
-        if (y_gradient < 0.0) {
-          didi += 1.0;
-        } else if (y_gradient > 0.0) {
-          didi -= 1.0;
-        }
-        gradient[index] +=
-            2 * gradient_constants[index] * residuals[index] * didi;
-        // Derivative w.r.t. the pixel to the left.
-        if (col - 1 >= 0) {
-          const int left_index =
-              util::GetPixelIndex(image_size_, channel, row, col - 1);
-          const double left_gradient = GetXGradientAtPixel(
-              image_data, image_size_, channel, row, col - 1);
-          double dldi = 0.0;
-          if (left_gradient > 0.0) {
-            dldi = 1.0;
-          } else if (left_gradient < 0.0) {
-            dldi = -1.0;
-          }
-          gradient[index] +=
-              2 * gradient_constants[left_index] * residuals[left_index] * dldi;
+    for (int row = 0; row < height; ++row) {
+      ComputeTotalVariationRow(
+          image_data,
+          image_size_,
+          num_channels,
+          use_3d_total_variation_,
+          channel,
+          row,
+          &total_variation_row);
+      const bool has_z_differences = total_variation_row.has_z_differences;
+      const int row_index = util::GetPixelIndex(image_size_, channel, row, 0);
+      const double* row_weights = weights.data() + row_index;
+      if (residuals != nullptr) {
+        std::copy(values, values + width, residuals + row_index);
+      }
+
+      for (int col = 0; col < width; ++col) {
+        const double weighted_value = row_weights[col] * values[col];
+        weighted_sum += weighted_value * values[col];
+        const double partial_scale =
+            2 * regularization_parameter * weighted_value;
+        x_partials[col] = partial_scale * util::GetSign(x_differences[col]);
+        y_partials[col] = partial_scale * util::GetSign(y_differences[col]);
+        if (has_z_differences) {
+          z_partials[col] = partial_scale * util::GetSign(z_differences[col]);
         }
-        // Derivative w.r.t. the pixel above.
-        if (row - 1 >= 0) {
-          const int above_index =
-              util::GetPixelIndex(image_size_, channel, row - 1, col);
-          const double above_gradient = GetYGradientAtPixel(
-              image_data, image_size_, channel, row - 1, col);
-          double dadi = 0.0;
-          if (above_gradient > 0.0) {
-            dadi = 1.0;
-          } else if (above_gradient < 0.0) {
-            dadi = -1.0;
-          }
-          gradient[index] +=
-              2 *
-              gradient_constants[above_index] *
-              residuals[above_index] *
-              dadi;
+      }
+      if (!has_z_differences) {
+        std::fill(z_partials.begin(), z_partials.end(), 0.0);
+      }
+
+      // Each pixel receives its own partials and the X partial of the pixel
+      // to its left in this row.
+      double* row_gradient = gradient + row_index;
+      row_gradient[0] -= x_partials[0] + y_partials[0] + z_partials[0];
+      for (int col = 1; col < width; ++col) {
+        row_gradient[col] +=
+            x_partials[col - 1] -
+            x_partials[col] -
+            y_partials[col] -
+            z_partials[col];
+      }
+
+      // The Y and Z partials belong to the pixels below and in the next
+      // channel, which are visited later.
+      if (row + 1 < height) {
+        double* below_gradient = row_gradient + width;
+        for (int col = 0; col < width; ++col) {
+          below_gradient[col] += y_partials[col];
         }
-        // Derivative w.r.t. the pixel in the channel before (if 3D TV).
-        if (use_3d_total_variation_ && channel > 0) {
-          const int before_index =
-              util::GetPixelIndex(image_size_, channel - 1, row, col);
-          const double before_gradient = GetZGradientAtPixel(
-              image_data, image_size_, channel - 1, row, col);
-          double dbdi = 0.0;
-          if (before_gradient > 0.0) {
-            dbdi = 1.0;
-          } else if (before_gradient < 0.0) {
-            dbdi = -1.0;
-          }
-          gradient[index] +=
-              2 *
-              gradient_constants[before_index] *
-              residuals[before_index] *
-              dbdi;
+      }
+      if (has_z_differences) {
+        double* next_channel_gradient = row_gradient + num_pixels;
+        for (int col = 0; col < width; ++col) {
+          next_channel_gradient[col] += z_partials[col];
         }
       }
     }
   }
+  return regularization_parameter * weighted_sum;
+}
 
-  return std::make_pair(residuals, gradient);
+bool TotalVariationRegularizer::GetShiftedDifferences(
+    std::vector<ShiftedDifference>* shifted_differences) const {
+
+  CHECK_NOTNULL(shifted_differences);
+  shifted_differences->clear();
+  shifted_differences->push_back(ShiftedDifference(0, 0, 1, 1.0));
+  shifted_differences->push_back(ShiftedDifference(0, 1, 0, 1.0));
+  if (use_3d_total_variation_) {
+    shifted_differences->push_back(ShiftedDifference(1, 0, 0, 1.0));
+  }
+  return true;
+}
+
+std::shared_ptr<Regularizer> TotalVariationRegularizer::CreateForImageSize(
+    const cv::Size& image_size) const {
+
+  std::shared_ptr<TotalVariationRegularizer> regularizer(
+      new TotalVariationRegularizer(image_size));
+  regularizer->SetUse3dTotalVariation(use_3d_total_variation_);
+  return regularizer;
 }
 
 }  // namespace super_resolution
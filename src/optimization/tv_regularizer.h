@@ -32,6 +32,25 @@ class TotalVariationRegularizer : public Regularizer {
       const std::vector<double>& gradient_constants,
       const int num_channels) const;
 
+  virtual double ComputeWeightedSquaredSum(
+      const double* image_data,
+      const std::vector<double>& weights,
+      const int num_channels) const;
+
+  virtual double ComputeWeightedSquaredSumAndGradient(
+      const double* image_data,
+      const int num_channels,
+      const double regularization_parameter,
+      const std::vector<double>& weights,
+      double* residuals,
+      double* gradient) const;
+
+  virtual std::shared_ptr<Regularizer> CreateForImageSize(
+      const cv::Size& image_size) const;
+
+  virtual bool GetShiftedDifferences(
+      std::vector<ShiftedDifference>* shifted_differences) const;
+
   // Turn using 3D total variation on or off. 3D TV may be preferable for
   // hyperspectral data and can be used experimentally for color images.
   void SetUse3dTotalVariation(const bool use_3d_total_variation) {
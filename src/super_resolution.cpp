@@ -2,10 +2,17 @@
 // a given set of images or a video. It provides an interface for the user to
 // specify parameters of the algorithm without needing to code it directly.
 
+#include <unistd.h>
+
+#include <algorithm>
 #include <chrono>
+#include <fstream>
 #include <iostream>
 #include <memory>
+#include <sstream>
 #include <string>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
 #include "evaluation/peak_signal_to_noise_ratio.h"
@@ -18,9 +25,19 @@
 #include "image_model/image_model.h"
 #include "image_model/motion_module.h"
 #include "motion/motion_shift.h"
+#include "optimization/admm_solver.h"
 #include "optimization/btv_regularizer.h"
 #include "optimization/irls_map_solver.h"
+#include "optimization/laplacian_regularizer.h"
+#include "optimization/nonlocal_regularizer.h"
+#include "optimization/primal_dual_solver.h"
+#include "optimization/regularizer.h"
+#include "optimization/smooth_tv_regularizer.h"
+#include "optimization/solver.h"
+#include "optimization/solver_telemetry.h"
+#include "optimization/tiled_map_solver.h"
 #include "optimization/tv_regularizer.h"
+#include "util/batch_scheduler.h"
 #include "util/data_loader.h"
 #include "util/macros.h"
 #include "util/string_util.h"
@@ -28,6 +45,8 @@
 #include "util/visualization.h"
 #include "wavelet/wavelet_transform.h"
 
+#include "opencv2/core/core.hpp"
+
 #include "gflags/gflags.h"
 #include "glog/logging.h"
 
@@ -70,6 +89,8 @@ DEFINE_string(motion_sequence_path, "",
 // TODO: Add support for different solver strategies (e.g. ADMM).
 DEFINE_int32(optimization_iterations, 20,
     "Max number of optimization iterations (e.g. number of IRLS iterations).");
+DEFINE_double(regularization_norm, 1.0,
+    "The p-norm in (0, 2] that IRLS reweights the regularizers towards.");
 DEFINE_bool(solve_in_wavelet_domain, false,
     "Run super-resolution in the wavelet domain (experimental).");
 DEFINE_bool(interpolate_color, false,
@@ -84,23 +105,70 @@ DEFINE_bool(split_channels, false,
     "Each channel will be solved as an independent image.");
 
 // Regularization options:
-// TODO: Add support for multiple regularizers simultaneously.
 DEFINE_string(regularizer, "tv",
-    "The regularizer to use ('tv', '3dtv', 'btv').");
+    "Comma-delimited regularizers ('tv', '3dtv', 'btv', 'itv', 'huber', "
+    "'laplacian', 'nonlocal'), each with an optional ':lambda' "
+    "(e.g. 'tv:0.01,btv:0.005').");
 DEFINE_int32(btv_scale_range, 3,
     "The range (window size) for BTV regularization. Minumum range is 1.");
 DEFINE_double(btv_spatial_decay, 0.5,
     "The spatial decay factor for BTV regularization (0 < decay <= 1).");
+DEFINE_double(itv_epsilon, 0.001,
+    "The smoothing epsilon for isotropic TV ('itv') regularization.");
+DEFINE_double(huber_threshold, 0.01,
+    "The gradient magnitude threshold (delta) for Huber TV regularization.");
+DEFINE_int32(nonlocal_search_radius, 5,
+    "The search window radius for non-local regularization.");
+DEFINE_int32(nonlocal_patch_radius, 1,
+    "The patch radius for non-local patch distances.");
+DEFINE_int32(nonlocal_num_neighbors, 8,
+    "The number of most similar patches linked to each pixel (non-local).");
+DEFINE_double(nonlocal_filtering_parameter, 0.1,
+    "The patch distance falloff (h) of non-local weights exp(-d / h^2).");
 DEFINE_double(regularization_parameter, 0.01,
-    "The regularization parameter (lambda). 0 to not use regularization.");
+    "The default regularization parameter (lambda). 0 to not regularize.");
 
 // Solver parameters:
+DEFINE_string(optimization_method, "irls",
+    "The MAP optimization strategy ('irls', 'admm' or 'primal_dual'). ADMM "
+    "and primal-dual only support 'tv', '3dtv' and 'btv' regularizers.");
+DEFINE_int32(admm_iterations, 200,
+    "The maximum number of ADMM iterations.");
+DEFINE_int32(primal_dual_iterations, 1000,
+    "The maximum number of primal-dual iterations.");
+DEFINE_int32(multiscale_levels, 1,
+    "The number of coarse-to-fine resolution levels (IRLS only).");
+DEFINE_int32(tile_size, 0,
+    "Solve in overlapping tiles of this many HR pixels to bound memory on "
+    "very large images (IRLS only). 0 to solve the whole image at once.");
+DEFINE_string(checkpoint_path, "",
+    "File where the solver state is periodically checkpointed (IRLS only).");
+DEFINE_int32(checkpoint_interval, 1,
+    "The number of IRLS iterations between checkpoints.");
+DEFINE_bool(resume, false,
+    "Continue from the checkpoint in --checkpoint_path, if it exists.");
+DEFINE_bool(mixed_precision, false,
+    "Apply the image model in single precision, finishing in double "
+    "precision (IRLS only).");
+DEFINE_bool(refine_motion, false,
+    "Re-estimate the motion against the HR estimate between iterations "
+    "(IRLS only, not with split_channels).");
+DEFINE_double(time_limit, 0.0,
+    "Wall-clock time limit for the solver in seconds. The best estimate so "
+    "far is returned when it runs out. 0 for no limit.");
 DEFINE_string(solver, "cg",
     "The least squares solver to use ('cg' or 'lbfgs').");
 DEFINE_int32(solver_iterations, 50,
     "The maximum number of solver iterations.");
 DEFINE_bool(use_numerical_differentiation, false,
     "Use numerical differentiation (very slow) for test purposes.");
+DEFINE_bool(use_normal_equation_data_term, false,
+    "Precompute A'y and fuse A'A for translational models (faster).");
+DEFINE_bool(use_diagonal_preconditioner, true,
+    "Precondition the solvers with the observation coverage and weights.");
+DEFINE_bool(use_fourier_solver_if_possible, true,
+    "Solve in closed form with FFTs when only 'laplacian' is used and the "
+    "motion covers all downsampling phases uniformly.");
 
 // Evaluation and testing:
 DEFINE_bool(verbose, false,
@@ -113,6 +181,21 @@ DEFINE_string(display_mode, "",
     "'result' to display; 'compare' to also display bilinear upsampling.");
 DEFINE_string(result_path, "",
     "Name of file (with path) where the result image will be saved.");
+DEFINE_string(telemetry_path, "",
+    "File where per-iteration solver statistics are written (JSON Lines if "
+    "it ends in '.json' or '.jsonl', otherwise CSV).");
+
+// Batch mode (optional):
+DEFINE_string(batch_manifest, "",
+    "File listing scenes to super-resolve in this process instead of "
+    "data_path, one per line as space-separated key=value options (e.g. "
+    "'data_path=a/ motion_sequence_path=a.txt result_path=a.png').");
+DEFINE_int32(batch_num_workers, 0,
+    "The number of scenes solved concurrently in batch mode (0 = one per "
+    "CPU core).");
+DEFINE_int32(batch_memory_limit_mb, 0,
+    "The estimated memory (MB) that the scenes solved at once in batch mode "
+    "may use. 0 for no limit.");
 
 // This struct is used to track input data.
 struct InputData {
@@ -120,76 +203,423 @@ struct InputData {
   std::vector<ImageData> low_res_images;  // Necessary for super-resolution.
 };
 
+// The options that can be set for every scene of a batch (see the
+// batch_manifest flag). Outside of batch mode, these are set by the flags of
+// the same names. All other options are shared by every scene.
+struct SceneOptions {
+  // Identifies the scene in the logs. Defaults to the data path.
+  std::string name;
+
+  // Prepended to the stage names of the scene's telemetry records, so that
+  // the records of concurrently solved scenes can be told apart. Empty
+  // outside of batch mode.
+  std::string telemetry_stage_prefix;
+
+  std::string data_path;
+  std::string ground_truth_image;
+  std::string motion_sequence_path;
+  std::string result_path;
+  std::string checkpoint_path;
+  // Continue from the checkpoint, if it exists. Only applies to scenes with a
+  // checkpoint path.
+  bool resume;
+  int upsampling_scale;
+  int blur_radius;
+  double blur_sigma;
+  std::string regularizer;
+  double regularization_parameter;
+  int optimization_iterations;
+  double time_limit;
+};
+
+// The approximate number of HR-sized buffers that the solvers keep besides
+// the observations (e.g. the estimate, gradients, search directions and IRLS
+// weights). Used to estimate the memory of a scene in batch mode.
+constexpr int kNumSolverImageBuffers = 12;
+
+// Returns the scene options set by the flags.
+SceneOptions GetSceneOptionsFromFlags() {
+  SceneOptions scene_options;
+  scene_options.name = FLAGS_data_path;
+  scene_options.data_path = FLAGS_data_path;
+  scene_options.ground_truth_image = FLAGS_ground_truth_image;
+  scene_options.motion_sequence_path = FLAGS_motion_sequence_path;
+  scene_options.result_path = FLAGS_result_path;
+  scene_options.checkpoint_path = FLAGS_checkpoint_path;
+  scene_options.resume = FLAGS_resume;
+  scene_options.upsampling_scale = FLAGS_upsampling_scale;
+  scene_options.blur_radius = FLAGS_blur_radius;
+  scene_options.blur_sigma = FLAGS_blur_sigma;
+  scene_options.regularizer = FLAGS_regularizer;
+  scene_options.regularization_parameter = FLAGS_regularization_parameter;
+  scene_options.optimization_iterations = FLAGS_optimization_iterations;
+  scene_options.time_limit = FLAGS_time_limit;
+  return scene_options;
+}
+
+// Sets the scene option with the given name (as in the manifest) to the given
+// value. Returns false if there is no option with that name or if the value is
+// not valid for that option (e.g. a number with trailing characters).
+bool SetSceneOption(
+    const std::string& key,
+    const std::string& value,
+    SceneOptions* scene_options) {
+
+  if (key == "name") {
+    scene_options->name = value;
+  } else if (key == "data_path") {
+    scene_options->data_path = value;
+  } else if (key == "ground_truth_image") {
+    scene_options->ground_truth_image = value;
+  } else if (key == "motion_sequence_path") {
+    scene_options->motion_sequence_path = value;
+  } else if (key == "result_path") {
+    scene_options->result_path = value;
+  } else if (key == "checkpoint_path") {
+    scene_options->checkpoint_path = value;
+  } else if (key == "resume") {
+    if (value != "true" && value != "false") {
+      return false;
+    }
+    scene_options->resume = (value == "true");
+  } else if (key == "upsampling_scale") {
+    return super_resolution::util::ParseInt(
+        value, &scene_options->upsampling_scale);
+  } else if (key == "blur_radius") {
+    return super_resolution::util::ParseInt(
+        value, &scene_options->blur_radius);
+  } else if (key == "blur_sigma") {
+    return super_resolution::util::ParseDouble(
+        value, &scene_options->blur_sigma);
+  } else if (key == "regularizer") {
+    scene_options->regularizer = value;
+  } else if (key == "regularization_parameter") {
+    return super_resolution::util::ParseDouble(
+        value, &scene_options->regularization_parameter);
+  } else if (key == "optimization_iterations") {
+    return super_resolution::util::ParseInt(
+        value, &scene_options->optimization_iterations);
+  } else if (key == "time_limit") {
+    return super_resolution::util::ParseDouble(
+        value, &scene_options->time_limit);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Returns true if the given file or directory exists and can be read.
+bool IsReadablePath(const std::string& path) {
+  return access(path.c_str(), R_OK) == 0;
+}
+
+// Reads the scenes of the given batch manifest. Each non-empty line that does
+// not start with a "#" is a scene, given as space-separated key=value options
+// (see SceneOptions). Options that are not given for a scene are set by the
+// flags, except for the per-scene files, which must be given explicitly. The
+// resume flag only applies to the scenes that have a checkpoint path. Scenes
+// are solved concurrently, so no two scenes may write to the same file. The
+// input files of every scene are checked up front, since a missing file would
+// otherwise abort the other scenes in the middle of solving.
+std::vector<SceneOptions> ReadBatchManifest(const std::string& manifest_path) {
+  std::ifstream fin(manifest_path);
+  CHECK(fin.is_open())
+      << "Could not open batch manifest '" << manifest_path << "'.";
+
+  SceneOptions default_scene_options = GetSceneOptionsFromFlags();
+  default_scene_options.name.clear();
+  default_scene_options.data_path.clear();
+  default_scene_options.ground_truth_image.clear();
+  default_scene_options.motion_sequence_path.clear();
+  default_scene_options.result_path.clear();
+  default_scene_options.checkpoint_path.clear();
+
+  std::vector<SceneOptions> scenes;
+  std::unordered_set<std::string> output_paths;
+  std::string line;
+  int line_number = 0;
+  while (std::getline(fin, line)) {
+    line_number++;
+    line = super_resolution::util::TrimString(line);
+    if (line.empty() || line.find("#") == 0) {
+      continue;
+    }
+    SceneOptions scene_options = default_scene_options;
+    for (const std::string& option :
+         super_resolution::util::SplitString(line, ' ', true)) {
+      const std::vector<std::string> key_and_value =
+          super_resolution::util::SplitString(option, '=', true, 2);
+      CHECK(key_and_value.size() == 2 &&
+            SetSceneOption(key_and_value[0], key_and_value[1], &scene_options))
+          << "Invalid option '" << option << "' on line " << line_number
+          << " of the batch manifest.";
+    }
+    CHECK(!scene_options.data_path.empty())
+        << "Missing data_path on line " << line_number
+        << " of the batch manifest.";
+    for (const std::string& input_path :
+         {scene_options.data_path,
+          scene_options.ground_truth_image,
+          scene_options.motion_sequence_path}) {
+      CHECK(input_path.empty() || IsReadablePath(input_path))
+          << "Cannot read the input file '" << input_path << "' on line "
+          << line_number << " of the batch manifest.";
+    }
+    CHECK(FLAGS_generate_lr_images ||
+          !super_resolution::util::GetImageFilePaths(
+              scene_options.data_path).empty())
+        << "No images in data_path '" << scene_options.data_path
+        << "' on line " << line_number << " of the batch manifest.";
+    if (scene_options.name.empty()) {
+      scene_options.name = scene_options.data_path;
+    }
+    // Stage names must not contain commas or quotes (see
+    // SolverIterationRecord).
+    scene_options.telemetry_stage_prefix = scene_options.name + "/";
+    std::replace_if(
+        scene_options.telemetry_stage_prefix.begin(),
+        scene_options.telemetry_stage_prefix.end(),
+        [](const char c) { return c == ',' || c == '"'; },
+        '_');
+    if (scene_options.checkpoint_path.empty()) {
+      scene_options.resume = false;
+    }
+    for (const std::string& output_path :
+         {scene_options.result_path, scene_options.checkpoint_path}) {
+      CHECK(output_path.empty() || output_paths.insert(output_path).second)
+          << "The output file '" << output_path << "' on line " << line_number
+          << " of the batch manifest is already written by another scene.";
+    }
+    scenes.push_back(scene_options);
+  }
+  return scenes;
+}
+
+// Returns the approximate memory in bytes that solving for the given number
+// of LR images needs, given the number of values (pixels times channels) of
+// the HR image: the observations are stored at the HR size, along with the
+// solver's own HR-sized buffers.
+size_t EstimateSceneMemoryBytes(
+    const size_t num_high_res_values, const int num_low_res_images) {
+
+  return num_high_res_values * sizeof(double) *
+      (num_low_res_images + kNumSolverImageBuffers);
+}
+
+// Returns a new regularizer for the given name (see the regularizer flag).
+// Unknown names fall back to the default Total Variation regularizer.
+std::shared_ptr<super_resolution::Regularizer> CreateRegularizer(
+    const std::string& regularizer_name, const cv::Size& image_size) {
+
+  if (regularizer_name == "tv" || regularizer_name == "3dtv") {
+    std::shared_ptr<super_resolution::TotalVariationRegularizer> regularizer(
+        new super_resolution::TotalVariationRegularizer(image_size));
+    regularizer->SetUse3dTotalVariation(regularizer_name == "3dtv");
+    return regularizer;
+  }
+  if (regularizer_name == "btv") {
+    return std::shared_ptr<super_resolution::Regularizer>(
+        new super_resolution::BilateralTotalVariationRegularizer(
+            image_size, FLAGS_btv_scale_range, FLAGS_btv_spatial_decay));
+  }
+  if (regularizer_name == "itv") {
+    return std::shared_ptr<super_resolution::Regularizer>(
+        new super_resolution::IsotropicTotalVariationRegularizer(
+            image_size, FLAGS_itv_epsilon));
+  }
+  if (regularizer_name == "huber") {
+    return std::shared_ptr<super_resolution::Regularizer>(
+        new super_resolution::HuberTotalVariationRegularizer(
+            image_size, FLAGS_huber_threshold));
+  }
+  if (regularizer_name == "laplacian") {
+    return std::shared_ptr<super_resolution::Regularizer>(
+        new super_resolution::LaplacianRegularizer(image_size));
+  }
+  if (regularizer_name == "nonlocal") {
+    return std::shared_ptr<super_resolution::Regularizer>(
+        new super_resolution::NonLocalRegularizer(
+            image_size,
+            FLAGS_nonlocal_search_radius,
+            FLAGS_nonlocal_patch_radius,
+            FLAGS_nonlocal_num_neighbors,
+            FLAGS_nonlocal_filtering_parameter));
+  }
+  LOG(WARNING) << "Unknown regularizer option '" << regularizer_name
+               << "'. Using default Total Variation regularizer.";
+  return std::shared_ptr<super_resolution::Regularizer>(
+      new super_resolution::TotalVariationRegularizer(image_size));
+}
+
+// Returns the telemetry sink for the --telemetry_path flag, or nullptr if the
+// flag is not set. All solver runs of the program share one sink, so the
+// records of batch scenes are told apart by their stage prefix (see
+// SceneOptions::telemetry_stage_prefix).
+std::shared_ptr<super_resolution::SolverTelemetry> GetSolverTelemetry() {
+  static const std::shared_ptr<super_resolution::SolverTelemetry> telemetry =
+      FLAGS_telemetry_path.empty() ? nullptr :
+      super_resolution::SolverTelemetry::CreateForFile(FLAGS_telemetry_path);
+  return telemetry;
+}
+
 // Runs the solver on the given inputs and returns the output. All solver
-// options are set based on the user input flags. Post-processing the result
-// (such as changing color space back to BGR) is not handled here.
+// options are set based on the scene options and the user input flags.
+// Post-processing the result (such as changing color space back to BGR) is not
+// handled here.
 ImageData SetupAndRunSolver(
+    const SceneOptions& scene_options,
     const ImageModel& image_model,
     const std::vector<ImageData>& input_images,
     const ImageData& initial_estimate) {
 
-  // Set up the solver.
-  // TODO: let the user choose the solver (once more solvers are supported).
-  super_resolution::IRLSMapSolverOptions solver_options;
+  // Set up the solver. Options shared by all MAP solvers are set first.
+  super_resolution::IRLSMapSolverOptions irls_options;
+  super_resolution::AdmmSolverOptions admm_options;
+  super_resolution::PrimalDualSolverOptions primal_dual_options;
+  super_resolution::MapSolverOptions* solver_options = &irls_options;
+  if (FLAGS_optimization_method == "admm") {
+    solver_options = &admm_options;
+  } else if (FLAGS_optimization_method == "primal_dual") {
+    solver_options = &primal_dual_options;
+  } else if (FLAGS_optimization_method != "irls") {
+    LOG(WARNING) << "Invalid optimization method flag. Using default (IRLS).";
+  }
   if (FLAGS_solver == "cg") {
-    solver_options.least_squares_solver = super_resolution::CG_SOLVER;
+    solver_options->least_squares_solver = super_resolution::CG_SOLVER;
     LOG(INFO) << "Using conjugate gradient solver.";
   } else if (FLAGS_solver == "lbfgs") {
-    solver_options.least_squares_solver = super_resolution::LBFGS_SOLVER;
+    solver_options->least_squares_solver = super_resolution::LBFGS_SOLVER;
     LOG(INFO) << "Using LBFGS solver.";
   } else {
     LOG(WARNING) << "Invalid solver flag. Using default (conjugate gradient).";
   }
-  solver_options.max_num_irls_iterations = FLAGS_optimization_iterations;
-  solver_options.max_num_solver_iterations = FLAGS_solver_iterations;
-  solver_options.use_numerical_differentiation =
+  solver_options->max_num_solver_iterations = FLAGS_solver_iterations;
+  solver_options->use_numerical_differentiation =
       FLAGS_use_numerical_differentiation;
-  solver_options.split_channels = FLAGS_split_channels;
-  super_resolution::IRLSMapSolver solver(
-      solver_options, image_model, input_images);
-  if (!FLAGS_verbose) {
-    solver.Stfu();
+  solver_options->use_normal_equation_data_term =
+      FLAGS_use_normal_equation_data_term;
+  solver_options->use_diagonal_preconditioner =
+      FLAGS_use_diagonal_preconditioner;
+  solver_options->use_fourier_solver_if_possible =
+      FLAGS_use_fourier_solver_if_possible;
+  solver_options->split_channels = FLAGS_split_channels;
+  solver_options->time_limit_seconds = scene_options.time_limit;
+
+  // Set up the appropriate regularizer(s) based on user input. Compatible
+  // regularizers are evaluated together in a single fused pass.
+  std::vector<std::pair<std::shared_ptr<super_resolution::Regularizer>, double>>
+      regularizers;
+  const std::vector<std::string> regularizer_args =
+      super_resolution::util::SplitString(
+          scene_options.regularizer, ',', true);
+  for (const std::string& regularizer_arg : regularizer_args) {
+    const std::vector<std::string> name_and_parameter =
+        super_resolution::util::SplitString(regularizer_arg, ':', true);
+    if (name_and_parameter.empty()) {
+      continue;
+    }
+    const std::string regularizer_name =
+        super_resolution::util::TrimString(name_and_parameter[0]);
+    double regularization_parameter = scene_options.regularization_parameter;
+    if (name_and_parameter.size() > 1) {
+      CHECK(super_resolution::util::ParseDouble(
+          name_and_parameter[1], &regularization_parameter))
+          << "Invalid regularization parameter in regularizer argument '"
+          << regularizer_arg << "'.";
+    }
+    if (regularization_parameter <= 0.0) {
+      continue;
+    }
+    regularizers.push_back(std::make_pair(
+        CreateRegularizer(regularizer_name, initial_estimate.GetImageSize()),
+        regularization_parameter));
+    LOG(INFO) << "Added " << regularizer_name
+              << " regularizer with regularization parameter "
+              << regularization_parameter;
   }
 
-  // Add the appropriate regularizer based on user input.
-  // TODO: support for multiple regularizers at once.
-  std::shared_ptr<super_resolution::Regularizer> regularizer;
-  if (FLAGS_regularization_parameter > 0.0) {
-    if (FLAGS_regularizer == "tv" || FLAGS_regularizer == "3dtv") {
-      regularizer =
-          std::shared_ptr<super_resolution::Regularizer>(
-              new super_resolution::TotalVariationRegularizer(
-                  initial_estimate.GetImageSize()));
-      if (FLAGS_regularizer == "3dtv") {
-        dynamic_cast<super_resolution::TotalVariationRegularizer*>(
-            regularizer.get())->SetUse3dTotalVariation(true);
+  if (FLAGS_tile_size > 0 && solver_options != &irls_options) {
+    LOG(WARNING) << "Tiled solving is only supported with IRLS. Ignored.";
+  }
+  CHECK(!scene_options.resume || !scene_options.checkpoint_path.empty())
+      << "Resuming requires a checkpoint path.";
+  if (!scene_options.checkpoint_path.empty() &&
+      solver_options != &irls_options) {
+    LOG(WARNING) << "Checkpointing is only supported with IRLS.";
+  }
+  if (FLAGS_mixed_precision && solver_options != &irls_options) {
+    LOG(WARNING) << "Mixed precision is only supported with IRLS. Ignored.";
+  }
+  if (FLAGS_refine_motion && solver_options != &irls_options) {
+    LOG(WARNING) << "Motion refinement is only supported with IRLS. Ignored.";
+  }
+  std::shared_ptr<super_resolution::Solver> solver;
+  if (solver_options == &admm_options) {
+    admm_options.max_num_admm_iterations = FLAGS_admm_iterations;
+    std::shared_ptr<super_resolution::AdmmSolver> admm_solver(
+        new super_resolution::AdmmSolver(
+            admm_options, image_model, input_images));
+    for (const auto& regularizer_and_parameter : regularizers) {
+      admm_solver->AddRegularizer(
+          regularizer_and_parameter.first, regularizer_and_parameter.second);
+    }
+    solver = admm_solver;
+    LOG(INFO) << "Using ADMM optimization.";
+  } else if (solver_options == &primal_dual_options) {
+    primal_dual_options.max_num_primal_dual_iterations =
+        FLAGS_primal_dual_iterations;
+    std::shared_ptr<super_resolution::PrimalDualSolver> primal_dual_solver(
+        new super_resolution::PrimalDualSolver(
+            primal_dual_options, image_model, input_images));
+    for (const auto& regularizer_and_parameter : regularizers) {
+      primal_dual_solver->AddRegularizer(
+          regularizer_and_parameter.first, regularizer_and_parameter.second);
+    }
+    solver = primal_dual_solver;
+    LOG(INFO) << "Using primal-dual optimization.";
+  } else {
+    irls_options.max_num_irls_iterations =
+        scene_options.optimization_iterations;
+    irls_options.regularization_norm = FLAGS_regularization_norm;
+    irls_options.num_multiscale_levels = FLAGS_multiscale_levels;
+    irls_options.checkpoint_path = scene_options.checkpoint_path;
+    irls_options.checkpoint_interval = FLAGS_checkpoint_interval;
+    irls_options.resume_from_checkpoint = scene_options.resume;
+    irls_options.use_mixed_precision = FLAGS_mixed_precision;
+    irls_options.refine_motion = FLAGS_refine_motion;
+    CHECK(!FLAGS_refine_motion || !FLAGS_split_channels)
+        << "Motion refinement cannot be combined with split_channels.";
+    if (FLAGS_tile_size > 0) {
+      std::shared_ptr<super_resolution::TiledMapSolver> tiled_solver(
+          new super_resolution::TiledMapSolver(
+              irls_options, FLAGS_tile_size, image_model, input_images));
+      for (const auto& regularizer_and_parameter : regularizers) {
+        tiled_solver->AddRegularizer(
+            regularizer_and_parameter.first, regularizer_and_parameter.second);
       }
-    } else if (FLAGS_regularizer == "btv") {
-      regularizer =
-          std::shared_ptr<super_resolution::Regularizer>(
-              new super_resolution::BilateralTotalVariationRegularizer(
-                  initial_estimate.GetImageSize(),
-                  FLAGS_btv_scale_range,
-                  FLAGS_btv_spatial_decay));
+      solver = tiled_solver;
+      LOG(INFO) << "Solving in tiles of size " << FLAGS_tile_size << ".";
     } else {
-      LOG(WARNING) << "Unknown regularizer option '" << FLAGS_regularizer
-                   << "'. Using default Total Variation regularizer.";
-      FLAGS_regularizer = "tv";
-      regularizer =
-          std::shared_ptr<super_resolution::Regularizer>(
-              new super_resolution::TotalVariationRegularizer(
-                  initial_estimate.GetImageSize()));
+      std::shared_ptr<super_resolution::IRLSMapSolver> irls_solver(
+          new super_resolution::IRLSMapSolver(
+              irls_options, image_model, input_images));
+      for (const auto& regularizer_and_parameter : regularizers) {
+        irls_solver->AddRegularizer(
+            regularizer_and_parameter.first, regularizer_and_parameter.second);
+      }
+      solver = irls_solver;
     }
-    solver.AddRegularizer(regularizer, FLAGS_regularization_parameter);
-    LOG(INFO) << "Added " << FLAGS_regularizer
-              << " regularizer with regularization parameter "
-              << FLAGS_regularization_parameter;
   }
+  if (!FLAGS_verbose) {
+    solver->Stfu();
+  }
+  solver->SetTelemetry(
+      GetSolverTelemetry(), scene_options.telemetry_stage_prefix);
 
   // Run the solver and time it.
   LOG(INFO) << "Super-resolving from " << input_images.size() << " images...";
   const auto start_time = std::chrono::steady_clock::now();
-  ImageData result = solver.Solve(initial_estimate);
+  ImageData result = solver->Solve(initial_estimate);
   const auto end_time = std::chrono::steady_clock::now();
   std::chrono::duration<double> elapsed_time_seconds = end_time - start_time;
   LOG(INFO) << "Done! Finished in "
@@ -199,6 +629,7 @@ ImageData SetupAndRunSolver(
 }
 
 ImageData SolveInWaveletDomain(
+    const SceneOptions& scene_options,
     const ImageModel& image_model,
     const std::vector<ImageData>& input_images) {
 
@@ -221,27 +652,39 @@ ImageData SolveInWaveletDomain(
   // LL:
   ImageData initial_estimate_ll = input_dwt_ll_coefficients[0];
   initial_estimate_ll.ResizeImage(
-      FLAGS_upsampling_scale, super_resolution::INTERPOLATE_LINEAR);
+      scene_options.upsampling_scale, super_resolution::INTERPOLATE_LINEAR);
   ImageData result_ll = SetupAndRunSolver(
-      image_model, input_dwt_ll_coefficients, initial_estimate_ll);
+      scene_options,
+      image_model,
+      input_dwt_ll_coefficients,
+      initial_estimate_ll);
   // LH:
   ImageData initial_estimate_lh = input_dwt_lh_coefficients[0];
   initial_estimate_lh.ResizeImage(
-      FLAGS_upsampling_scale, super_resolution::INTERPOLATE_LINEAR);
+      scene_options.upsampling_scale, super_resolution::INTERPOLATE_LINEAR);
   ImageData result_lh = SetupAndRunSolver(
-      image_model, input_dwt_lh_coefficients, initial_estimate_lh);
+      scene_options,
+      image_model,
+      input_dwt_lh_coefficients,
+      initial_estimate_lh);
   // HL:
   ImageData initial_estimate_hl = input_dwt_hl_coefficients[0];
   initial_estimate_hl.ResizeImage(
-      FLAGS_upsampling_scale, super_resolution::INTERPOLATE_LINEAR);
+      scene_options.upsampling_scale, super_resolution::INTERPOLATE_LINEAR);
   ImageData result_hl = SetupAndRunSolver(
-      image_model, input_dwt_hl_coefficients, initial_estimate_hl);
+      scene_options,
+      image_model,
+      input_dwt_hl_coefficients,
+      initial_estimate_hl);
   // HH:
   ImageData initial_estimate_hh = input_dwt_hh_coefficients[0];
   initial_estimate_hh.ResizeImage(
-      FLAGS_upsampling_scale, super_resolution::INTERPOLATE_LINEAR);
+      scene_options.upsampling_scale, super_resolution::INTERPOLATE_LINEAR);
   ImageData result_hh = SetupAndRunSolver(
-      image_model, input_dwt_hh_coefficients, initial_estimate_hh);
+      scene_options,
+      image_model,
+      input_dwt_hh_coefficients,
+      initial_estimate_hh);
 
   // Merge and reconstruct. Because of size precision errors where the lower
   // resolutions don't divide evenly by the upsampling scale, scale the ll
@@ -260,35 +703,47 @@ ImageData SolveInWaveletDomain(
 
   const cv::Size original_size = input_images[0].GetImageSize();
   const cv::Size target_size(
-      original_size.width * FLAGS_upsampling_scale,
-      original_size.height * FLAGS_upsampling_scale);
+      original_size.width * scene_options.upsampling_scale,
+      original_size.height * scene_options.upsampling_scale);
   result.ResizeImage(target_size, super_resolution::INTERPOLATE_CUBIC);
   return result;
 }
 
-int main(int argc, char** argv) {
-  super_resolution::util::InitApp(argc, argv, "Super resolution.");
-
-  REQUIRE_ARG(FLAGS_data_path);
+// Super-resolves a single scene with the given options, from loading its images
+// to saving the result. In batch mode, the scheduler is given and the scene
+// waits until its estimated memory can be reserved. The estimate only needs
+// the first image, so the scene waits before loading the others.
+void SuperResolveScene(
+    const SceneOptions& scene_options,
+    super_resolution::util::BatchScheduler* scheduler) {
 
   // Create the forward image model.
   super_resolution::ImageModelParameters model_parameters;
-  model_parameters.scale = FLAGS_upsampling_scale;
-  model_parameters.blur_radius = FLAGS_blur_radius;
-  model_parameters.blur_sigma = FLAGS_blur_sigma;
-  model_parameters.motion_sequence_path = FLAGS_motion_sequence_path;
+  model_parameters.scale = scene_options.upsampling_scale;
+  model_parameters.blur_radius = scene_options.blur_radius;
+  model_parameters.blur_sigma = scene_options.blur_sigma;
+  model_parameters.motion_sequence_path = scene_options.motion_sequence_path;
 
   const ImageModel image_model =
       ImageModel::CreateImageModel(model_parameters);
 
-  // Load in or generate the low-resolution images.
+  // Load in or generate the low-resolution images. In batch mode, the memory
+  // is reserved in between (see above).
+  std::unique_ptr<super_resolution::util::BatchScheduler::MemoryReservation>
+      memory_reservation;
   InputData input_data;
   if (FLAGS_generate_lr_images) {
     // If generating low-res images, use the specified data_path as the ground
     // truth file.
     LOG(INFO) << "Generating low-resolution images from ground truth.";
     input_data.high_res_image =
-        super_resolution::util::LoadImage(FLAGS_data_path);
+        super_resolution::util::LoadImage(scene_options.data_path);
+    if (scheduler != nullptr) {
+      memory_reservation = scheduler->ReserveMemory(EstimateSceneMemoryBytes(
+          static_cast<size_t>(input_data.high_res_image.GetNumPixels()) *
+              input_data.high_res_image.GetNumChannels(),
+          FLAGS_number_of_frames));
+    }
     // Create another image model with the noise module to generate LR images.
     model_parameters.noise_sigma = FLAGS_noise_sigma;
     ImageModel image_model_with_noise =
@@ -301,12 +756,28 @@ int main(int argc, char** argv) {
   } else {
     // Otherwise, assume the given data_path is a directory containing the LR
     // images.
-    input_data.low_res_images =
-        super_resolution::util::LoadImages(FLAGS_data_path);
+    const std::vector<std::string> image_file_paths =
+        super_resolution::util::GetImageFilePaths(scene_options.data_path);
+    CHECK_GT(image_file_paths.size(), 0)
+        << "At least one low-resolution image is required for "
+        << "super-resolution.";
+    for (const std::string& image_file_path : image_file_paths) {
+      input_data.low_res_images.push_back(
+          super_resolution::util::LoadImage(image_file_path));
+      if (scheduler != nullptr && memory_reservation == nullptr) {
+        const ImageData& low_res_image = input_data.low_res_images[0];
+        memory_reservation = scheduler->ReserveMemory(EstimateSceneMemoryBytes(
+            static_cast<size_t>(low_res_image.GetNumPixels()) *
+                low_res_image.GetNumChannels() *
+                scene_options.upsampling_scale *
+                scene_options.upsampling_scale,
+            image_file_paths.size()));
+      }
+    }
     // We can also load in a ground truth file for comparison, if available.
-    if (!FLAGS_ground_truth_image.empty()) {
+    if (!scene_options.ground_truth_image.empty()) {
       input_data.high_res_image =
-          super_resolution::util::LoadImage(FLAGS_ground_truth_image);
+          super_resolution::util::LoadImage(scene_options.ground_truth_image);
     }
   }
   CHECK_GT(input_data.low_res_images.size(), 0)
@@ -315,7 +786,7 @@ int main(int argc, char** argv) {
   // Set flags for evaluation. We will evaluate if ground truth is available
   // and if an evaluator is specified.
   const bool has_ground_truth =
-      !FLAGS_ground_truth_image.empty() || FLAGS_generate_lr_images;
+      !scene_options.ground_truth_image.empty() || FLAGS_generate_lr_images;
   const bool evaluate_results = has_ground_truth && !FLAGS_evaluators.empty();
 
   // Create an interpolated (bilinear upsampled) image as a reference. We only
@@ -324,7 +795,7 @@ int main(int argc, char** argv) {
   if (evaluate_results || FLAGS_display_mode == "compare") {
     upsampled_image = input_data.low_res_images[0];
     upsampled_image.ResizeImage(
-        FLAGS_upsampling_scale, super_resolution::INTERPOLATE_LINEAR);
+        scene_options.upsampling_scale, super_resolution::INTERPOLATE_LINEAR);
   }
 
   // If the interpolate_color flag is set, only run super-resolution on the
@@ -370,17 +841,22 @@ int main(int argc, char** argv) {
   // that the solver will operate in.
   ImageData initial_estimate = input_data.low_res_images[0];
   initial_estimate.ResizeImage(
-      FLAGS_upsampling_scale, super_resolution::INTERPOLATE_LINEAR);
+      scene_options.upsampling_scale, super_resolution::INTERPOLATE_LINEAR);
 
   // Run super-resolution in the selected domain.
   ImageData result;
   if (FLAGS_solve_in_wavelet_domain) {
-    result = SolveInWaveletDomain(image_model, input_data.low_res_images);
+    result = SolveInWaveletDomain(
+        scene_options, image_model, input_data.low_res_images);
   } else {
     // Solving is handled in the SetupAndRunSolver function above.
     result = SetupAndRunSolver(
-        image_model, input_data.low_res_images, initial_estimate);
+        scene_options,
+        image_model,
+        input_data.low_res_images,
+        initial_estimate);
   }
+  memory_reservation.reset();
 
   // If SR was only done on the luminance channel, interpolate the colors now
   // and change the color space back to BGR.
@@ -400,8 +876,13 @@ int main(int argc, char** argv) {
   }
 
   // If an evaluation criteria is passed in and the high-resolution image is
-  // available, display the evaluation results.
+  // available, display the evaluation results. In batch mode, the results are
+  // labeled with the scene and printed at once, since scenes finish
+  // concurrently.
   if (evaluate_results) {
+    const std::string output_prefix =
+        (scheduler != nullptr) ? "[" + scene_options.name + "] " : "";
+    std::ostringstream evaluation_output;
     std::vector<std::string> evaluators =
         super_resolution::util::SplitString(FLAGS_evaluators, ',');
     for (const std::string& evaluator_arg : evaluators) {
@@ -412,19 +893,24 @@ int main(int argc, char** argv) {
             input_data.high_res_image);
         const double upsampled_psnr = psnr_evaluator.Evaluate(upsampled_image);
         const double result_psnr = psnr_evaluator.Evaluate(result);
-        std::cout << "PSNR score on upsampled: " << upsampled_psnr << std::endl;
-        std::cout << "PSNR score on result:    " << result_psnr << std::endl;
+        evaluation_output << output_prefix << "PSNR score on upsampled: "
+                          << upsampled_psnr << std::endl;
+        evaluation_output << output_prefix << "PSNR score on result:    "
+                          << result_psnr << std::endl;
       } else if (evaluator == "ssim") {
         super_resolution::StructuralSimilarityEvaluator ssim_evaluator(
             input_data.high_res_image);
         const double upsampled_ssim = ssim_evaluator.Evaluate(upsampled_image);
         const double result_ssim = ssim_evaluator.Evaluate(result);
-        std::cout << "SSIM score on upsampled: " << upsampled_ssim << std::endl;
-        std::cout << "SSIM score on result:    " << result_ssim << std::endl;
+        evaluation_output << output_prefix << "SSIM score on upsampled: "
+                          << upsampled_ssim << std::endl;
+        evaluation_output << output_prefix << "SSIM score on result:    "
+                          << result_ssim << std::endl;
       } else {
         LOG(ERROR) << "Unknown/unsupported evaluator '" << evaluator << "'.";
       }
     }
+    std::cout << evaluation_output.str();
   }
   if (FLAGS_verbose) {
     result.GetImageDataReport().Print();
@@ -445,9 +931,47 @@ int main(int argc, char** argv) {
   }
 
   // Save file.
-  if (!FLAGS_result_path.empty()) {
-    super_resolution::util::SaveImage(result, FLAGS_result_path);
+  if (!scene_options.result_path.empty()) {
+    super_resolution::util::SaveImage(result, scene_options.result_path);
   }
+}
+
+int main(int argc, char** argv) {
+  super_resolution::util::InitApp(argc, argv, "Super resolution.");
+
+  if (FLAGS_batch_manifest.empty()) {
+    REQUIRE_ARG(FLAGS_data_path);
+    SuperResolveScene(GetSceneOptionsFromFlags(), nullptr);
+    return EXIT_SUCCESS;
+  }
+
+  // In batch mode, every scene of the manifest is solved in this process on a
+  // shared pool of workers, so that many small scenes do not each pay for the
+  // process startup.
+  const std::vector<SceneOptions> scenes =
+      ReadBatchManifest(FLAGS_batch_manifest);
+  if (!FLAGS_display_mode.empty()) {
+    LOG(WARNING) << "Results are not displayed in batch mode.";
+    FLAGS_display_mode.clear();
+  }
+  super_resolution::util::BatchScheduler scheduler(
+      FLAGS_batch_num_workers,
+      static_cast<size_t>(std::max(FLAGS_batch_memory_limit_mb, 0)) *
+          1024 * 1024);
+  LOG(INFO) << "Super-resolving " << scenes.size() << " scenes with "
+            << scheduler.GetNumWorkers() << " workers.";
+  const auto start_time = std::chrono::steady_clock::now();
+  scheduler.Run(scenes.size(), [&scenes, &scheduler](const int i) {
+    LOG(INFO) << "Starting scene #" << (i + 1) << " ("
+              << scenes[i].name << ").";
+    SuperResolveScene(scenes[i], &scheduler);
+    LOG(INFO) << "Finished scene #" << (i + 1) << " ("
+              << scenes[i].name << ").";
+  });
+  const auto end_time = std::chrono::steady_clock::now();
+  std::chrono::duration<double> elapsed_time_seconds = end_time - start_time;
+  LOG(INFO) << "Batch done! Finished " << scenes.size() << " scenes in "
+            << elapsed_time_seconds.count() << " seconds.";
 
   return EXIT_SUCCESS;
 }
@@ -0,0 +1,83 @@
+#include "util/batch_scheduler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "glog/logging.h"
+
+namespace super_resolution {
+namespace util {
+
+BatchScheduler::MemoryReservation::~MemoryReservation() {
+  scheduler_->ReleaseMemory(num_bytes_);
+}
+
+BatchScheduler::BatchScheduler(
+    const int num_workers, const size_t memory_limit_bytes)
+    : num_workers_((num_workers > 0) ? num_workers :
+          std::max(static_cast<int>(std::thread::hardware_concurrency()), 1)),
+      memory_limit_bytes_(memory_limit_bytes),
+      reserved_bytes_(0),
+      next_ticket_(0),
+      serving_ticket_(0) {}
+
+void BatchScheduler::Run(
+    const int num_tasks, const std::function<void(int)>& task) {
+
+  // Every worker takes the next task that has not been started yet.
+  std::atomic<int> next_task(0);
+  const auto run_worker = [&]() {
+    for (int i = next_task++; i < num_tasks; i = next_task++) {
+      task(i);
+    }
+  };
+  std::vector<std::thread> workers;
+  const int num_threads = std::min(num_workers_, num_tasks);
+  for (int i = 0; i < num_threads; ++i) {
+    workers.push_back(std::thread(run_worker));
+  }
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+}
+
+std::unique_ptr<BatchScheduler::MemoryReservation>
+BatchScheduler::ReserveMemory(const size_t num_bytes) {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    const uint64_t ticket = next_ticket_++;
+    memory_condition_.wait(lock, [&]() {
+      return ticket == serving_ticket_ &&
+          (memory_limit_bytes_ == 0 || reserved_bytes_ == 0 ||
+           reserved_bytes_ + num_bytes <= memory_limit_bytes_);
+    });
+    reserved_bytes_ += num_bytes;
+    serving_ticket_++;
+  }
+  // The next ticket may fit as well.
+  memory_condition_.notify_all();
+  return std::unique_ptr<MemoryReservation>(
+      new MemoryReservation(this, num_bytes));
+}
+
+size_t BatchScheduler::GetReservedMemory() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return reserved_bytes_;
+}
+
+void BatchScheduler::ReleaseMemory(const size_t num_bytes) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    CHECK_GE(reserved_bytes_, num_bytes) << "Released unreserved memory.";
+    reserved_bytes_ -= num_bytes;
+  }
+  memory_condition_.notify_all();
+}
+
+}  // namespace util
+}  // namespace super_resolution
@@ -0,0 +1,81 @@
+// Schedules a batch of independent tasks (e.g. the scenes of a batch
+// super-resolution run) on a shared pool of worker threads. Since every task
+// can need a lot of memory, tasks reserve their estimated memory before the
+// expensive part of their work (e.g. before loading most of their data), and
+// reservations are only granted while the total stays within a limit.
+
+#ifndef SRC_UTIL_BATCH_SCHEDULER_H_
+#define SRC_UTIL_BATCH_SCHEDULER_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace super_resolution {
+namespace util {
+
+class BatchScheduler {
+ public:
+  // Holds reserved memory of the scheduler until it is destroyed.
+  class MemoryReservation {
+   public:
+    ~MemoryReservation();
+
+   private:
+    friend class BatchScheduler;
+
+    MemoryReservation(BatchScheduler* scheduler, const size_t num_bytes)
+        : scheduler_(scheduler), num_bytes_(num_bytes) {}
+
+    BatchScheduler* const scheduler_;
+    const size_t num_bytes_;
+  };
+
+  // Runs tasks on num_workers threads (the number of CPU cores if this is not
+  // positive). If memory_limit_bytes is 0, memory reservations are never
+  // limited.
+  BatchScheduler(const int num_workers, const size_t memory_limit_bytes);
+
+  // Runs task(i) for every i in [0, num_tasks) on the worker threads, starting
+  // the tasks in order, and returns once all of them are done.
+  void Run(const int num_tasks, const std::function<void(int)>& task);
+
+  // Blocks until the given amount of memory can be reserved without exceeding
+  // the limit, and returns the reservation. Reservations are granted in the
+  // order they are requested, so a large one is not starved by smaller ones.
+  // A reservation larger than the whole limit is granted once no other memory
+  // is reserved. Every task should hold at most one reservation at a time,
+  // since a task waiting for more memory would otherwise block the others.
+  std::unique_ptr<MemoryReservation> ReserveMemory(const size_t num_bytes);
+
+  // Returns the total memory that is currently reserved.
+  size_t GetReservedMemory() const;
+
+  // Returns the number of worker threads.
+  int GetNumWorkers() const {
+    return num_workers_;
+  }
+
+ private:
+  // Called by MemoryReservation when it is destroyed.
+  void ReleaseMemory(const size_t num_bytes);
+
+  const int num_workers_;
+  const size_t memory_limit_bytes_;
+
+  // The reserved memory, and the tickets that keep the reservations in order.
+  size_t reserved_bytes_;
+  uint64_t next_ticket_;
+  uint64_t serving_ticket_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable memory_condition_;
+};
+
+}  // namespace util
+}  // namespace super_resolution
+
+#endif  // SRC_UTIL_BATCH_SCHEDULER_H_
@@ -72,8 +72,8 @@ bool IsSupportedImageExtension(const std::string& extension) {
   return DoesSetContain(kSupportedImageExtensions, extension);
 }
 
-std::vector<ImageData> LoadImages(const std::string& data_path) {
-  std::vector<ImageData> images;
+std::vector<std::string> GetImageFilePaths(const std::string& data_path) {
+  std::vector<std::string> file_paths;
   if (IsDirectory(data_path)) {
     DIR* dir;
     struct dirent* ent;
@@ -82,13 +82,21 @@ std::vector<ImageData> LoadImages(const std::string& data_path) {
         const std::string file_name(ent->d_name);
         const std::string file_path = data_path + "/" + file_name;
         if (IsFile(file_path)) {
-          images.push_back(LoadImage(file_path));
+          file_paths.push_back(file_path);
         }
       }
       closedir(dir);
     }
   } else {
-    images.push_back(LoadImage(data_path));
+    file_paths.push_back(data_path);
+  }
+  return file_paths;
+}
+
+std::vector<ImageData> LoadImages(const std::string& data_path) {
+  std::vector<ImageData> images;
+  for (const std::string& file_path : GetImageFilePaths(data_path)) {
+    images.push_back(LoadImage(file_path));
   }
   return images;
 }
@@ -29,6 +29,11 @@ bool IsFile(const std::string& path, const bool include_hidden_files = false);
 // that can be read or written with OpenCV.
 bool IsSupportedImageExtension(const std::string& extension);
 
+// Returns the paths of the image files that LoadImages() loads for the given
+// data_path, in the same order. This allows inspecting or loading the images
+// one at a time.
+std::vector<std::string> GetImageFilePaths(const std::string& data_path);
+
 // Returns a list of images loaded from the given data_path. If the data_path
 // points to a directory, the list will contain images loaded from all files in
 // that directory. If it is the name of a file, the returned list will contain
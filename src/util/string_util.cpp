@@ -1,7 +1,10 @@
 #include "util/string_util.h"
 
 #include <algorithm>
+#include <cerrno>
+#include <cstdlib>
 #include <functional>
+#include <limits>
 #include <string>
 #include <vector>
 
@@ -69,5 +72,38 @@ std::string GetFileExtension(const std::string& file_path) {
   return file_path.substr(pos + 1);
 }
 
+bool ParseDouble(const std::string& number_string, double* value) {
+  const std::string trimmed_string = TrimString(number_string);
+  if (trimmed_string.empty()) {
+    return false;
+  }
+  char* end = nullptr;
+  errno = 0;
+  const double parsed_value = std::strtod(trimmed_string.c_str(), &end);
+  if (errno != 0 || *end != '\0') {
+    return false;
+  }
+  *value = parsed_value;
+  return true;
+}
+
+bool ParseInt(const std::string& number_string, int* value) {
+  const std::string trimmed_string = TrimString(number_string);
+  if (trimmed_string.empty()) {
+    return false;
+  }
+  char* end = nullptr;
+  errno = 0;
+  const long parsed_value =  // NOLINT(runtime/int)
+      std::strtol(trimmed_string.c_str(), &end, 10);
+  if (errno != 0 || *end != '\0' ||
+      parsed_value < std::numeric_limits<int>::min() ||
+      parsed_value > std::numeric_limits<int>::max()) {
+    return false;
+  }
+  *value = static_cast<int>(parsed_value);
+  return true;
+}
+
 }  // namespace util
 }  // namespace super_resolution
@@ -45,6 +45,23 @@ std::string TrimString(const std::string& untrimmed_string);
 //   GetFileExtension("path/to/image.png") => "png"
 std::string GetFileExtension(const std::string& file_path);
 
+// Parses the given string as a floating point number into value. Returns false
+// (leaving value unchanged) unless the whole string, ignoring surrounding white
+// space, is a valid number.
+//
+// Examples:
+//   ParseDouble(" 0.5 ", &value) => true, value = 0.5
+//   ParseDouble("0.5x", &value) => false
+//   ParseDouble("abc", &value) => false
+bool ParseDouble(const std::string& number_string, double* value);
+
+// Same as ParseDouble, but for a base-10 integer that fits in an int.
+//
+// Examples:
+//   ParseInt("42", &value) => true, value = 42
+//   ParseInt("4.2", &value) => false
+bool ParseInt(const std::string& number_string, int* value);
+
 }  // namespace util
 }  // namespace super_resolution
 
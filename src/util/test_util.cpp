@@ -1,9 +1,16 @@
 #include "util/test_util.h"
 
+#include <cmath>
+#include <functional>
 #include <iostream>
 #include <limits>
+#include <vector>
 
 #include "image/image_data.h"
+#include "image_model/image_model.h"
+#include "motion/motion_shift.h"
+#include "optimization/objective_data_term.h"
+#include "optimization/regularizer.h"
 
 #include "opencv2/core/core.hpp"
 #include "opencv2/imgproc/imgproc.hpp"
@@ -133,5 +140,134 @@ bool AreImagesEqual(
   return true;
 }
 
+ImageData CreateTestImage(
+    const cv::Size& image_size,
+    const std::function<double(int, int)>& pixel_function) {
+
+  cv::Mat image(image_size, CV_64FC1);
+  for (int row = 0; row < image_size.height; ++row) {
+    for (int col = 0; col < image_size.width; ++col) {
+      image.at<double>(row, col) = pixel_function(row, col);
+    }
+  }
+  return ImageData(image);
+}
+
+SuperResolutionTestProblem CreateTestProblem(
+    const ImageData& ground_truth,
+    const ImageModelParameters& model_parameters,
+    const int num_images) {
+
+  CHECK_GT(num_images, 0);
+
+  const ImageModel image_model =
+      ImageModel::CreateImageModel(model_parameters);
+  std::vector<ImageData> low_res_images;
+  for (int i = 0; i < num_images; ++i) {
+    low_res_images.push_back(image_model.ApplyToImage(ground_truth, i));
+  }
+  ImageData initial_estimate = low_res_images[0];
+  initial_estimate.ResizeImage(model_parameters.scale, INTERPOLATE_LINEAR);
+  return {ground_truth, image_model, low_res_images, initial_estimate};
+}
+
+SuperResolutionTestProblem CreateSmallDataTestProblem() {
+  const std::vector<cv::Mat> lr_image_matrices = {
+    (cv::Mat_<double>(2, 2) << 0.4, 0.4, 0.4, 0.4),
+    (cv::Mat_<double>(2, 2) << 0.2, 0.2, 0.2, 0.2),
+    (cv::Mat_<double>(2, 2) << 0.0, 0.0, 0.0, 0.0),
+    (cv::Mat_<double>(2, 2) << 1.0, 1.0, 1.0, 1.0)
+  };
+  std::vector<ImageData> low_res_images;
+  for (const cv::Mat& lr_image_matrix : lr_image_matrices) {
+    low_res_images.push_back(ImageData(lr_image_matrix));
+  }
+
+  ImageModelParameters model_parameters;
+  model_parameters.scale = 2;
+  model_parameters.motion_sequence = MotionShiftSequence({
+    MotionShift(0, 0),
+    MotionShift(-1, 0),
+    MotionShift(0, -1),
+    MotionShift(-1, -1)
+  });
+
+  const cv::Mat ground_truth_matrix = (cv::Mat_<double>(4, 4)
+    << 0.4, 0.2, 0.4, 0.2,
+       0.0, 1.0, 0.0, 1.0,
+       0.4, 0.2, 0.4, 0.2,
+       0.0, 1.0, 0.0, 1.0);
+  return {
+    ImageData(ground_truth_matrix),
+    ImageModel::CreateImageModel(model_parameters),
+    low_res_images,
+    ImageData(cv::Mat::zeros(4, 4, CV_64FC1))
+  };
+}
+
+SuperResolutionTestProblem CreatePiecewiseConstantTestProblem() {
+  const ImageData ground_truth = CreateTestImage(
+      cv::Size(16, 16), [](const int row, const int col) {
+        return ((row < 8) == (col < 10) ? 0.8 : 0.2) +
+            0.05 * std::sin(1.3 * row + 0.7 * col);
+      });
+
+  ImageModelParameters model_parameters;
+  model_parameters.scale = 2;
+  model_parameters.motion_sequence = MotionShiftSequence({
+    MotionShift(0, 0),
+    MotionShift(1, 0),
+    MotionShift(0, 1)
+  });
+  model_parameters.blur_radius = 3;
+  model_parameters.blur_sigma = 1.0;
+  return CreateTestProblem(ground_truth, model_parameters, 3);
+}
+
+double ComputeRootMeanSquaredError(
+    const ImageData& image, const ImageData& ground_truth) {
+
+  CHECK_EQ(image.GetNumChannels(), ground_truth.GetNumChannels());
+  CHECK(image.GetImageSize() == ground_truth.GetImageSize());
+
+  const int num_pixels = ground_truth.GetNumPixels();
+  double squared_error = 0.0;
+  for (int channel = 0; channel < ground_truth.GetNumChannels(); ++channel) {
+    const double* image_data = image.GetChannelData(channel);
+    const double* ground_truth_data = ground_truth.GetChannelData(channel);
+    for (int pixel_index = 0; pixel_index < num_pixels; ++pixel_index) {
+      const double error =
+          image_data[pixel_index] - ground_truth_data[pixel_index];
+      squared_error += error * error;
+    }
+  }
+  return std::sqrt(
+      squared_error / (num_pixels * ground_truth.GetNumChannels()));
+}
+
+double ComputeL1MapObjective(
+    const ImageModel& image_model,
+    const std::vector<ImageData>& low_res_images,
+    const Regularizer& regularizer,
+    const double regularization_parameter,
+    const ImageData& estimate) {
+
+  const cv::Size image_size = estimate.GetImageSize();
+  std::vector<ImageData> observations;
+  for (const ImageData& low_res_image : low_res_images) {
+    ImageData observation = low_res_image;
+    observation.ResizeImage(image_size, INTERPOLATE_NEAREST);
+    observations.push_back(observation);
+  }
+  const ObjectiveDataTerm data_term(
+      image_model, observations, 0, 1, image_size);
+  double objective = data_term.Compute(estimate.GetChannelData(0), nullptr);
+  for (const double value :
+       regularizer.ApplyToImage(estimate.GetChannelData(0), 1)) {
+    objective += regularization_parameter * value;
+  }
+  return objective;
+}
+
 }  // namespace test
 }  // namespace super_resolution
@@ -3,7 +3,12 @@
 #ifndef SRC_UTIL_TEST_UTIL_H_
 #define SRC_UTIL_TEST_UTIL_H_
 
+#include <functional>
+#include <vector>
+
 #include "image/image_data.h"
+#include "image_model/image_model.h"
+#include "optimization/regularizer.h"
 
 #include "opencv2/core/core.hpp"
 
@@ -35,6 +40,57 @@ bool AreImagesEqual(
     const ImageData& image2,
     const double diff_tolerance = 0.0);
 
+// A super-resolution problem for testing solvers: the low-resolution images
+// that the image model generates from the ground truth, and the initial
+// estimate of the ground truth to start solving from.
+struct SuperResolutionTestProblem {
+  ImageData ground_truth;
+  ImageModel image_model;
+  std::vector<ImageData> low_res_images;
+  ImageData initial_estimate;
+};
+
+// Returns a single-channel image of the given size, where the value of every
+// pixel is pixel_function(row, col).
+ImageData CreateTestImage(
+    const cv::Size& image_size,
+    const std::function<double(int, int)>& pixel_function);
+
+// Generates num_images low-resolution images (one for each motion shift) of
+// the ground truth with the image model of the given parameters. The initial
+// estimate is the first low-resolution image, upsampled linearly.
+SuperResolutionTestProblem CreateTestProblem(
+    const ImageData& ground_truth,
+    const ImageModelParameters& model_parameters,
+    const int num_images);
+
+// Returns a small, "perfect" problem: four 2x2 images that observe every
+// downsampling phase of a 4x4 ground truth without blur or noise, so that the
+// least squares solution is exactly the ground truth. The initial estimate is
+// all zeros.
+SuperResolutionTestProblem CreateSmallDataTestProblem();
+
+// Returns a blurred problem with a 16x16 piecewise constant ground truth with
+// some texture, which three of the four downsampling phases observe. This is
+// useful for comparing the solvers of the 1-norm problem (see
+// ComputeL1MapObjective()).
+SuperResolutionTestProblem CreatePiecewiseConstantTestProblem();
+
+// Returns the root-mean-square error of the image over all pixels and channels
+// of the ground truth, which must have the same size.
+double ComputeRootMeanSquaredError(
+    const ImageData& image, const ImageData& ground_truth);
+
+// Returns the 1-norm MAP objective of the first channel of the estimate:
+//   data(x) + lambda * sum_p r_p(x)
+// where r_p are the regularizer's values.
+double ComputeL1MapObjective(
+    const ImageModel& image_model,
+    const std::vector<ImageData>& low_res_images,
+    const Regularizer& regularizer,
+    const double regularization_parameter,
+    const ImageData& estimate);
+
 }  // namespace test
 }  // namespace super_resolution
 
@@ -2,6 +2,7 @@
 
 #include <dirent.h>
 
+#include <functional>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -21,6 +22,22 @@ namespace {
 // processed from the argv list. Any other misc input parameters will remain.
 constexpr bool kRemoveFlagsAfterParsing = true;
 
+// Adapts a std::function to OpenCV's parallel loop interface.
+class ParallelTaskLoopBody : public cv::ParallelLoopBody {
+ public:
+  explicit ParallelTaskLoopBody(const std::function<void(int)>& task)
+      : task_(task) {}
+
+  virtual void operator()(const cv::Range& range) const {
+    for (int i = range.start; i < range.end; ++i) {
+      task_(i);
+    }
+  }
+
+ private:
+  const std::function<void(int)>& task_;
+};
+
 }  // namespace
 
 void InitApp(int argc, char** argv, const std::string& usage_message) {
@@ -88,5 +105,16 @@ int GetPixelIndex(
   return channel_index + (row * image_size.width + col);
 }
 
+void ParallelFor(const int num_tasks, const std::function<void(int)>& task) {
+  if (num_tasks <= 0) {
+    return;
+  }
+  if (num_tasks == 1) {
+    task(0);
+    return;
+  }
+  cv::parallel_for_(cv::Range(0, num_tasks), ParallelTaskLoopBody(task));
+}
+
 }  // namespace util
 }  // namespace super_resolution
@@ -3,6 +3,7 @@
 #ifndef SRC_UTIL_UTIL_H_
 #define SRC_UTIL_UTIL_H_
 
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -45,6 +46,19 @@ int GetPixelIndex(
     const int row,
     const int col);
 
+// Returns 1 if value is positive, -1 if it is negative, and 0 otherwise. This
+// is also the derivative of |value| (with 0 at the kink). It is branch-free
+// and defined inline, so that pixel loops using it can be vectorized.
+inline double GetSign(const double value) {
+  return static_cast<double>(value > 0.0) - static_cast<double>(value < 0.0);
+}
+
+// Runs task(i) for every i in [0, num_tasks) using OpenCV's parallel
+// framework (cv::parallel_for_), which falls back to a sequential loop if
+// OpenCV was built without a parallel backend. Tasks may run concurrently and
+// in any order, so they must not write to shared data.
+void ParallelFor(const int num_tasks, const std::function<void(int)>& task);
+
 }  // namespace util
 }  // namespace super_resolution
 
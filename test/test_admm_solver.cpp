@@ -0,0 +1,113 @@
+#include <memory>
+#include <vector>
+
+#include "image/image_data.h"
+#include "image_model/image_model.h"
+#include "optimization/admm_solver.h"
+#include "optimization/btv_regularizer.h"
+#include "optimization/irls_map_solver.h"
+#include "optimization/objective_function.h"
+#include "optimization/regularizer.h"
+#include "optimization/tv_regularizer.h"
+#include "util/test_util.h"
+
+#include "opencv2/core/core.hpp"
+
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+
+using super_resolution::AdmmSolver;
+using super_resolution::AdmmSolverOptions;
+using super_resolution::ImageData;
+using super_resolution::test::AreMatricesEqual;
+using super_resolution::test::ComputeL1MapObjective;
+using super_resolution::test::CreatePiecewiseConstantTestProblem;
+using super_resolution::test::CreateSmallDataTestProblem;
+using super_resolution::test::SuperResolutionTestProblem;
+
+constexpr bool kPrintSolverOutput = false;
+
+// Tests the solver on small, "perfect" data (see MapSolver.SmallDataTest).
+TEST(AdmmSolver, SmallDataTest) {
+  const SuperResolutionTestProblem problem = CreateSmallDataTestProblem();
+  const cv::Mat ground_truth_matrix = problem.ground_truth.GetChannelImage(0);
+
+  // Without regularization, ADMM reduces to solving the least squares data
+  // term.
+  const AdmmSolverOptions solver_options;
+  AdmmSolver solver(
+      solver_options,
+      problem.image_model,
+      problem.low_res_images,
+      kPrintSolverOutput);
+  const ImageData result = solver.Solve(problem.initial_estimate);
+  EXPECT_TRUE(AreMatricesEqual(
+      result.GetChannelImage(0), ground_truth_matrix, 0.001));
+
+  // A very weak TV prior should barely change the result.
+  AdmmSolver solver_with_tv(
+      solver_options,
+      problem.image_model,
+      problem.low_res_images,
+      kPrintSolverOutput);
+  solver_with_tv.AddRegularizer(
+      std::shared_ptr<super_resolution::Regularizer>(
+          new super_resolution::TotalVariationRegularizer(cv::Size(4, 4))),
+      0.0001);
+  const ImageData result_with_tv =
+      solver_with_tv.Solve(problem.initial_estimate);
+  EXPECT_TRUE(AreMatricesEqual(
+      result_with_tv.GetChannelImage(0), ground_truth_matrix, 0.01));
+}
+
+// ADMM solves the same 1-norm problem that IRLS approximates, so on a blurred
+// problem it should reach an objective value at least as low as IRLS.
+TEST(AdmmSolver, MatchesIRLSObjective) {
+  const SuperResolutionTestProblem problem =
+      CreatePiecewiseConstantTestProblem();
+  const cv::Size image_size = problem.ground_truth.GetImageSize();
+
+  const std::vector<std::shared_ptr<super_resolution::Regularizer>>
+      regularizers = {
+        std::shared_ptr<super_resolution::Regularizer>(
+            new super_resolution::TotalVariationRegularizer(image_size)),
+        std::shared_ptr<super_resolution::Regularizer>(
+            new super_resolution::BilateralTotalVariationRegularizer(
+                image_size, 2, 0.5))
+      };
+  const double regularization_parameter = 0.01;
+  for (const auto& regularizer : regularizers) {
+    const AdmmSolverOptions admm_options;
+    AdmmSolver admm_solver(
+        admm_options,
+        problem.image_model,
+        problem.low_res_images,
+        kPrintSolverOutput);
+    admm_solver.AddRegularizer(regularizer, regularization_parameter);
+    const ImageData admm_result = admm_solver.Solve(problem.initial_estimate);
+
+    super_resolution::IRLSMapSolverOptions irls_options;
+    irls_options.max_num_solver_iterations = 200;
+    super_resolution::IRLSMapSolver irls_solver(
+        irls_options,
+        problem.image_model,
+        problem.low_res_images,
+        kPrintSolverOutput);
+    irls_solver.AddRegularizer(regularizer, regularization_parameter);
+    const ImageData irls_result = irls_solver.Solve(problem.initial_estimate);
+
+    const double admm_objective = ComputeL1MapObjective(
+        problem.image_model,
+        problem.low_res_images,
+        *regularizer,
+        regularization_parameter,
+        admm_result);
+    const double irls_objective = ComputeL1MapObjective(
+        problem.image_model,
+        problem.low_res_images,
+        *regularizer,
+        regularization_parameter,
+        irls_result);
+    EXPECT_LE(admm_objective, irls_objective * 1.001);
+  }
+}
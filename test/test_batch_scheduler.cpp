@@ -0,0 +1,62 @@
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "util/batch_scheduler.h"
+
+#include "gtest/gtest.h"
+
+using super_resolution::util::BatchScheduler;
+
+// Every task should run exactly once.
+TEST(BatchScheduler, Run) {
+  BatchScheduler scheduler(3, 0);
+  EXPECT_EQ(scheduler.GetNumWorkers(), 3);
+
+  std::vector<int> num_runs(20, 0);
+  scheduler.Run(num_runs.size(), [&num_runs](const int i) {
+    num_runs[i]++;
+  });
+  EXPECT_EQ(num_runs, std::vector<int>(20, 1));
+
+  // Nothing to run.
+  scheduler.Run(0, [](const int i) {
+    FAIL() << "No task should run.";
+  });
+
+  // The default number of workers depends on the machine.
+  EXPECT_GT(BatchScheduler(0, 0).GetNumWorkers(), 0);
+}
+
+// The memory reserved by concurrently running tasks should never exceed the
+// limit, except for a task that needs more than the whole limit, which runs
+// alone.
+TEST(BatchScheduler, MemoryLimit) {
+  const size_t memory_limit = 100;
+  BatchScheduler scheduler(4, memory_limit);
+  const std::vector<size_t> task_memory = {40, 40, 40, 150, 40, 60, 10, 40};
+
+  std::mutex mutex;
+  size_t max_reserved_memory = 0;
+  bool is_large_task_alone = true;
+  scheduler.Run(task_memory.size(), [&](const int i) {
+    const std::unique_ptr<BatchScheduler::MemoryReservation> reservation =
+        scheduler.ReserveMemory(task_memory[i]);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      const size_t reserved_memory = scheduler.GetReservedMemory();
+      if (task_memory[i] > memory_limit) {
+        is_large_task_alone &= (reserved_memory == task_memory[i]);
+      } else {
+        max_reserved_memory = std::max(max_reserved_memory, reserved_memory);
+      }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  });
+  EXPECT_LE(max_reserved_memory, memory_limit);
+  EXPECT_TRUE(is_large_task_alone);
+  EXPECT_EQ(scheduler.GetReservedMemory(), 0);
+}
@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <cmath>
 #include <vector>
 
 #include "optimization/btv_regularizer.h"
@@ -91,5 +92,97 @@ TEST(BilateralTotalVariationRegularizer, ApplyToImageWithDifferentiation) {
   EXPECT_DOUBLE_EQ(residuals[0], 2.8125);
   EXPECT_DOUBLE_EQ(residuals[24], 0.0);
 
-  // TODO: check the gradient for accuracy.
+  // Compare the gradient to finite differences of sum_i c_i * r_i^2.
+  const auto compute_cost = [&](const std::vector<double>& image_data) {
+    const std::vector<double> diff_residuals =
+        btv_regularizer.ApplyToImage(image_data.data(), 1);
+    double cost = 0.0;
+    for (int i = 0; i < 25; ++i) {
+      cost += gradient_constants[i] * diff_residuals[i] * diff_residuals[i];
+    }
+    return cost;
+  };
+  const double finite_difference = 1e-6;
+  const double gradient_error_tolerance = 0.0001;
+  for (int i = 0; i < 25; ++i) {
+    std::vector<double> pos_diff_image_data(
+        test_image_data, test_image_data + 25);
+    pos_diff_image_data[i] += finite_difference;
+    std::vector<double> neg_diff_image_data(
+        test_image_data, test_image_data + 25);
+    neg_diff_image_data[i] -= finite_difference;
+    const double numerical_gradient_at_i =
+        (compute_cost(pos_diff_image_data) -
+         compute_cost(neg_diff_image_data)) / (2 * finite_difference);
+    EXPECT_NEAR(numerical_gradient_at_i, gradient[i], gradient_error_tolerance);
+  }
+}
+
+TEST(BilateralTotalVariationRegularizer, ComputeWeightedSquaredSum) {
+  const super_resolution::BilateralTotalVariationRegularizer btv_regularizer(
+      test_image_size, 2, 0.5);
+  std::vector<double> weights(25);
+  for (int i = 0; i < 25; ++i) {
+    weights[i] = 0.1 * (i % 7) + 0.5;
+  }
+
+  // The cost-only path should match the weighted sum of squared residuals.
+  const std::vector<double> residuals =
+      btv_regularizer.ApplyToImage(test_image_data, 1);
+  double expected_sum = 0.0;
+  for (int i = 0; i < 25; ++i) {
+    expected_sum += weights[i] * residuals[i] * residuals[i];
+  }
+  EXPECT_DOUBLE_EQ(
+      btv_regularizer.ComputeWeightedSquaredSum(test_image_data, weights, 1),
+      expected_sum);
+}
+
+// Compares against a direct evaluation of the BTV definition with a range
+// larger than the image, on two different channels.
+TEST(BilateralTotalVariationRegularizer, LargeRangeMultichannel) {
+  const int scale_range = 6;
+  const double spatial_decay = 0.7;
+  const super_resolution::BilateralTotalVariationRegularizer btv_regularizer(
+      test_image_size, scale_range, spatial_decay);
+
+  std::vector<double> image_data(test_image_data, test_image_data + 25);
+  for (int i = 0; i < 25; ++i) {
+    image_data.push_back(test_image_data[24 - i] * 0.5);
+  }
+  const std::vector<double> residuals =
+      btv_regularizer.ApplyToImage(image_data.data(), 2);
+  EXPECT_THAT(residuals, SizeIs(50));
+  for (int channel = 0; channel < 2; ++channel) {
+    for (int row = 0; row < 5; ++row) {
+      for (int col = 0; col < 5; ++col) {
+        const int index = channel * 25 + row * 5 + col;
+        double expected_value = 0.0;
+        for (int i = 0; i <= scale_range && row + i < 5; ++i) {
+          for (int j = 0; j <= scale_range && col + j < 5; ++j) {
+            expected_value += std::pow(spatial_decay, i + j) *
+                std::abs(image_data[index] - image_data[index + i * 5 + j]);
+          }
+        }
+        EXPECT_NEAR(residuals[index], expected_value, 1e-12);
+      }
+    }
+  }
+}
+
+// The allocation-free values should match ApplyToImage.
+TEST(BilateralTotalVariationRegularizer, ComputeValues) {
+  const super_resolution::BilateralTotalVariationRegularizer btv_regularizer(
+      test_image_size, 2, 0.5);
+  std::vector<double> image_data(test_image_data, test_image_data + 25);
+  for (int i = 0; i < 25; ++i) {
+    image_data.push_back(test_image_data[24 - i] * 0.5);
+  }
+  const std::vector<double> expected_values =
+      btv_regularizer.ApplyToImage(image_data.data(), 2);
+  std::vector<double> values(50, -1.0);
+  btv_regularizer.ComputeValues(image_data.data(), 2, values.data());
+  for (int i = 0; i < 50; ++i) {
+    EXPECT_NEAR(values[i], expected_values[i], 1e-12);
+  }
 }
@@ -486,3 +486,107 @@ TEST(ImageModel, GetModelMatrix) {
   cv::Mat returned_operator_matrix = image_model.GetModelMatrix(image_size, 0);
   EXPECT_TRUE(AreMatricesEqual(returned_operator_matrix, expected_result));
 }
+
+// Tests that a downscaled model applied to an image that is constant within
+// each factor x factor block gives the same LR images as the original model
+// applied to the full image.
+TEST(ImageModel, CreateDownscaledModel) {
+  super_resolution::ImageModelParameters model_parameters;
+  model_parameters.scale = 4;
+  model_parameters.motion_sequence = super_resolution::MotionShiftSequence({
+    super_resolution::MotionShift(0, 0),
+    super_resolution::MotionShift(2, -2),
+    super_resolution::MotionShift(-4, 2)
+  });
+  const super_resolution::ImageModel image_model =
+      super_resolution::ImageModel::CreateImageModel(model_parameters);
+
+  // The scale (4) is not divisible by 3.
+  EXPECT_EQ(image_model.CreateDownscaledModel(3), nullptr);
+
+  const std::shared_ptr<super_resolution::ImageModel> coarse_image_model =
+      image_model.CreateDownscaledModel(2);
+  ASSERT_NE(coarse_image_model, nullptr);
+  EXPECT_EQ(coarse_image_model->GetDownsamplingScale(), 2);
+
+  cv::Mat coarse_image_matrix(cv::Size(8, 8), CV_64FC1);
+  for (int row = 0; row < 8; ++row) {
+    for (int col = 0; col < 8; ++col) {
+      coarse_image_matrix.at<double>(row, col) = 0.1 * ((row * 3 + col) % 7);
+    }
+  }
+  const super_resolution::ImageData coarse_image(
+      coarse_image_matrix, super_resolution::DO_NOT_NORMALIZE_IMAGE);
+  super_resolution::ImageData image = coarse_image;
+  image.ResizeImage(cv::Size(16, 16), super_resolution::INTERPOLATE_NEAREST);
+  for (int i = 0; i < 3; ++i) {
+    const super_resolution::ImageData low_res_image =
+        image_model.ApplyToImage(image, i);
+    const super_resolution::ImageData coarse_low_res_image =
+        coarse_image_model->ApplyToImage(coarse_image, i);
+    ASSERT_EQ(coarse_low_res_image.GetImageSize(), cv::Size(4, 4));
+    for (int row = 0; row < 4; ++row) {
+      for (int col = 0; col < 4; ++col) {
+        EXPECT_NEAR(
+            coarse_low_res_image.GetPixelValue(0, row, col),
+            low_res_image.GetPixelValue(0, row, col),
+            1e-9);
+      }
+    }
+  }
+
+  // Blur is downscaled with the model.
+  model_parameters.blur_radius = 5;
+  model_parameters.blur_sigma = 1.0;
+  const super_resolution::ImageModel blurred_image_model =
+      super_resolution::ImageModel::CreateImageModel(model_parameters);
+  EXPECT_NE(blurred_image_model.CreateDownscaledModel(4), nullptr);
+}
+
+TEST(ImageModel, CreateModelWithMotion) {
+  super_resolution::ImageModelParameters model_parameters;
+  model_parameters.scale = 2;
+  model_parameters.motion_sequence = super_resolution::MotionShiftSequence({
+    super_resolution::MotionShift(0, 0),
+    super_resolution::MotionShift(1, -1)
+  });
+  model_parameters.blur_radius = 3;
+  model_parameters.blur_sigma = 1.0;
+  const super_resolution::ImageModel image_model =
+      super_resolution::ImageModel::CreateImageModel(model_parameters);
+
+  const super_resolution::MotionShiftSequence motion_shift_sequence =
+      image_model.GetMotionShiftSequence();
+  ASSERT_EQ(motion_shift_sequence.GetNumMotionShifts(), 2);
+  EXPECT_EQ(motion_shift_sequence[1].dx, 1);
+  EXPECT_EQ(motion_shift_sequence[1].dy, -1);
+  EXPECT_EQ(
+      super_resolution::ImageModel(2).GetMotionShiftSequence()
+          .GetNumMotionShifts(),
+      0);
+
+  // A model with the other shift for the second image applies that shift but
+  // keeps the other operators.
+  const std::shared_ptr<super_resolution::ImageModel> moved_image_model =
+      image_model.CreateModelWithMotion(super_resolution::MotionShiftSequence({
+        super_resolution::MotionShift(0, 0),
+        super_resolution::MotionShift(-1, 1)
+      }));
+  ASSERT_NE(moved_image_model, nullptr);
+  EXPECT_EQ(moved_image_model->GetDownsamplingScale(), 2);
+  EXPECT_EQ(moved_image_model->GetMotionShiftSequence()[1].dx, -1);
+
+  model_parameters.motion_sequence = super_resolution::MotionShiftSequence({
+    super_resolution::MotionShift(0, 0),
+    super_resolution::MotionShift(-1, 1)
+  });
+  const super_resolution::ImageModel expected_image_model =
+      super_resolution::ImageModel::CreateImageModel(model_parameters);
+  const super_resolution::ImageData image(
+      kSmallTestImage, super_resolution::DO_NOT_NORMALIZE_IMAGE);
+  for (int i = 0; i < 2; ++i) {
+    EXPECT_TRUE(super_resolution::test::AreImagesEqual(
+        moved_image_model->ApplyToImage(image, i),
+        expected_image_model.ApplyToImage(image, i)));
+  }
+}
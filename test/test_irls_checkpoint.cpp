@@ -0,0 +1,228 @@
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "image/image_data.h"
+#include "image_model/image_model.h"
+#include "motion/motion_shift.h"
+#include "optimization/irls_checkpoint.h"
+#include "optimization/irls_map_solver.h"
+#include "optimization/regularizer.h"
+#include "optimization/tv_regularizer.h"
+#include "util/util.h"
+
+#include "opencv2/core/core.hpp"
+
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+
+using super_resolution::ImageData;
+using super_resolution::IRLSCheckpoint;
+using super_resolution::IRLSSubsetState;
+using super_resolution::util::GetAbsoluteCodePath;
+
+using testing::ElementsAre;
+
+static const std::string kTestCheckpointPath =
+    GetAbsoluteCodePath("test_data/test_tmp_dir/irls_checkpoint_test");
+
+// Tests that a written checkpoint is read back exactly, and that invalid files
+// are rejected.
+TEST(IRLSCheckpoint, WriteAndRead) {
+  IRLSCheckpoint checkpoint;
+  checkpoint.image_width = 3;
+  checkpoint.image_height = 2;
+  checkpoint.num_channels = 2;
+  checkpoint.split_channels = true;
+  checkpoint.max_num_irls_iterations = 7;
+  checkpoint.max_num_solver_iterations = 30;
+  checkpoint.irls_cost_difference_threshold = 0.25;
+  checkpoint.regularization_parameters = {0.01, 0.5};
+  checkpoint.regularizer_types = {"TotalVariation", ""};
+  checkpoint.regularization_norm = 1.0;
+  checkpoint.problem_hash = 0x0123456789abcdefULL;
+  IRLSSubsetState first_subset;
+  first_subset.channel_start = 0;
+  first_subset.channel_end = 1;
+  first_subset.is_complete = true;
+  first_subset.num_irls_iterations_ran = 4;
+  first_subset.previous_cost = 1.5;
+  first_subset.estimate = {1, 2, 3, 4, 5, 6};
+  first_subset.irls_weights = {{6, 5, 4, 3, 2, 1}, {1, 1, 1, 2, 2, 2}};
+  IRLSSubsetState second_subset;  // Not started yet.
+  second_subset.channel_start = 1;
+  second_subset.channel_end = 2;
+  checkpoint.subsets = {first_subset, second_subset};
+
+  ASSERT_TRUE(WriteIRLSCheckpoint(kTestCheckpointPath, checkpoint));
+  IRLSCheckpoint read_checkpoint;
+  ASSERT_TRUE(ReadIRLSCheckpoint(kTestCheckpointPath, &read_checkpoint));
+  EXPECT_EQ(read_checkpoint.image_width, 3);
+  EXPECT_EQ(read_checkpoint.image_height, 2);
+  EXPECT_EQ(read_checkpoint.num_channels, 2);
+  EXPECT_TRUE(read_checkpoint.split_channels);
+  EXPECT_EQ(read_checkpoint.max_num_irls_iterations, 7);
+  EXPECT_EQ(read_checkpoint.max_num_solver_iterations, 30);
+  EXPECT_EQ(read_checkpoint.irls_cost_difference_threshold, 0.25);
+  EXPECT_THAT(
+      read_checkpoint.regularization_parameters, ElementsAre(0.01, 0.5));
+  EXPECT_THAT(
+      read_checkpoint.regularizer_types, ElementsAre("TotalVariation", ""));
+  EXPECT_EQ(read_checkpoint.regularization_norm, 1.0);
+  EXPECT_EQ(read_checkpoint.problem_hash, 0x0123456789abcdefULL);
+  ASSERT_EQ(read_checkpoint.subsets.size(), 2);
+  const IRLSSubsetState& read_subset = read_checkpoint.subsets[0];
+  EXPECT_EQ(read_subset.channel_start, 0);
+  EXPECT_EQ(read_subset.channel_end, 1);
+  EXPECT_TRUE(read_subset.is_complete);
+  EXPECT_EQ(read_subset.num_irls_iterations_ran, 4);
+  EXPECT_EQ(read_subset.previous_cost, 1.5);
+  EXPECT_EQ(read_subset.estimate, first_subset.estimate);
+  EXPECT_EQ(read_subset.irls_weights, first_subset.irls_weights);
+  EXPECT_FALSE(read_checkpoint.subsets[1].is_complete);
+  EXPECT_TRUE(read_checkpoint.subsets[1].estimate.empty());
+  EXPECT_TRUE(read_checkpoint.subsets[1].irls_weights.empty());
+
+  // A truncated file is not a valid checkpoint.
+  {
+    std::ofstream file(kTestCheckpointPath, std::ios::binary);
+    file << "SRIRLSCP";
+  }
+  EXPECT_FALSE(ReadIRLSCheckpoint(kTestCheckpointPath, &read_checkpoint));
+
+  // A count that is larger than the rest of the file is rejected before
+  // anything is allocated for it.
+  {
+    std::ofstream file(kTestCheckpointPath, std::ios::binary);
+    file << "SRIRLSCP";
+    const int32_t header_values[] = {2, 3, 2, 2};
+    file.write(
+        reinterpret_cast<const char*>(header_values), sizeof(header_values));
+    const uint8_t split_channels = 1;
+    file.write(reinterpret_cast<const char*>(&split_channels), 1);
+    const int32_t iteration_limits[] = {7, 30};
+    file.write(
+        reinterpret_cast<const char*>(iteration_limits),
+        sizeof(iteration_limits));
+    const double irls_cost_difference_threshold = 0.25;
+    file.write(
+        reinterpret_cast<const char*>(&irls_cost_difference_threshold),
+        sizeof(double));
+    const int64_t num_regularizers = int64_t(1) << 60;
+    file.write(
+        reinterpret_cast<const char*>(&num_regularizers), sizeof(int64_t));
+  }
+  EXPECT_FALSE(ReadIRLSCheckpoint(kTestCheckpointPath, &read_checkpoint));
+  std::remove(kTestCheckpointPath.c_str());
+  EXPECT_FALSE(ReadIRLSCheckpoint(kTestCheckpointPath, &read_checkpoint));
+}
+
+// Tests that the asynchronous writer writes the latest state of every subset.
+TEST(IRLSCheckpoint, CheckpointWriter) {
+  IRLSCheckpoint checkpoint;
+  checkpoint.image_width = 2;
+  checkpoint.image_height = 1;
+  checkpoint.num_channels = 2;
+  checkpoint.subsets.resize(2);
+  checkpoint.subsets[0].channel_end = 1;
+  checkpoint.subsets[1].channel_start = 1;
+  checkpoint.subsets[1].channel_end = 2;
+
+  super_resolution::IRLSCheckpointWriter writer(
+      kTestCheckpointPath, checkpoint);
+  IRLSSubsetState subset_state = checkpoint.subsets[1];
+  for (int i = 1; i <= 10; ++i) {
+    subset_state.num_irls_iterations_ran = i;
+    subset_state.estimate = {static_cast<double>(i), 0.0};
+    writer.UpdateSubset(subset_state);
+  }
+  writer.Flush();
+
+  IRLSCheckpoint read_checkpoint;
+  ASSERT_TRUE(ReadIRLSCheckpoint(kTestCheckpointPath, &read_checkpoint));
+  ASSERT_EQ(read_checkpoint.subsets.size(), 2);
+  EXPECT_EQ(read_checkpoint.subsets[0].num_irls_iterations_ran, 0);
+  EXPECT_EQ(read_checkpoint.subsets[1].num_irls_iterations_ran, 10);
+  EXPECT_THAT(read_checkpoint.subsets[1].estimate, ElementsAre(10.0, 0.0));
+  std::remove(kTestCheckpointPath.c_str());
+}
+
+// Tests that a solve that is interrupted and resumed from its checkpoint gives
+// the same result as an uninterrupted solve.
+TEST(IRLSCheckpoint, ResumeMatchesUninterruptedSolve) {
+  const cv::Size image_size(16, 16);
+  cv::Mat ground_truth_matrix(image_size, CV_64FC1);
+  for (int row = 0; row < image_size.height; ++row) {
+    for (int col = 0; col < image_size.width; ++col) {
+      ground_truth_matrix.at<double>(row, col) =
+          ((row < 8) == (col < 10) ? 0.8 : 0.2) +
+          0.05 * std::sin(1.3 * row + 0.7 * col);
+    }
+  }
+  const ImageData ground_truth(ground_truth_matrix);
+
+  super_resolution::ImageModelParameters model_parameters;
+  model_parameters.scale = 2;
+  model_parameters.motion_sequence = super_resolution::MotionShiftSequence({
+    super_resolution::MotionShift(0, 0),
+    super_resolution::MotionShift(1, 0),
+    super_resolution::MotionShift(0, 1)
+  });
+  model_parameters.blur_radius = 3;
+  model_parameters.blur_sigma = 1.0;
+  const super_resolution::ImageModel image_model =
+      super_resolution::ImageModel::CreateImageModel(model_parameters);
+  std::vector<ImageData> low_res_images;
+  for (int i = 0; i < 3; ++i) {
+    low_res_images.push_back(image_model.ApplyToImage(ground_truth, i));
+  }
+  ImageData initial_estimate = low_res_images[0];
+  initial_estimate.ResizeImage(2, super_resolution::INTERPOLATE_LINEAR);
+
+  const auto solve = [&](
+      const super_resolution::IRLSMapSolverOptions& solver_options) {
+    super_resolution::IRLSMapSolver solver(
+        solver_options, image_model, low_res_images, false);
+    solver.AddRegularizer(
+        std::shared_ptr<super_resolution::Regularizer>(
+            new super_resolution::TotalVariationRegularizer(image_size)),
+        0.01);
+    return solver.Solve(initial_estimate);
+  };
+
+  super_resolution::IRLSMapSolverOptions solver_options;
+  solver_options.max_num_irls_iterations = 4;
+  solver_options.irls_cost_difference_threshold = 0.0;
+  const ImageData uninterrupted_result = solve(solver_options);
+
+  // Run the first two iterations. The resumed solve has a higher iteration
+  // limit, so it continues the completed subset as if the first solve had
+  // been interrupted.
+  super_resolution::IRLSMapSolverOptions first_solver_options = solver_options;
+  first_solver_options.max_num_irls_iterations = 2;
+  first_solver_options.checkpoint_path = kTestCheckpointPath;
+  solve(first_solver_options);
+  IRLSCheckpoint checkpoint;
+  ASSERT_TRUE(ReadIRLSCheckpoint(kTestCheckpointPath, &checkpoint));
+  ASSERT_EQ(checkpoint.subsets.size(), 1);
+  EXPECT_EQ(checkpoint.subsets[0].num_irls_iterations_ran, 2);
+  EXPECT_TRUE(checkpoint.subsets[0].is_complete);
+  EXPECT_EQ(checkpoint.regularizer_types.size(), 1);
+  EXPECT_EQ(checkpoint.regularization_norm, 1.0);
+
+  super_resolution::IRLSMapSolverOptions resumed_solver_options =
+      solver_options;
+  resumed_solver_options.checkpoint_path = kTestCheckpointPath;
+  resumed_solver_options.resume_from_checkpoint = true;
+  const ImageData resumed_result = solve(resumed_solver_options);
+  const double* expected_data = uninterrupted_result.GetChannelData(0);
+  const double* resumed_data = resumed_result.GetChannelData(0);
+  for (int i = 0; i < image_size.width * image_size.height; ++i) {
+    EXPECT_NEAR(resumed_data[i], expected_data[i], 1e-12);
+  }
+  std::remove(kTestCheckpointPath.c_str());
+}
@@ -0,0 +1,106 @@
+#include <vector>
+
+#include "optimization/laplacian_regularizer.h"
+
+#include "opencv2/core/core.hpp"
+
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+
+using super_resolution::LaplacianRegularizer;
+
+using testing::ElementsAre;
+using testing::SizeIs;
+
+const cv::Size test_image_size(3, 3);
+const std::vector<double> test_image_data = {
+     0,  0, 1,
+     0,  1, 3,
+    -3, -1, 0
+};
+
+TEST(LaplacianRegularizer, ApplyToImage) {
+  const LaplacianRegularizer regularizer(test_image_size);
+
+  // Sum of differences to the 4-connected neighbors inside the image, e.g.
+  // at the center: (0 - 1) + (3 - 1) + (0 - 1) + (-1 - 1) = -2.
+  const std::vector<double> values =
+      regularizer.ApplyToImage(test_image_data.data(), 1);
+  EXPECT_THAT(values, ElementsAre(
+      0, 2, 1,
+      -2, -2, -7,
+      5, 1, 2));
+  EXPECT_TRUE(regularizer.IsSmooth());
+
+  // Each channel is regularized independently.
+  std::vector<double> two_channel_data = test_image_data;
+  two_channel_data.insert(
+      two_channel_data.end(), test_image_data.begin(), test_image_data.end());
+  const std::vector<double> two_channel_values =
+      regularizer.ApplyToImage(two_channel_data.data(), 2);
+  ASSERT_THAT(two_channel_values, SizeIs(18));
+  for (int i = 0; i < 9; ++i) {
+    EXPECT_EQ(two_channel_values[i], values[i]);
+    EXPECT_EQ(two_channel_values[i + 9], values[i]);
+  }
+}
+
+TEST(LaplacianRegularizer, ComputeWeightedSquaredSumAndGradient) {
+  const LaplacianRegularizer regularizer(test_image_size);
+
+  const int num_channels = 2;
+  std::vector<double> image_data;
+  for (int channel = 0; channel < num_channels; ++channel) {
+    for (const double value : test_image_data) {
+      image_data.push_back(value * (channel + 1) * 0.1 + channel * 0.05);
+    }
+  }
+  const int num_parameters = image_data.size();
+  std::vector<double> weights(num_parameters);
+  for (int i = 0; i < num_parameters; ++i) {
+    weights[i] = 0.1 * (i % 5) + 0.5;
+  }
+  const double regularization_parameter = 0.7;
+
+  const auto compute_cost = [&](const std::vector<double>& data) {
+    const std::vector<double> residuals =
+        regularizer.ApplyToImage(data.data(), num_channels);
+    double cost = 0.0;
+    for (int i = 0; i < num_parameters; ++i) {
+      cost += weights[i] * residuals[i] * residuals[i];
+    }
+    return regularization_parameter * cost;
+  };
+
+  // The gradient is accumulated onto the given values.
+  std::vector<double> gradient(num_parameters, 1.0);
+  std::vector<double> residuals(num_parameters);
+  const double cost = regularizer.ComputeWeightedSquaredSumAndGradient(
+      image_data.data(),
+      num_channels,
+      regularization_parameter,
+      weights,
+      residuals.data(),
+      gradient.data());
+  EXPECT_NEAR(cost, compute_cost(image_data), 1e-12);
+  EXPECT_NEAR(
+      regularization_parameter * regularizer.ComputeWeightedSquaredSum(
+          image_data.data(), weights, num_channels),
+      cost,
+      1e-12);
+  EXPECT_EQ(
+      residuals, regularizer.ApplyToImage(image_data.data(), num_channels));
+
+  // The cost is quadratic, so central differences are exact up to rounding.
+  const double finite_difference = 1e-4;
+  for (int i = 0; i < num_parameters; ++i) {
+    std::vector<double> pos_diff_image_data = image_data;
+    pos_diff_image_data[i] += finite_difference;
+    std::vector<double> neg_diff_image_data = image_data;
+    neg_diff_image_data[i] -= finite_difference;
+    const double numerical_gradient_at_i =
+        (compute_cost(pos_diff_image_data) -
+         compute_cost(neg_diff_image_data)) / (2 * finite_difference);
+    EXPECT_NEAR(gradient[i] - 1.0, numerical_gradient_at_i, 1e-8);
+  }
+}
@@ -0,0 +1,57 @@
+#include <vector>
+
+#include "optimization/linear_conjugate_gradient.h"
+
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+
+using super_resolution::LinearConjugateGradientSolver;
+
+using testing::DoubleNear;
+using testing::ElementsAre;
+
+// Tests that CG solves a small symmetric positive definite system exactly in
+// as many iterations as there are unknowns, and that a warm start at the
+// solution needs no iterations at all.
+TEST(LinearConjugateGradient, SmallSystemTest) {
+  // Q = [4 1 0; 1 3 1; 0 1 2], x = [1, -2, 3], b = Qx.
+  const std::vector<double> matrix = {
+    4.0, 1.0, 0.0,
+    1.0, 3.0, 1.0,
+    0.0, 1.0, 2.0
+  };
+  const super_resolution::LinearOperator apply_matrix =
+      [&matrix](const double* input, double* output) {
+        for (int row = 0; row < 3; ++row) {
+          output[row] = 0.0;
+          for (int col = 0; col < 3; ++col) {
+            output[row] += matrix[row * 3 + col] * input[col];
+          }
+        }
+      };
+  const std::vector<double> right_hand_side = {2.0, -2.0, 4.0};
+
+  LinearConjugateGradientSolver solver(3);
+  std::vector<double> solution = {0.0, 0.0, 0.0};
+  const int num_iterations = solver.Solve(
+      apply_matrix, right_hand_side.data(), 100, 1e-12, solution.data());
+  EXPECT_LE(num_iterations, 3);
+  EXPECT_THAT(solution, ElementsAre(
+      DoubleNear(1.0, 1e-10), DoubleNear(-2.0, 1e-10), DoubleNear(3.0, 1e-10)));
+
+  EXPECT_EQ(solver.Solve(
+      apply_matrix, right_hand_side.data(), 100, 1e-6, solution.data()), 0);
+
+  // Jacobi preconditioning converges to the same solution.
+  solver.SetDiagonalPreconditioner({4.0, 3.0, 2.0});
+  solution = {0.0, 0.0, 0.0};
+  EXPECT_LE(solver.Solve(
+      apply_matrix, right_hand_side.data(), 100, 1e-12, solution.data()), 3);
+  EXPECT_THAT(solution, ElementsAre(
+      DoubleNear(1.0, 1e-10), DoubleNear(-2.0, 1e-10), DoubleNear(3.0, 1e-10)));
+
+  // The iteration limit is respected.
+  solution = {0.0, 0.0, 0.0};
+  EXPECT_EQ(solver.Solve(
+      apply_matrix, right_hand_side.data(), 1, 0.0, solution.data()), 1);
+}
@@ -1,3 +1,7 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
 #include <memory>
 #include <string>
 #include <utility>
@@ -12,7 +16,13 @@
 #include "image_model/motion_module.h"
 #include "motion/motion_shift.h"
 #include "optimization/btv_regularizer.h"
+#include "optimization/fourier_map_solver.h"
 #include "optimization/irls_map_solver.h"
+#include "optimization/laplacian_regularizer.h"
+#include "optimization/nonlocal_regularizer.h"
+#include "optimization/objective_data_term.h"
+#include "optimization/objective_function.h"
+#include "optimization/objective_irls_regularization_term.h"
 #include "optimization/tv_regularizer.h"
 #include "util/test_util.h"
 #include "util/util.h"
@@ -31,6 +41,10 @@ using super_resolution::ImageData;
 using super_resolution::MotionModule;
 using super_resolution::test::AreImagesEqual;
 using super_resolution::test::AreMatricesEqual;
+using super_resolution::test::ComputeRootMeanSquaredError;
+using super_resolution::test::CreateTestImage;
+using super_resolution::test::CreateTestProblem;
+using super_resolution::test::SuperResolutionTestProblem;
 using super_resolution::util::GetAbsoluteCodePath;
 
 using testing::_;
@@ -58,6 +72,79 @@ static const std::string kTestIconPath =
 static const std::string kTestImagePath =
     GetAbsoluteCodePath("test_data/goat.jpg");
 
+namespace {
+
+// The motion shifts of the four downsampling phases of a downsampling scale
+// of 2.
+const std::vector<super_resolution::MotionShift> kPhaseMotionShifts = {
+  super_resolution::MotionShift(0, 0),
+  super_resolution::MotionShift(1, 0),
+  super_resolution::MotionShift(0, 1),
+  super_resolution::MotionShift(1, 1)
+};
+
+// Returns the parameters of an image model with the given downsampling scale
+// and motion shifts, and a Gaussian blur of radius 3 with the given sigma.
+super_resolution::ImageModelParameters CreateModelParameters(
+    const int scale,
+    const std::vector<super_resolution::MotionShift>& motion_shifts,
+    const double blur_sigma) {
+
+  super_resolution::ImageModelParameters model_parameters;
+  model_parameters.scale = scale;
+  model_parameters.motion_sequence =
+      super_resolution::MotionShiftSequence(motion_shifts);
+  model_parameters.blur_radius = 3;
+  model_parameters.blur_sigma = blur_sigma;
+  return model_parameters;
+}
+
+// Returns a smooth image of the given size for the tests of quadratic
+// (Laplacian-regularized) objectives.
+ImageData CreateSmoothTestImage(const cv::Size& image_size) {
+  return CreateTestImage(image_size, [](const int row, const int col) {
+    return 0.5 + 0.3 * std::sin(0.7 * col) * std::cos(0.4 * row);
+  });
+}
+
+// Returns the gradient of the quadratic objective with the given Laplacian
+// regularizer (IRLS weights of 1) at the first channel of the estimate. The
+// gradient vanishes at the minimum.
+std::vector<double> ComputeLaplacianObjectiveGradient(
+    const SuperResolutionTestProblem& problem,
+    const std::shared_ptr<super_resolution::Regularizer>& laplacian_regularizer,
+    const double regularization_parameter,
+    const ImageData& estimate) {
+
+  const cv::Size image_size = estimate.GetImageSize();
+  std::vector<ImageData> observations;
+  for (const ImageData& low_res_image : problem.low_res_images) {
+    ImageData observation = low_res_image;
+    observation.ResizeImage(image_size, super_resolution::INTERPOLATE_NEAREST);
+    observations.push_back(observation);
+  }
+  super_resolution::ObjectiveFunction objective_function(image_size.area());
+  objective_function.AddTerm(
+      std::shared_ptr<super_resolution::ObjectiveTerm>(
+          new super_resolution::ObjectiveDataTerm(
+              problem.image_model, observations, 0, 1, image_size)));
+  const std::vector<double> irls_weights(image_size.area(), 1.0);
+  objective_function.AddTerm(
+      std::shared_ptr<super_resolution::ObjectiveTerm>(
+          new super_resolution::ObjectiveIRLSRegularizationTerm(
+              laplacian_regularizer,
+              regularization_parameter,
+              irls_weights,
+              1,
+              image_size)));
+  std::vector<double> gradient(image_size.area());
+  objective_function.ComputeAllTerms(
+      estimate.GetChannelData(0), gradient.data());
+  return gradient;
+}
+
+}  // namespace
+
 class MockRegularizer : public super_resolution::Regularizer {
  public:
   // Handle super constructor, since we don't need the image_size_ field.
@@ -139,6 +226,23 @@ TEST(MapSolver, SmallDataTest) {
       ground_truth_matrix,
       kSolverResultErrorTolerance));
 
+  // The normal-equation data term (fused for this translational model) should
+  // converge to the same solution.
+  super_resolution::IRLSMapSolverOptions options_with_normal_equation =
+      kDefaultSolverOptions;
+  options_with_normal_equation.use_normal_equation_data_term = true;
+  super_resolution::IRLSMapSolver solver_with_normal_equation(
+      options_with_normal_equation,
+      image_model,
+      low_res_images,
+      kPrintSolverOutput);
+  const ImageData result_with_normal_equation =
+      solver_with_normal_equation.Solve(initial_estimate);
+  EXPECT_TRUE(AreMatricesEqual(
+      result_with_normal_equation.GetChannelImage(0),
+      ground_truth_matrix,
+      kSolverResultErrorTolerance));
+
   /* Repeat the same tests, but this time with multiple channels. */
 
   // Simply replicate the channels for each image.
@@ -479,3 +583,432 @@ TEST(MapSolver, RegularizationTest) {
         "Ground Truth, Upsampled, Unregualrzed, TV, TV Split, BTV");
   }
 }
+
+// Tests the closed-form Fourier solver on a translational model whose shifts
+// cover every downsampling phase once. The periodic border assumption only
+// affects pixels near the image border, so the gradient of the true objective
+// must vanish at the solution everywhere in the interior.
+TEST(MapSolver, FourierSolverTest) {
+  const cv::Size image_size(32, 32);
+  const SuperResolutionTestProblem problem = CreateTestProblem(
+      CreateSmoothTestImage(image_size),
+      CreateModelParameters(2, kPhaseMotionShifts, 0.5),
+      4);
+  const int num_images = problem.low_res_images.size();
+
+  const double regularization_parameter = 0.01;
+  const std::shared_ptr<super_resolution::Regularizer> laplacian_regularizer(
+      new super_resolution::LaplacianRegularizer(image_size));
+  const std::vector<
+      std::pair<std::shared_ptr<super_resolution::Regularizer>, double>>
+      regularizers = {
+        std::make_pair(laplacian_regularizer, regularization_parameter)
+      };
+  EXPECT_TRUE(super_resolution::FourierMapSolver::CanSolve(
+      problem.image_model, num_images, regularizers));
+
+  // Missing a downsampling phase or using a non-quadratic regularizer both
+  // rule out the closed-form solution.
+  EXPECT_FALSE(super_resolution::FourierMapSolver::CanSolve(
+      problem.image_model, num_images - 1, regularizers));
+  const std::shared_ptr<super_resolution::Regularizer> tv_regularizer(
+      new super_resolution::TotalVariationRegularizer(image_size));
+  EXPECT_FALSE(super_resolution::FourierMapSolver::CanSolve(
+      problem.image_model,
+      num_images,
+      {std::make_pair(tv_regularizer, 0.01)}));
+
+  // The IRLS solver selects the Fourier solver automatically.
+  super_resolution::IRLSMapSolver solver(
+      kDefaultSolverOptions,
+      problem.image_model,
+      problem.low_res_images,
+      kPrintSolverOutput);
+  solver.AddRegularizer(laplacian_regularizer, regularization_parameter);
+  const ImageData result = solver.Solve(problem.initial_estimate);
+  ASSERT_EQ(result.GetImageSize(), image_size);
+
+  const std::vector<double> gradient = ComputeLaplacianObjectiveGradient(
+      problem, laplacian_regularizer, regularization_parameter, result);
+  const int border = 4;
+  for (int row = border; row < image_size.height - border; ++row) {
+    for (int col = border; col < image_size.width - border; ++col) {
+      EXPECT_NEAR(gradient[row * image_size.width + col], 0.0, 1e-8);
+    }
+  }
+
+  // The solution should also be close to the ground truth in the interior.
+  for (int row = border; row < image_size.height - border; ++row) {
+    for (int col = border; col < image_size.width - border; ++col) {
+      EXPECT_NEAR(
+          result.GetPixelValue(0, row, col),
+          problem.ground_truth.GetPixelValue(0, row, col),
+          0.01);
+    }
+  }
+}
+
+// The closed-form Fourier solver ignores options such as checkpointing and
+// motion refinement, so the IRLS solver must not use it when they are set,
+// even if the objective itself is shift-invariant.
+TEST(MapSolver, FourierSolverSkippedTest) {
+  const cv::Size image_size(16, 16);
+  const SuperResolutionTestProblem problem = CreateTestProblem(
+      CreateSmoothTestImage(image_size),
+      CreateModelParameters(2, kPhaseMotionShifts, 0.5),
+      4);
+  const int num_images = problem.low_res_images.size();
+
+  const std::shared_ptr<super_resolution::Regularizer> laplacian_regularizer(
+      new super_resolution::LaplacianRegularizer(image_size));
+  const std::vector<
+      std::pair<std::shared_ptr<super_resolution::Regularizer>, double>>
+      regularizers = {std::make_pair(laplacian_regularizer, 0.01)};
+  EXPECT_TRUE(super_resolution::FourierMapSolver::CanSolve(
+      kDefaultSolverOptions, problem.image_model, num_images, regularizers));
+
+  super_resolution::IRLSMapSolverOptions refine_motion_options =
+      kDefaultSolverOptions;
+  refine_motion_options.refine_motion = true;
+  EXPECT_FALSE(super_resolution::FourierMapSolver::CanSolve(
+      refine_motion_options, problem.image_model, num_images, regularizers));
+
+  super_resolution::IRLSMapSolverOptions checkpoint_options =
+      kDefaultSolverOptions;
+  checkpoint_options.checkpoint_path = super_resolution::util::
+      GetAbsoluteCodePath("test_data/test_tmp_dir/fourier_skipped_checkpoint");
+  checkpoint_options.max_num_irls_iterations = 1;
+  EXPECT_FALSE(super_resolution::FourierMapSolver::CanSolve(
+      checkpoint_options, problem.image_model, num_images, regularizers));
+
+  // Only the iterative solve writes the checkpoint.
+  std::remove(checkpoint_options.checkpoint_path.c_str());
+  super_resolution::IRLSMapSolver solver(
+      checkpoint_options,
+      problem.image_model,
+      problem.low_res_images,
+      kPrintSolverOutput);
+  solver.AddRegularizer(laplacian_regularizer, 0.01);
+  const ImageData result = solver.Solve(problem.initial_estimate);
+  EXPECT_EQ(result.GetImageSize(), image_size);
+  EXPECT_TRUE(std::ifstream(checkpoint_options.checkpoint_path).good());
+  std::remove(checkpoint_options.checkpoint_path.c_str());
+}
+
+// Tests that the IRLS solver minimizes a quadratic objective (here a Laplacian
+// prior on a model that the Fourier solver cannot handle) with linear CG, and
+// that the result is a stationary point of the full objective.
+TEST(MapSolver, LinearConjugateGradientTest) {
+  // Only three of the four downsampling phases are observed.
+  const cv::Size image_size(16, 16);
+  const SuperResolutionTestProblem problem = CreateTestProblem(
+      CreateSmoothTestImage(image_size),
+      CreateModelParameters(2, kPhaseMotionShifts, 0.5),
+      3);
+
+  const double regularization_parameter = 0.01;
+  const std::shared_ptr<super_resolution::Regularizer> laplacian_regularizer(
+      new super_resolution::LaplacianRegularizer(image_size));
+  EXPECT_FALSE(super_resolution::FourierMapSolver::CanSolve(
+      problem.image_model,
+      problem.low_res_images.size(),
+      {std::make_pair(laplacian_regularizer, regularization_parameter)}));
+
+  super_resolution::IRLSMapSolverOptions solver_options;
+  solver_options.least_squares_solver = super_resolution::CG_SOLVER;
+  solver_options.max_num_solver_iterations = 0;
+  solver_options.gradient_norm_threshold = 1e-10;
+  super_resolution::IRLSMapSolver solver(
+      solver_options,
+      problem.image_model,
+      problem.low_res_images,
+      kPrintSolverOutput);
+  solver.AddRegularizer(laplacian_regularizer, regularization_parameter);
+  const ImageData result = solver.Solve(problem.initial_estimate);
+  ASSERT_EQ(result.GetImageSize(), image_size);
+
+  for (const double gradient_value : ComputeLaplacianObjectiveGradient(
+           problem, laplacian_regularizer, regularization_parameter, result)) {
+    EXPECT_NEAR(gradient_value, 0.0, 1e-8);
+  }
+}
+
+// Tests that with the same (small) iteration budget at the full resolution, a
+// coarse-to-fine solve gets closer to the ground truth than a single-level
+// solve, because the coarse levels already resolve the low frequencies.
+TEST(MapSolver, MultiscaleTest) {
+  const cv::Size image_size(32, 32);
+  const SuperResolutionTestProblem problem = CreateTestProblem(
+      CreateTestImage(image_size, [](const int row, const int col) {
+        return 0.5 + 0.3 * std::sin(0.3 * col) * std::cos(0.2 * row);
+      }),
+      CreateModelParameters(4, {
+        super_resolution::MotionShift(0, 0),
+        super_resolution::MotionShift(2, 0),
+        super_resolution::MotionShift(0, 2),
+        super_resolution::MotionShift(2, 2),
+        super_resolution::MotionShift(1, 3),
+        super_resolution::MotionShift(3, 1)
+      }, 1.0),
+      6);
+
+  super_resolution::IRLSMapSolverOptions solver_options;
+  solver_options.max_num_irls_iterations = 2;
+  solver_options.max_num_solver_iterations = 5;
+  const auto solve = [&](const int num_multiscale_levels) {
+    solver_options.num_multiscale_levels = num_multiscale_levels;
+    super_resolution::IRLSMapSolver solver(
+        solver_options,
+        problem.image_model,
+        problem.low_res_images,
+        kPrintSolverOutput);
+    solver.AddRegularizer(
+        std::shared_ptr<super_resolution::Regularizer>(
+            new super_resolution::TotalVariationRegularizer(image_size)),
+        0.0001);
+    const ImageData result = solver.Solve(problem.initial_estimate);
+    EXPECT_EQ(result.GetImageSize(), image_size);
+    return ComputeRootMeanSquaredError(result, problem.ground_truth);
+  };
+  const double single_level_error = solve(1);
+  const double multiscale_error = solve(3);
+  EXPECT_LT(multiscale_error, single_level_error);
+}
+
+// Tests that the concurrently solved channel subsets of split_channels give
+// exactly the results of solving each channel on its own. The non-local
+// regularizer rebuilds its state from each subset's estimate, so this also
+// checks that the subsets do not share regularizer state.
+TEST(MapSolver, SplitChannelsTest) {
+  const cv::Size image_size(16, 16);
+  const int num_channels = 3;
+  ImageData ground_truth;
+  for (int channel = 0; channel < num_channels; ++channel) {
+    ground_truth.AddChannel(
+        CreateTestImage(image_size, [channel](const int row, const int col) {
+          return 0.5 + 0.3 *
+              std::sin(0.4 * (channel + 1) * col) * std::cos(0.3 * row);
+        }).GetChannelImage(0),
+        super_resolution::DO_NOT_NORMALIZE_IMAGE);
+  }
+  const SuperResolutionTestProblem problem = CreateTestProblem(
+      ground_truth, CreateModelParameters(2, kPhaseMotionShifts, 0.5), 3);
+
+  super_resolution::IRLSMapSolverOptions solver_options;
+  solver_options.max_num_irls_iterations = 3;
+  solver_options.split_channels = true;
+  const double regularization_parameter = 0.001;
+  const auto make_regularizer = [&image_size]() {
+    return std::shared_ptr<super_resolution::Regularizer>(
+        new super_resolution::NonLocalRegularizer(image_size, 2, 1, 4, 0.1));
+  };
+  super_resolution::IRLSMapSolver solver(
+      solver_options,
+      problem.image_model,
+      problem.low_res_images,
+      kPrintSolverOutput);
+  solver.AddRegularizer(make_regularizer(), regularization_parameter);
+  const ImageData result = solver.Solve(problem.initial_estimate);
+  ASSERT_EQ(result.GetNumChannels(), num_channels);
+
+  const int num_pixels = image_size.area();
+  for (int channel = 0; channel < num_channels; ++channel) {
+    std::vector<ImageData> channel_low_res_images;
+    for (const ImageData& low_res_image : problem.low_res_images) {
+      channel_low_res_images.push_back(ImageData(
+          low_res_image.GetChannelData(channel),
+          low_res_image.GetImageSize(),
+          1));
+    }
+    const ImageData channel_initial_estimate(
+        problem.initial_estimate.GetChannelData(channel), image_size, 1);
+    super_resolution::IRLSMapSolver channel_solver(
+        solver_options,
+        problem.image_model,
+        channel_low_res_images,
+        kPrintSolverOutput);
+    channel_solver.AddRegularizer(
+        make_regularizer(), regularization_parameter);
+    const ImageData channel_result =
+        channel_solver.Solve(channel_initial_estimate);
+    const double* expected_data = channel_result.GetChannelData(0);
+    const double* result_data = result.GetChannelData(channel);
+    for (int pixel_index = 0; pixel_index < num_pixels; ++pixel_index) {
+      EXPECT_NEAR(result_data[pixel_index], expected_data[pixel_index], 1e-12);
+    }
+  }
+}
+
+// Tests that the solver stops at the time limit with a valid estimate, and
+// that a time limit that is never reached does not change the result.
+TEST(MapSolver, TimeLimitTest) {
+  const cv::Size image_size(64, 64);
+  const SuperResolutionTestProblem problem = CreateTestProblem(
+      CreateTestImage(image_size, [](const int row, const int col) {
+        return ((row < 30) == (col < 40) ? 0.8 : 0.2) +
+            0.1 * std::sin(0.5 * col) * std::cos(0.3 * row);
+      }),
+      CreateModelParameters(2, kPhaseMotionShifts, 1.0),
+      4);
+
+  super_resolution::IRLSMapSolverOptions solver_options;
+  solver_options.max_num_irls_iterations = 10;
+  solver_options.max_num_solver_iterations = 100;
+  const auto solve = [&](const double time_limit_seconds) {
+    solver_options.time_limit_seconds = time_limit_seconds;
+    super_resolution::IRLSMapSolver solver(
+        solver_options,
+        problem.image_model,
+        problem.low_res_images,
+        kPrintSolverOutput);
+    solver.AddRegularizer(
+        std::shared_ptr<super_resolution::Regularizer>(
+            new super_resolution::TotalVariationRegularizer(image_size)),
+        0.001);
+    return solver.Solve(problem.initial_estimate);
+  };
+
+  const auto start_time = std::chrono::steady_clock::now();
+  const ImageData unlimited_result = solve(0.0);
+  const double unlimited_seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start_time).count();
+
+  // A limit that is never reached gives exactly the same result.
+  const ImageData generous_result = solve(1000.0);
+  EXPECT_TRUE(AreImagesEqual(generous_result, unlimited_result, 0.0));
+
+  // An exhausted limit returns the initial estimate.
+  const ImageData exhausted_result = solve(1.0e-9);
+  EXPECT_TRUE(AreImagesEqual(exhausted_result, problem.initial_estimate, 0.0));
+
+  // A tight limit stops early (allowing for one iteration past the deadline)
+  // with an estimate that is still better than the initial one.
+  const double time_limit_seconds = unlimited_seconds / 4.0;
+  const auto limited_start_time = std::chrono::steady_clock::now();
+  const ImageData limited_result = solve(time_limit_seconds);
+  const double limited_seconds = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - limited_start_time).count();
+  EXPECT_LT(limited_seconds, 0.75 * unlimited_seconds);
+  EXPECT_LT(
+      ComputeRootMeanSquaredError(limited_result, problem.ground_truth),
+      ComputeRootMeanSquaredError(
+          problem.initial_estimate, problem.ground_truth));
+}
+
+// Tests that mixed precision reconstructs the image as well as full double
+// precision, measured in PSNR.
+TEST(MapSolver, MixedPrecisionTest) {
+  const cv::Size image_size(32, 32);
+  const SuperResolutionTestProblem problem = CreateTestProblem(
+      CreateTestImage(image_size, [](const int row, const int col) {
+        return ((row < 14) == (col < 20) ? 0.8 : 0.2) +
+            0.1 * std::sin(0.5 * col) * std::cos(0.3 * row);
+      }),
+      CreateModelParameters(2, kPhaseMotionShifts, 1.0),
+      4);
+
+  super_resolution::IRLSMapSolverOptions solver_options;
+  solver_options.max_num_irls_iterations = 5;
+  const auto solve = [&](const bool use_mixed_precision) {
+    solver_options.use_mixed_precision = use_mixed_precision;
+    super_resolution::IRLSMapSolver solver(
+        solver_options,
+        problem.image_model,
+        problem.low_res_images,
+        kPrintSolverOutput);
+    solver.AddRegularizer(
+        std::shared_ptr<super_resolution::Regularizer>(
+            new super_resolution::TotalVariationRegularizer(image_size)),
+        0.001);
+    return solver.Solve(problem.initial_estimate);
+  };
+
+  const super_resolution::PeakSignalToNoiseRatioEvaluator psnr_evaluator(
+      problem.ground_truth);
+  const double double_precision_psnr = psnr_evaluator.Evaluate(solve(false));
+  const double mixed_precision_psnr = psnr_evaluator.Evaluate(solve(true));
+  EXPECT_GT(
+      double_precision_psnr,
+      psnr_evaluator.Evaluate(problem.initial_estimate));
+  EXPECT_NEAR(mixed_precision_psnr, double_precision_psnr, 0.05);
+}
+
+// With perturbed motion, refining the motion between the IRLS iterations
+// should get closer to the ground truth than solving with the given motion.
+TEST(MapSolver, MotionRefinementTest) {
+  const cv::Size image_size(32, 32);
+  const SuperResolutionTestProblem problem = CreateTestProblem(
+      CreateTestImage(image_size, [](const int row, const int col) {
+        return 0.5 + 0.2 * std::sin(0.4 * col + 0.1 * row) +
+            0.2 * std::cos(0.3 * row - 0.2 * col);
+      }),
+      CreateModelParameters(2, kPhaseMotionShifts, 1.0),
+      4);
+  const std::shared_ptr<super_resolution::ImageModel> perturbed_image_model =
+      problem.image_model.CreateModelWithMotion(
+          super_resolution::MotionShiftSequence({
+            super_resolution::MotionShift(0, 0),
+            super_resolution::MotionShift(1.3, -0.2),
+            super_resolution::MotionShift(-0.25, 1.2),
+            super_resolution::MotionShift(0.8, 1.3)
+          }));
+
+  super_resolution::IRLSMapSolverOptions solver_options;
+  solver_options.max_num_irls_iterations = 5;
+  const auto solve = [&](const bool refine_motion) {
+    solver_options.refine_motion = refine_motion;
+    super_resolution::IRLSMapSolver solver(
+        solver_options,
+        *perturbed_image_model,
+        problem.low_res_images,
+        kPrintSolverOutput);
+    solver.AddRegularizer(
+        std::shared_ptr<super_resolution::Regularizer>(
+            new super_resolution::TotalVariationRegularizer(image_size)),
+        0.001);
+    return solver.Solve(problem.initial_estimate);
+  };
+
+  const super_resolution::PeakSignalToNoiseRatioEvaluator psnr_evaluator(
+      problem.ground_truth);
+  const double unrefined_psnr = psnr_evaluator.Evaluate(solve(false));
+  const double refined_psnr = psnr_evaluator.Evaluate(solve(true));
+  EXPECT_GT(refined_psnr, unrefined_psnr + 1.0);
+}
+
+// The IRLS weights can reweight the regularizer towards any p-norm in (0, 2].
+TEST(MapSolver, IRLSRegularizationNormTest) {
+  const cv::Size image_size(32, 32);
+  const SuperResolutionTestProblem problem = CreateTestProblem(
+      CreateTestImage(image_size, [](const int row, const int col) {
+        return ((row < 14) == (col < 20) ? 0.8 : 0.2);
+      }),
+      CreateModelParameters(2, kPhaseMotionShifts, 1.0),
+      4);
+
+  super_resolution::IRLSMapSolverOptions solver_options;
+  solver_options.max_num_irls_iterations = 5;
+  const auto solve = [&](const double regularization_norm) {
+    solver_options.regularization_norm = regularization_norm;
+    super_resolution::IRLSMapSolver solver(
+        solver_options,
+        problem.image_model,
+        problem.low_res_images,
+        kPrintSolverOutput);
+    solver.AddRegularizer(
+        std::shared_ptr<super_resolution::Regularizer>(
+            new super_resolution::TotalVariationRegularizer(image_size)),
+        0.001);
+    return solver.Solve(problem.initial_estimate);
+  };
+
+  const super_resolution::PeakSignalToNoiseRatioEvaluator psnr_evaluator(
+      problem.ground_truth);
+  const double initial_psnr = psnr_evaluator.Evaluate(problem.initial_estimate);
+  const ImageData one_norm_result = solve(1.0);
+  const ImageData sparse_norm_result = solve(0.7);
+  EXPECT_GT(psnr_evaluator.Evaluate(one_norm_result), initial_psnr);
+  EXPECT_GT(psnr_evaluator.Evaluate(sparse_norm_result), initial_psnr);
+  EXPECT_GT(psnr_evaluator.Evaluate(solve(2.0)), initial_psnr);
+  EXPECT_FALSE(AreImagesEqual(one_norm_result, sparse_norm_result, 1e-6));
+}
@@ -0,0 +1,82 @@
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "image/image_data.h"
+#include "image_model/image_model.h"
+#include "motion/motion_refinement.h"
+#include "motion/motion_shift.h"
+
+#include "opencv2/core/core.hpp"
+
+#include "gtest/gtest.h"
+
+using super_resolution::ImageData;
+using super_resolution::MotionShift;
+using super_resolution::MotionShiftSequence;
+
+// Refining perturbed shifts against the true HR image should recover the true
+// motion of every frame but the first, which is the reference.
+TEST(MotionRefinement, RefineMotionShifts) {
+  const cv::Size image_size(32, 32);
+  cv::Mat ground_truth_matrix(image_size, CV_64FC1);
+  for (int row = 0; row < image_size.height; ++row) {
+    for (int col = 0; col < image_size.width; ++col) {
+      ground_truth_matrix.at<double>(row, col) =
+          0.5 + 0.2 * std::sin(0.4 * col + 0.1 * row) +
+          0.2 * std::cos(0.3 * row - 0.2 * col);
+    }
+  }
+  const ImageData ground_truth(
+      ground_truth_matrix, super_resolution::DO_NOT_NORMALIZE_IMAGE);
+
+  const int downsampling_scale = 2;
+  const std::vector<MotionShift> true_motion_shifts = {
+    MotionShift(0, 0),
+    MotionShift(1, 0),
+    MotionShift(0, 1),
+    MotionShift(1, 1)
+  };
+  super_resolution::ImageModelParameters model_parameters;
+  model_parameters.scale = downsampling_scale;
+  model_parameters.motion_sequence = MotionShiftSequence(true_motion_shifts);
+  model_parameters.blur_radius = 3;
+  model_parameters.blur_sigma = 1.0;
+  const super_resolution::ImageModel true_image_model =
+      super_resolution::ImageModel::CreateImageModel(model_parameters);
+
+  // The observations are stored at the HR size (see MapSolver).
+  std::vector<ImageData> observations;
+  for (int i = 0; i < true_motion_shifts.size(); ++i) {
+    ImageData observation = true_image_model.ApplyToImage(ground_truth, i);
+    observation.ResizeImage(image_size, super_resolution::INTERPOLATE_NEAREST);
+    observations.push_back(observation);
+  }
+
+  const std::vector<MotionShift> perturbed_motion_shifts = {
+    MotionShift(0, 0),
+    MotionShift(1.3, -0.2),
+    MotionShift(-0.25, 1.2),
+    MotionShift(0.8, 1.3)
+  };
+  const std::shared_ptr<super_resolution::ImageModel> perturbed_image_model =
+      true_image_model.CreateModelWithMotion(
+          MotionShiftSequence(perturbed_motion_shifts));
+
+  const MotionShiftSequence refined_motion_shifts =
+      super_resolution::RefineMotionShifts(
+          *perturbed_image_model,
+          observations,
+          ground_truth.GetChannelData(0),
+          0,  // channel_start
+          1,  // channel_end
+          image_size,
+          10);  // num_iterations
+  ASSERT_EQ(refined_motion_shifts.GetNumMotionShifts(), 4);
+  EXPECT_EQ(refined_motion_shifts[0].dx, 0);
+  EXPECT_EQ(refined_motion_shifts[0].dy, 0);
+  for (int i = 1; i < true_motion_shifts.size(); ++i) {
+    EXPECT_NEAR(refined_motion_shifts[i].dx, true_motion_shifts[i].dx, 0.02);
+    EXPECT_NEAR(refined_motion_shifts[i].dy, true_motion_shifts[i].dy, 0.02);
+  }
+}
@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include "optimization/nonlocal_regularizer.h"
+
+#include "opencv2/core/core.hpp"
+
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+
+using super_resolution::NonLocalRegularizer;
+
+// Returns a deterministic pseudo-random image with values in [0, 1).
+std::vector<double> MakeRandomImage(const int num_values) {
+  std::vector<double> image_data(num_values);
+  unsigned int state = 12345;
+  for (int i = 0; i < num_values; ++i) {
+    state = state * 1103515245 + 12345;
+    image_data[i] = ((state >> 8) % 10000) / 10000.0;
+  }
+  return image_data;
+}
+
+// Compares the neighbor graph with a brute-force search over all patch pairs.
+// The image spans more than one row band of the index construction.
+TEST(NonLocalRegularizer, NeighborIndex) {
+  const cv::Size image_size(23, 41);
+  const int num_pixels = image_size.area();
+  const int num_channels = 2;
+  const int search_radius = 3;
+  const int patch_radius = 1;
+  const int num_neighbors = 5;
+  const double filtering_parameter = 0.3;
+  const std::vector<double> image_data =
+      MakeRandomImage(num_pixels * num_channels);
+
+  NonLocalRegularizer regularizer(
+      image_size,
+      search_radius,
+      patch_radius,
+      num_neighbors,
+      filtering_parameter);
+  regularizer.UpdateFromEstimate(image_data.data(), num_channels);
+  const std::vector<int>& neighbor_indices = regularizer.GetNeighborIndices();
+  const std::vector<double>& neighbor_weights =
+      regularizer.GetNeighborWeights();
+  ASSERT_EQ(neighbor_indices.size(), num_pixels * num_neighbors);
+
+  const auto get_patch_distance = [&](
+      const int row, const int col, const int row_shift, const int col_shift) {
+    double squared_difference_sum = 0.0;
+    int num_valid_pixels = 0;
+    for (int i = -patch_radius; i <= patch_radius; ++i) {
+      for (int j = -patch_radius; j <= patch_radius; ++j) {
+        const int r = row + i;
+        const int c = col + j;
+        const int shifted_r = r + row_shift;
+        const int shifted_c = c + col_shift;
+        if (r < 0 || r >= image_size.height || c < 0 ||
+            c >= image_size.width || shifted_r < 0 ||
+            shifted_r >= image_size.height || shifted_c < 0 ||
+            shifted_c >= image_size.width) {
+          continue;
+        }
+        for (int channel = 0; channel < num_channels; ++channel) {
+          const double difference =
+              image_data[channel * num_pixels + r * image_size.width + c] -
+              image_data[channel * num_pixels +
+                         shifted_r * image_size.width + shifted_c];
+          squared_difference_sum += difference * difference;
+        }
+        num_valid_pixels++;
+      }
+    }
+    return squared_difference_sum / num_valid_pixels;
+  };
+
+  for (int row = 0; row < image_size.height; ++row) {
+    for (int col = 0; col < image_size.width; ++col) {
+      std::vector<double> distances;
+      for (int i = -search_radius; i <= search_radius; ++i) {
+        for (int j = -search_radius; j <= search_radius; ++j) {
+          const int r = row + i;
+          const int c = col + j;
+          if ((i == 0 && j == 0) || r < 0 || r >= image_size.height ||
+              c < 0 || c >= image_size.width) {
+            continue;
+          }
+          distances.push_back(get_patch_distance(row, col, i, j));
+        }
+      }
+      std::sort(distances.begin(), distances.end());
+      double weight_sum = 0.0;
+      std::vector<double> expected_weights(num_neighbors);
+      for (int k = 0; k < num_neighbors; ++k) {
+        expected_weights[k] = std::exp(
+            -distances[k] / (filtering_parameter * filtering_parameter));
+        weight_sum += expected_weights[k];
+      }
+
+      const int pixel_index = row * image_size.width + col;
+      for (int k = 0; k < num_neighbors; ++k) {
+        const int slot = pixel_index * num_neighbors + k;
+        EXPECT_NEAR(
+            neighbor_weights[slot], expected_weights[k] / weight_sum, 1e-9);
+
+        // The stored neighbor must be at the expected patch distance.
+        const int neighbor_index = neighbor_indices[slot];
+        const int row_shift = neighbor_index / image_size.width - row;
+        const int col_shift = neighbor_index % image_size.width - col;
+        EXPECT_LE(std::abs(row_shift), search_radius);
+        EXPECT_LE(std::abs(col_shift), search_radius);
+        EXPECT_NEAR(
+            get_patch_distance(row, col, row_shift, col_shift),
+            distances[k],
+            1e-9);
+      }
+    }
+  }
+}
+
+TEST(NonLocalRegularizer, ComputeWeightedSquaredSumAndGradient) {
+  const cv::Size image_size(9, 7);
+  const int num_pixels = image_size.area();
+  const int num_channels = 2;
+  const int num_parameters = num_pixels * num_channels;
+  const std::vector<double> image_data = MakeRandomImage(num_parameters);
+
+  NonLocalRegularizer regularizer(image_size, 2, 1, 4, 0.5);
+  regularizer.UpdateFromEstimate(image_data.data(), num_channels);
+
+  std::vector<double> weights(num_parameters);
+  for (int i = 0; i < num_parameters; ++i) {
+    weights[i] = 0.1 * (i % 5) + 0.5;
+  }
+  const double regularization_parameter = 0.7;
+
+  // The values follow the definition on the stored neighbor graph.
+  const std::vector<double> values =
+      regularizer.ApplyToImage(image_data.data(), num_channels);
+  const std::vector<int>& neighbor_indices = regularizer.GetNeighborIndices();
+  const std::vector<double>& neighbor_weights =
+      regularizer.GetNeighborWeights();
+  for (int channel = 0; channel < num_channels; ++channel) {
+    const double* channel_data = image_data.data() + channel * num_pixels;
+    for (int pixel_index = 0; pixel_index < num_pixels; ++pixel_index) {
+      double expected_value = 0.0;
+      for (int k = 0; k < 4; ++k) {
+        expected_value += neighbor_weights[pixel_index * 4 + k] * std::abs(
+            channel_data[pixel_index] -
+            channel_data[neighbor_indices[pixel_index * 4 + k]]);
+      }
+      EXPECT_NEAR(
+          values[channel * num_pixels + pixel_index], expected_value, 1e-12);
+    }
+  }
+
+  const auto compute_cost = [&](const std::vector<double>& data) {
+    const std::vector<double> residuals =
+        regularizer.ApplyToImage(data.data(), num_channels);
+    double cost = 0.0;
+    for (int i = 0; i < num_parameters; ++i) {
+      cost += weights[i] * residuals[i] * residuals[i];
+    }
+    return regularization_parameter * cost;
+  };
+
+  std::vector<double> gradient(num_parameters, 0.0);
+  const double cost = regularizer.ComputeWeightedSquaredSumAndGradient(
+      image_data.data(),
+      num_channels,
+      regularization_parameter,
+      weights,
+      nullptr,
+      gradient.data());
+  EXPECT_NEAR(cost, compute_cost(image_data), 1e-12);
+  EXPECT_NEAR(
+      regularization_parameter * regularizer.ComputeWeightedSquaredSum(
+          image_data.data(), weights, num_channels),
+      cost,
+      1e-12);
+
+  const double finite_difference = 1e-6;
+  for (int i = 0; i < num_parameters; ++i) {
+    std::vector<double> pos_diff_image_data = image_data;
+    pos_diff_image_data[i] += finite_difference;
+    std::vector<double> neg_diff_image_data = image_data;
+    neg_diff_image_data[i] -= finite_difference;
+    const double numerical_gradient_at_i =
+        (compute_cost(pos_diff_image_data) -
+         compute_cost(neg_diff_image_data)) / (2 * finite_difference);
+    EXPECT_NEAR(gradient[i], numerical_gradient_at_i, 1e-4);
+  }
+}
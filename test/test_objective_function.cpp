@@ -0,0 +1,597 @@
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "image/image_data.h"
+#include "image_model/image_model.h"
+#include "motion/motion_shift.h"
+#include "optimization/btv_regularizer.h"
+#include "optimization/laplacian_regularizer.h"
+#include "optimization/objective_data_term.h"
+#include "optimization/objective_function.h"
+#include "optimization/objective_fused_regularization_term.h"
+#include "optimization/objective_irls_regularization_term.h"
+#include "optimization/objective_normal_equation_data_term.h"
+#include "optimization/regularizer.h"
+#include "optimization/solver_telemetry.h"
+#include "optimization/tv_regularizer.h"
+#include "util/string_util.h"
+
+#include "opencv2/core/core.hpp"
+
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+
+using super_resolution::ImageData;
+using super_resolution::ImageModel;
+using super_resolution::ImageModelParameters;
+using super_resolution::MotionShift;
+using super_resolution::MotionShiftSequence;
+
+using testing::_;
+using testing::Invoke;
+
+constexpr double kCostErrorTolerance = 1.0e-9;
+constexpr double kGradientErrorTolerance = 1.0e-9;
+
+static const cv::Size kHighResImageSize(12, 12);
+constexpr int kNumChannels = 2;
+
+// Returns a deterministic, non-trivial multichannel image of the given size.
+ImageData MakeTestImage(const cv::Size& image_size, const double frequency) {
+  ImageData image;
+  for (int channel = 0; channel < kNumChannels; ++channel) {
+    cv::Mat channel_image(image_size, CV_64FC1);
+    for (int row = 0; row < image_size.height; ++row) {
+      for (int col = 0; col < image_size.width; ++col) {
+        channel_image.at<double>(row, col) =
+            0.5 + 0.4 * std::sin(frequency * (row + 1) * (channel + 1) + col);
+      }
+    }
+    image.AddChannel(channel_image, super_resolution::DO_NOT_NORMALIZE_IMAGE);
+  }
+  return image;
+}
+
+// Generates the observations the same way the MapSolver stores them: degraded
+// by the image model and then upsampled back to the HR size.
+std::vector<ImageData> MakeObservations(
+    const ImageModel& image_model, const int num_images) {
+
+  const ImageData ground_truth = MakeTestImage(kHighResImageSize, 0.7);
+  std::vector<ImageData> observations;
+  for (int i = 0; i < num_images; ++i) {
+    ImageData observation = image_model.ApplyToImage(ground_truth, i);
+    observation.ResizeImage(
+        kHighResImageSize, super_resolution::INTERPOLATE_NEAREST);
+    observations.push_back(observation);
+  }
+  return observations;
+}
+
+// Returns the estimate x (all channels stacked) to evaluate the terms at.
+std::vector<double> MakeEstimate() {
+  const ImageData estimate_image = MakeTestImage(kHighResImageSize, 0.3);
+  const int num_pixels = estimate_image.GetNumPixels();
+  std::vector<double> estimate(num_pixels * kNumChannels);
+  for (int channel = 0; channel < kNumChannels; ++channel) {
+    const double* channel_data = estimate_image.GetChannelData(channel);
+    std::copy(
+        channel_data,
+        channel_data + num_pixels,
+        estimate.begin() + channel * num_pixels);
+  }
+  return estimate;
+}
+
+// The normal-equation data term must produce the same cost and gradient as the
+// regular data term if the model cannot be fused (sub-pixel motion).
+TEST(ObjectiveFunction, NormalEquationDataTerm) {
+  ImageModelParameters model_parameters;
+  model_parameters.scale = 2;
+  model_parameters.blur_radius = 3;
+  model_parameters.blur_sigma = 1.0;
+  model_parameters.motion_sequence = MotionShiftSequence({
+    MotionShift(0, 0),
+    MotionShift(0.5, 0),
+    MotionShift(1, 0.5),
+    MotionShift(-1, 1)
+  });
+  const ImageModel image_model =
+      ImageModel::CreateImageModel(model_parameters);
+  EXPECT_FALSE(image_model.IsTranslationalModel(4));
+
+  const std::vector<ImageData> observations =
+      MakeObservations(image_model, 4);
+  const super_resolution::ObjectiveDataTerm data_term(
+      image_model, observations, 0, kNumChannels, kHighResImageSize);
+  const super_resolution::ObjectiveNormalEquationDataTerm normal_data_term(
+      image_model, observations, 0, kNumChannels, kHighResImageSize);
+  EXPECT_FALSE(normal_data_term.IsFused());
+
+  const std::vector<double> estimate = MakeEstimate();
+  const int num_data_points = estimate.size();
+  std::vector<double> gradient(num_data_points, 0.0);
+  std::vector<double> normal_gradient(num_data_points, 0.0);
+  const double cost = data_term.Compute(estimate.data(), gradient.data());
+  const double normal_cost =
+      normal_data_term.Compute(estimate.data(), normal_gradient.data());
+  EXPECT_NEAR(normal_cost, cost, kCostErrorTolerance);
+  for (int i = 0; i < num_data_points; ++i) {
+    EXPECT_NEAR(normal_gradient[i], gradient[i], kGradientErrorTolerance);
+  }
+
+  // Cost-only evaluation should match as well.
+  EXPECT_NEAR(
+      normal_data_term.Compute(estimate.data(), nullptr),
+      cost,
+      kCostErrorTolerance);
+}
+
+// For integer motion without blur, the fused operator is exact.
+TEST(ObjectiveFunction, FusedNormalEquationDataTerm) {
+  ImageModelParameters model_parameters;
+  model_parameters.scale = 2;
+  model_parameters.motion_sequence = MotionShiftSequence({
+    MotionShift(0, 0),
+    MotionShift(1, 0),
+    MotionShift(0, 1),
+    MotionShift(-1, -1),
+    MotionShift(3, 2)
+  });
+  const ImageModel image_model =
+      ImageModel::CreateImageModel(model_parameters);
+  EXPECT_TRUE(image_model.IsTranslationalModel(5));
+
+  // The coverage map counts the number of observations sampling each pixel.
+  // Pixel (row 1, col 1) is only sampled by frame 3, pixel (row 0, col 1) by
+  // frames 1 and 4, and pixel (row 2, col 2) only by frame 0.
+  const ImageData coverage_map =
+      image_model.ComputeTranslationalCoverageMap(kHighResImageSize, 5);
+  EXPECT_EQ(coverage_map.GetPixelValue(0, 1, 1), 1);
+  EXPECT_EQ(coverage_map.GetPixelValue(0, 0, 1), 2);
+  EXPECT_EQ(coverage_map.GetPixelValue(0, 2, 2), 1);
+
+  const std::vector<ImageData> observations =
+      MakeObservations(image_model, 5);
+  const super_resolution::ObjectiveDataTerm data_term(
+      image_model, observations, 0, kNumChannels, kHighResImageSize);
+  const super_resolution::ObjectiveNormalEquationDataTerm normal_data_term(
+      image_model, observations, 0, kNumChannels, kHighResImageSize);
+  EXPECT_TRUE(normal_data_term.IsFused());
+
+  const std::vector<double> estimate = MakeEstimate();
+  const int num_data_points = estimate.size();
+  std::vector<double> gradient(num_data_points, 0.0);
+  std::vector<double> normal_gradient(num_data_points, 0.0);
+  const double cost = data_term.Compute(estimate.data(), gradient.data());
+  const double normal_cost =
+      normal_data_term.Compute(estimate.data(), normal_gradient.data());
+  EXPECT_NEAR(normal_cost, cost, kCostErrorTolerance);
+  for (int i = 0; i < num_data_points; ++i) {
+    EXPECT_NEAR(normal_gradient[i], gradient[i], kGradientErrorTolerance);
+  }
+}
+
+// Computes sum_i x_i^2, with gradient 2x.
+class MockObjectiveTerm : public super_resolution::ObjectiveTerm {
+ public:
+  explicit MockObjectiveTerm(const int num_parameters)
+      : num_parameters_(num_parameters) {
+    ON_CALL(*this, Compute(_, _))
+        .WillByDefault(Invoke(this, &MockObjectiveTerm::SumOfSquares));
+  }
+
+  MOCK_CONST_METHOD2(Compute, double(const double*, double*));
+
+ private:
+  double SumOfSquares(const double* x, double* gradient) const {
+    double sum = 0.0;
+    for (int i = 0; i < num_parameters_; ++i) {
+      sum += x[i] * x[i];
+      if (gradient != nullptr) {
+        gradient[i] += 2 * x[i];
+      }
+    }
+    return sum;
+  }
+
+  const int num_parameters_;
+};
+
+// Repeated evaluations at the same point should be served from the cache.
+TEST(ObjectiveFunction, EvaluationCache) {
+  const int num_parameters = 4;
+  std::shared_ptr<MockObjectiveTerm> term(
+      new MockObjectiveTerm(num_parameters));
+  super_resolution::ObjectiveFunction objective_function(num_parameters);
+  objective_function.AddTerm(term);
+
+  std::vector<double> x = {1, 2, 3, 4};
+  const std::vector<double> expected_gradient = {2, 4, 6, 8};
+  std::vector<double> gradient(num_parameters);
+
+  // Cost only: computed once.
+  EXPECT_CALL(*term, Compute(_, nullptr)).Times(1);
+  EXPECT_EQ(objective_function.ComputeAllTerms(x.data()), 30);
+  EXPECT_EQ(objective_function.ComputeAllTerms(x.data()), 30);
+  testing::Mock::VerifyAndClearExpectations(term.get());
+
+  // The cost-only entry cannot provide a gradient, but the new one can also
+  // serve cost-only requests.
+  EXPECT_CALL(*term, Compute(_, _)).Times(1);
+  EXPECT_EQ(objective_function.ComputeAllTerms(x.data(), gradient.data()), 30);
+  EXPECT_EQ(gradient, expected_gradient);
+  std::fill(gradient.begin(), gradient.end(), 0);
+  EXPECT_EQ(objective_function.ComputeAllTerms(x.data(), gradient.data()), 30);
+  EXPECT_EQ(gradient, expected_gradient);
+  EXPECT_EQ(objective_function.ComputeAllTerms(x.data()), 30);
+  testing::Mock::VerifyAndClearExpectations(term.get());
+
+  // A different point must be recomputed.
+  EXPECT_CALL(*term, Compute(_, _)).Times(1);
+  x[3] = 0;
+  EXPECT_EQ(objective_function.ComputeAllTerms(x.data()), 14);
+  testing::Mock::VerifyAndClearExpectations(term.get());
+  EXPECT_EQ(objective_function.GetNumEvaluations(), 6);
+  EXPECT_EQ(objective_function.GetNumCacheHits(), 3);
+
+  // With caching disabled, every evaluation is computed.
+  objective_function.SetCacheCapacity(0);
+  EXPECT_CALL(*term, Compute(_, _)).Times(2);
+  objective_function.ComputeAllTerms(x.data());
+  objective_function.ComputeAllTerms(x.data());
+}
+
+// Every reported iteration is recorded with the statistics of the evaluation
+// at the reported point.
+TEST(ObjectiveFunction, Telemetry) {
+  const int num_parameters = 2;
+  super_resolution::ObjectiveFunction objective_function(num_parameters);
+  objective_function.AddTerm(std::shared_ptr<MockObjectiveTerm>(
+      new testing::NiceMock<MockObjectiveTerm>(num_parameters)));
+  objective_function.AddTerm(std::shared_ptr<MockObjectiveTerm>(
+      new testing::NiceMock<MockObjectiveTerm>(num_parameters)));
+
+  std::shared_ptr<std::ostringstream> stream(new std::ostringstream());
+  objective_function.SetTelemetry(
+      std::shared_ptr<super_resolution::SolverTelemetry>(
+          new super_resolution::SolverTelemetry(
+              stream, super_resolution::TELEMETRY_CSV)),
+      "stage",
+      3);
+
+  // Both terms are 25 and the gradient is (12, 16).
+  std::vector<double> x = {3, 4};
+  std::vector<double> gradient(num_parameters);
+  objective_function.ReportIterationComplete(
+      x.data(), objective_function.ComputeAllTerms(x.data(), gradient.data()));
+  // Without a gradient, the gradient norm is unknown.
+  x[0] = 0;
+  objective_function.ReportIterationComplete(
+      x.data(), objective_function.ComputeAllTerms(x.data()));
+  // The latest evaluation is not at the reported point (different cost).
+  objective_function.ReportIterationComplete(x.data(), 1.0);
+  EXPECT_EQ(objective_function.GetNumCompletedIterations(), 3);
+
+  // The wall time (column 6) is not deterministic.
+  const std::vector<std::string> lines =
+      super_resolution::util::SplitString(stream->str(), '\n', true);
+  ASSERT_EQ(lines.size(), 4);
+  EXPECT_EQ(lines[0],
+      "stage,round,iteration,cost,gradient_norm,step_size,wall_time,"
+      "num_evaluations,term_costs");
+  const std::vector<std::vector<std::string>> expected_fields = {
+    {"stage", "3", "1", "50", "20", "", "", "1", "25;25"},
+    {"stage", "3", "2", "32", "", "3", "", "2", "16;16"},
+    {"stage", "3", "3", "1", "", "0", "", "2", ""}
+  };
+  for (int i = 0; i < expected_fields.size(); ++i) {
+    std::vector<std::string> fields =
+        super_resolution::util::SplitString(lines[i + 1], ',');
+    ASSERT_EQ(fields.size(), expected_fields[i].size());
+    fields[6] = "";
+    EXPECT_EQ(fields, expected_fields[i]);
+  }
+}
+
+// The fused regularization term must match evaluating each regularizer with
+// its own ObjectiveIRLSRegularizationTerm.
+TEST(ObjectiveFunction, FusedRegularizationTerm) {
+  std::shared_ptr<super_resolution::TotalVariationRegularizer> tv_regularizer(
+      new super_resolution::TotalVariationRegularizer(kHighResImageSize));
+  std::shared_ptr<super_resolution::TotalVariationRegularizer>
+  tv_3d_regularizer(
+      new super_resolution::TotalVariationRegularizer(kHighResImageSize));
+  tv_3d_regularizer->SetUse3dTotalVariation(true);
+  std::shared_ptr<super_resolution::Regularizer> btv_regularizer(
+      new super_resolution::BilateralTotalVariationRegularizer(
+          kHighResImageSize, 2, 0.6));
+  const std::vector<std::shared_ptr<super_resolution::Regularizer>>
+  regularizers = {tv_regularizer, tv_3d_regularizer, btv_regularizer};
+  const std::vector<double> regularization_parameters = {0.1, 0.02, 0.05};
+
+  const std::vector<double> estimate = MakeEstimate();
+  const int num_data_points = estimate.size();
+  std::vector<std::vector<double>> irls_weights(regularizers.size());
+  for (int k = 0; k < regularizers.size(); ++k) {
+    irls_weights[k].resize(num_data_points);
+    for (int i = 0; i < num_data_points; ++i) {
+      irls_weights[k][i] = 0.5 + 0.1 * ((i + k) % 6);
+    }
+  }
+
+  super_resolution::ObjectiveFusedRegularizationTerm fused_term(
+      kNumChannels, kHighResImageSize);
+  double expected_cost = 0.0;
+  std::vector<double> expected_gradient(num_data_points, 0.0);
+  for (int k = 0; k < regularizers.size(); ++k) {
+    fused_term.AddRegularizer(
+        regularizers[k], regularization_parameters[k], irls_weights[k]);
+    const super_resolution::ObjectiveIRLSRegularizationTerm term(
+        regularizers[k],
+        regularization_parameters[k],
+        irls_weights[k],
+        kNumChannels,
+        kHighResImageSize);
+    expected_cost += term.Compute(estimate.data(), expected_gradient.data());
+  }
+  EXPECT_EQ(fused_term.GetNumFusedRegularizers(), 3);
+
+  std::vector<double> gradient(num_data_points, 0.0);
+  EXPECT_NEAR(
+      fused_term.Compute(estimate.data(), gradient.data()),
+      expected_cost,
+      kCostErrorTolerance);
+  for (int i = 0; i < num_data_points; ++i) {
+    EXPECT_NEAR(gradient[i], expected_gradient[i], kGradientErrorTolerance);
+  }
+  EXPECT_NEAR(
+      fused_term.Compute(estimate.data(), nullptr),
+      expected_cost,
+      kCostErrorTolerance);
+}
+
+// Tests the Hessian diagonal approximations used for preconditioning.
+TEST(ObjectiveFunction, HessianDiagonal) {
+  // Without blur, every row of A_k selects a single pixel, so the Hessian of
+  // the data term is the diagonal 2 * scale^2 * W itself.
+  ImageModelParameters model_parameters;
+  model_parameters.scale = 2;
+  model_parameters.motion_sequence = MotionShiftSequence({
+    MotionShift(0, 0),
+    MotionShift(1, 0),
+    MotionShift(-1, -1)
+  });
+  const ImageModel image_model =
+      ImageModel::CreateImageModel(model_parameters);
+  const std::vector<ImageData> observations =
+      MakeObservations(image_model, 3);
+  const ImageData coverage_map =
+      image_model.ComputeTranslationalCoverageMap(kHighResImageSize, 3);
+  const int num_pixels = kHighResImageSize.area();
+  const int num_data_points = num_pixels * kNumChannels;
+
+  std::vector<double> data_diagonal(num_data_points, 0.0);
+  std::vector<double> normal_data_diagonal(num_data_points, 0.0);
+  const super_resolution::ObjectiveDataTerm data_term(
+      image_model, observations, 0, kNumChannels, kHighResImageSize);
+  const super_resolution::ObjectiveNormalEquationDataTerm normal_data_term(
+      image_model, observations, 0, kNumChannels, kHighResImageSize);
+  data_term.AddToHessianDiagonal(data_diagonal.data());
+  normal_data_term.AddToHessianDiagonal(normal_data_diagonal.data());
+  for (int i = 0; i < num_data_points; ++i) {
+    const double expected_value =
+        8.0 * coverage_map.GetChannelData(0)[i % num_pixels];
+    EXPECT_NEAR(data_diagonal[i], expected_value, kGradientErrorTolerance);
+    EXPECT_NEAR(
+        normal_data_diagonal[i], expected_value, kGradientErrorTolerance);
+  }
+
+  // The Laplacian regularizer is quadratic, so its diagonal is exact. Probe
+  // the Hessian column by column with gradient differences.
+  const std::shared_ptr<super_resolution::Regularizer> laplacian_regularizer(
+      new super_resolution::LaplacianRegularizer(kHighResImageSize));
+  std::vector<double> irls_weights(num_data_points);
+  for (int i = 0; i < num_data_points; ++i) {
+    irls_weights[i] = 0.5 + 0.1 * (i % 7);
+  }
+  const super_resolution::ObjectiveIRLSRegularizationTerm laplacian_term(
+      laplacian_regularizer,
+      0.3,
+      irls_weights,
+      kNumChannels,
+      kHighResImageSize);
+  std::vector<double> laplacian_diagonal(num_data_points, 0.0);
+  laplacian_term.AddToHessianDiagonal(laplacian_diagonal.data());
+  std::vector<double> unit_vector(num_data_points, 0.0);
+  for (int i = 0; i < num_data_points; ++i) {
+    unit_vector[i] = 1.0;
+    std::vector<double> gradient(num_data_points, 0.0);
+    laplacian_term.Compute(unit_vector.data(), gradient.data());
+    EXPECT_NEAR(laplacian_diagonal[i], gradient[i], kGradientErrorTolerance);
+    unit_vector[i] = 0.0;
+  }
+
+  // The fused term adds the same values as the individual terms.
+  const std::shared_ptr<super_resolution::Regularizer> tv_regularizer(
+      new super_resolution::TotalVariationRegularizer(kHighResImageSize));
+  const std::shared_ptr<super_resolution::Regularizer> btv_regularizer(
+      new super_resolution::BilateralTotalVariationRegularizer(
+          kHighResImageSize, 2, 0.6));
+  super_resolution::ObjectiveFusedRegularizationTerm fused_term(
+      kNumChannels, kHighResImageSize);
+  fused_term.AddRegularizer(tv_regularizer, 0.1, irls_weights);
+  fused_term.AddRegularizer(btv_regularizer, 0.05, irls_weights);
+  fused_term.AddRegularizer(laplacian_regularizer, 0.3, irls_weights);
+  std::vector<double> fused_diagonal(num_data_points, 0.0);
+  fused_term.AddToHessianDiagonal(fused_diagonal.data());
+  std::vector<double> expected_diagonal = laplacian_diagonal;
+  super_resolution::ObjectiveIRLSRegularizationTerm(
+      tv_regularizer, 0.1, irls_weights, kNumChannels, kHighResImageSize)
+      .AddToHessianDiagonal(expected_diagonal.data());
+  super_resolution::ObjectiveIRLSRegularizationTerm(
+      btv_regularizer, 0.05, irls_weights, kNumChannels, kHighResImageSize)
+      .AddToHessianDiagonal(expected_diagonal.data());
+  for (int i = 0; i < num_data_points; ++i) {
+    EXPECT_GT(fused_diagonal[i], laplacian_diagonal[i]);
+    EXPECT_NEAR(
+        fused_diagonal[i], expected_diagonal[i], kGradientErrorTolerance);
+  }
+
+  // Uncovered pixels are clamped to a positive value, and an objective
+  // without curvature estimates falls back to the identity.
+  super_resolution::ObjectiveFunction objective_function(num_data_points);
+  objective_function.AddTerm(
+      std::shared_ptr<super_resolution::ObjectiveTerm>(
+          new super_resolution::ObjectiveDataTerm(
+              image_model, observations, 0, kNumChannels, kHighResImageSize)));
+  for (const double value :
+       objective_function.ComputeDiagonalPreconditioner()) {
+    EXPECT_GT(value, 0.0);
+  }
+  super_resolution::ObjectiveFunction mock_objective_function(num_data_points);
+  mock_objective_function.AddTerm(
+      std::shared_ptr<super_resolution::ObjectiveTerm>(
+          new MockObjectiveTerm(num_data_points)));
+  for (const double value :
+       mock_objective_function.ComputeDiagonalPreconditioner()) {
+    EXPECT_EQ(value, 1.0);
+  }
+}
+
+// For quadratic objectives, the Hessian product of the terms must match the
+// gradient difference grad f(v) - grad f(0).
+TEST(ObjectiveFunction, HessianProduct) {
+  ImageModelParameters model_parameters;
+  model_parameters.scale = 2;
+  model_parameters.blur_radius = 3;
+  model_parameters.blur_sigma = 0.8;
+  model_parameters.motion_sequence = MotionShiftSequence({
+    MotionShift(0, 0),
+    MotionShift(1, 0),
+    MotionShift(-1, -1)
+  });
+  const ImageModel image_model =
+      ImageModel::CreateImageModel(model_parameters);
+  const std::vector<ImageData> observations =
+      MakeObservations(image_model, 3);
+  const int num_data_points = kHighResImageSize.area() * kNumChannels;
+  std::vector<double> irls_weights(num_data_points);
+  for (int i = 0; i < num_data_points; ++i) {
+    irls_weights[i] = 0.5 + 0.1 * (i % 7);
+  }
+  const std::shared_ptr<super_resolution::Regularizer> laplacian_regularizer(
+      new super_resolution::LaplacianRegularizer(kHighResImageSize));
+  std::shared_ptr<super_resolution::ObjectiveFusedRegularizationTerm>
+      regularization_term(
+          new super_resolution::ObjectiveFusedRegularizationTerm(
+              kNumChannels, kHighResImageSize));
+  regularization_term->AddRegularizer(
+      laplacian_regularizer, 0.3, irls_weights);
+
+  const std::vector<double> direction = MakeEstimate();
+  const std::vector<double> zeros(num_data_points, 0.0);
+  for (const bool use_normal_equation : {false, true}) {
+    super_resolution::ObjectiveFunction objective_function(num_data_points);
+    if (use_normal_equation) {
+      objective_function.AddTerm(
+          std::shared_ptr<super_resolution::ObjectiveTerm>(
+              new super_resolution::ObjectiveNormalEquationDataTerm(
+                  image_model,
+                  observations,
+                  0,
+                  kNumChannels,
+                  kHighResImageSize)));
+    } else {
+      objective_function.AddTerm(
+          std::shared_ptr<super_resolution::ObjectiveTerm>(
+              new super_resolution::ObjectiveDataTerm(
+                  image_model,
+                  observations,
+                  0,
+                  kNumChannels,
+                  kHighResImageSize)));
+    }
+    objective_function.AddTerm(regularization_term);
+    ASSERT_TRUE(objective_function.HasHessianProduct());
+
+    std::vector<double> hessian_product(num_data_points);
+    objective_function.ComputeHessianProduct(
+        direction.data(), hessian_product.data());
+    std::vector<double> gradient(num_data_points, 0.0);
+    std::vector<double> constant_gradient(num_data_points, 0.0);
+    objective_function.ComputeAllTerms(direction.data(), gradient.data());
+    objective_function.ComputeAllTerms(
+        zeros.data(), constant_gradient.data());
+    for (int i = 0; i < num_data_points; ++i) {
+      EXPECT_NEAR(
+          hessian_product[i],
+          gradient[i] - constant_gradient[i],
+          kGradientErrorTolerance);
+    }
+  }
+
+  // A TV regularizer is not quadratic, so the objective has no Hessian
+  // product.
+  regularization_term->AddRegularizer(
+      std::shared_ptr<super_resolution::Regularizer>(
+          new super_resolution::TotalVariationRegularizer(kHighResImageSize)),
+      0.1,
+      irls_weights);
+  EXPECT_FALSE(regularization_term->HasHessianProduct());
+}
+
+// The mixed-precision data term must agree with the double-precision one up to
+// single-precision rounding, and switching back must restore exact results.
+TEST(ObjectiveFunction, MixedPrecisionDataTerm) {
+  ImageModelParameters model_parameters;
+  model_parameters.scale = 2;
+  model_parameters.blur_radius = 3;
+  model_parameters.blur_sigma = 1.0;
+  model_parameters.motion_sequence = MotionShiftSequence({
+    MotionShift(0, 0),
+    MotionShift(0.5, 0),
+    MotionShift(1, 0.5)
+  });
+  const ImageModel image_model =
+      ImageModel::CreateImageModel(model_parameters);
+  const std::vector<ImageData> observations =
+      MakeObservations(image_model, 3);
+  const std::shared_ptr<super_resolution::ObjectiveDataTerm> data_term(
+      new super_resolution::ObjectiveDataTerm(
+          image_model, observations, 0, kNumChannels, kHighResImageSize));
+
+  const std::vector<double> estimate = MakeEstimate();
+  const int num_data_points = estimate.size();
+  super_resolution::ObjectiveFunction objective_function(num_data_points);
+  objective_function.AddTerm(data_term);
+  std::vector<double> gradient(num_data_points, 0.0);
+  const double cost =
+      objective_function.ComputeAllTerms(estimate.data(), gradient.data());
+
+  objective_function.SetMixedPrecision(true);
+  std::vector<double> mixed_gradient(num_data_points, 0.0);
+  const double mixed_cost = objective_function.ComputeAllTerms(
+      estimate.data(), mixed_gradient.data());
+  EXPECT_NE(mixed_cost, cost);
+  EXPECT_NEAR(mixed_cost, cost, 1.0e-5 * cost);
+  double max_gradient_value = 0.0;
+  for (int i = 0; i < num_data_points; ++i) {
+    max_gradient_value = std::max(max_gradient_value, std::abs(gradient[i]));
+  }
+  for (int i = 0; i < num_data_points; ++i) {
+    EXPECT_NEAR(mixed_gradient[i], gradient[i], 1.0e-5 * max_gradient_value);
+  }
+
+  objective_function.SetMixedPrecision(false);
+  std::vector<double> double_gradient(num_data_points, 0.0);
+  EXPECT_EQ(
+      objective_function.ComputeAllTerms(
+          estimate.data(), double_gradient.data()),
+      cost);
+  EXPECT_EQ(double_gradient, gradient);
+}
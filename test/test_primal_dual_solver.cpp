@@ -0,0 +1,113 @@
+#include <memory>
+#include <vector>
+
+#include "image/image_data.h"
+#include "image_model/image_model.h"
+#include "optimization/admm_solver.h"
+#include "optimization/btv_regularizer.h"
+#include "optimization/primal_dual_solver.h"
+#include "optimization/regularizer.h"
+#include "optimization/tv_regularizer.h"
+#include "util/test_util.h"
+
+#include "opencv2/core/core.hpp"
+
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+
+using super_resolution::ImageData;
+using super_resolution::PrimalDualSolver;
+using super_resolution::PrimalDualSolverOptions;
+using super_resolution::test::AreMatricesEqual;
+using super_resolution::test::ComputeL1MapObjective;
+using super_resolution::test::CreatePiecewiseConstantTestProblem;
+using super_resolution::test::CreateSmallDataTestProblem;
+using super_resolution::test::SuperResolutionTestProblem;
+
+constexpr bool kPrintSolverOutput = false;
+
+// Tests the solver on small, "perfect" data (see MapSolver.SmallDataTest).
+TEST(PrimalDualSolver, SmallDataTest) {
+  const SuperResolutionTestProblem problem = CreateSmallDataTestProblem();
+  const cv::Mat ground_truth_matrix = problem.ground_truth.GetChannelImage(0);
+
+  // Without regularization, the iterations are plain gradient descent on the
+  // least squares data term.
+  const PrimalDualSolverOptions solver_options;
+  PrimalDualSolver solver(
+      solver_options,
+      problem.image_model,
+      problem.low_res_images,
+      kPrintSolverOutput);
+  const ImageData result = solver.Solve(problem.initial_estimate);
+  EXPECT_TRUE(AreMatricesEqual(
+      result.GetChannelImage(0), ground_truth_matrix, 0.001));
+
+  // A very weak TV prior should barely change the result.
+  PrimalDualSolver solver_with_tv(
+      solver_options,
+      problem.image_model,
+      problem.low_res_images,
+      kPrintSolverOutput);
+  solver_with_tv.AddRegularizer(
+      std::shared_ptr<super_resolution::Regularizer>(
+          new super_resolution::TotalVariationRegularizer(cv::Size(4, 4))),
+      0.0001);
+  const ImageData result_with_tv =
+      solver_with_tv.Solve(problem.initial_estimate);
+  EXPECT_TRUE(AreMatricesEqual(
+      result_with_tv.GetChannelImage(0), ground_truth_matrix, 0.01));
+}
+
+// The primal-dual solver minimizes the same 1-norm problem as ADMM, so both
+// should reach (nearly) the same objective value on a blurred problem.
+TEST(PrimalDualSolver, MatchesAdmmObjective) {
+  const SuperResolutionTestProblem problem =
+      CreatePiecewiseConstantTestProblem();
+  const cv::Size image_size = problem.ground_truth.GetImageSize();
+
+  const std::vector<std::shared_ptr<super_resolution::Regularizer>>
+      regularizers = {
+        std::shared_ptr<super_resolution::Regularizer>(
+            new super_resolution::TotalVariationRegularizer(image_size)),
+        std::shared_ptr<super_resolution::Regularizer>(
+            new super_resolution::BilateralTotalVariationRegularizer(
+                image_size, 2, 0.5))
+      };
+  const double regularization_parameter = 0.01;
+  for (const auto& regularizer : regularizers) {
+    PrimalDualSolverOptions primal_dual_options;
+    primal_dual_options.max_num_primal_dual_iterations = 5000;
+    PrimalDualSolver primal_dual_solver(
+        primal_dual_options,
+        problem.image_model,
+        problem.low_res_images,
+        kPrintSolverOutput);
+    primal_dual_solver.AddRegularizer(regularizer, regularization_parameter);
+    const ImageData primal_dual_result =
+        primal_dual_solver.Solve(problem.initial_estimate);
+
+    const super_resolution::AdmmSolverOptions admm_options;
+    super_resolution::AdmmSolver admm_solver(
+        admm_options,
+        problem.image_model,
+        problem.low_res_images,
+        kPrintSolverOutput);
+    admm_solver.AddRegularizer(regularizer, regularization_parameter);
+    const ImageData admm_result = admm_solver.Solve(problem.initial_estimate);
+
+    const double primal_dual_objective = ComputeL1MapObjective(
+        problem.image_model,
+        problem.low_res_images,
+        *regularizer,
+        regularization_parameter,
+        primal_dual_result);
+    const double admm_objective = ComputeL1MapObjective(
+        problem.image_model,
+        problem.low_res_images,
+        *regularizer,
+        regularization_parameter,
+        admm_result);
+    EXPECT_NEAR(primal_dual_objective, admm_objective, 0.001 * admm_objective);
+  }
+}
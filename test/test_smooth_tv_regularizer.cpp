@@ -0,0 +1,130 @@
+#include <cmath>
+#include <vector>
+
+#include "optimization/smooth_tv_regularizer.h"
+
+#include "opencv2/core/core.hpp"
+
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+
+using super_resolution::HuberTotalVariationRegularizer;
+using super_resolution::IsotropicTotalVariationRegularizer;
+using super_resolution::SmoothTotalVariationRegularizer;
+
+using testing::SizeIs;
+
+const cv::Size test_image_size(3, 3);
+const std::vector<double> test_image_data = {
+     0,  0, 1,
+     0,  1, 3,
+    -3, -1, 0
+};
+
+// Returns the test image repeated (and scaled) in each channel.
+std::vector<double> MakeMultichannelImage(const int num_channels) {
+  std::vector<double> image_data;
+  for (int channel = 0; channel < num_channels; ++channel) {
+    for (const double value : test_image_data) {
+      image_data.push_back(value * (channel + 1) * 0.1 + channel * 0.05);
+    }
+  }
+  return image_data;
+}
+
+// Verifies the gradient of lambda * sum_i w_i * r_i^2 against finite
+// differences of the values returned by ApplyToImage.
+void ExpectGradientMatchesFiniteDifferences(
+    const SmoothTotalVariationRegularizer& regularizer,
+    const int num_channels) {
+
+  const std::vector<double> image_data = MakeMultichannelImage(num_channels);
+  const int num_parameters = image_data.size();
+  std::vector<double> weights(num_parameters);
+  for (int i = 0; i < num_parameters; ++i) {
+    weights[i] = 0.1 * (i % 5) + 0.5;
+  }
+  const double regularization_parameter = 0.7;
+
+  const auto compute_cost = [&](const std::vector<double>& data) {
+    const std::vector<double> residuals =
+        regularizer.ApplyToImage(data.data(), num_channels);
+    double cost = 0.0;
+    for (int i = 0; i < num_parameters; ++i) {
+      cost += weights[i] * residuals[i] * residuals[i];
+    }
+    return regularization_parameter * cost;
+  };
+
+  std::vector<double> gradient(num_parameters, 0.0);
+  const double cost = regularizer.ComputeWeightedSquaredSumAndGradient(
+      image_data.data(),
+      num_channels,
+      regularization_parameter,
+      weights,
+      nullptr,
+      gradient.data());
+  EXPECT_NEAR(cost, compute_cost(image_data), 1e-12);
+  EXPECT_NEAR(
+      regularization_parameter * regularizer.ComputeWeightedSquaredSum(
+          image_data.data(), weights, num_channels),
+      cost,
+      1e-12);
+
+  const double finite_difference = 1e-6;
+  for (int i = 0; i < num_parameters; ++i) {
+    std::vector<double> pos_diff_image_data = image_data;
+    pos_diff_image_data[i] += finite_difference;
+    std::vector<double> neg_diff_image_data = image_data;
+    neg_diff_image_data[i] -= finite_difference;
+    const double numerical_gradient_at_i =
+        (compute_cost(pos_diff_image_data) -
+         compute_cost(neg_diff_image_data)) / (2 * finite_difference);
+    EXPECT_NEAR(numerical_gradient_at_i, gradient[i], 1e-4);
+  }
+}
+
+TEST(SmoothTotalVariationRegularizer, IsotropicValues) {
+  const double epsilon = 0.001;
+  const IsotropicTotalVariationRegularizer regularizer(
+      test_image_size, epsilon);
+  EXPECT_TRUE(regularizer.IsSmooth());
+
+  // The squared value is sqrt(dx^2 + dy^2 + epsilon^2) - epsilon. At (1, 1),
+  // dx = 2 and dy = -2; the bottom-right pixel has no forward differences.
+  const std::vector<double> residuals =
+      regularizer.ApplyToImage(test_image_data.data(), 1);
+  EXPECT_THAT(residuals, SizeIs(9));
+  EXPECT_NEAR(
+      residuals[4] * residuals[4],
+      std::sqrt(8 + epsilon * epsilon) - epsilon,
+      1e-12);
+  EXPECT_DOUBLE_EQ(residuals[8], 0.0);
+}
+
+TEST(SmoothTotalVariationRegularizer, HuberValues) {
+  const double delta = 1.5;
+  const HuberTotalVariationRegularizer regularizer(test_image_size, delta);
+
+  // At (0, 0), t = 0 so the value is 0. At (0, 1), dx = 1 and dy = 1, so
+  // t = sqrt(2) <= delta and rho = t^2 / (2 * delta). At (1, 1), t = sqrt(8)
+  // > delta and rho = t - delta / 2.
+  const std::vector<double> residuals =
+      regularizer.ApplyToImage(test_image_data.data(), 1);
+  EXPECT_DOUBLE_EQ(residuals[0], 0.0);
+  EXPECT_NEAR(residuals[1] * residuals[1], 2 / (2 * delta), 1e-12);
+  EXPECT_NEAR(
+      residuals[4] * residuals[4], std::sqrt(8) - delta / 2, 1e-12);
+}
+
+TEST(SmoothTotalVariationRegularizer, Gradient) {
+  IsotropicTotalVariationRegularizer isotropic_regularizer(
+      test_image_size, 0.01);
+  HuberTotalVariationRegularizer huber_regularizer(test_image_size, 0.15);
+  for (const bool use_3d_total_variation : {false, true}) {
+    isotropic_regularizer.SetUse3dTotalVariation(use_3d_total_variation);
+    huber_regularizer.SetUse3dTotalVariation(use_3d_total_variation);
+    ExpectGradientMatchesFiniteDifferences(isotropic_regularizer, 3);
+    ExpectGradientMatchesFiniteDifferences(huber_regularizer, 3);
+  }
+}
@@ -0,0 +1,84 @@
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "optimization/solver_telemetry.h"
+#include "util/string_util.h"
+
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+
+using super_resolution::SolverIterationRecord;
+using super_resolution::SolverTelemetry;
+
+// Returns a record with all values set, except for the gradient norm.
+SolverIterationRecord MakeTestRecord() {
+  SolverIterationRecord record;
+  record.stage = "tile_1/irls";
+  record.round = 2;
+  record.iteration = 7;
+  record.cost = 0.5;
+  record.step_size = 0.25;
+  record.num_evaluations = 9;
+  record.term_costs = {0.375, 0.125};
+  return record;
+}
+
+// Returns the given JSON line without the (non-deterministic) wall time value.
+std::string RemoveWallTime(const std::string& line) {
+  const std::string key = "\"wall_time\":";
+  const std::string::size_type value_start = line.find(key) + key.size();
+  const std::string::size_type value_end = line.find(',', value_start);
+  return line.substr(0, value_start) + line.substr(value_end);
+}
+
+TEST(SolverTelemetry, WritesCsv) {
+  std::shared_ptr<std::ostringstream> stream(new std::ostringstream());
+  SolverTelemetry telemetry(stream, super_resolution::TELEMETRY_CSV);
+  telemetry.RecordIteration(MakeTestRecord());
+  telemetry.RecordIteration(SolverIterationRecord());
+
+  const std::vector<std::string> lines =
+      super_resolution::util::SplitString(stream->str(), '\n', true);
+  ASSERT_EQ(lines.size(), 3);
+  EXPECT_EQ(lines[0],
+      "stage,round,iteration,cost,gradient_norm,step_size,wall_time,"
+      "num_evaluations,term_costs");
+  // Missing values are empty fields. The wall time is not deterministic.
+  const std::vector<std::vector<std::string>> expected_fields = {
+    {"tile_1/irls", "2", "7", "0.5", "", "0.25", "", "9", "0.375;0.125"},
+    {"", "0", "0", "", "", "", "", "0", ""}
+  };
+  for (int i = 0; i < expected_fields.size(); ++i) {
+    std::vector<std::string> fields =
+        super_resolution::util::SplitString(lines[i + 1], ',');
+    ASSERT_EQ(fields.size(), expected_fields[i].size());
+    fields[6] = "";
+    EXPECT_EQ(fields, expected_fields[i]);
+  }
+}
+
+TEST(SolverTelemetry, WritesJson) {
+  std::shared_ptr<std::ostringstream> stream(new std::ostringstream());
+  SolverTelemetry telemetry(stream, super_resolution::TELEMETRY_JSON);
+  SolverIterationRecord record = MakeTestRecord();
+  record.gradient_norm = 1.5;
+  record.term_costs[1] = std::numeric_limits<double>::quiet_NaN();
+  telemetry.RecordIteration(record);
+  telemetry.RecordIteration(SolverIterationRecord());
+
+  // One object per line, with nulls for missing values.
+  const std::vector<std::string> lines =
+      super_resolution::util::SplitString(stream->str(), '\n', true);
+  ASSERT_EQ(lines.size(), 2);
+  EXPECT_EQ(RemoveWallTime(lines[0]),
+      "{\"stage\":\"tile_1/irls\",\"round\":2,\"iteration\":7,\"cost\":0.5,"
+      "\"gradient_norm\":1.5,\"step_size\":0.25,\"wall_time\":,"
+      "\"num_evaluations\":9,\"term_costs\":[0.375,null]}");
+  EXPECT_EQ(RemoveWallTime(lines[1]),
+      "{\"stage\":\"\",\"round\":0,\"iteration\":0,\"cost\":null,"
+      "\"gradient_norm\":null,\"step_size\":null,\"wall_time\":,"
+      "\"num_evaluations\":0,\"term_costs\":[]}");
+}
@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "image/image_data.h"
+#include "image_model/image_model.h"
+#include "motion/motion_shift.h"
+#include "optimization/irls_map_solver.h"
+#include "optimization/laplacian_regularizer.h"
+#include "optimization/regularizer.h"
+#include "optimization/tiled_map_solver.h"
+
+#include "opencv2/core/core.hpp"
+
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+
+using super_resolution::ImageData;
+using super_resolution::TiledMapSolver;
+
+constexpr bool kPrintSolverOutput = false;
+
+// The halo must cover twice the model support plus padding, rounded up to a
+// multiple of the downsampling scale.
+TEST(TiledMapSolver, HaloSize) {
+  super_resolution::ImageModelParameters model_parameters;
+  model_parameters.scale = 3;
+  model_parameters.motion_sequence = super_resolution::MotionShiftSequence({
+    super_resolution::MotionShift(0, 0),
+    super_resolution::MotionShift(-2, 1.5)
+  });
+  model_parameters.blur_radius = 5;
+  model_parameters.blur_sigma = 1.0;
+  const super_resolution::ImageModel image_model =
+      super_resolution::ImageModel::CreateImageModel(model_parameters);
+  EXPECT_EQ(image_model.GetSupportRadius(1), 2);
+  EXPECT_EQ(image_model.GetSupportRadius(2), 4);
+
+  const std::vector<ImageData> low_res_images = {
+    ImageData(cv::Mat::zeros(4, 4, CV_64FC1)),
+    ImageData(cv::Mat::zeros(4, 4, CV_64FC1))
+  };
+  const super_resolution::IRLSMapSolverOptions solver_options;
+  const TiledMapSolver solver(
+      solver_options, 6, image_model, low_res_images, kPrintSolverOutput);
+  // 2 * 4 + 4 = 12, which is already a multiple of 3.
+  EXPECT_EQ(solver.GetHaloSize(), 12);
+}
+
+// Solving in tiles should give (nearly) the same result as solving the whole
+// image at once, including at the seams between tiles.
+TEST(TiledMapSolver, MatchesFullSolve) {
+  const cv::Size image_size(48, 40);
+  cv::Mat ground_truth_matrix(image_size, CV_64FC1);
+  for (int row = 0; row < image_size.height; ++row) {
+    for (int col = 0; col < image_size.width; ++col) {
+      ground_truth_matrix.at<double>(row, col) = 0.5 +
+          0.3 * std::sin(0.5 * col) * std::cos(0.35 * row);
+    }
+  }
+  const ImageData ground_truth(ground_truth_matrix);
+
+  const int downsampling_scale = 2;
+  super_resolution::ImageModelParameters model_parameters;
+  model_parameters.scale = downsampling_scale;
+  model_parameters.motion_sequence = super_resolution::MotionShiftSequence({
+    super_resolution::MotionShift(0, 0),
+    super_resolution::MotionShift(1, 0),
+    super_resolution::MotionShift(0, 1),
+    super_resolution::MotionShift(1, 1)
+  });
+  model_parameters.blur_radius = 3;
+  model_parameters.blur_sigma = 0.5;
+  const super_resolution::ImageModel image_model =
+      super_resolution::ImageModel::CreateImageModel(model_parameters);
+
+  std::vector<ImageData> low_res_images;
+  for (int i = 0; i < 4; ++i) {
+    low_res_images.push_back(image_model.ApplyToImage(ground_truth, i));
+  }
+  ImageData initial_estimate = low_res_images[0];
+  initial_estimate.ResizeImage(
+      downsampling_scale, super_resolution::INTERPOLATE_LINEAR);
+
+  super_resolution::IRLSMapSolverOptions solver_options;
+  solver_options.max_num_solver_iterations = 500;
+  solver_options.gradient_norm_threshold = 1.0e-10;
+  // The closed-form solver assumes periodic borders, which are not the same
+  // for a tile as for the full image.
+  solver_options.use_fourier_solver_if_possible = false;
+  const double regularization_parameter = 0.001;
+  const std::shared_ptr<super_resolution::Regularizer> regularizer(
+      new super_resolution::LaplacianRegularizer(image_size));
+
+  super_resolution::IRLSMapSolver full_solver(
+      solver_options, image_model, low_res_images, kPrintSolverOutput);
+  full_solver.AddRegularizer(regularizer, regularization_parameter);
+  const ImageData full_result = full_solver.Solve(initial_estimate);
+
+  TiledMapSolver tiled_solver(
+      solver_options, 16, image_model, low_res_images, kPrintSolverOutput);
+  tiled_solver.AddRegularizer(regularizer, regularization_parameter);
+  const ImageData tiled_result = tiled_solver.Solve(initial_estimate);
+  ASSERT_EQ(tiled_result.GetImageSize(), image_size);
+
+  double max_difference = 0.0;
+  for (int i = 0; i < image_size.area(); ++i) {
+    max_difference = std::max(max_difference, std::abs(
+        tiled_result.GetChannelData(0)[i] - full_result.GetChannelData(0)[i]));
+  }
+  EXPECT_LT(max_difference, 0.001);
+}
@@ -196,3 +196,196 @@ TEST(TotalVariationRegularizer, ApplyToImageWithDifferentiation) {
     EXPECT_NEAR(numerical_gradient_at_i, gradient[i], gradient_error_tolerance);
   }
 }
+
+// Verifies that the cost-only path matches the weighted sum of squared
+// residuals returned by ApplyToImage, in both 2D and 3D modes.
+TEST(TotalVariationRegularizer, ComputeWeightedSquaredSum) {
+  super_resolution::TotalVariationRegularizer tv_regularizer(test_image_size);
+  const std::vector<double> input_data = ReplicateVector(test_image_data, 3);
+  std::vector<double> weights(input_data.size());
+  for (int i = 0; i < weights.size(); ++i) {
+    weights[i] = 0.1 * (i % 7) + 0.5;
+  }
+
+  for (const bool use_3d_total_variation : {false, true}) {
+    tv_regularizer.SetUse3dTotalVariation(use_3d_total_variation);
+    const std::vector<double> residuals =
+        tv_regularizer.ApplyToImage(input_data.data(), 3);
+    double expected_sum = 0.0;
+    for (int i = 0; i < residuals.size(); ++i) {
+      expected_sum += weights[i] * residuals[i] * residuals[i];
+    }
+    EXPECT_DOUBLE_EQ(
+        tv_regularizer.ComputeWeightedSquaredSum(
+            input_data.data(), weights, 3),
+        expected_sum);
+  }
+}
+
+// Verifies that the allocation-free path returns the weighted cost and
+// accumulates its gradient, checked against finite differences in both 2D and
+// 3D modes.
+TEST(TotalVariationRegularizer, ComputeWeightedSquaredSumAndGradient) {
+  super_resolution::TotalVariationRegularizer tv_regularizer(test_image_size);
+  const int num_channels = 3;
+  std::vector<double> input_data;
+  for (int channel = 0; channel < num_channels; ++channel) {
+    for (const double value : test_image_data) {
+      input_data.push_back(value * (channel + 1) + channel);
+    }
+  }
+  const int num_parameters = input_data.size();
+  std::vector<double> weights(num_parameters);
+  for (int i = 0; i < num_parameters; ++i) {
+    weights[i] = 0.1 * (i % 7) + 0.5;
+  }
+  const double regularization_parameter = 0.3;
+
+  // Returns lambda * sum_i w_i * r_i^2 using ApplyToImage.
+  const auto compute_cost = [&](const std::vector<double>& image_data) {
+    const std::vector<double> residuals =
+        tv_regularizer.ApplyToImage(image_data.data(), num_channels);
+    double cost = 0.0;
+    for (int i = 0; i < num_parameters; ++i) {
+      cost += weights[i] * residuals[i] * residuals[i];
+    }
+    return regularization_parameter * cost;
+  };
+
+  const double finite_difference = 1e-6;
+  const double gradient_error_tolerance = 0.0001;
+  for (const bool use_3d_total_variation : {false, true}) {
+    tv_regularizer.SetUse3dTotalVariation(use_3d_total_variation);
+
+    // The gradient is accumulated into the existing values.
+    std::vector<double> residuals(num_parameters);
+    std::vector<double> gradient(num_parameters, 1.0);
+    const double cost = tv_regularizer.ComputeWeightedSquaredSumAndGradient(
+        input_data.data(),
+        num_channels,
+        regularization_parameter,
+        weights,
+        residuals.data(),
+        gradient.data());
+    EXPECT_DOUBLE_EQ(cost, compute_cost(input_data));
+    EXPECT_THAT(
+        residuals,
+        ContainerEq(
+            tv_regularizer.ApplyToImage(input_data.data(), num_channels)));
+
+    for (int i = 0; i < num_parameters; ++i) {
+      std::vector<double> pos_diff_image_data = input_data;
+      pos_diff_image_data[i] += finite_difference;
+      std::vector<double> neg_diff_image_data = input_data;
+      neg_diff_image_data[i] -= finite_difference;
+      const double numerical_gradient_at_i =
+          (compute_cost(pos_diff_image_data) -
+           compute_cost(neg_diff_image_data)) / (2 * finite_difference);
+      EXPECT_NEAR(
+          numerical_gradient_at_i + 1.0, gradient[i], gradient_error_tolerance);
+    }
+  }
+}
+
+// The 3D TV is evaluated in parallel tiles of rows. Verifies an image large
+// enough to be split into several tiles against a direct evaluation.
+TEST(TotalVariationRegularizer, TiledTotalVariation3d) {
+  const cv::Size image_size(100, 130);
+  const int num_channels = 4;
+  const int num_pixels = image_size.area();
+  const int num_parameters = num_pixels * num_channels;
+  std::vector<double> image_data(num_parameters);
+  std::vector<double> weights(num_parameters);
+  for (int i = 0; i < num_parameters; ++i) {
+    image_data[i] = std::sin(0.37 * i) + 0.01 * (i % 13);
+    weights[i] = 0.5 + 0.1 * (i % 5);
+  }
+  const double regularization_parameter = 0.2;
+
+  // Direct evaluation of the value and gradient at every pixel.
+  std::vector<double> expected_residuals(num_parameters);
+  std::vector<double> expected_gradient(num_parameters, 0.0);
+  double expected_cost = 0.0;
+  for (int channel = 0; channel < num_channels; ++channel) {
+    for (int row = 0; row < image_size.height; ++row) {
+      for (int col = 0; col < image_size.width; ++col) {
+        const int index = channel * num_pixels + row * image_size.width + col;
+        std::vector<int> neighbors;
+        if (col + 1 < image_size.width) {
+          neighbors.push_back(index + 1);
+        }
+        if (row + 1 < image_size.height) {
+          neighbors.push_back(index + image_size.width);
+        }
+        if (channel + 1 < num_channels) {
+          neighbors.push_back(index + num_pixels);
+        }
+        double value = 0.0;
+        for (const int neighbor : neighbors) {
+          value += std::abs(image_data[neighbor] - image_data[index]);
+        }
+        expected_residuals[index] = value;
+        expected_cost += regularization_parameter * weights[index] * value *
+            value;
+        const double partial_scale =
+            2 * regularization_parameter * weights[index] * value;
+        for (const int neighbor : neighbors) {
+          const double difference = image_data[neighbor] - image_data[index];
+          const double sign = (difference > 0) - (difference < 0);
+          expected_gradient[neighbor] += partial_scale * sign;
+          expected_gradient[index] -= partial_scale * sign;
+        }
+      }
+    }
+  }
+
+  super_resolution::TotalVariationRegularizer tv_regularizer(image_size);
+  tv_regularizer.SetUse3dTotalVariation(true);
+  EXPECT_THAT(
+      tv_regularizer.ApplyToImage(image_data.data(), num_channels),
+      ContainerEq(expected_residuals));
+  EXPECT_NEAR(
+      regularization_parameter * tv_regularizer.ComputeWeightedSquaredSum(
+          image_data.data(), weights, num_channels),
+      expected_cost,
+      1e-8);
+
+  std::vector<double> gradient(num_parameters, 0.0);
+  EXPECT_NEAR(
+      tv_regularizer.ComputeWeightedSquaredSumAndGradient(
+          image_data.data(),
+          num_channels,
+          regularization_parameter,
+          weights,
+          nullptr,
+          gradient.data()),
+      expected_cost,
+      1e-8);
+  for (int i = 0; i < num_parameters; ++i) {
+    EXPECT_NEAR(gradient[i], expected_gradient[i], 1e-10);
+  }
+}
+
+// The allocation-free values should match ApplyToImage in 2D and 3D mode.
+TEST(TotalVariationRegularizer, ComputeValues) {
+  const cv::Size image_size(7, 5);
+  const int num_channels = 3;
+  const int num_parameters = image_size.area() * num_channels;
+  std::vector<double> image_data(num_parameters);
+  for (int i = 0; i < num_parameters; ++i) {
+    image_data[i] = std::sin(0.37 * i) + 0.01 * (i % 13);
+  }
+
+  super_resolution::TotalVariationRegularizer tv_regularizer(image_size);
+  for (const bool use_3d_total_variation : {false, true}) {
+    tv_regularizer.SetUse3dTotalVariation(use_3d_total_variation);
+    const std::vector<double> expected_values =
+        tv_regularizer.ApplyToImage(image_data.data(), num_channels);
+    std::vector<double> values(num_parameters, -1.0);
+    tv_regularizer.ComputeValues(
+        image_data.data(), num_channels, values.data());
+    for (int i = 0; i < num_parameters; ++i) {
+      EXPECT_NEAR(values[i], expected_values[i], 1e-12);
+    }
+  }
+}
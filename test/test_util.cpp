@@ -90,3 +90,30 @@ TEST(Util, GetFileExtension) {
   EXPECT_EQ(super_resolution::util::GetFileExtension("one.two.three"), "three");
   EXPECT_EQ(super_resolution::util::GetFileExtension("........dots"), "dots");
 }
+
+TEST(Util, ParseDouble) {
+  double value = 0.0;
+  EXPECT_TRUE(super_resolution::util::ParseDouble("0.5", &value));
+  EXPECT_EQ(value, 0.5);
+  EXPECT_TRUE(super_resolution::util::ParseDouble(" -2e-3\n", &value));
+  EXPECT_EQ(value, -2e-3);
+  EXPECT_FALSE(super_resolution::util::ParseDouble("abc", &value));
+  EXPECT_FALSE(super_resolution::util::ParseDouble("0.5x", &value));
+  EXPECT_FALSE(super_resolution::util::ParseDouble("1 2", &value));
+  EXPECT_FALSE(super_resolution::util::ParseDouble("", &value));
+  EXPECT_FALSE(super_resolution::util::ParseDouble("1e999", &value));
+  EXPECT_EQ(value, -2e-3);
+}
+
+TEST(Util, ParseInt) {
+  int value = 0;
+  EXPECT_TRUE(super_resolution::util::ParseInt("42", &value));
+  EXPECT_EQ(value, 42);
+  EXPECT_TRUE(super_resolution::util::ParseInt(" -7 ", &value));
+  EXPECT_EQ(value, -7);
+  EXPECT_FALSE(super_resolution::util::ParseInt("4.2", &value));
+  EXPECT_FALSE(super_resolution::util::ParseInt("3x", &value));
+  EXPECT_FALSE(super_resolution::util::ParseInt("", &value));
+  EXPECT_FALSE(super_resolution::util::ParseInt("99999999999", &value));
+  EXPECT_EQ(value, -7);
+}